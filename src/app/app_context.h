@@ -1,12 +1,20 @@
 #ifndef APP_CONTEXT_H
 #define APP_CONTEXT_H
 
+#include "platform.h"
 #include "video_manager.h"
+#include "package_registry.h"
+#include "package_reasm.h"
 #include "PPCS_API.h"
 
 typedef struct {
     INT32 session_handle;
+    struct PPCSSession* net;    // Commands are queued to its writer thread
     VideoStreamManager* video_mgr;
+    // Per package class (PKG_TYPE_*), made by its handler on the first
+    // package: package ids are only unique within one device. Video has its
+    // own in video_mgr. Reset on reconnect, destroyed with the session.
+    PackageReasm* reasm[PKG_REGISTRY_MAX];
     int live_started;
     int playback_started;
     int timelapse_recording;
@@ -0,0 +1,262 @@
+#include "session_manager.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "video_manager.h"
+#include "image_handler.h"
+#include "command_handler.h"
+#include "timelapse_manager.h"
+#include "control_panel_tab.h"
+
+#define SESSION_BATCH_SIZE 64
+
+SessionManager* session_manager_create(const Config* config) {
+    SessionManager* mgr = (SessionManager*)calloc(1, sizeof(SessionManager));
+    if (!mgr) return NULL;
+    mgr->config = config;
+    mgr->max_sessions = config ? config->MaxNumSess : 1;
+    if (mgr->max_sessions > SESSION_MANAGER_MAX) mgr->max_sessions = SESSION_MANAGER_MAX;
+    return mgr;
+}
+
+static void device_session_destroy(DeviceSession* dev) {
+    if (!dev) return;
+    // Recovery may have replaced the handle the app context last saw
+    INT32 handle = dev->net ? ppcs_session_handle(dev->net) : dev->app_ctx.session_handle;
+    // Commands still in flight refer to the session
+    command_tracker_cancel_session(dev->net);
+    // Reader first: it still reads from the handle and pins the ring
+    ppcs_session_stop(dev->net);
+    if (dev->app_ctx.video_mgr) destroy_video_stream_manager(dev->app_ctx.video_mgr);
+    for (int i = 0; i < PKG_REGISTRY_MAX; i++) package_reasm_destroy(dev->app_ctx.reasm[i]);
+    if (handle >= 0) PPCS_Close(handle);
+    free(dev);
+}
+
+// Follow a reconnect made by the reader: new handle for commands, video
+// held to the next I-frame on the existing decoders, streams restarted
+static void device_session_sync(DeviceSession* dev) {
+    dev->app_ctx.session_handle = ppcs_session_handle(dev->net);
+    int generation = ppcs_session_generation(dev->net);
+    if (generation <= dev->generation || dev->app_ctx.session_handle < 0) return;
+    dev->generation = generation;
+    printf("[Sessions] %s: resuming on handle 0x%08X\n", dev->did, dev->app_ctx.session_handle);
+    video_manager_resume(dev->app_ctx.video_mgr, ppcs_session_lost_at(dev->net));
+    // Fragments of the old connection will never be completed
+    for (int i = 0; i < PKG_REGISTRY_MAX; i++) package_reasm_reset(dev->app_ctx.reasm[i]);
+    command_handler_resume_streams(&dev->app_ctx);
+}
+
+void session_manager_destroy(SessionManager* mgr) {
+    if (!mgr) return;
+    for (int i = 0; i < mgr->count; i++) device_session_destroy(mgr->sessions[i]);
+    free(mgr);
+}
+
+DeviceSession* session_manager_add(SessionManager* mgr, const char* did, int primary) {
+    if (!mgr || !did || !did[0]) return NULL;
+    if (mgr->count >= mgr->max_sessions) {
+        printf("[Sessions] WARNING: MaxNumSess (%d) reached, not connecting %s\n", mgr->max_sessions, did);
+        return NULL;
+    }
+    DeviceSession* dev = (DeviceSession*)calloc(1, sizeof(DeviceSession));
+    if (!dev) return NULL;
+    strncpy(dev->did, did, sizeof(dev->did) - 1);
+    dev->primary = primary;
+    dev->app_ctx.session_handle = -1;
+
+    printf("[Sessions] Connecting to %s...\n", dev->did);
+    INT32 handle = connect_to_device(dev->did, (Config*)mgr->config);
+    if (handle < 0) {
+        printf("[Sessions] ERROR: Failed to connect to %s\n", dev->did);
+        free(dev);
+        return NULL;
+    }
+    dev->app_ctx.session_handle = handle;
+
+    char prefix[128];
+    if (primary) snprintf(prefix, sizeof(prefix), "output_video");
+    else snprintf(prefix, sizeof(prefix), "output_video_%s", dev->did);
+    dev->app_ctx.video_mgr = create_video_stream_manager(prefix);
+    if (dev->app_ctx.video_mgr && !primary && !(mgr->config && mgr->config->FleetShowVideo)) {
+        video_manager_set_headless(dev->app_ctx.video_mgr, 1);
+    }
+    if (dev->app_ctx.video_mgr && mgr->config) {
+        video_manager_set_decode_mode(dev->app_ctx.video_mgr, mgr->config->DecodeMode ? DECODE_MODE_AU : DECODE_MODE_PARSER);
+        VideoDecoderThreading threading = { mgr->config->DecodeThreads, mgr->config->DecodeThreadType, mgr->config->DecodeLowDelay };
+        video_manager_set_decoder_threading(dev->app_ctx.video_mgr, &threading);
+    }
+
+    dev->pkg_ctx.did = dev->did;
+    dev->pkg_ctx.app = &dev->app_ctx;
+    dev->pkg_ctx.video_mgr = dev->app_ctx.video_mgr;
+
+    dev->net = ppcs_session_start(handle, dev->did, mgr->config);
+    if (!dev->net) {
+        printf("[Sessions] ERROR: Failed to start network for %s\n", dev->did);
+        device_session_destroy(dev);
+        return NULL;
+    }
+    dev->app_ctx.net = dev->net;
+
+    mgr->sessions[mgr->count] = dev;
+    mgr->events[mgr->count] = ppcs_session_event(dev->net);
+    mgr->count++;
+    printf("[Sessions] %s connected (handle 0x%08X), %d/%d sessions\n", dev->did, handle, mgr->count, mgr->max_sessions);
+    return dev;
+}
+
+int session_manager_add_fleet(SessionManager* mgr, const char* did_list) {
+    if (!mgr || !did_list) return 0;
+    int added = 0;
+    const char* p = did_list;
+    while (*p) {
+        while (*p == ',' || *p == ' ' || *p == '\t') p++;
+        const char* end = p;
+        while (*end && *end != ',') end++;
+        int len = (int)(end - p);
+        while (len > 0 && (p[len - 1] == ' ' || p[len - 1] == '\t')) len--;
+        if (len > 0 && len < MAX_CONFIG_VALUE_LEN) {
+            char did[MAX_CONFIG_VALUE_LEN];
+            memcpy(did, p, len);
+            did[len] = '\0';
+            int known = 0;
+            for (int i = 0; i < mgr->count; i++) {
+                if (strcmp(mgr->sessions[i]->did, did) == 0) { known = 1; break; }
+            }
+            if (!known) {
+                DeviceSession* dev = session_manager_add(mgr, did, 0);
+                if (dev) {
+                    added++;
+                    // Fleet devices are monitored: start their live stream right away
+                    if (!mgr->config || mgr->config->FleetAutoLive) on_command_triggered(CMD_LIVE_START, &dev->app_ctx);
+                }
+            }
+        }
+        p = end;
+    }
+    return added;
+}
+
+static int drain_session(DeviceSession* dev, int budget) {
+    PackageView batch[SESSION_BATCH_SIZE];
+    int processed = 0;
+    while (processed < budget) {
+        int want = budget - processed;
+        if (want > SESSION_BATCH_SIZE) want = SESSION_BATCH_SIZE;
+        int count = ppcs_session_pop_packages(dev->net, batch, want);
+        if (count == 0) break;
+        for (int i = 0; i < count; i++) {
+            // First package from a reopened session: switch over before handling it
+            if (batch[i].generation > dev->generation) device_session_sync(dev);
+            dev->bytes += (unsigned long long)batch[i].len;
+            package_registry_dispatch(&batch[i], &dev->pkg_ctx);
+            ppcs_session_free_package(dev->net, &batch[i]);
+        }
+        dev->packages += count;
+        processed += count;
+    }
+    return processed;
+}
+
+int session_manager_drain(SessionManager* mgr, int budget) {
+    if (!mgr || mgr->count == 0) return 0;
+    // Equal share per session; whatever a quiet session leaves unused is
+    // spread over the ones after it in the rotation
+    int processed = 0;
+    for (int n = 0; n < mgr->count && processed < budget; n++) {
+        DeviceSession* dev = mgr->sessions[(mgr->next + n) % mgr->count];
+        int remaining = mgr->count - n;
+        int want = (budget - processed + remaining - 1) / remaining;
+        processed += drain_session(dev, want);
+    }
+    mgr->next = (mgr->next + 1) % mgr->count;
+    return processed;
+}
+
+int session_manager_queue_depth(SessionManager* mgr) {
+    if (!mgr) return 0;
+    int depth = 0;
+    for (int i = 0; i < mgr->count; i++) depth += ppcs_session_queue_depth(mgr->sessions[i]->net);
+    return depth;
+}
+
+DWORD session_manager_wait(SessionManager* mgr, DWORD timeout_ms) {
+    DWORD n = mgr ? (DWORD)mgr->count : 0;
+    return MsgWaitForMultipleObjectsEx(n, n ? mgr->events : NULL, timeout_ms, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+}
+
+int session_manager_poll_events(SessionManager* mgr) {
+    if (!mgr) return 0;
+    int running = 1;
+    for (int i = 0; i < mgr->count; i++) {
+        DeviceSession* dev = mgr->sessions[i];
+        device_session_sync(dev);
+        if (!video_manager_poll_events(dev->app_ctx.video_mgr) && dev->primary) running = 0;
+    }
+    return running;
+}
+
+void session_manager_print_stats(SessionManager* mgr) {
+    if (!mgr) return;
+    unsigned long long total_packages = 0, total_bytes = 0;
+    for (int i = 0; i < mgr->count; i++) {
+        DeviceSession* dev = mgr->sessions[i];
+        NetReadStats read_stats;
+        ppcs_session_get_read_stats(dev->net, &read_stats);
+        printf("[Sessions] %s%s: %llu packages, %llu bytes dispatched\n",
+               dev->did, dev->primary ? " (primary)" : "", dev->packages, dev->bytes);
+        printf("[Sessions]   Reads: %llu calls, %llu bytes (%.0f bytes/call, max %u), %llu bulk / %llu idle\n",
+               read_stats.read_calls, read_stats.bytes,
+               read_stats.read_calls ? (double)read_stats.bytes / read_stats.read_calls : 0.0,
+               read_stats.max_bytes_per_call, read_stats.bulk_reads, read_stats.idle_reads);
+        StreamFramerStats framer_stats;
+        ppcs_session_get_framer_stats(dev->net, &framer_stats);
+        if (framer_stats.checksums > 0) {
+            printf("[Sessions]   Checksums: %llu verified, failed json %lu / video %lu / image %lu / timelapse %lu, %llu dropped\n",
+                   framer_stats.checksums, framer_stats.checksum_failures[PKG_TYPE_JSON],
+                   framer_stats.checksum_failures[PKG_TYPE_VIDEO], framer_stats.checksum_failures[PKG_TYPE_IMAGE],
+                   framer_stats.checksum_failures[PKG_TYPE_TIMELAPSE], read_stats.checksum_drops);
+        }
+        SessionRecoveryStats recovery;
+        ppcs_session_get_recovery_stats(dev->net, &recovery);
+        if (recovery.losses > 0) {
+            printf("[Sessions]   Recovery: %lu lost, %lu recovered in %lu attempts, last %.0f ms, max %.0f ms%s\n",
+                   recovery.losses, recovery.recoveries, recovery.attempts, recovery.last_ms, recovery.max_ms,
+                   recovery.failed ? ", gave up" : "");
+        }
+        CommandWriterStats write_stats;
+        ppcs_session_get_write_stats(dev->net, &write_stats);
+        if (write_stats.submitted > 0) {
+            printf("[Sessions]   Commands: %llu queued, %llu written in %llu writes (%llu bytes), max queue %d, %llu throttled waits (max %u unsent), %llu rejected, %llu dropped\n",
+                   write_stats.submitted, write_stats.packages, write_stats.writes, write_stats.bytes, write_stats.max_depth,
+                   write_stats.throttled, write_stats.max_buffered, write_stats.rejected, write_stats.dropped);
+        }
+        int channels = ppcs_session_channel_count(dev->net);
+        for (int c = 0; channels > 1 && c < channels; c++) {
+            NetReadStats ch_stats;
+            int channel = ppcs_session_get_channel_stats(dev->net, c, &ch_stats);
+            printf("[Sessions]   Channel %d: %llu calls, %llu bytes\n", channel, ch_stats.read_calls, ch_stats.bytes);
+        }
+        for (int lane = 0; lane < PKG_LANE_COUNT; lane++) {
+            PackageLaneStats lane_stats;
+            ppcs_session_get_lane_stats(dev->net, lane, &lane_stats);
+            printf("[Sessions]   %s lane: %llu pushed, %llu popped, max depth %d, %llu full waits, delay avg %.2f ms max %.2f ms\n",
+                   ppcs_lane_name(lane), lane_stats.queue.pushed, lane_stats.queue.popped,
+                   lane_stats.queue.max_depth, lane_stats.queue.full,
+                   lane_stats.delay_count ? lane_stats.delay_total_ms / lane_stats.delay_count : 0.0,
+                   lane_stats.delay_max_ms);
+        }
+        for (int stream_type = 1; stream_type <= 5; stream_type++) {
+            IngestDropStats drop_stats;
+            ppcs_session_get_drop_stats(dev->net, stream_type, &drop_stats);
+            if (drop_stats.packages_dropped == 0) continue;
+            printf("[Sessions]   Stream %d shed: %llu frames, %llu packages, %llu bytes in %lu episodes\n",
+                   stream_type, drop_stats.frames_dropped, drop_stats.packages_dropped,
+                   drop_stats.bytes_dropped, drop_stats.shed_events);
+        }
+        total_packages += dev->packages;
+        total_bytes += dev->bytes;
+    }
+    printf("[Sessions] Total: %d sessions, %llu packages, %llu bytes\n", mgr->count, total_packages, total_bytes);
+}
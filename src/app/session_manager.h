@@ -0,0 +1,53 @@
+#ifndef SESSION_MANAGER_H
+#define SESSION_MANAGER_H
+
+#include <windows.h>
+#include "ppcs_core.h"
+#include "app_context.h"
+#include "package_registry.h"
+
+// One reader per session plus the consumer's own wait slot for window messages
+#define SESSION_MANAGER_MAX (MAXIMUM_WAIT_OBJECTS - 1)
+
+// A connected device: network session, video streams and command context
+typedef struct {
+    char did[MAX_CONFIG_VALUE_LEN];
+    PPCSSession* net;
+    AppContext app_ctx;         // session_handle + video_mgr, passed to command callbacks
+    PackageContext pkg_ctx;     // Handed to the registered package handlers
+    int primary;                // Driven by the control panel
+    int generation;             // Session handle generation the app state follows
+    unsigned long long packages;
+    unsigned long long bytes;
+} DeviceSession;
+
+typedef struct {
+    DeviceSession* sessions[SESSION_MANAGER_MAX];
+    HANDLE events[SESSION_MANAGER_MAX];
+    int count;
+    int next;                   // Round-robin start for the next drain
+    int max_sessions;           // Config MaxNumSess
+    const Config* config;
+} SessionManager;
+
+SessionManager* session_manager_create(const Config* config);
+// Stops every reader, closes the PPCS sessions and video managers
+void session_manager_destroy(SessionManager* mgr);
+
+// Connect to did and start its reader. The primary device keeps the legacy
+// output names and opens display windows; others follow FleetShowVideo.
+DeviceSession* session_manager_add(SessionManager* mgr, const char* did, int primary);
+// Add every DID from a comma-separated list, skipping ones already connected.
+// Returns the number of sessions added.
+int session_manager_add_fleet(SessionManager* mgr, const char* did_list);
+
+// Dispatch up to budget packages, taking a fair share from each session
+int session_manager_drain(SessionManager* mgr, int budget);
+int session_manager_queue_depth(SessionManager* mgr);
+// Block until any session has packages, a window message arrives or timeout_ms passes
+DWORD session_manager_wait(SessionManager* mgr, DWORD timeout_ms);
+// Pump display windows of every session; returns 0 if the primary's window closed
+int session_manager_poll_events(SessionManager* mgr);
+void session_manager_print_stats(SessionManager* mgr);
+
+#endif // SESSION_MANAGER_H
@@ -31,6 +31,7 @@
 #define IDC_SDCARD_FORMAT 1036
 #define IDC_SDCARD_POP 1037
 #define IDC_TELNET_ENABLE 1038
+#define IDC_DUMP_METRICS 1039
 
 #define IDC_STATUS_LABEL 2000
 
@@ -164,6 +165,9 @@ LRESULT CALLBACK ControlPanelTabWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPAR
                         case IDC_TELNET_ENABLE:
                             cmd_id = CMD_TELNET_ENABLE;
                             break;
+                        case IDC_DUMP_METRICS:
+                            cmd_id = CMD_DUMP_METRICS;
+                            break;
                         default:
                             return DefWindowProc(hwnd, msg, wParam, lParam);
                     }
@@ -344,7 +348,7 @@ static void create_tab_page(ControlPanel* panel, int tab_id) {
         tab->buttons[5] = btn_snapshot;
     }
     else if (tab_id == TAB_SETTINGS) {
-        // Settings Tab - 网格布局 (7 个按钮)
+        // Settings Tab - 网格布局 (9 个按钮)
         int grid_spacing_x = 8;
         int grid_spacing_y = 8;
         int button_width = 105;
@@ -369,9 +373,11 @@ static void create_tab_page(ControlPanel* panel, int tab_id) {
                           start_x, start_y + 2 * (button_height + grid_spacing_y), button_width, button_height, parent, (HMENU)IDC_SDCARD_POP, GetModuleHandle(NULL), NULL)
             ,CreateWindowW(L"BUTTON", L"Telnet Enable", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
                           start_x + (button_width + grid_spacing_x), start_y + 2 * (button_height + grid_spacing_y), button_width, button_height, parent, (HMENU)IDC_TELNET_ENABLE, GetModuleHandle(NULL), NULL)
+            ,CreateWindowW(L"BUTTON", L"Dump Metrics", WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+                          start_x + 2 * (button_width + grid_spacing_x), start_y + 2 * (button_height + grid_spacing_y), button_width, button_height, parent, (HMENU)IDC_DUMP_METRICS, GetModuleHandle(NULL), NULL)
         };
 
-        for (int i = 0; i < 7; i++) {
+        for (int i = 0; i < 9; i++) {
             if (!buttons[i]) {
                 printf("[UI] ERROR: Failed to create button %d\n", i);
             } else {
@@ -379,8 +385,8 @@ static void create_tab_page(ControlPanel* panel, int tab_id) {
             }
         }
 
-        tab->button_count = 8;
-        tab->buttons = (HWND*)malloc(sizeof(HWND) * 8);
+        tab->button_count = 9;
+        tab->buttons = (HWND*)malloc(sizeof(HWND) * 9);
         memcpy(tab->buttons, buttons, sizeof(buttons));
     }
 }
@@ -38,6 +38,7 @@ typedef enum {
     CMD_SDCARD_FORMAT = 0x17,
     CMD_SDCARD_POP = 0x18,
     CMD_TELNET_ENABLE = 0x60,
+    CMD_DUMP_METRICS = 0x61,
 } CommandID;
 
 // 选项卡 ID
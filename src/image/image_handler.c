@@ -4,73 +4,89 @@
 #include <string.h>
 #include <time.h>
 #include "protocol_defs.h"
+#include "package_reasm.h"
+#include "package_registry.h"
+#include "app_context.h"
 
 #define MAX_VIDEO_FRAME_SIZE (1024*1024)
+#define IMAGE_REASM_SLOTS 4
 
 // Use unified protocol definitions
 typedef PackageHeader_t TAG_PKG_HEADER_S;
 typedef ImageStreamHeader_t TAG_PKG_IMAGE_HEADER_S;
 
-int handle_image_package(const unsigned char* package, int pkg_len) {
-    if (pkg_len < 4) return -1;
-    // Copy of original implementation simplified and moved here
-    // Caller should pass full package starting with "$gmi"
-    int offset = 4;
+// The session's image reassembler, made with its first image package
+static PackageReasm* session_image_reasm(const PackageContext* ctx) {
+    AppContext* app = ctx ? (AppContext*)ctx->app : NULL;
+    if (!app) return NULL;
+    if (!app->reasm[PKG_TYPE_IMAGE]) {
+        char name[64];
+        snprintf(name, sizeof(name), "image %s", ctx->did ? ctx->did : "");
+        app->reasm[PKG_TYPE_IMAGE] = package_reasm_create(name, IMAGE_REASM_SLOTS, MAX_VIDEO_FRAME_SIZE, 0, 0);
+    }
+    return app->reasm[PKG_TYPE_IMAGE];
+}
 
-    const TAG_PKG_HEADER_S* header = (const TAG_PKG_HEADER_S*)(package + offset);
-    offset += sizeof(TAG_PKG_HEADER_S);
+// Write a complete image to snapshot_ch<ch>_<time>_<pts>.<ext>
+static int save_image(const TAG_PKG_IMAGE_HEADER_S* image_header, const unsigned char* data, int len) {
+    const char* ext = (image_header->s8EncodeType == 1) ? "jpg" : "png";
+    time_t now = time(NULL);
+    struct tm* tm_info = localtime(&now);
+    char time_str[32];
+    strftime(time_str, sizeof(time_str), "%Y%m%d_%H%M%S", tm_info);
+    char filename[256];
+    snprintf(filename, sizeof(filename), "snapshot_ch%d_%s_%llu.%s",
+             image_header->s8Ch, time_str, (unsigned long long)image_header->u64Pts, ext);
+    FILE* image_file = fopen(filename, "wb");
+    if (!image_file) return -1;
+    size_t written = fwrite(data, 1, len, image_file);
+    fclose(image_file);
+    if (written != (size_t)len) return -1;
+    printf("[Image] Saved complete image: %s (%zu bytes)\n", filename, written);
+    return 0;
+}
 
-    static struct ImageBuffer {
-        unsigned short pkg_id;
-        int total_len;
-        int used_len;
-        unsigned char data[MAX_VIDEO_FRAME_SIZE];
-        char filename[256];
-        int has_header;
-        TAG_PKG_IMAGE_HEADER_S image_header;
-    } image_buf = {0};
+int handle_image_package(const PackageView* pkg, const PackageContext* ctx) {
+    if (!pkg || pkg->len < PKG_MIN_LEN) return -1;
+    PackageReasm* image_reasm = session_image_reasm(ctx);
+    if (!image_reasm) return -1;
+    // Caller passes a full package view starting with "$gmi"
+    int offset = PKG_HEADER_TOTAL_LEN;
+    const TAG_PKG_HEADER_S* header = &pkg->header;
+    ReasmPayload image;
+    int ret;
 
     if (header->u8PkgSubHead == 1) {
+        // The header package carries no image data
         if (header->u16PkgLen < sizeof(TAG_PKG_IMAGE_HEADER_S)) return -1;
-        const TAG_PKG_IMAGE_HEADER_S* image_header = (const TAG_PKG_IMAGE_HEADER_S*)(package + offset);
-        offset += sizeof(TAG_PKG_IMAGE_HEADER_S);
-        image_buf.pkg_id = header->u16PkgId;
-        image_buf.total_len = image_header->s32ImageLen;
-        image_buf.used_len = 0;
-        image_buf.has_header = 1;
-        memcpy(&image_buf.image_header, image_header, sizeof(TAG_PKG_IMAGE_HEADER_S));
-        const char* ext = (image_header->s8EncodeType == 1) ? "jpg" : "png";
-        time_t now = time(NULL);
-        struct tm* tm_info = localtime(&now);
-        char time_str[32];
-        strftime(time_str, sizeof(time_str), "%Y%m%d_%H%M%S", tm_info);
-        snprintf(image_buf.filename, sizeof(image_buf.filename), "snapshot_ch%d_%s_%llu.%s",
-                 image_header->s8Ch, time_str, image_header->u64Pts, ext);
-        printf("[Image] Start new image: %s (total %d bytes)\n", image_buf.filename, image_buf.total_len);
-        return 0;
+        TAG_PKG_IMAGE_HEADER_S ih;
+        if (package_view_read(pkg, offset, &ih, sizeof(ih)) < 0) return -1;
+        printf("[Image] Start new image on ch%d (total %d bytes)\n", ih.s8Ch, ih.s32ImageLen);
+        ret = package_reasm_begin(image_reasm, PKG_TYPE_IMAGE, ih.s8Ch, pkg, offset, 0, ih.s32ImageLen,
+                                  &ih, sizeof(ih), NULL, 0, &image);
+        return ret < 0 ? -1 : 0;
     }
 
     if (header->u8PkgSubHead == 0) {
-        if (image_buf.pkg_id == 0 || image_buf.pkg_id != header->u16PkgId) {
-            printf("[Image] No valid image header for data packet\n");
-            return -1;
-        }
         int data_len = header->u16PkgLen;
         if (data_len <= 0) return -1;
-        if (image_buf.used_len + data_len > MAX_VIDEO_FRAME_SIZE) { memset(&image_buf,0,sizeof(image_buf)); return -1; }
-        memcpy(image_buf.data + image_buf.used_len, package + offset, data_len);
-        image_buf.used_len += data_len;
-        //printf("[Image] Accumulated %d/%d bytes for PkgId %d\n", image_buf.used_len, image_buf.total_len, image_buf.pkg_id);
-        if (header->u16PkgIndex == 0) {
-            FILE* image_file = fopen(image_buf.filename, "wb");
-            if (!image_file) { memset(&image_buf,0,sizeof(image_buf)); return -1; }
-            size_t written = fwrite(image_buf.data,1,image_buf.used_len,image_file);
-            fclose(image_file);
-            if (written != image_buf.used_len) { memset(&image_buf,0,sizeof(image_buf)); return -1; }
-            printf("[Image] Saved complete image: %s (%zu bytes)\n", image_buf.filename, written);
-            memset(&image_buf,0,sizeof(image_buf));
+        ret = package_reasm_add(image_reasm, PKG_TYPE_IMAGE, pkg, offset, data_len, &image);
+        if (ret < 0) return -1;
+        if (ret == REASM_COMPLETE) {
+            ret = save_image((const TAG_PKG_IMAGE_HEADER_S*)image.meta, image.data, image.len);
+            package_reasm_payload_release(&image);
+            if (ret < 0) return -1;
         }
         return data_len;
     }
     return -1;
 }
+
+static int image_package_handler(const PackageView* pkg, const PackageContext* ctx) {
+    return handle_image_package(pkg, ctx);
+}
+
+void image_handler_register_packages(void) {
+    package_registry_register(PKG_IMAGE_MAGIC, PKG_TYPE_IMAGE, "image", sizeof(TAG_PKG_IMAGE_HEADER_S),
+                              image_package_handler);
+}
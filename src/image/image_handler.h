@@ -1,6 +1,11 @@
 #ifndef IMAGE_HANDLER_H
 #define IMAGE_HANDLER_H
 
-int handle_image_package(const unsigned char* package, int pkg_len);
+#include "stream_framer.h"
+#include "package_registry.h"
+
+int handle_image_package(const PackageView* pkg, const PackageContext* ctx);
+// Register "$gmi" with the package registry; call before sessions start
+void image_handler_register_packages(void);
 
 #endif // IMAGE_HANDLER_H
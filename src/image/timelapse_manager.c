@@ -3,59 +3,82 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include "package_reasm.h"
+#include "package_registry.h"
+#include "app_context.h"
 
 #define MAX_TIMELAPSE_FRAME_SIZE (1024*1024)
+#define TIMELAPSE_REASM_SLOTS 4
 
 // Use unified protocol definitions
 typedef PackageHeader_t PKG_HEADER_S;
 typedef PackageTail_t PKG_TAIL_S;
 
+// The session's timelapse reassembler, made with its first timelapse package
+static PackageReasm* session_timelapse_reasm(const PackageContext* ctx) {
+    AppContext* app = ctx ? (AppContext*)ctx->app : NULL;
+    if (!app) return NULL;
+    if (!app->reasm[PKG_TYPE_TIMELAPSE]) {
+        char name[64];
+        snprintf(name, sizeof(name), "timelapse %s", ctx->did ? ctx->did : "");
+        app->reasm[PKG_TYPE_TIMELAPSE] = package_reasm_create(name, TIMELAPSE_REASM_SLOTS, MAX_TIMELAPSE_FRAME_SIZE, 0, 0);
+    }
+    return app->reasm[PKG_TYPE_TIMELAPSE];
+}
+
+// Append a complete frame to timelapse_<task>.<ext>
+static void save_timelapse_frame(const char* what, const ReasmPayload* frame) {
+    const TAG_PKG_FILE_HEADER_S* file_header = (const TAG_PKG_FILE_HEADER_S*)frame->meta;
+    char filename[256];
+    const char* ext;
+    switch (file_header->s8FileType) {
+        case 1: ext = "h265";  break;
+        case 2: ext = "h264";  break;
+        case 3: ext = "pcm";   break;
+        case 4: ext = "g711a"; break;
+        case 5: ext = "g711u"; break;
+        case 6: ext = "aac";   break;
+        default: ext = "bin";  break;
+    }
+    snprintf(filename, sizeof(filename), "timelapse_%d.%s",
+             file_header->s32TaskId, ext);
+    
+    FILE* out = fopen(filename, "ab");
+    if (out) {
+        fwrite(frame->data, 1, frame->len, out);
+        fclose(out);
+        printf("[Timelapse] Saved %s: %d bytes to %s\n", what,
+               frame->len, filename);
+    } else {
+        printf("[Timelapse] ERROR: Failed to open file: %s\n", filename);
+    }
+}
+
 // Handle timelapse package - similar to handle_video_package
-int handle_timelapse_package(const unsigned char* package, int pkg_len) {
-    if (!package || pkg_len < 4) {
+int handle_timelapse_package(const PackageView* pkg, const PackageContext* ctx) {
+    PackageReasm* timelapse_reasm = pkg && pkg->len >= PKG_MIN_LEN ? session_timelapse_reasm(ctx) : NULL;
+    if (!timelapse_reasm) {
         printf("[Timelapse] Invalid package\n");
         return -1;
     }
 
-    // Frame buffer for reassembly (static to persist across calls)
-    typedef struct {
-        unsigned char data[MAX_TIMELAPSE_FRAME_SIZE];
-        int pkg_id;
-        int task_id;
-        int total_len;
-        int used_len;
-        int8_t file_type;
-        int8_t frame_type;
-        int32_t timestamp;
-        int valid;
-    } FrameBuffer;
-    
-    static FrameBuffer frame_buf = {0};
-
     // Package structure:
     // offset 0-3: prefix ("@lif" for timelapse)
     // offset 4+: PKG_HEADER_S
-    // offset 4+28: data or TAG_PKG_FILE_HEADER_S (if u8PkgSubHead==1)
-    
-    int offset = 4;  // Skip prefix "@lif"
+    // offset 4+24: data or TAG_PKG_FILE_HEADER_S (if u8PkgSubHead==1)
     
-    // Validate header size
-    if (pkg_len < offset + sizeof(PKG_HEADER_S)) {
-        printf("[Timelapse] Package header incomplete\n");
-        return -1;
-    }
-
-    PKG_HEADER_S* header = (PKG_HEADER_S*)(package + offset);
-    offset += sizeof(PKG_HEADER_S);
+    int offset = PKG_HEADER_TOTAL_LEN;
+    const PKG_HEADER_S* header = &pkg->header;
+    ReasmPayload frame;
 
     if (header->u8PkgSubHead == 1) {
         // New frame start with file header
-        if (pkg_len < offset + sizeof(TAG_PKG_FILE_HEADER_S)) {
+        TAG_PKG_FILE_HEADER_S fh;
+        if (package_view_read(pkg, offset, &fh, sizeof(fh)) < 0) {
             printf("[Timelapse] Package incomplete for file header\n");
             return -1;
         }
-
-        TAG_PKG_FILE_HEADER_S* file_header = (TAG_PKG_FILE_HEADER_S*)(package + offset);
+        const TAG_PKG_FILE_HEADER_S* file_header = &fh;
         offset += sizeof(TAG_PKG_FILE_HEADER_S);
 
         // Log frame info
@@ -63,101 +86,35 @@ int handle_timelapse_package(const unsigned char* package, int pkg_len) {
             file_header->s32TaskId, file_header->s8FileType, 
             file_header->s8FrameType, file_header->s32FileLength, file_header->s32StartTime);
 
-        // Initialize frame reassembly buffer
-        frame_buf.pkg_id = header->u16PkgId;
-        frame_buf.task_id = file_header->s32TaskId;
-        frame_buf.file_type = file_header->s8FileType;
-        frame_buf.frame_type = file_header->s8FrameType;
-        frame_buf.total_len = file_header->s32FileLength;
-        frame_buf.timestamp = file_header->s32StartTime;
-        frame_buf.used_len = 0;
-        frame_buf.valid = 1;
-
-        // Add this frame data to buffer
-        int data_len = pkg_len - offset - sizeof(PKG_TAIL_S);
-        if (data_len > 0 && data_len <= MAX_TIMELAPSE_FRAME_SIZE) {
-            memcpy(frame_buf.data, package + offset, data_len);
-            frame_buf.used_len = data_len;
-        }
-
-        // Check if this is the last fragment (u16PkgIndex == 0 means last)
-        if (header->u16PkgIndex == 0) {
-            if (frame_buf.valid && frame_buf.used_len > 0) {
-                // Save frame to file
-                char filename[256];
-                const char* ext;
-                switch (frame_buf.file_type) {
-                    case 1: ext = "h265"; break;
-                    case 2: ext = "h264"; break;
-                    case 3: ext = "pcm";  break;
-                    case 4: ext = "g711a"; break;
-                    case 5: ext = "g711u"; break;
-                    case 6: ext = "aac";  break;
-                    default: ext = "bin"; break;
-                }
-                snprintf(filename, sizeof(filename), "timelapse_%d.%s",
-                         frame_buf.task_id, ext);
-                
-                FILE* out = fopen(filename, "ab");
-                if (out) {
-                    fwrite(frame_buf.data, 1, frame_buf.used_len, out);
-                    fclose(out);
-                    printf("[Timelapse] Saved frame: %d bytes to %s\n", 
-                           frame_buf.used_len, filename);
-                } else {
-                    printf("[Timelapse] ERROR: Failed to open file: %s\n", filename);
-                }
-            }
-            frame_buf.valid = 0;
+        // Frames of one task follow each other; a new one abandons an unfinished one
+        int data_len = pkg->len - offset - sizeof(PKG_TAIL_S);
+        if (data_len <= 0 && header->u16PkgIndex == 0) return 0;   // Empty frame, nothing follows
+        int ret = package_reasm_begin(timelapse_reasm, PKG_TYPE_TIMELAPSE, file_header->s32TaskId, pkg, offset, data_len,
+                                      file_header->s32FileLength, file_header, sizeof(*file_header), NULL, 0, &frame);
+        if (ret < 0) return -1;
+        if (ret == REASM_COMPLETE) {
+            save_timelapse_frame("frame", &frame);
+            package_reasm_payload_release(&frame);
         }
-
-        return frame_buf.used_len;
+        return data_len;
     } else {
-        // Fragment packet - must match existing frame buffer
-        if (!frame_buf.valid || header->u16PkgId != frame_buf.pkg_id) {
-            printf("[Timelapse] No matching frame buffer for fragment (PkgId=%d)\n",
-                header->u16PkgId);
-            return -1;
-        }
-
-        // Add fragment data to buffer
-        int data_len = pkg_len - offset - sizeof(PKG_TAIL_S);
-        if (data_len > 0 && frame_buf.used_len + data_len <= MAX_TIMELAPSE_FRAME_SIZE) {
-            memcpy(frame_buf.data + frame_buf.used_len, package + offset, data_len);
-            frame_buf.used_len += data_len;
+        // Fragment packet - must match a frame begun before
+        int data_len = pkg->len - offset - sizeof(PKG_TAIL_S);
+        int ret = package_reasm_add(timelapse_reasm, PKG_TYPE_TIMELAPSE, pkg, offset, data_len, &frame);
+        if (ret < 0) return -1;
+        if (ret == REASM_COMPLETE) {
+            save_timelapse_frame("complete frame", &frame);
+            package_reasm_payload_release(&frame);
         }
-
-        // Check if this is the last fragment
-        if (header->u16PkgIndex == 0) {
-            if (frame_buf.valid && frame_buf.used_len > 0) {
-                // Save complete frame to file
-                char filename[256];
-                const char* ext;
-                switch (frame_buf.file_type) {
-                    case 1: ext = "h265";  break;
-                    case 2: ext = "h264";  break;
-                    case 3: ext = "pcm";   break;
-                    case 4: ext = "g711a"; break;
-                    case 5: ext = "g711u"; break;
-                    case 6: ext = "aac";   break;
-                    default: ext = "bin";  break;
-                }
-                snprintf(filename, sizeof(filename), "timelapse_%d.%s",
-                         frame_buf.task_id, ext);
-                
-                FILE* out = fopen(filename, "ab");
-                if (out) {
-                    fwrite(frame_buf.data, 1, frame_buf.used_len, out);
-                    fclose(out);
-                    printf("[Timelapse] Saved complete frame: %d bytes to %s\n", 
-                           frame_buf.used_len, filename);
-                } else {
-                    printf("[Timelapse] ERROR: Failed to open file: %s\n", filename);
-                }
-            }
-            frame_buf.valid = 0;
-        }
-
         return data_len;
     }
 }
+
+static int timelapse_package_handler(const PackageView* pkg, const PackageContext* ctx) {
+    return handle_timelapse_package(pkg, ctx);
+}
+
+void timelapse_manager_register_packages(void) {
+    package_registry_register(PKG_TIMELAPSE_MAGIC, PKG_TYPE_TIMELAPSE, "timelapse", sizeof(TAG_PKG_FILE_HEADER_S),
+                              timelapse_package_handler);
+}
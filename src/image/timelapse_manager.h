@@ -2,6 +2,8 @@
 #define TIMELAPSE_MANAGER_H
 
 #include "protocol_defs.h"
+#include "stream_framer.h"
+#include "package_registry.h"
 
 // 延时摄影文件头结构 (sub-header for timelapse packets)
 typedef struct {
@@ -14,6 +16,8 @@ typedef struct {
 } TAG_PKG_FILE_HEADER_S;
 
 // 处理延时摄影包（类似 handle_video_package）
-int handle_timelapse_package(const unsigned char* package, int pkg_len);
+int handle_timelapse_package(const PackageView* pkg, const PackageContext* ctx);
+// Register "@lif" with the package registry; call before sessions start
+void timelapse_manager_register_packages(void);
 
 #endif // TIMELAPSE_MANAGER_H
@@ -0,0 +1,306 @@
+// Async Log Implementation
+#include "async_log.h"
+#include "platform.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_CACHE_LINE 64
+#define LOG_TAG_LEN 12
+#define LOG_OUT_BUFFER (64 * 1024)
+
+#define LOG_RING_ACTIVE   1
+#define LOG_RING_DETACHED 2
+
+typedef struct {
+    unsigned long long seq;         // Global call order, for merging the rings
+    unsigned char level;
+    unsigned char more;             // Message continues in the next record
+    unsigned short len;
+    char tag[LOG_TAG_LEN];
+    char text[LOG_RECORD_TEXT];
+} LogRecord;
+
+// One per logging thread: that thread produces, the writer thread consumes
+typedef struct {
+    atomic_uint head;
+    char pad0[LOG_CACHE_LINE - sizeof(atomic_uint)];
+    atomic_uint tail;
+    char pad1[LOG_CACHE_LINE - sizeof(atomic_uint)];
+    atomic_int state;
+    atomic_ullong dropped;
+    LogRecord slots[LOG_RING_SLOTS];
+} LogRing;
+
+volatile int g_log_level = LOG_LEVEL_INFO;
+
+static LogRing* g_rings[LOG_MAX_RINGS];
+static atomic_int g_ring_count;
+static atomic_flag g_ring_lock = ATOMIC_FLAG_INIT;      // Ring registration
+static atomic_flag g_direct_lock = ATOMIC_FLAG_INIT;    // Synchronous fallback output
+static atomic_ullong g_seq;
+static volatile int g_log_running = 0;
+static HANDLE g_log_thread = NULL;
+static HANDLE g_log_event = NULL;
+static _Thread_local LogRing* t_ring = NULL;
+
+// Writer thread only
+static char g_out[LOG_OUT_BUFFER];
+static int g_out_len = 0;
+
+static atomic_ullong g_messages;
+static atomic_ullong g_suppressed;
+static atomic_ullong g_bytes;
+static atomic_ullong g_flushes;
+
+static void spin_lock(atomic_flag* lock) { while (atomic_flag_test_and_set_explicit(lock, memory_order_acquire)) { } }
+static void spin_unlock(atomic_flag* lock) { atomic_flag_clear_explicit(lock, memory_order_release); }
+
+static const char* level_prefix(int level) {
+    if (level == LOG_LEVEL_ERROR) return "ERROR: ";
+    if (level == LOG_LEVEL_WARN) return "WARNING: ";
+    return "";
+}
+
+// Used before init, after shutdown and when no ring is available
+static void log_direct(int level, const char* tag, const char* msg) {
+    spin_lock(&g_direct_lock);
+    printf("[%s] %s%s\n", tag, level_prefix(level), msg);
+    spin_unlock(&g_direct_lock);
+}
+
+// The calling thread's ring: reuse a drained detached one, else allocate
+static LogRing* log_thread_ring(void) {
+    if (t_ring) return t_ring;
+    LogRing* ring = NULL;
+    spin_lock(&g_ring_lock);
+    int count = atomic_load_explicit(&g_ring_count, memory_order_relaxed);
+    for (int i = 0; i < count && !ring; i++) {
+        LogRing* r = g_rings[i];
+        if (atomic_load_explicit(&r->state, memory_order_relaxed) == LOG_RING_DETACHED &&
+            atomic_load_explicit(&r->tail, memory_order_acquire) == atomic_load_explicit(&r->head, memory_order_relaxed)) {
+            atomic_store_explicit(&r->state, LOG_RING_ACTIVE, memory_order_relaxed);
+            ring = r;
+        }
+    }
+    if (!ring && count < LOG_MAX_RINGS) {
+        ring = (LogRing*)calloc(1, sizeof(LogRing));
+        if (ring) {
+            atomic_init(&ring->head, 0);
+            atomic_init(&ring->tail, 0);
+            atomic_init(&ring->state, LOG_RING_ACTIVE);
+            atomic_init(&ring->dropped, 0);
+            g_rings[count] = ring;
+            atomic_store_explicit(&g_ring_count, count + 1, memory_order_release);
+        }
+    }
+    spin_unlock(&g_ring_lock);
+    t_ring = ring;
+    return ring;
+}
+
+static void log_vwrite(int level, const char* tag, const char* fmt, va_list ap) {
+    char msg[LOG_MAX_MESSAGE];
+    int len = vsnprintf(msg, sizeof(msg), fmt, ap);
+    if (len < 0) return;
+    if (len >= (int)sizeof(msg)) len = (int)sizeof(msg) - 1;
+    while (len > 0 && msg[len - 1] == '\n') msg[--len] = '\0';
+
+    LogRing* ring = g_log_running ? log_thread_ring() : NULL;
+    if (!ring) {
+        log_direct(level, tag, msg);
+        return;
+    }
+
+    // All records of a message are published together, or none
+    int parts = len > 0 ? (len + LOG_RECORD_TEXT - 1) / LOG_RECORD_TEXT : 1;
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (LOG_RING_SLOTS - (head - tail) < (unsigned int)parts) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    unsigned long long seq = atomic_fetch_add_explicit(&g_seq, 1, memory_order_relaxed);
+    const char* text = msg;
+    for (int p = 0; p < parts; p++) {
+        LogRecord* rec = &ring->slots[(head + p) & (LOG_RING_SLOTS - 1)];
+        int n = len > LOG_RECORD_TEXT ? LOG_RECORD_TEXT : len;
+        rec->seq = seq;
+        rec->level = (unsigned char)level;
+        rec->more = p < parts - 1;
+        rec->len = (unsigned short)n;
+        strncpy(rec->tag, tag, LOG_TAG_LEN - 1);
+        rec->tag[LOG_TAG_LEN - 1] = '\0';
+        memcpy(rec->text, text, n);
+        text += n;
+        len -= n;
+    }
+    atomic_store_explicit(&ring->head, head + parts, memory_order_release);
+
+    // The writer polls; only wake it early for problems or a filling ring
+    if (level <= LOG_LEVEL_WARN || head + parts - tail >= LOG_RING_SLOTS / 2) SetEvent(g_log_event);
+}
+
+void async_log_write(int level, const char* tag, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    log_vwrite(level, tag, fmt, ap);
+    va_end(ap);
+}
+
+void async_log_write_limited(LogRateLimit* limit, int per_sec, int level, const char* tag, const char* fmt, ...) {
+    long now = (long)(GetTickCount() / 1000);
+    long window = limit->window;
+    if (window != now && InterlockedCompareExchange(&limit->window, now, window) == window) {
+        long suppressed = InterlockedExchange(&limit->suppressed, 0);
+        InterlockedExchange(&limit->count, 0);
+        if (suppressed > 0) async_log_write(level, tag, "(%ld similar messages suppressed)", suppressed);
+    }
+    if (InterlockedIncrement(&limit->count) > per_sec) {
+        InterlockedIncrement(&limit->suppressed);
+        atomic_fetch_add_explicit(&g_suppressed, 1, memory_order_relaxed);
+        return;
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    log_vwrite(level, tag, fmt, ap);
+    va_end(ap);
+}
+
+static void out_flush(void) {
+    if (g_out_len == 0) return;
+    fwrite(g_out, 1, g_out_len, stdout);
+    fflush(stdout);
+    atomic_fetch_add_explicit(&g_bytes, (unsigned long long)g_out_len, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_flushes, 1, memory_order_relaxed);
+    g_out_len = 0;
+}
+
+static void out_append(const char* data, int len) {
+    while (len > 0) {
+        if (g_out_len == LOG_OUT_BUFFER) out_flush();
+        int n = LOG_OUT_BUFFER - g_out_len;
+        if (n > len) n = len;
+        memcpy(g_out + g_out_len, data, n);
+        g_out_len += n;
+        data += n;
+        len -= n;
+    }
+}
+
+// Writer side: emit every queued message, oldest call first across all rings
+static void log_drain(void) {
+    int count = atomic_load_explicit(&g_ring_count, memory_order_acquire);
+    unsigned int heads[LOG_MAX_RINGS];
+    for (int i = 0; i < count; i++) heads[i] = atomic_load_explicit(&g_rings[i]->head, memory_order_acquire);
+
+    for (;;) {
+        int best = -1;
+        unsigned long long best_seq = 0;
+        for (int i = 0; i < count; i++) {
+            LogRing* ring = g_rings[i];
+            unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+            if (tail == heads[i]) continue;
+            unsigned long long seq = ring->slots[tail & (LOG_RING_SLOTS - 1)].seq;
+            if (best < 0 || seq < best_seq) {
+                best = i;
+                best_seq = seq;
+            }
+        }
+        if (best < 0) break;
+
+        LogRing* ring = g_rings[best];
+        unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        const LogRecord* rec = &ring->slots[tail & (LOG_RING_SLOTS - 1)];
+        char prefix[LOG_TAG_LEN + 16];
+        int n = snprintf(prefix, sizeof(prefix), "[%s] %s", rec->tag, level_prefix(rec->level));
+        out_append(prefix, n);
+        for (;;) {
+            rec = &ring->slots[tail & (LOG_RING_SLOTS - 1)];
+            out_append(rec->text, rec->len);
+            tail++;
+            if (!rec->more) break;
+        }
+        out_append("\n", 1);
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+        atomic_fetch_add_explicit(&g_messages, 1, memory_order_relaxed);
+    }
+    out_flush();
+}
+
+static DWORD WINAPI log_writer_thread(LPVOID param) {
+    (void)param;
+    while (g_log_running) {
+        WaitForSingleObject(g_log_event, LOG_FLUSH_INTERVAL_MS);
+        log_drain();
+    }
+    return 0;
+}
+
+int async_log_init(int level) {
+    if (g_log_thread) return 0;
+    async_log_set_level(level);
+    g_log_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (!g_log_event) return -1;
+    g_log_running = 1;
+    DWORD tid = 0;
+    g_log_thread = CreateThread(NULL, 0, log_writer_thread, NULL, 0, &tid);
+    if (!g_log_thread) {
+        g_log_running = 0;
+        CloseHandle(g_log_event);
+        g_log_event = NULL;
+        printf("[Log] ERROR: Failed to start log writer thread, logging synchronously\n");
+        return -1;
+    }
+    return 0;
+}
+
+void async_log_shutdown(void) {
+    if (!g_log_thread) return;
+    g_log_running = 0;
+    SetEvent(g_log_event);
+    WaitForSingleObject(g_log_thread, INFINITE);
+    CloseHandle(g_log_thread);
+    g_log_thread = NULL;
+    log_drain();
+    CloseHandle(g_log_event);
+    g_log_event = NULL;
+}
+
+void async_log_set_level(int level) {
+    if (level < LOG_LEVEL_ERROR) level = LOG_LEVEL_ERROR;
+    if (level > LOG_LEVEL_TRACE) level = LOG_LEVEL_TRACE;
+    g_log_level = level;
+}
+
+int async_log_parse_level(const char* name) {
+    static const char* names[] = { "error", "warn", "info", "debug", "trace" };
+    if (!name || !*name) return -1;
+    if (name[0] >= '0' && name[0] <= '9') {
+        int level = atoi(name);
+        return level <= LOG_LEVEL_TRACE ? level : -1;
+    }
+    for (int i = 0; i <= LOG_LEVEL_TRACE; i++) {
+        if (_stricmp(name, names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+void async_log_thread_detach(void) {
+    if (!t_ring) return;
+    atomic_store_explicit(&t_ring->state, LOG_RING_DETACHED, memory_order_relaxed);
+    t_ring = NULL;
+}
+
+void async_log_get_stats(AsyncLogStats* stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    int count = atomic_load_explicit(&g_ring_count, memory_order_acquire);
+    for (int i = 0; i < count; i++) stats->dropped += atomic_load_explicit(&g_rings[i]->dropped, memory_order_relaxed);
+    stats->messages = atomic_load_explicit(&g_messages, memory_order_relaxed);
+    stats->suppressed = atomic_load_explicit(&g_suppressed, memory_order_relaxed);
+    stats->bytes = atomic_load_explicit(&g_bytes, memory_order_relaxed);
+    stats->flushes = atomic_load_explicit(&g_flushes, memory_order_relaxed);
+    stats->rings = count;
+}
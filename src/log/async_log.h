@@ -0,0 +1,95 @@
+// Async Log Header
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include <stdatomic.h>
+
+// Levelled logging for the hot paths. A log call formats its message into
+// a fixed-size record in a per-thread single-producer ring and returns; a
+// background thread merges the rings in call order and does the console
+// writes in batches. When a ring is full the message is dropped and
+// counted rather than blocking the caller.
+//
+// Output keeps the "[Tag] message" form used by plain printf elsewhere;
+// warnings and errors get the usual "WARNING: " / "ERROR: " prefix.
+
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_WARN  1
+#define LOG_LEVEL_INFO  2
+#define LOG_LEVEL_DEBUG 3
+#define LOG_LEVEL_TRACE 4
+
+// Calls above this level are compiled out (override with -DLOG_COMPILE_LEVEL=n)
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+#define LOG_RING_SLOTS 512          // Records per thread ring (power of two)
+#define LOG_RECORD_TEXT 232         // Text bytes per record; longer messages span records
+#define LOG_MAX_MESSAGE 4096        // Longest message kept, in bytes
+#define LOG_MAX_RINGS 64            // Threads logging at once
+#define LOG_FLUSH_INTERVAL_MS 20
+
+// Runtime filter; read without a lock on every call
+extern volatile int g_log_level;
+
+// Per call site limiter for per-packet messages
+typedef struct {
+    volatile long window;           // Second the counts belong to
+    volatile long count;
+    volatile long suppressed;
+} LogRateLimit;
+
+typedef struct {
+    unsigned long long messages;    // Messages written
+    unsigned long long dropped;     // Lost to full rings
+    unsigned long long suppressed;  // Held back by rate limits
+    unsigned long long bytes;       // Bytes written to the console
+    unsigned long long flushes;     // Batched writes
+    int rings;                      // Thread rings allocated
+} AsyncLogStats;
+
+// Start the writer thread. Before init and after shutdown log calls print directly.
+int async_log_init(int level);
+// Flush everything queued and stop the writer thread
+void async_log_shutdown(void);
+void async_log_set_level(int level);
+// Name ("error", "warn", "info", "debug", "trace") or number to level, -1 if unknown
+int async_log_parse_level(const char* name);
+
+void async_log_write(int level, const char* tag, const char* fmt, ...);
+void async_log_write_limited(LogRateLimit* limit, int per_sec, int level, const char* tag, const char* fmt, ...);
+
+// Hand the calling thread's ring back for reuse (call before the thread exits)
+void async_log_thread_detach(void);
+void async_log_get_stats(AsyncLogStats* stats);
+
+#define LOG_ENABLED(level) ((level) <= LOG_COMPILE_LEVEL && (level) <= g_log_level)
+
+#define LOG_AT(level, tag, ...) \
+    do { if (LOG_ENABLED(level)) async_log_write((level), (tag), __VA_ARGS__); } while (0)
+
+// At most per_sec messages per second from this call site
+#define LOG_RATELIMITED(level, tag, per_sec, ...) \
+    do { \
+        static LogRateLimit log_limit_; \
+        if (LOG_ENABLED(level)) async_log_write_limited(&log_limit_, (per_sec), (level), (tag), __VA_ARGS__); \
+    } while (0)
+
+#define LOG_ERROR(tag, ...) LOG_AT(LOG_LEVEL_ERROR, tag, __VA_ARGS__)
+#define LOG_WARN(tag, ...)  LOG_AT(LOG_LEVEL_WARN, tag, __VA_ARGS__)
+#define LOG_INFO(tag, ...)  LOG_AT(LOG_LEVEL_INFO, tag, __VA_ARGS__)
+
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(tag, ...) LOG_AT(LOG_LEVEL_DEBUG, tag, __VA_ARGS__)
+#else
+#define LOG_DEBUG(tag, ...) ((void)0)
+#endif
+
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_TRACE
+#define LOG_TRACE(tag, ...) LOG_AT(LOG_LEVEL_TRACE, tag, __VA_ARGS__)
+#else
+#define LOG_TRACE(tag, ...) ((void)0)
+#endif
+
+#endif // ASYNC_LOG_H
@@ -0,0 +1,926 @@
+// PPCS Loopback Implementation
+#include "ppcs_loopback.h"
+
+#ifdef LINUX
+
+#include <errno.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOOPBACK_MAGIC "PPLB"
+#define LOOPBACK_PROTO_VERSION 1
+#define LOOPBACK_RECV_BUFFER (4*1024*1024)  // Per channel, like the vendor library's default
+#define LOOPBACK_SEND_LIMIT (16*1024*1024)  // Unsent bytes per channel before Write refuses
+#define LOOPBACK_CHUNK (16*1024)            // Largest frame on the wire
+#define LOOPBACK_POLL_MS 100                // Listen/connect re-check interval for breaks
+#define LOOPBACK_HELLO_TIMEOUT_MS 2000
+#define LOOPBACK_CLOSE_FLUSH_MS 1000        // PPCS_Close waits this long for unsent data
+#define LOOPBACK_MAX_LISTENERS 16
+
+// Wire format: a hello each way, then frames
+#pragma pack(1)
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint8_t role;                   // 0 client, 1 device
+    uint8_t status;                 // Device reply: 0 accepted, 1 wrong DID
+    char did[24];
+} LoopbackHello;
+
+typedef struct {
+    uint32_t len;
+    uint8_t channel;
+    uint8_t kind;                   // LOOPBACK_FRAME_*
+    uint16_t reserved;
+} LoopbackFrame;
+#pragma pack()
+
+#define LOOPBACK_FRAME_DATA 1
+#define LOOPBACK_FRAME_CLOSE 2      // Graceful close: the peer sees CLOSED_REMOTE
+
+typedef struct LoopbackSegment {
+    struct LoopbackSegment* next;
+    long long due_us;               // Not sent before this (injected latency)
+    int len;
+    int sent;
+    unsigned char data[];
+} LoopbackSegment;
+
+typedef struct {
+    // Receive ring, filled by the receiver thread
+    unsigned char* buf;
+    int head;
+    int used;
+    // Send queue, drained by the sender thread
+    LoopbackSegment* first;
+    LoopbackSegment* last;
+    unsigned int unsent;
+    long long last_due_us;
+} LoopbackChannel;
+
+typedef struct {
+    int handle;
+    int fd;
+    int is_device;
+    char did[24];
+    int refs;                       // Table, threads and calls in progress; under g_lock
+    pthread_mutex_t lock;
+    pthread_cond_t data_cond;       // Receive ring gained bytes, or the session closed
+    pthread_cond_t space_cond;      // Receive ring lost bytes
+    pthread_cond_t send_cond;       // Send queue gained a segment, or the session is closing
+    int state;                      // 0 open, else the ERROR_PPCS_SESSION_CLOSED_* code
+    int closing;                    // PPCS_Close: flush, then send a close frame
+    long long closing_at;
+    long long opened_us;
+    long long drop_at_us;           // Injected drop, 0 for none
+    PPCSLoopbackConfig config;
+    double tokens;                  // Bandwidth cap, in bytes
+    long long tokens_at;
+    LoopbackChannel ch[PPCS_LOOPBACK_CHANNELS];
+    struct sockaddr_in local_addr;
+    struct sockaddr_in remote_addr;
+} LoopbackSession;
+
+typedef struct {
+    int port;
+    int fd;
+} LoopbackListener;
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static int g_initialized = 0;
+static PPCSLoopbackConfig g_config;
+static LoopbackSession* g_sessions[PPCS_LOOPBACK_MAX_SESSIONS];
+static LoopbackListener g_listeners[LOOPBACK_MAX_LISTENERS];
+static int g_listener_count = 0;
+static PPCSLoopbackStats g_stats;
+static volatile int g_listen_break = 0;
+static volatile int g_connect_epoch = 0;   // Bumped by PPCS_Connect_Break
+static unsigned int g_seed = 1;
+
+static long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void deadline_after_us(struct timespec* ts, long long us) {
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    long long ns = (long long)ts->tv_nsec + (us % 1000000) * 1000;
+    ts->tv_sec += (time_t)(us / 1000000 + ns / 1000000000);
+    ts->tv_nsec = (long)(ns % 1000000000);
+}
+
+static void sleep_us(long long us) {
+    if (us <= 0) return;
+    struct timespec ts = { (time_t)(us / 1000000), (long)(us % 1000000) * 1000 };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) { }
+}
+
+// Under g_lock
+static int random_below(int n) {
+    if (n <= 0) return 0;
+    g_seed = g_seed * 1103515245u + 12345u;
+    return (int)((g_seed >> 8) % (unsigned int)n);
+}
+
+static int env_int(const char* name, int fallback) {
+    const char* value = getenv(name);
+    return value && *value ? atoi(value) : fallback;
+}
+
+static void load_env_config(void) {
+    memset(&g_config, 0, sizeof(g_config));
+    g_config.latency_ms = env_int("PPCS_LOOPBACK_LATENCY_MS", 0);
+    g_config.jitter_ms = env_int("PPCS_LOOPBACK_JITTER_MS", 0);
+    g_config.rate_kbps = env_int("PPCS_LOOPBACK_RATE_KBPS", 0);
+    g_config.drop_after_ms = env_int("PPCS_LOOPBACK_DROP_AFTER_MS", 0);
+    g_config.connect_timeout_ms = env_int("PPCS_LOOPBACK_CONNECT_TIMEOUT_MS", 3000);
+    g_config.base_port = env_int("PPCS_LOOPBACK_PORT", 40000);
+    const char* host = getenv("PPCS_LOOPBACK_HOST");
+    strncpy(g_config.host, host && *host ? host : "127.0.0.1", sizeof(g_config.host) - 1);
+}
+
+void ppcs_loopback_configure(const PPCSLoopbackConfig* config) {
+    if (!config) return;
+    pthread_mutex_lock(&g_lock);
+    g_config = *config;
+    g_config.host[sizeof(g_config.host) - 1] = '\0';
+    if (!g_config.host[0]) strcpy(g_config.host, "127.0.0.1");
+    if (g_config.base_port <= 0) g_config.base_port = 40000;
+    if (g_config.connect_timeout_ms <= 0) g_config.connect_timeout_ms = 3000;
+    pthread_mutex_unlock(&g_lock);
+}
+
+void ppcs_loopback_get_config(PPCSLoopbackConfig* config) {
+    if (!config) return;
+    pthread_mutex_lock(&g_lock);
+    *config = g_config;
+    pthread_mutex_unlock(&g_lock);
+}
+
+void ppcs_loopback_get_stats(PPCSLoopbackStats* stats) {
+    if (!stats) return;
+    pthread_mutex_lock(&g_lock);
+    *stats = g_stats;
+    pthread_mutex_unlock(&g_lock);
+}
+
+int ppcs_loopback_port(const char* did) {
+    // FNV-1a, so a device and its clients agree without any registry
+    unsigned int hash = 2166136261u;
+    for (const char* p = did ? did : ""; *p; p++) hash = (hash ^ (unsigned char)*p) * 16777619u;
+    int base;
+    pthread_mutex_lock(&g_lock);
+    base = g_config.base_port > 0 ? g_config.base_port : 40000;
+    pthread_mutex_unlock(&g_lock);
+    return base + (int)(hash % PPCS_LOOPBACK_PORT_RANGE);
+}
+
+// ---------------- Sessions ----------------
+
+static void session_unref(LoopbackSession* s) {
+    pthread_mutex_lock(&g_lock);
+    int refs = --s->refs;
+    pthread_mutex_unlock(&g_lock);
+    if (refs > 0) return;
+    close(s->fd);
+    for (int i = 0; i < PPCS_LOOPBACK_CHANNELS; i++) {
+        free(s->ch[i].buf);
+        while (s->ch[i].first) {
+            LoopbackSegment* next = s->ch[i].first->next;
+            free(s->ch[i].first);
+            s->ch[i].first = next;
+        }
+    }
+    pthread_cond_destroy(&s->data_cond);
+    pthread_cond_destroy(&s->space_cond);
+    pthread_cond_destroy(&s->send_cond);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+}
+
+// A reference for the duration of one API call; NULL for a bad handle
+static LoopbackSession* session_get(INT32 handle) {
+    if (handle < 0 || handle >= PPCS_LOOPBACK_MAX_SESSIONS) return NULL;
+    pthread_mutex_lock(&g_lock);
+    LoopbackSession* s = g_sessions[handle];
+    if (s) s->refs++;
+    pthread_mutex_unlock(&g_lock);
+    return s;
+}
+
+// Under s->lock. The first reason wins.
+static void session_set_closed(LoopbackSession* s, int state) {
+    if (s->state == 0) s->state = state;
+    pthread_cond_broadcast(&s->data_cond);
+    pthread_cond_broadcast(&s->space_cond);
+    pthread_cond_broadcast(&s->send_cond);
+}
+
+static int send_all(int fd, const void* data, int len) {
+    const char* p = (const char*)data;
+    while (len > 0) {
+        ssize_t n = send(fd, p, (size_t)len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (int)n;
+    }
+    return 0;
+}
+
+static int recv_all(int fd, void* data, int len) {
+    char* p = (char*)data;
+    while (len > 0) {
+        ssize_t n = recv(fd, p, (size_t)len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (int)n;
+    }
+    return 0;
+}
+
+// Wait for the bandwidth cap to allow len more bytes. Sender thread only.
+static void throttle(LoopbackSession* s, int len) {
+    if (s->config.rate_kbps <= 0) return;
+    double rate = (double)s->config.rate_kbps * 1000.0 / 8.0;     // Bytes per second
+    double burst = rate / 50.0 > LOOPBACK_CHUNK ? rate / 50.0 : LOOPBACK_CHUNK;
+    long long now = now_us();
+    s->tokens += (double)(now - s->tokens_at) * rate / 1000000.0;
+    if (s->tokens > burst) s->tokens = burst;
+    s->tokens_at = now;
+    s->tokens -= len;
+    if (s->tokens < 0) sleep_us((long long)(-s->tokens * 1000000.0 / rate));
+}
+
+// Pick the channel whose oldest segment is due, round robin. Under s->lock.
+// Returns -1 and the earliest due time when nothing can go yet.
+static int next_due_channel(LoopbackSession* s, int* rr, long long now, long long* earliest) {
+    *earliest = 0;
+    for (int i = 0; i < PPCS_LOOPBACK_CHANNELS; i++) {
+        int c = (*rr + i) % PPCS_LOOPBACK_CHANNELS;
+        LoopbackSegment* seg = s->ch[c].first;
+        if (!seg) continue;
+        if (seg->due_us <= now || s->closing) {
+            *rr = (c + 1) % PPCS_LOOPBACK_CHANNELS;
+            return c;
+        }
+        if (*earliest == 0 || seg->due_us < *earliest) *earliest = seg->due_us;
+    }
+    return -1;
+}
+
+static void* sender_thread(void* param) {
+    LoopbackSession* s = (LoopbackSession*)param;
+    int rr = 0;
+    pthread_mutex_lock(&s->lock);
+    while (s->state == 0) {
+        long long now = now_us();
+        if (s->drop_at_us > 0 && now >= s->drop_at_us) {
+            // Injected drop: no close frame, both ends see a timeout
+            pthread_mutex_lock(&g_lock);
+            g_stats.drops++;
+            pthread_mutex_unlock(&g_lock);
+            printf("[Loopback] Dropping session %d (%s) after %lld ms\n", s->handle, s->did, (now - s->opened_us) / 1000);
+            shutdown(s->fd, SHUT_RDWR);
+            session_set_closed(s, ERROR_PPCS_SESSION_CLOSED_TIMEOUT);
+            break;
+        }
+        long long earliest;
+        int c = next_due_channel(s, &rr, now, &earliest);
+        if (c < 0) {
+            if (s->closing) {
+                // Flushed: say goodbye and stop both threads
+                LoopbackFrame frame = { 0, 0, LOOPBACK_FRAME_CLOSE, 0 };
+                send_all(s->fd, &frame, sizeof(frame));
+                shutdown(s->fd, SHUT_RDWR);
+                session_set_closed(s, ERROR_PPCS_SESSION_CLOSED_CALLED);
+                break;
+            }
+            long long wait_until = earliest;
+            if (s->drop_at_us > 0 && (wait_until == 0 || s->drop_at_us < wait_until)) wait_until = s->drop_at_us;
+            struct timespec deadline;
+            deadline_after_us(&deadline, wait_until > 0 ? wait_until - now : LOOPBACK_POLL_MS * 1000LL);
+            pthread_cond_timedwait(&s->send_cond, &s->lock, &deadline);
+            continue;
+        }
+        if (s->closing && now - s->closing_at > LOOPBACK_CLOSE_FLUSH_MS * 1000LL) {
+            // Still not flushed (bandwidth cap): give up on the rest
+            for (int i = 0; i < PPCS_LOOPBACK_CHANNELS; i++) {
+                while (s->ch[i].first) {
+                    LoopbackSegment* next = s->ch[i].first->next;
+                    free(s->ch[i].first);
+                    s->ch[i].first = next;
+                }
+                s->ch[i].last = NULL;
+                s->ch[i].unsent = 0;
+            }
+            continue;
+        }
+        // Only this thread removes segments, so the data stays put unlocked
+        LoopbackSegment* seg = s->ch[c].first;
+        int len = seg->len - seg->sent;
+        if (len > LOOPBACK_CHUNK) len = LOOPBACK_CHUNK;
+        const unsigned char* data = seg->data + seg->sent;
+        pthread_mutex_unlock(&s->lock);
+
+        throttle(s, len);
+        LoopbackFrame frame = { (uint32_t)len, (uint8_t)c, LOOPBACK_FRAME_DATA, 0 };
+        int failed = send_all(s->fd, &frame, sizeof(frame)) != 0 || send_all(s->fd, data, len) != 0;
+
+        pthread_mutex_lock(&s->lock);
+        if (failed) {
+            session_set_closed(s, ERROR_PPCS_SESSION_CLOSED_TIMEOUT);
+            break;
+        }
+        seg->sent += len;
+        s->ch[c].unsent -= (unsigned int)len;
+        if (seg->sent == seg->len) {
+            s->ch[c].first = seg->next;
+            if (!s->ch[c].first) s->ch[c].last = NULL;
+            free(seg);
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+    session_unref(s);
+    return NULL;
+}
+
+static void* receiver_thread(void* param) {
+    LoopbackSession* s = (LoopbackSession*)param;
+    int state = ERROR_PPCS_SESSION_CLOSED_TIMEOUT;
+    LoopbackFrame frame;
+    while (recv_all(s->fd, &frame, sizeof(frame)) == 0) {
+        if (frame.kind == LOOPBACK_FRAME_CLOSE) {
+            state = ERROR_PPCS_SESSION_CLOSED_REMOTE;
+            break;
+        }
+        if (frame.kind != LOOPBACK_FRAME_DATA || frame.channel >= PPCS_LOOPBACK_CHANNELS || frame.len > LOOPBACK_CHUNK) break;
+        LoopbackChannel* ch = &s->ch[frame.channel];
+        int remaining = (int)frame.len;
+        int failed = 0;
+        while (remaining > 0 && !failed) {
+            // Wait for room; a full ring stops reading the socket, which
+            // holds back the peer's sender, as the real flow control does
+            pthread_mutex_lock(&s->lock);
+            while (ch->used == LOOPBACK_RECV_BUFFER && s->state == 0) pthread_cond_wait(&s->space_cond, &s->lock);
+            if (s->state != 0) {
+                pthread_mutex_unlock(&s->lock);
+                failed = 1;
+                break;
+            }
+            int tail = (ch->head + ch->used) % LOOPBACK_RECV_BUFFER;
+            int room = LOOPBACK_RECV_BUFFER - ch->used;
+            if (room > LOOPBACK_RECV_BUFFER - tail) room = LOOPBACK_RECV_BUFFER - tail;
+            if (room > remaining) room = remaining;
+            pthread_mutex_unlock(&s->lock);
+
+            // Readers only touch the used part of the ring
+            if (recv_all(s->fd, ch->buf + tail, room) != 0) {
+                failed = 1;
+                break;
+            }
+            pthread_mutex_lock(&s->lock);
+            ch->used += room;
+            pthread_cond_broadcast(&s->data_cond);
+            pthread_mutex_unlock(&s->lock);
+            remaining -= room;
+        }
+        if (failed) break;
+    }
+    pthread_mutex_lock(&s->lock);
+    session_set_closed(s, state);
+    pthread_mutex_unlock(&s->lock);
+    session_unref(s);
+    return NULL;
+}
+
+// Takes over fd. Returns the session handle or a PPCS error.
+static INT32 session_create(int fd, const char* did, int is_device) {
+    LoopbackSession* s = (LoopbackSession*)calloc(1, sizeof(LoopbackSession));
+    if (!s) {
+        close(fd);
+        return ERROR_PPCS_FAIL_TO_ALLOCATE_MEMORY;
+    }
+    for (int i = 0; i < PPCS_LOOPBACK_CHANNELS; i++) {
+        s->ch[i].buf = (unsigned char*)malloc(LOOPBACK_RECV_BUFFER);
+        if (!s->ch[i].buf) {
+            for (int j = 0; j < i; j++) free(s->ch[j].buf);
+            free(s);
+            close(fd);
+            return ERROR_PPCS_FAIL_TO_ALLOCATE_MEMORY;
+        }
+    }
+    s->fd = fd;
+    s->is_device = is_device;
+    strncpy(s->did, did, sizeof(s->did) - 1);
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&s->data_cond, &attr);
+    pthread_cond_init(&s->space_cond, &attr);
+    pthread_cond_init(&s->send_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    socklen_t addr_len = sizeof(s->local_addr);
+    getsockname(fd, (struct sockaddr*)&s->local_addr, &addr_len);
+    addr_len = sizeof(s->remote_addr);
+    getpeername(fd, (struct sockaddr*)&s->remote_addr, &addr_len);
+    s->opened_us = now_us();
+    s->tokens_at = s->opened_us;
+
+    pthread_mutex_lock(&g_lock);
+    int handle = -1;
+    for (int i = 0; i < PPCS_LOOPBACK_MAX_SESSIONS; i++) {
+        if (!g_sessions[i]) {
+            handle = i;
+            break;
+        }
+    }
+    if (handle < 0) {
+        pthread_mutex_unlock(&g_lock);
+        s->refs = 1;
+        session_unref(s);
+        return ERROR_PPCS_MAX_SESSION;
+    }
+    s->handle = handle;
+    s->config = g_config;
+    if (s->config.drop_after_ms > 0) {
+        s->drop_at_us = s->opened_us + (long long)s->config.drop_after_ms * (500 + random_below(1001));
+    }
+    s->refs = 3;                    // Table and both threads
+    g_sessions[handle] = s;
+    g_stats.sessions++;
+    pthread_mutex_unlock(&g_lock);
+
+    pthread_t thread;
+    pthread_attr_t thread_attr;
+    pthread_attr_init(&thread_attr);
+    pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_DETACHED);
+    int failed = 0;
+    if (pthread_create(&thread, &thread_attr, receiver_thread, s) != 0) {
+        failed = 1;
+        session_unref(s);
+    }
+    if (pthread_create(&thread, &thread_attr, sender_thread, s) != 0) {
+        failed = 1;
+        session_unref(s);
+    }
+    pthread_attr_destroy(&thread_attr);
+    if (failed) {
+        PPCS_ForceClose(handle);
+        return ERROR_PPCS_FAIL_TO_CREATE_THREAD;
+    }
+    return handle;
+}
+
+// Remove from the table; flush first unless forced
+static INT32 session_close(INT32 handle, int flush) {
+    if (handle < 0 || handle >= PPCS_LOOPBACK_MAX_SESSIONS) return ERROR_PPCS_INVALID_SESSION_HANDLE;
+    pthread_mutex_lock(&g_lock);
+    LoopbackSession* s = g_sessions[handle];
+    g_sessions[handle] = NULL;
+    pthread_mutex_unlock(&g_lock);
+    if (!s) return ERROR_PPCS_INVALID_SESSION_HANDLE;
+    pthread_mutex_lock(&s->lock);
+    if (s->state == 0) {
+        if (flush) {
+            s->closing = 1;
+            s->closing_at = now_us();
+            pthread_cond_broadcast(&s->send_cond);
+            // Readers blocked on this handle return now, as with the vendor library
+            pthread_cond_broadcast(&s->data_cond);
+        } else {
+            shutdown(s->fd, SHUT_RDWR);
+            session_set_closed(s, ERROR_PPCS_SESSION_CLOSED_CALLED);
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+    session_unref(s);
+    return ERROR_PPCS_SUCCESSFUL;
+}
+
+int ppcs_loopback_drop(INT32 handle) {
+    LoopbackSession* s = session_get(handle);
+    if (!s) return -1;
+    pthread_mutex_lock(&s->lock);
+    s->drop_at_us = 1;
+    pthread_cond_broadcast(&s->send_cond);
+    pthread_mutex_unlock(&s->lock);
+    session_unref(s);
+    return 0;
+}
+
+// ---------------- Connection setup ----------------
+
+static int set_socket_options(int fd) {
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    struct timeval tv = { LOOPBACK_HELLO_TIMEOUT_MS / 1000, (LOOPBACK_HELLO_TIMEOUT_MS % 1000) * 1000 };
+    return setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+static void clear_receive_timeout(int fd) {
+    struct timeval tv = { 0, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+static void hello_init(LoopbackHello* hello, int role, const char* did) {
+    memset(hello, 0, sizeof(*hello));
+    memcpy(hello->magic, LOOPBACK_MAGIC, 4);
+    hello->version = LOOPBACK_PROTO_VERSION;
+    hello->role = (uint8_t)role;
+    strncpy(hello->did, did, sizeof(hello->did) - 1);
+}
+
+static int listener_fd(int port, const char* host) {
+    pthread_mutex_lock(&g_lock);
+    for (int i = 0; i < g_listener_count; i++) {
+        if (g_listeners[i].port == port) {
+            int fd = g_listeners[i].fd;
+            pthread_mutex_unlock(&g_lock);
+            return fd;
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    // A remote host means clients come from elsewhere: listen on every interface
+    addr.sin_addr.s_addr = strcmp(host, "127.0.0.1") == 0 ? htonl(INADDR_LOOPBACK) : htonl(INADDR_ANY);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+        close(fd);
+        return -1;
+    }
+    pthread_mutex_lock(&g_lock);
+    if (g_listener_count < LOOPBACK_MAX_LISTENERS) {
+        g_listeners[g_listener_count].port = port;
+        g_listeners[g_listener_count].fd = fd;
+        g_listener_count++;
+    }
+    pthread_mutex_unlock(&g_lock);
+    return fd;
+}
+
+INT32 PPCS_Listen(const CHAR* MyID, const UINT32 TimeOut_Sec, UINT16 UDP_Port, CHAR bEnableInternet, const CHAR* APILicense) {
+    (void)UDP_Port;
+    (void)bEnableInternet;
+    (void)APILicense;
+    if (!g_initialized) return ERROR_PPCS_NOT_INITIALIZED;
+    if (!MyID || !*MyID) return ERROR_PPCS_INVALID_ID;
+    PPCSLoopbackConfig config;
+    ppcs_loopback_get_config(&config);
+    int port = ppcs_loopback_port(MyID);
+    int fd = listener_fd(port, config.host);
+    if (fd < 0) {
+        printf("[Loopback] ERROR: Cannot listen on port %d for %s: %s\n", port, MyID, strerror(errno));
+        return ERROR_PPCS_UDP_PORT_BIND_FAILED;
+    }
+    g_listen_break = 0;
+    long long deadline = TimeOut_Sec > 0 ? now_us() + (long long)TimeOut_Sec * 1000000 : 0;
+    while (!g_listen_break) {
+        if (deadline > 0 && now_us() >= deadline) return ERROR_PPCS_TIME_OUT;
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, LOOPBACK_POLL_MS) <= 0) continue;
+        int conn = accept(fd, NULL, NULL);
+        if (conn < 0) continue;
+        set_socket_options(conn);
+        LoopbackHello hello, reply;
+        if (recv_all(conn, &hello, sizeof(hello)) != 0 || memcmp(hello.magic, LOOPBACK_MAGIC, 4) != 0 ||
+            hello.version != LOOPBACK_PROTO_VERSION) {
+            close(conn);
+            continue;
+        }
+        hello.did[sizeof(hello.did) - 1] = '\0';
+        hello_init(&reply, 1, MyID);
+        // Two DIDs can share a port; a client looking for the other one is turned away
+        reply.status = strcmp(hello.did, MyID) == 0 ? 0 : 1;
+        if (send_all(conn, &reply, sizeof(reply)) != 0 || reply.status != 0) {
+            close(conn);
+            continue;
+        }
+        clear_receive_timeout(conn);
+        return session_create(conn, MyID, 1);
+    }
+    return ERROR_PPCS_USER_LISTEN_BREAK;
+}
+
+INT32 PPCS_Listen_Break(void) {
+    g_listen_break = 1;
+    return ERROR_PPCS_SUCCESSFUL;
+}
+
+// One connect attempt; 1 if refused (device not listening yet)
+static int try_connect(const struct sockaddr_in* addr, int* out_fd) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (const struct sockaddr*)addr, sizeof(*addr)) != 0) {
+        int refused = errno == ECONNREFUSED;
+        close(fd);
+        return refused ? 1 : -1;
+    }
+    *out_fd = fd;
+    return 0;
+}
+
+INT32 PPCS_ConnectByServer(const CHAR* TargetID, CHAR bEnableLanSearch, UINT16 UDP_Port, CHAR* ServerString) {
+    (void)bEnableLanSearch;
+    (void)UDP_Port;
+    (void)ServerString;
+    if (!g_initialized) return ERROR_PPCS_NOT_INITIALIZED;
+    if (!TargetID || !*TargetID) return ERROR_PPCS_INVALID_ID;
+    int epoch = g_connect_epoch;
+    PPCSLoopbackConfig config;
+    ppcs_loopback_get_config(&config);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)ppcs_loopback_port(TargetID));
+    if (inet_pton(AF_INET, config.host, &addr.sin_addr) != 1) return ERROR_PPCS_FAIL_TO_RESOLVE_NAME;
+
+    long long deadline = now_us() + (long long)config.connect_timeout_ms * 1000;
+    int fd = -1;
+    for (;;) {
+        if (g_connect_epoch != epoch) return ERROR_PPCS_USER_CONNECT_BREAK;
+        int ret = try_connect(&addr, &fd);
+        if (ret == 0) break;
+        if (ret < 0 || now_us() >= deadline) return ERROR_PPCS_DEVICE_NOT_ONLINE;
+        sleep_us(LOOPBACK_POLL_MS * 1000LL);
+    }
+    set_socket_options(fd);
+    LoopbackHello hello, reply;
+    hello_init(&hello, 0, TargetID);
+    if (send_all(fd, &hello, sizeof(hello)) != 0 || recv_all(fd, &reply, sizeof(reply)) != 0 ||
+        memcmp(reply.magic, LOOPBACK_MAGIC, 4) != 0) {
+        close(fd);
+        return ERROR_PPCS_DEVICE_NOT_ONLINE;
+    }
+    if (reply.status != 0) {
+        close(fd);
+        return ERROR_PPCS_INVALID_ID;
+    }
+    clear_receive_timeout(fd);
+    // The handshake costs a round trip on the injected path
+    sleep_us(2000LL * config.latency_ms);
+    if (g_connect_epoch != epoch) {
+        close(fd);
+        return ERROR_PPCS_USER_CONNECT_BREAK;
+    }
+    return session_create(fd, TargetID, 0);
+}
+
+INT32 PPCS_Connect(const CHAR* TargetID, CHAR bEnableLanSearch, UINT16 UDP_Port) {
+    return PPCS_ConnectByServer(TargetID, bEnableLanSearch, UDP_Port, NULL);
+}
+
+INT32 PPCS_Connect_Break(void) {
+    __sync_fetch_and_add(&g_connect_epoch, 1);
+    return ERROR_PPCS_SUCCESSFUL;
+}
+
+// ---------------- Data ----------------
+
+INT32 PPCS_Write(INT32 SessionHandle, UCHAR Channel, CHAR* DataBuf, INT32 DataSizeToWrite) {
+    if (Channel >= PPCS_LOOPBACK_CHANNELS || !DataBuf || DataSizeToWrite < 0) return ERROR_PPCS_INVALID_PARAMETER;
+    LoopbackSession* s = session_get(SessionHandle);
+    if (!s) return ERROR_PPCS_INVALID_SESSION_HANDLE;
+    INT32 ret = DataSizeToWrite;
+    LoopbackChannel* ch = &s->ch[Channel];
+    LoopbackSegment* seg = DataSizeToWrite > 0 ? (LoopbackSegment*)malloc(sizeof(LoopbackSegment) + DataSizeToWrite) : NULL;
+    if (seg) {
+        memcpy(seg->data, DataBuf, DataSizeToWrite);
+        seg->next = NULL;
+        seg->len = DataSizeToWrite;
+        seg->sent = 0;
+    }
+    pthread_mutex_lock(&s->lock);
+    if (s->state != 0 || s->closing) {
+        ret = s->state != 0 ? s->state : ERROR_PPCS_SESSION_CLOSED_CALLED;
+    } else if (DataSizeToWrite > 0 && !seg) {
+        ret = ERROR_PPCS_FAIL_TO_ALLOCATE_MEMORY;
+    } else if (DataSizeToWrite > 0 && ch->unsent + (unsigned int)DataSizeToWrite > LOOPBACK_SEND_LIMIT) {
+        ret = ERROR_PPCS_REMOTE_SITE_BUFFER_FULL;
+        pthread_mutex_lock(&g_lock);
+        g_stats.writes_rejected++;
+        pthread_mutex_unlock(&g_lock);
+    } else if (seg) {
+        // Latency plus jitter, never earlier than the previous write so order holds
+        long long due = now_us() + (long long)s->config.latency_ms * 1000;
+        if (s->config.jitter_ms > 0) {
+            pthread_mutex_lock(&g_lock);
+            due += (long long)random_below(s->config.jitter_ms * 1000 + 1);
+            pthread_mutex_unlock(&g_lock);
+        }
+        if (due < ch->last_due_us) due = ch->last_due_us;
+        ch->last_due_us = due;
+        seg->due_us = due;
+        if (ch->last) ch->last->next = seg;
+        else ch->first = seg;
+        ch->last = seg;
+        ch->unsent += (unsigned int)DataSizeToWrite;
+        seg = NULL;
+        pthread_cond_broadcast(&s->send_cond);
+    }
+    pthread_mutex_unlock(&s->lock);
+    free(seg);
+    if (ret > 0) {
+        pthread_mutex_lock(&g_lock);
+        g_stats.bytes_written += (unsigned long long)ret;
+        pthread_mutex_unlock(&g_lock);
+    }
+    session_unref(s);
+    return ret;
+}
+
+INT32 PPCS_Read(INT32 SessionHandle, UCHAR Channel, CHAR* DataBuf, INT32* DataSize, UINT32 TimeOut_ms) {
+    if (Channel >= PPCS_LOOPBACK_CHANNELS || !DataBuf || !DataSize || *DataSize < 0) return ERROR_PPCS_INVALID_PARAMETER;
+    LoopbackSession* s = session_get(SessionHandle);
+    if (!s) return ERROR_PPCS_INVALID_SESSION_HANDLE;
+    LoopbackChannel* ch = &s->ch[Channel];
+    int want = *DataSize;
+    int got = 0;
+    int timed_out = 0;
+    struct timespec deadline;
+    deadline_after_us(&deadline, (long long)TimeOut_ms * 1000);
+    pthread_mutex_lock(&s->lock);
+    // Like the vendor library: wait for the full size, return what came on timeout
+    for (;;) {
+        while (got < want && ch->used > 0) {
+            int n = ch->used;
+            if (n > want - got) n = want - got;
+            if (n > LOOPBACK_RECV_BUFFER - ch->head) n = LOOPBACK_RECV_BUFFER - ch->head;
+            memcpy(DataBuf + got, ch->buf + ch->head, n);
+            ch->head = (ch->head + n) % LOOPBACK_RECV_BUFFER;
+            ch->used -= n;
+            got += n;
+            pthread_cond_broadcast(&s->space_cond);
+        }
+        if (got == want || s->state != 0 || s->closing || timed_out) break;
+        if (pthread_cond_timedwait(&s->data_cond, &s->lock, &deadline) == ETIMEDOUT) timed_out = 1;
+    }
+    int state = s->state != 0 ? s->state : (s->closing ? ERROR_PPCS_SESSION_CLOSED_CALLED : 0);
+    pthread_mutex_unlock(&s->lock);
+    session_unref(s);
+    *DataSize = got;
+    if (got > 0) {
+        pthread_mutex_lock(&g_lock);
+        g_stats.bytes_read += (unsigned long long)got;
+        pthread_mutex_unlock(&g_lock);
+    }
+    if (got == want) return ERROR_PPCS_SUCCESSFUL;
+    if (got == 0 && state != 0) return state;
+    return ERROR_PPCS_TIME_OUT;
+}
+
+INT32 PPCS_Check_Buffer(INT32 SessionHandle, UCHAR Channel, UINT32* WriteSize, UINT32* ReadSize) {
+    if (Channel >= PPCS_LOOPBACK_CHANNELS) return ERROR_PPCS_INVALID_PARAMETER;
+    LoopbackSession* s = session_get(SessionHandle);
+    if (!s) return ERROR_PPCS_INVALID_SESSION_HANDLE;
+    pthread_mutex_lock(&s->lock);
+    INT32 ret = s->state;
+    if (WriteSize) *WriteSize = s->ch[Channel].unsent;
+    if (ReadSize) *ReadSize = (UINT32)s->ch[Channel].used;
+    pthread_mutex_unlock(&s->lock);
+    session_unref(s);
+    return ret;
+}
+
+INT32 PPCS_PktSend(INT32 SessionHandle, UCHAR Channel, CHAR* PktBuf, INT32 PktSize) {
+    return PPCS_Write(SessionHandle, Channel, PktBuf, PktSize);
+}
+
+INT32 PPCS_PktRecv(INT32 SessionHandle, UCHAR Channel, CHAR* PktBuf, INT32* PktSize, UINT32 TimeOut_ms) {
+    // No packet boundaries on this transport: whatever is buffered, up to PktSize
+    UINT32 pending = 0;
+    INT32 ret = PPCS_Check_Buffer(SessionHandle, Channel, NULL, &pending);
+    if (ret != ERROR_PPCS_SUCCESSFUL || !PktSize) return ret != ERROR_PPCS_SUCCESSFUL ? ret : ERROR_PPCS_INVALID_PARAMETER;
+    if (pending > 0 && (UINT32)*PktSize > pending) *PktSize = (INT32)pending;
+    return PPCS_Read(SessionHandle, Channel, PktBuf, PktSize, TimeOut_ms);
+}
+
+INT32 PPCS_Check(INT32 SessionHandle, st_PPCS_Session* SInfo) {
+    if (!SInfo) return ERROR_PPCS_INVALID_PARAMETER;
+    LoopbackSession* s = session_get(SessionHandle);
+    if (!s) return ERROR_PPCS_INVALID_SESSION_HANDLE;
+    memset(SInfo, 0, sizeof(*SInfo));
+    pthread_mutex_lock(&s->lock);
+    INT32 ret = s->state;
+    SInfo->Skt = s->fd;
+    SInfo->RemoteAddr = s->remote_addr;
+    SInfo->MyLocalAddr = s->local_addr;
+    SInfo->MyWanAddr = s->local_addr;
+    SInfo->ConnectTime = (UINT32)((now_us() - s->opened_us) / 1000000);
+    memcpy(SInfo->DID, s->did, sizeof(SInfo->DID));      // Same size, NUL-terminated
+    SInfo->bCorD = (CHAR)s->is_device;
+    SInfo->bMode = 0;               // Always reported as P2P
+    pthread_mutex_unlock(&s->lock);
+    session_unref(s);
+    return ret;
+}
+
+INT32 PPCS_Close(INT32 SessionHandle) {
+    return session_close(SessionHandle, 1);
+}
+
+INT32 PPCS_ForceClose(INT32 SessionHandle) {
+    return session_close(SessionHandle, 0);
+}
+
+// ---------------- Library ----------------
+
+UINT32 PPCS_GetAPIVersion(void) {
+    return PPCS_LOOPBACK_VERSION;
+}
+
+CHAR* PPCS_GetAPIInformation(void) {
+    static char info[] = "PPCS loopback stand-in (TCP), not the vendor library";
+    return info;
+}
+
+INT32 PPCS_QueryDID(const CHAR* DeviceName, CHAR* DID, INT32 DIDBufSize) {
+    if (!DeviceName || !DID || DIDBufSize <= 0) return ERROR_PPCS_INVALID_PARAMETER;
+    snprintf(DID, (size_t)DIDBufSize, "%s", DeviceName);
+    return ERROR_PPCS_SUCCESSFUL;
+}
+
+INT32 PPCS_Initialize(CHAR* Parameter) {
+    (void)Parameter;
+    pthread_mutex_lock(&g_lock);
+    if (g_initialized) {
+        pthread_mutex_unlock(&g_lock);
+        return ERROR_PPCS_ALREADY_INITIALIZED;
+    }
+    g_initialized = 1;
+    g_seed = (unsigned int)now_us() ^ (unsigned int)getpid();
+    load_env_config();
+    pthread_mutex_unlock(&g_lock);
+    printf("[Loopback] PPCS stand-in on %s, ports %d+, latency %d+%d ms, rate %d kbps, drops after %d ms\n",
+           g_config.host, g_config.base_port, g_config.latency_ms, g_config.jitter_ms,
+           g_config.rate_kbps, g_config.drop_after_ms);
+    return ERROR_PPCS_SUCCESSFUL;
+}
+
+INT32 PPCS_DeInitialize(void) {
+    if (!g_initialized) return ERROR_PPCS_NOT_INITIALIZED;
+    for (int i = 0; i < PPCS_LOOPBACK_MAX_SESSIONS; i++) session_close(i, 0);
+    pthread_mutex_lock(&g_lock);
+    for (int i = 0; i < g_listener_count; i++) close(g_listeners[i].fd);
+    g_listener_count = 0;
+    g_initialized = 0;
+    PPCSLoopbackStats stats = g_stats;
+    pthread_mutex_unlock(&g_lock);
+    printf("[Loopback] %llu sessions, %llu dropped, %.2f MB written, %.2f MB read, %llu writes refused\n",
+           stats.sessions, stats.drops, (double)stats.bytes_written / (1024 * 1024),
+           (double)stats.bytes_read / (1024 * 1024), stats.writes_rejected);
+    return ERROR_PPCS_SUCCESSFUL;
+}
+
+INT32 PPCS_NetworkDetect(st_PPCS_NetInfo* NetInfo, UINT16 UDP_Port) {
+    (void)UDP_Port;
+    if (!NetInfo) return ERROR_PPCS_INVALID_PARAMETER;
+    if (!g_initialized) return ERROR_PPCS_NOT_INITIALIZED;
+    memset(NetInfo, 0, sizeof(*NetInfo));
+    NetInfo->bFlagInternet = 1;
+    NetInfo->bFlagHostResolved = 1;
+    NetInfo->bFlagServerHello = 1;
+    strcpy(NetInfo->MyLanIP, "127.0.0.1");
+    strcpy(NetInfo->MyWanIP, "127.0.0.1");
+    return ERROR_PPCS_SUCCESSFUL;
+}
+
+INT32 PPCS_NetworkDetectByServer(st_PPCS_NetInfo* NetInfo, UINT16 UDP_Port, CHAR* ServerString) {
+    (void)ServerString;
+    return PPCS_NetworkDetect(NetInfo, UDP_Port);
+}
+
+INT32 PPCS_Share_Bandwidth(CHAR bOnOff) {
+    (void)bOnOff;
+    return ERROR_PPCS_SUCCESSFUL;
+}
+
+INT32 PPCS_Enable_SmartDevice(CHAR bOnOff) {
+    (void)bOnOff;
+    return ERROR_PPCS_SUCCESSFUL;
+}
+
+INT32 PPCS_LoginStatus_Check(CHAR* bLoginStatus) {
+    if (bLoginStatus) *bLoginStatus = 1;
+    return ERROR_PPCS_SUCCESSFUL;
+}
+
+#endif // LINUX
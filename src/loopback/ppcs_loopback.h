@@ -0,0 +1,58 @@
+// PPCS Loopback Header
+#ifndef PPCS_LOOPBACK_H
+#define PPCS_LOOPBACK_H
+
+#include "PPCS_API.h"
+
+// Stand-in for the PPCS library on Linux. It implements the PPCS_API.h
+// calls over TCP on the loopback interface (or any host, for containers),
+// so the client and a device emulator can run with no camera, in one
+// process or two. Link bin/libPPCS_API.a instead of the vendor library.
+//
+// A device calls PPCS_Listen with its DID; a client's PPCS_ConnectByServer
+// with the same DID reaches it on a port derived from the DID. Channels,
+// read timeouts, Check_Buffer and the session-closed error codes behave
+// like the real library. Latency, bandwidth caps and session drops can be
+// injected, from the environment or ppcs_loopback_configure():
+//
+//   PPCS_LOOPBACK_LATENCY_MS     one-way delay added to every write
+//   PPCS_LOOPBACK_JITTER_MS      plus up to this much, order kept
+//   PPCS_LOOPBACK_RATE_KBPS      cap per session and direction, 0 = none
+//   PPCS_LOOPBACK_DROP_AFTER_MS  drop sessions after 0.5..1.5 times this
+//   PPCS_LOOPBACK_HOST           where devices are (default 127.0.0.1)
+//   PPCS_LOOPBACK_PORT           base of the per-DID ports (default 40000)
+
+#define PPCS_LOOPBACK_VERSION 0x04020001    // Reported by PPCS_GetAPIVersion
+#define PPCS_LOOPBACK_MAX_SESSIONS 64
+#define PPCS_LOOPBACK_CHANNELS 8
+#define PPCS_LOOPBACK_PORT_RANGE 4096       // Ports base..base+range-1
+
+typedef struct {
+    int latency_ms;
+    int jitter_ms;
+    int rate_kbps;
+    int drop_after_ms;
+    int connect_timeout_ms;         // Give up on a device that is not listening
+    int base_port;
+    char host[64];
+} PPCSLoopbackConfig;
+
+typedef struct {
+    unsigned long long sessions;    // Opened, both roles
+    unsigned long long drops;       // Injected
+    unsigned long long bytes_written;
+    unsigned long long bytes_read;
+    unsigned long long writes_rejected;     // Send buffer full
+} PPCSLoopbackStats;
+
+// Applies to sessions opened afterwards. PPCS_Initialize loads the
+// environment first, so call this after it to override.
+void ppcs_loopback_configure(const PPCSLoopbackConfig* config);
+void ppcs_loopback_get_config(PPCSLoopbackConfig* config);
+// Drop a session now, as the network would: both ends see CLOSED_TIMEOUT
+int ppcs_loopback_drop(INT32 session_handle);
+void ppcs_loopback_get_stats(PPCSLoopbackStats* stats);
+// TCP port a device with this DID listens on
+int ppcs_loopback_port(const char* did);
+
+#endif // PPCS_LOOPBACK_H
@@ -8,21 +8,53 @@
 #include "image_handler.h"
 #include "command_handler.h"
 #include "app_context.h"
+#include "session_manager.h"
 #include "control_panel.h"
 #include "control_panel_tab.h"
 #include "timelapse_manager.h"
 #include "cJSON.h"
+#include "async_log.h"
+#include "metrics.h"
+#include "package_registry.h"
+#include "package_reasm.h"
+
+#define LOOP_BUDGET_MIN 16          // Packages handled before pumping window messages
+#define LOOP_BUDGET_MAX 1024
+#define LOOP_IDLE_WAIT_MS 500       // Upper bound on a wait, to re-check the run time
+
+typedef struct {
+    unsigned long long iterations;
+    unsigned long long packages;
+    unsigned long long wakeups_package;
+    unsigned long long wakeups_message;
+    unsigned long long wakeups_timeout;
+    double idle_ms;
+    unsigned long long depth_sum;   // Queue depth sampled once per iteration
+    int max_depth;
+    int max_budget;
+} MainLoopStats;
 
 int main(int argc, char* argv[]) {
     INT32 ret;
     st_PPCS_NetInfo net_info;
     Config config;
 
+    metrics_now_us();   // Start of the uptime reported in snapshots
     print_api_info();
     init_config(&config);
     if (!validate_config(&config)) return -1;
     print_config(&config);
+    async_log_init(config.LogLevel);
+    ppcs_set_channel_map(&config);
+    metrics_set_path(config.MetricsFile);
+    metrics_start_periodic(config.MetricsIntervalSec);
     init_record_list();
+    command_tracker_init(config.CommandTimeoutMs, config.CommandRetries);
+    // Package classes, before any reader starts framing
+    command_handler_register_packages();
+    video_manager_register_packages();
+    image_handler_register_packages();
+    timelapse_manager_register_packages();
 
     char json_init_string[2048];
     if (strlen(config.APILogFile) > 0) snprintf(json_init_string, sizeof(json_init_string), "{\"InitString\":\"%s\",\"MaxNumSess\":%d,\"SessAliveSec\":%d,\"APILogFile\":\"%s\"}", config.InitString, config.MaxNumSess, config.SessAliveSec, config.APILogFile);
@@ -39,47 +71,98 @@ int main(int argc, char* argv[]) {
 
     const char* target_did = config.TargetDID;
     if (argc > 1) target_did = argv[1];
-    if (strlen(target_did) == 0) { printf("Usage: %s [TARGET_DID]\n", argv[0]); PPCS_DeInitialize(); return 0; }
+    if (strlen(target_did) == 0) { printf("Usage: %s [TARGET_DID [FLEET_DID...]]\n", argv[0]); async_log_shutdown(); PPCS_DeInitialize(); return 0; }
 
-    INT32 session_handle = connect_to_device(target_did, &config);
-    if (session_handle < 0) { PPCS_DeInitialize(); return -1; }
+    SessionManager* sessions = session_manager_create(&config);
+    if (!sessions) { async_log_shutdown(); PPCS_DeInitialize(); return -1; }
+    DeviceSession* primary = session_manager_add(sessions, target_did, 1);
+    if (!primary) { session_manager_destroy(sessions); async_log_shutdown(); PPCS_DeInitialize(); return -1; }
 
-    if (ppcs_start_network(session_handle) != 0) { printf("[WARN] Failed to start network thread\n"); }
+    // Extra devices: FleetDIDs from config.conf, then any further DIDs on the command line
+    session_manager_add_fleet(sessions, config.FleetDIDs);
+    for (int i = 2; i < argc; i++) session_manager_add_fleet(sessions, argv[i]);
 
-    VideoStreamManager* video_mgr = create_video_stream_manager("output_video");
-    AppContext app_ctx = {0}; app_ctx.session_handle = session_handle; app_ctx.video_mgr = video_mgr; app_ctx.live_started = 0; app_ctx.playback_started = 0; app_ctx.timelapse_recording = 0;
-
-    ControlPanel* panel = control_panel_create_tabbed("P2P Client", on_command_triggered, &app_ctx);
-    if (!panel) { destroy_video_stream_manager(video_mgr); PPCS_Close(session_handle); PPCS_DeInitialize(); return -1; }
+    ControlPanel* panel = control_panel_create_tabbed("P2P Client", on_command_triggered, &primary->app_ctx);
+    if (!panel) { session_manager_destroy(sessions); async_log_shutdown(); PPCS_DeInitialize(); return -1; }
 
     time_t start_time = time(NULL);
+    LARGE_INTEGER qpc_freq; QueryPerformanceFrequency(&qpc_freq);
+    MainLoopStats loop_stats; memset(&loop_stats, 0, sizeof(loop_stats));
+    int budget = LOOP_BUDGET_MIN;
     while (1) {
         if (time(NULL) - start_time > 600) break;
         if (!control_panel_poll_events(panel)) break;
-        if (!video_manager_poll_events(video_mgr)) break;
-        int processed = 0; const int MAX_PROC_PER_LOOP = 8;
-        while (processed < MAX_PROC_PER_LOOP) {
-            PackageNode* node = ppcs_pop_package(); if (!node) break;
-            unsigned char* pkg = node->data; int pkg_len = node->len;
-            int is_json = (memcmp(pkg, "#nsj", 4) == 0);
-            int is_image = (memcmp(pkg, "$gmi", 4) == 0);
-            int is_video = (memcmp(pkg, "$div", 4) == 0);
-            int is_timelapse = (memcmp(pkg, "@lif", 4) == 0);
-            if (is_json) handle_command_package(pkg, pkg_len);
-            else if (is_image) handle_image_package(pkg, pkg_len);
-            else if (is_video) handle_video_package(video_mgr, pkg, pkg_len);
-            else if (is_timelapse) {
-                //printf("[Main] Received timelapse package (%d bytes)\n", pkg_len);
-                handle_timelapse_package(pkg, pkg_len);
-            } else { printf("[Main] WARNING: Received unknown package type (first 4 bytes: %c%c%c%c)\n", pkg[0], pkg[1], pkg[2], pkg[3]); }
-            free(pkg); free(node); processed++; }
-        Sleep(1);
+        if (!session_manager_poll_events(sessions)) break;
+        loop_stats.iterations++;
+
+        int processed = session_manager_drain(sessions, budget);
+        loop_stats.packages += processed;
+        int depth = session_manager_queue_depth(sessions);
+        loop_stats.depth_sum += depth;
+        metrics_set(MET_QUEUE_DEPTH, depth);
+        if (depth > loop_stats.max_depth) loop_stats.max_depth = depth;
+        int next_deadline = command_tracker_poll();     // Retries and timeouts of unanswered commands
+
+        // Grow the budget while a backlog remains, shrink it back when traffic is light
+        if (processed == budget && depth > 0) {
+            if (budget < LOOP_BUDGET_MAX) budget *= 2;
+            if (budget > loop_stats.max_budget) loop_stats.max_budget = budget;
+            continue;   // Pump messages, then keep draining without waiting
+        }
+        if (processed < budget / 4 && budget > LOOP_BUDGET_MIN) budget /= 2;
+        if (depth > 0) continue;
+
+        // Nothing queued: block until a reader signals, a window message
+        // arrives or the next command times out
+        DWORD wait_ms = next_deadline >= 0 && next_deadline < LOOP_IDLE_WAIT_MS ? (DWORD)next_deadline : LOOP_IDLE_WAIT_MS;
+        LARGE_INTEGER t0, t1;
+        QueryPerformanceCounter(&t0);
+        DWORD wait = session_manager_wait(sessions, wait_ms);
+        QueryPerformanceCounter(&t1);
+        loop_stats.idle_ms += (double)(t1.QuadPart - t0.QuadPart) * 1000.0 / (double)qpc_freq.QuadPart;
+        if (wait < WAIT_OBJECT_0 + (DWORD)sessions->count) loop_stats.wakeups_package++;
+        else if (wait == WAIT_TIMEOUT) loop_stats.wakeups_timeout++;
+        else loop_stats.wakeups_message++;
     }
 
+    double run_ms = difftime(time(NULL), start_time) * 1000.0;
+    metrics_stop_periodic();
+    if (metrics_dump(NULL) == 0) printf("[Main] Metrics snapshot written to %s\n", config.MetricsFile);
+    // Flush queued log output before the summary; later log calls print directly
+    async_log_shutdown();
+    AsyncLogStats log_stats;
+    async_log_get_stats(&log_stats);
+    printf("[Main] Log: %llu messages (%llu bytes in %llu writes), %llu rate-limited, %llu dropped, %d thread rings\n",
+           log_stats.messages, log_stats.bytes, log_stats.flushes, log_stats.suppressed, log_stats.dropped, log_stats.rings);
+    printf("[Main] Loop: %llu iterations, %llu packages, wakeups %llu package / %llu message / %llu timeout\n",
+           loop_stats.iterations, loop_stats.packages,
+           loop_stats.wakeups_package, loop_stats.wakeups_message, loop_stats.wakeups_timeout);
+    printf("[Main] Loop: idle %.0f ms of %.0f ms, queue depth avg %.1f max %d, budget peak %d\n",
+           loop_stats.idle_ms, run_ms,
+           loop_stats.iterations ? (double)loop_stats.depth_sum / loop_stats.iterations : 0.0,
+           loop_stats.max_depth, loop_stats.max_budget ? loop_stats.max_budget : LOOP_BUDGET_MIN);
+    printf("[Main] Throughput: %.0f packages/s across %d sessions\n",
+           run_ms > 0 ? loop_stats.packages * 1000.0 / run_ms : 0.0, sessions->count);
+    MetricsHistogramSummary connect_times;
+    metrics_get_histogram(MET_CONNECT_TIME, &connect_times);
+    printf("[Main] Time to connect: %llu sessions, p50 %.0f ms, p90 %.0f ms, p99 %.0f ms, max %.0f ms\n",
+           connect_times.count, connect_times.p50 / 1000.0, connect_times.p90 / 1000.0,
+           connect_times.p99 / 1000.0, connect_times.max / 1000.0);
+    session_manager_print_stats(sessions);
+    package_registry_print_stats();
+    package_reasm_print_stats();
+    command_tracker_print_stats();
+
+    PackageCopyStats copy_stats;
+    package_pool_get_stats(&copy_stats);
+    printf("[Main] Payload bytes: received %llu, copied %llu (%.2f copies/byte), buffers %llu (%llu from malloc)\n",
+           copy_stats.bytes_received, copy_stats.bytes_copied,
+           copy_stats.bytes_received ? (double)copy_stats.bytes_copied / copy_stats.bytes_received : 0.0,
+           copy_stats.buf_allocs, copy_stats.buf_misses);
+
     control_panel_destroy(panel);
-    destroy_video_stream_manager(video_mgr);
-    PPCS_Close(session_handle);
-    ppcs_stop_network();
+    session_manager_destroy(sessions);
+    package_pool_trim();
     destroy_record_list();
     PPCS_DeInitialize();
     return 0;
@@ -0,0 +1,297 @@
+// Metrics Implementation
+#include "metrics.h"
+#include "platform.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define METRICS_JSON_MAX (64 * 1024)
+
+typedef struct {
+    atomic_llong value;                 // Counter total or gauge value
+    atomic_ullong count;                // Histogram samples
+    atomic_ullong sum;
+    atomic_llong max;
+    atomic_ullong buckets[METRICS_HIST_BUCKETS];
+} Metric;
+
+typedef struct {
+    const char* name;
+    MetricType type;
+} MetricInfo;
+
+// Same order as MetricId
+static const MetricInfo s_info[METRIC_COUNT] = {
+    { "read_to_framed_us", METRIC_HISTOGRAM },
+    { "framed_to_dequeued_us", METRIC_HISTOGRAM },
+    { "dequeued_to_reassembled_us", METRIC_HISTOGRAM },
+    { "reassembled_to_decoded_us", METRIC_HISTOGRAM },
+    { "decoded_to_rendered_us", METRIC_HISTOGRAM },
+    { "read_to_rendered_us", METRIC_HISTOGRAM },
+    { "command_rtt_us", METRIC_HISTOGRAM },
+    { "command_queued_us", METRIC_HISTOGRAM },
+    { "connect_us", METRIC_HISTOGRAM },
+    { "recovery_us", METRIC_HISTOGRAM },
+    { "recovery_to_video_us", METRIC_HISTOGRAM },
+    { "packages_read", METRIC_COUNTER },
+    { "bytes_read", METRIC_COUNTER },
+    { "frames_reassembled", METRIC_COUNTER },
+    { "frames_decoded", METRIC_COUNTER },
+    { "frames_rendered", METRIC_COUNTER },
+    { "commands_sent", METRIC_COUNTER },
+    { "command_responses", METRIC_COUNTER },
+    { "command_unmatched", METRIC_COUNTER },
+    { "command_retries", METRIC_COUNTER },
+    { "command_timeouts", METRIC_COUNTER },
+    { "connect_attempts", METRIC_COUNTER },
+    { "connects_failed", METRIC_COUNTER },
+    { "sessions_lost", METRIC_COUNTER },
+    { "sessions_recovered", METRIC_COUNTER },
+    { "queue_depth", METRIC_GAUGE },
+    { "ingest_bytes", METRIC_GAUGE },
+};
+
+static Metric s_metrics[METRIC_COUNT];
+static double s_us_per_tick = 0.0;
+static long long s_start_us = 0;
+
+static HANDLE s_periodic_thread = NULL;
+static HANDLE s_periodic_stop = NULL;
+static char s_dump_path[MAX_PATH];
+static int s_periodic_interval = 0;
+static atomic_flag s_dump_lock = ATOMIC_FLAG_INIT;
+
+long long metrics_now_us(void) {
+    LARGE_INTEGER now;
+    if (s_us_per_tick == 0.0) {
+        LARGE_INTEGER freq;
+        QueryPerformanceFrequency(&freq);
+        s_us_per_tick = 1000000.0 / (double)freq.QuadPart;
+    }
+    QueryPerformanceCounter(&now);
+    long long us = (long long)((double)now.QuadPart * s_us_per_tick);
+    if (s_start_us == 0) s_start_us = us;
+    return us;
+}
+
+const char* metrics_name(MetricId id) {
+    return id >= 0 && id < METRIC_COUNT ? s_info[id].name : "unknown";
+}
+
+static long long filetime_us(const FILETIME* ft) {
+    return (long long)((((unsigned long long)ft->dwHighDateTime << 32) | ft->dwLowDateTime) / 10);
+}
+
+long long metrics_thread_cpu_us(void) {
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) return 0;
+    return filetime_us(&kernel) + filetime_us(&user);
+}
+
+long long metrics_process_cpu_us(void) {
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) return 0;
+    return filetime_us(&kernel) + filetime_us(&user);
+}
+
+void metrics_add(MetricId id, long long n) {
+    if (id < 0 || id >= METRIC_COUNT) return;
+    atomic_fetch_add_explicit(&s_metrics[id].value, n, memory_order_relaxed);
+}
+
+void metrics_set(MetricId id, long long value) {
+    if (id < 0 || id >= METRIC_COUNT) return;
+    atomic_store_explicit(&s_metrics[id].value, value, memory_order_relaxed);
+}
+
+static int hist_bucket(unsigned long long v) {
+    if (v < METRICS_HIST_SUB) return (int)v;
+    int e = 63 - __builtin_clzll(v);
+    int sub = (int)(v >> (e - METRICS_HIST_SUB_BITS)) & (METRICS_HIST_SUB - 1);
+    int idx = (e - METRICS_HIST_SUB_BITS + 1) * METRICS_HIST_SUB + sub;
+    return idx < METRICS_HIST_BUCKETS ? idx : METRICS_HIST_BUCKETS - 1;
+}
+
+// Smallest value that lands in bucket idx
+static unsigned long long hist_bucket_low(int idx) {
+    if (idx < METRICS_HIST_SUB) return (unsigned long long)idx;
+    int e = idx / METRICS_HIST_SUB + METRICS_HIST_SUB_BITS - 1;
+    int sub = idx % METRICS_HIST_SUB;
+    return (unsigned long long)(METRICS_HIST_SUB + sub) << (e - METRICS_HIST_SUB_BITS);
+}
+
+void metrics_record(MetricId id, long long us) {
+    if (id < 0 || id >= METRIC_COUNT || us < 0) return;
+    Metric* m = &s_metrics[id];
+    atomic_fetch_add_explicit(&m->buckets[hist_bucket((unsigned long long)us)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&m->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&m->sum, (unsigned long long)us, memory_order_relaxed);
+    long long max = atomic_load_explicit(&m->max, memory_order_relaxed);
+    while (us > max && !atomic_compare_exchange_weak_explicit(&m->max, &max, us, memory_order_relaxed, memory_order_relaxed)) { }
+}
+
+void metrics_record_since(MetricId id, long long since_us) {
+    if (since_us > 0) metrics_record(id, metrics_now_us() - since_us);
+}
+
+// Upper bound of the bucket holding the q-th quantile, capped at the observed max
+static long long hist_quantile(const unsigned long long* buckets, unsigned long long count, long long max, double q) {
+    if (count == 0) return 0;
+    unsigned long long rank = (unsigned long long)(q * (double)(count - 1)) + 1;
+    unsigned long long seen = 0;
+    for (int i = 0; i < METRICS_HIST_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            long long high = i + 1 < METRICS_HIST_BUCKETS ? (long long)hist_bucket_low(i + 1) - 1 : max;
+            return high < max ? high : max;
+        }
+    }
+    return max;
+}
+
+void metrics_get_histogram(MetricId id, MetricsHistogramSummary* summary) {
+    memset(summary, 0, sizeof(*summary));
+    if (id < 0 || id >= METRIC_COUNT) return;
+    const Metric* m = &s_metrics[id];
+    unsigned long long buckets[METRICS_HIST_BUCKETS];
+    for (int i = 0; i < METRICS_HIST_BUCKETS; i++) {
+        buckets[i] = atomic_load_explicit(&m->buckets[i], memory_order_relaxed);
+        summary->count += buckets[i];
+    }
+    if (summary->count == 0) return;
+    summary->mean = (double)atomic_load_explicit(&m->sum, memory_order_relaxed) / summary->count;
+    summary->max = atomic_load_explicit(&m->max, memory_order_relaxed);
+    summary->p50 = hist_quantile(buckets, summary->count, summary->max, 0.5);
+    summary->p90 = hist_quantile(buckets, summary->count, summary->max, 0.9);
+    summary->p99 = hist_quantile(buckets, summary->count, summary->max, 0.99);
+}
+
+#define JSON_APPEND(...) \
+    do { if (len < METRICS_JSON_MAX) len += snprintf(out + len, METRICS_JSON_MAX - len, __VA_ARGS__); } while (0)
+
+char* metrics_snapshot_json(void) {
+    char* out = (char*)malloc(METRICS_JSON_MAX);
+    if (!out) return NULL;
+    int len = 0;
+
+    char host[MAX_COMPUTERNAME_LENGTH + 1] = "unknown";
+    DWORD host_len = sizeof(host);
+    GetComputerNameA(host, &host_len);
+    long long now = metrics_now_us();
+
+    JSON_APPEND("{\"time\":%lld,\"uptime_ms\":%lld,\"host\":\"%s\",\"pid\":%lu,\"build\":\"%s %s\"",
+                (long long)time(NULL), (now - s_start_us) / 1000, host, (unsigned long)GetCurrentProcessId(),
+                __DATE__, __TIME__);
+
+    JSON_APPEND(",\"counters\":{");
+    int first = 1;
+    for (int id = 0; id < METRIC_COUNT; id++) {
+        if (s_info[id].type != METRIC_COUNTER) continue;
+        JSON_APPEND("%s\"%s\":%lld", first ? "" : ",", s_info[id].name,
+                    atomic_load_explicit(&s_metrics[id].value, memory_order_relaxed));
+        first = 0;
+    }
+    JSON_APPEND("},\"gauges\":{");
+    first = 1;
+    for (int id = 0; id < METRIC_COUNT; id++) {
+        if (s_info[id].type != METRIC_GAUGE) continue;
+        JSON_APPEND("%s\"%s\":%lld", first ? "" : ",", s_info[id].name,
+                    atomic_load_explicit(&s_metrics[id].value, memory_order_relaxed));
+        first = 0;
+    }
+    JSON_APPEND("},\"histograms\":{");
+    first = 1;
+    for (int id = 0; id < METRIC_COUNT; id++) {
+        if (s_info[id].type != METRIC_HISTOGRAM) continue;
+        const Metric* m = &s_metrics[id];
+        unsigned long long buckets[METRICS_HIST_BUCKETS];
+        unsigned long long count = 0;
+        for (int i = 0; i < METRICS_HIST_BUCKETS; i++) {
+            buckets[i] = atomic_load_explicit(&m->buckets[i], memory_order_relaxed);
+            count += buckets[i];
+        }
+        unsigned long long sum = atomic_load_explicit(&m->sum, memory_order_relaxed);
+        long long max = atomic_load_explicit(&m->max, memory_order_relaxed);
+        JSON_APPEND("%s\"%s\":{\"count\":%llu,\"mean\":%.1f,\"p50\":%lld,\"p90\":%lld,\"p99\":%lld,\"p999\":%lld,\"max\":%lld,\"buckets\":[",
+                    first ? "" : ",", s_info[id].name, count, count ? (double)sum / count : 0.0,
+                    hist_quantile(buckets, count, max, 0.5), hist_quantile(buckets, count, max, 0.9),
+                    hist_quantile(buckets, count, max, 0.99), hist_quantile(buckets, count, max, 0.999), max);
+        // Only non-empty buckets, as [lower bound us, samples]
+        int first_bucket = 1;
+        for (int i = 0; i < METRICS_HIST_BUCKETS; i++) {
+            if (!buckets[i]) continue;
+            JSON_APPEND("%s[%llu,%llu]", first_bucket ? "" : ",", hist_bucket_low(i), buckets[i]);
+            first_bucket = 0;
+        }
+        JSON_APPEND("]}");
+        first = 0;
+    }
+    JSON_APPEND("}}");
+    if (len >= METRICS_JSON_MAX) {
+        printf("[Metrics] WARNING: Snapshot truncated\n");
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+void metrics_set_path(const char* path) {
+    strncpy(s_dump_path, path ? path : "", sizeof(s_dump_path) - 1);
+    s_dump_path[sizeof(s_dump_path) - 1] = '\0';
+}
+
+int metrics_dump(const char* path) {
+    if (!path) path = s_dump_path;
+    if (!*path) return -1;
+    char* json = metrics_snapshot_json();
+    if (!json) return -1;
+    // Dumps can come from the UI, the periodic thread and shutdown at once
+    while (atomic_flag_test_and_set_explicit(&s_dump_lock, memory_order_acquire)) Sleep(0);
+    FILE* f = fopen(path, "a");
+    int ret = -1;
+    if (f) {
+        ret = fprintf(f, "%s\n", json) > 0 ? 0 : -1;
+        fclose(f);
+    }
+    atomic_flag_clear_explicit(&s_dump_lock, memory_order_release);
+    if (ret < 0) printf("[Metrics] ERROR: Failed to write snapshot to %s\n", path);
+    free(json);
+    return ret;
+}
+
+static DWORD WINAPI metrics_periodic_thread(LPVOID param) {
+    (void)param;
+    while (WaitForSingleObject(s_periodic_stop, (DWORD)s_periodic_interval * 1000) == WAIT_TIMEOUT) {
+        metrics_dump(NULL);
+    }
+    return 0;
+}
+
+int metrics_start_periodic(int interval_sec) {
+    if (!*s_dump_path || interval_sec <= 0 || s_periodic_thread) return -1;
+    s_periodic_interval = interval_sec;
+    s_periodic_stop = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (!s_periodic_stop) return -1;
+    DWORD tid = 0;
+    s_periodic_thread = CreateThread(NULL, 0, metrics_periodic_thread, NULL, 0, &tid);
+    if (!s_periodic_thread) {
+        CloseHandle(s_periodic_stop);
+        s_periodic_stop = NULL;
+        printf("[Metrics] ERROR: Failed to start periodic dump thread\n");
+        return -1;
+    }
+    printf("[Metrics] Writing snapshots to %s every %d s\n", s_dump_path, interval_sec);
+    return 0;
+}
+
+void metrics_stop_periodic(void) {
+    if (!s_periodic_thread) return;
+    SetEvent(s_periodic_stop);
+    WaitForSingleObject(s_periodic_thread, INFINITE);
+    CloseHandle(s_periodic_thread);
+    CloseHandle(s_periodic_stop);
+    s_periodic_thread = NULL;
+    s_periodic_stop = NULL;
+}
@@ -0,0 +1,101 @@
+// Metrics Header
+#ifndef METRICS_H
+#define METRICS_H
+
+// Process-wide pipeline metrics: counters, gauges and latency histograms in
+// a fixed registry indexed by MetricId, so recording is a couple of relaxed
+// atomics with no lookup. Snapshots are written as one JSON object per line
+// (on demand, periodically and at exit) for comparing builds and hosts.
+//
+// Histograms are log-linear over microseconds: each power of two is split
+// into METRICS_HIST_SUB linear buckets, so any recorded value is off by at
+// most 25% and the bucket table stays small enough to dump whole.
+
+#define METRICS_HIST_SUB_BITS 2
+#define METRICS_HIST_SUB (1 << METRICS_HIST_SUB_BITS)
+#define METRICS_HIST_BUCKETS 128        // Up to ~2^33 us (2.4 hours)
+
+typedef enum {
+    // Per-package stages
+    MET_READ_TO_FRAMED = 0,             // PPCS_Read returned -> package framed and queued
+    MET_FRAMED_TO_DEQUEUED,             // Time in the lane
+    // Per-frame stages
+    MET_DEQUEUED_TO_REASSEMBLED,        // First fragment dequeued -> frame complete
+    MET_REASSEMBLED_TO_DECODED,         // Frame handed to the decoder -> picture out
+    MET_DECODED_TO_RENDERED,            // Picture out -> drawn
+    MET_READ_TO_RENDERED,               // End to end, from the read of the first fragment
+    MET_COMMAND_RTT,                    // send_command -> matching JSON response
+    MET_COMMAND_QUEUED,                 // send_command -> PPCS_Write by the command writer
+    MET_CONNECT_TIME,                   // Connect race started -> session usable
+    MET_RECOVERY_TIME,                  // Session seen closed -> new handle
+    MET_RECOVERY_TO_VIDEO,              // Session seen closed -> first frame shown again
+
+    // Counters
+    MET_PACKAGES_READ,
+    MET_BYTES_READ,
+    MET_FRAMES_REASSEMBLED,
+    MET_FRAMES_DECODED,
+    MET_FRAMES_RENDERED,
+    MET_COMMANDS_SENT,
+    MET_COMMAND_RESPONSES,
+    MET_COMMAND_UNMATCHED,              // Responses with no pending send
+    MET_COMMAND_RETRIES,                // Resends after a timeout
+    MET_COMMAND_TIMEOUTS,               // Commands given up on
+    MET_CONNECT_ATTEMPTS,               // PPCS_ConnectByServer calls, one per raced mode
+    MET_CONNECT_FAILURES,               // Races where no mode connected
+    MET_SESSIONS_LOST,
+    MET_SESSIONS_RECOVERED,
+
+    // Gauges
+    MET_QUEUE_DEPTH,                    // Packages queued across sessions, sampled by the main loop
+    MET_INGEST_BYTES,                   // Bytes pinned by undelivered packages, all sessions
+
+    METRIC_COUNT
+} MetricId;
+
+typedef enum {
+    METRIC_HISTOGRAM = 0,
+    METRIC_COUNTER,
+    METRIC_GAUGE
+} MetricType;
+
+// Quantiles are bucket upper bounds, capped at the observed max
+typedef struct {
+    unsigned long long count;
+    double mean;
+    long long p50;
+    long long p90;
+    long long p99;
+    long long max;
+} MetricsHistogramSummary;
+
+// Microseconds on a monotonic clock (QueryPerformanceCounter)
+long long metrics_now_us(void);
+// CPU time used so far, user plus kernel, in microseconds. Windows advances
+// these in scheduler ticks, so compare totals over many frames, not calls.
+long long metrics_thread_cpu_us(void);
+long long metrics_process_cpu_us(void);
+
+void metrics_add(MetricId id, long long n);
+void metrics_set(MetricId id, long long value);
+// Record a duration in microseconds; negative values are ignored
+void metrics_record(MetricId id, long long us);
+// Record now - since_us, when since_us is set
+void metrics_record_since(MetricId id, long long since_us);
+
+const char* metrics_name(MetricId id);
+void metrics_get_histogram(MetricId id, MetricsHistogramSummary* summary);
+
+// Snapshot as one line of JSON; free() the result
+char* metrics_snapshot_json(void);
+// File that snapshots go to when no path is given (MetricsFile)
+void metrics_set_path(const char* path);
+// Append a snapshot line to path, or the configured file if NULL.
+// Returns 0, or -1 on failure.
+int metrics_dump(const char* path);
+
+// Append a snapshot to the configured file every interval_sec seconds
+int metrics_start_periodic(int interval_sec);
+void metrics_stop_periodic(void);
+
+#endif // METRICS_H
@@ -0,0 +1,94 @@
+// Platform Header
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+// The client is written against the Win32 API. Built with -DLINUX (as the
+// PPCS SDK does) this header supplies the subset the protocol core uses on
+// top of pthreads, so framing, reassembly and decoding also build on Linux
+// for replay and benchmarks. On Windows it is just <windows.h>.
+
+#ifndef LINUX
+#include <windows.h>
+#else
+
+#include <stddef.h>
+#include <stdint.h>
+#include <strings.h>
+#include <pthread.h>
+
+typedef void* HANDLE;
+typedef void* LPVOID;
+typedef unsigned long DWORD;
+typedef int BOOL;
+typedef long LONG;
+typedef const char* LPCSTR;
+typedef uintptr_t UINT_PTR;
+typedef union { long long QuadPart; } LARGE_INTEGER;
+typedef struct { DWORD dwLowDateTime; DWORD dwHighDateTime; } FILETIME;
+typedef DWORD (*LPTHREAD_START_ROUTINE)(LPVOID param);
+
+#define WINAPI
+#define TRUE 1
+#define FALSE 0
+#define INFINITE 0xFFFFFFFFUL
+#define WAIT_OBJECT_0 0UL
+#define WAIT_TIMEOUT 258UL
+#define WAIT_FAILED 0xFFFFFFFFUL
+#define MAX_COMPUTERNAME_LENGTH 15
+#define MAX_PATH 260
+
+#define _stricmp strcasecmp
+#define _strnicmp strncasecmp
+
+// Threads and events share one handle type; a thread handle is signalled
+// when the thread returns. Only the forms used in this tree are supported
+// (no security attributes, names or suspended threads).
+HANDLE CreateThread(void* attributes, size_t stack_size, LPTHREAD_START_ROUTINE start, LPVOID param,
+                    DWORD flags, DWORD* thread_id);
+HANDLE CreateEvent(void* attributes, BOOL manual_reset, BOOL initial_state, LPCSTR name);
+BOOL SetEvent(HANDLE event);
+BOOL ResetEvent(HANDLE event);
+DWORD WaitForSingleObject(HANDLE handle, DWORD timeout_ms);
+BOOL CloseHandle(HANDLE handle);
+
+void Sleep(DWORD ms);
+DWORD GetTickCount(void);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency);
+BOOL QueryPerformanceCounter(LARGE_INTEGER* count);
+BOOL GetComputerNameA(char* name, DWORD* size);
+DWORD GetCurrentProcessId(void);
+
+// CPU times of the calling thread or process only (the pseudo-handles),
+// all of it reported as user time
+HANDLE GetCurrentThread(void);
+HANDLE GetCurrentProcess(void);
+BOOL GetThreadTimes(HANDLE thread, FILETIME* creation, FILETIME* exit, FILETIME* kernel, FILETIME* user);
+BOOL GetProcessTimes(HANDLE process, FILETIME* creation, FILETIME* exit, FILETIME* kernel, FILETIME* user);
+
+// Critical sections are plain mutexes (Win32's are recursive; nothing here re-enters one)
+typedef pthread_mutex_t CRITICAL_SECTION;
+static inline void InitializeCriticalSection(CRITICAL_SECTION* cs) { pthread_mutex_init(cs, NULL); }
+static inline void DeleteCriticalSection(CRITICAL_SECTION* cs) { pthread_mutex_destroy(cs); }
+static inline void EnterCriticalSection(CRITICAL_SECTION* cs) { pthread_mutex_lock(cs); }
+static inline void LeaveCriticalSection(CRITICAL_SECTION* cs) { pthread_mutex_unlock(cs); }
+
+// Full barriers, like their Win32 namesakes; Increment/Decrement return the new value
+static inline LONG InterlockedCompareExchange(volatile LONG* dst, LONG exchange, LONG comparand) {
+    return __sync_val_compare_and_swap(dst, comparand, exchange);
+}
+static inline LONG InterlockedExchange(volatile LONG* dst, LONG value) {
+    return __atomic_exchange_n(dst, value, __ATOMIC_SEQ_CST);
+}
+static inline LONG InterlockedExchangeAdd(volatile LONG* dst, LONG value) {
+    return __atomic_fetch_add(dst, value, __ATOMIC_SEQ_CST);
+}
+static inline LONG InterlockedIncrement(volatile LONG* dst) {
+    return __atomic_add_fetch(dst, 1, __ATOMIC_SEQ_CST);
+}
+static inline LONG InterlockedDecrement(volatile LONG* dst) {
+    return __atomic_sub_fetch(dst, 1, __ATOMIC_SEQ_CST);
+}
+
+#endif // LINUX
+
+#endif // PLATFORM_H
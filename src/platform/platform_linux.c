@@ -0,0 +1,218 @@
+// Platform Implementation (Linux)
+#include "platform.h"
+
+#ifdef LINUX
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+    volatile LONG refs;         // The owner's handle, plus one while a thread runs
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int manual_reset;
+    int signalled;
+    int is_thread;
+    pthread_t thread;
+    LPTHREAD_START_ROUTINE start;
+    LPVOID param;
+} PlatformHandle;
+
+static PlatformHandle* handle_new(int manual_reset, int signalled) {
+    PlatformHandle* h = (PlatformHandle*)calloc(1, sizeof(PlatformHandle));
+    if (!h) return NULL;
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&h->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&h->lock, NULL);
+    h->refs = 1;
+    h->manual_reset = manual_reset;
+    h->signalled = signalled;
+    return h;
+}
+
+static void handle_unref(PlatformHandle* h) {
+    if (InterlockedDecrement(&h->refs) != 0) return;
+    pthread_cond_destroy(&h->cond);
+    pthread_mutex_destroy(&h->lock);
+    free(h);
+}
+
+static void handle_signal(PlatformHandle* h) {
+    pthread_mutex_lock(&h->lock);
+    h->signalled = 1;
+    if (h->manual_reset) pthread_cond_broadcast(&h->cond);
+    else pthread_cond_signal(&h->cond);
+    pthread_mutex_unlock(&h->lock);
+}
+
+static void* thread_main(void* param) {
+    PlatformHandle* h = (PlatformHandle*)param;
+    h->start(h->param);
+    handle_signal(h);
+    handle_unref(h);
+    return NULL;
+}
+
+HANDLE CreateThread(void* attributes, size_t stack_size, LPTHREAD_START_ROUTINE start, LPVOID param,
+                    DWORD flags, DWORD* thread_id) {
+    (void)attributes;
+    (void)flags;
+    PlatformHandle* h = handle_new(1, 0);
+    if (!h) return NULL;
+    h->is_thread = 1;
+    h->start = start;
+    h->param = param;
+    h->refs = 2;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (stack_size > 0) pthread_attr_setstacksize(&attr, stack_size);
+    int ret = pthread_create(&h->thread, &attr, thread_main, h);
+    pthread_attr_destroy(&attr);
+    if (ret != 0) {
+        h->refs = 1;
+        handle_unref(h);
+        return NULL;
+    }
+    if (thread_id) *thread_id = (DWORD)(uintptr_t)h;
+    return h;
+}
+
+HANDLE CreateEvent(void* attributes, BOOL manual_reset, BOOL initial_state, LPCSTR name) {
+    (void)attributes;
+    (void)name;
+    return handle_new(manual_reset != 0, initial_state != 0);
+}
+
+BOOL SetEvent(HANDLE event) {
+    if (!event) return FALSE;
+    handle_signal((PlatformHandle*)event);
+    return TRUE;
+}
+
+BOOL ResetEvent(HANDLE event) {
+    PlatformHandle* h = (PlatformHandle*)event;
+    if (!h) return FALSE;
+    pthread_mutex_lock(&h->lock);
+    h->signalled = 0;
+    pthread_mutex_unlock(&h->lock);
+    return TRUE;
+}
+
+DWORD WaitForSingleObject(HANDLE handle, DWORD timeout_ms) {
+    PlatformHandle* h = (PlatformHandle*)handle;
+    if (!h) return WAIT_FAILED;
+    struct timespec deadline;
+    if (timeout_ms != INFINITE) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += (time_t)(timeout_ms / 1000);
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+    DWORD result = WAIT_OBJECT_0;
+    pthread_mutex_lock(&h->lock);
+    while (!h->signalled) {
+        if (timeout_ms == INFINITE) {
+            pthread_cond_wait(&h->cond, &h->lock);
+        } else if (pthread_cond_timedwait(&h->cond, &h->lock, &deadline) == ETIMEDOUT) {
+            if (!h->signalled) result = WAIT_TIMEOUT;
+            break;
+        }
+    }
+    if (result == WAIT_OBJECT_0 && !h->manual_reset) h->signalled = 0;
+    pthread_mutex_unlock(&h->lock);
+    return result;
+}
+
+BOOL CloseHandle(HANDLE handle) {
+    if (!handle) return FALSE;
+    handle_unref((PlatformHandle*)handle);
+    return TRUE;
+}
+
+void Sleep(DWORD ms) {
+    if (ms == 0) {
+        sched_yield();
+        return;
+    }
+    struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) { }
+}
+
+DWORD GetTickCount(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (DWORD)((unsigned long long)ts.tv_sec * 1000 + (unsigned long long)ts.tv_nsec / 1000000);
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency) {
+    frequency->QuadPart = 1000000000LL;
+    return TRUE;
+}
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER* count) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    count->QuadPart = (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    return TRUE;
+}
+
+BOOL GetComputerNameA(char* name, DWORD* size) {
+    if (!name || !size || *size == 0) return FALSE;
+    if (gethostname(name, *size) != 0) return FALSE;
+    name[*size - 1] = '\0';
+    *size = (DWORD)strlen(name);
+    return TRUE;
+}
+
+DWORD GetCurrentProcessId(void) {
+    return (DWORD)getpid();
+}
+
+#define CURRENT_PROCESS ((HANDLE)(intptr_t)-1)
+#define CURRENT_THREAD ((HANDLE)(intptr_t)-2)
+
+HANDLE GetCurrentThread(void) {
+    return CURRENT_THREAD;
+}
+
+HANDLE GetCurrentProcess(void) {
+    return CURRENT_PROCESS;
+}
+
+// CPU clock in the 100 ns units of a FILETIME
+static BOOL cpu_times(clockid_t clock, FILETIME* creation, FILETIME* exit, FILETIME* kernel, FILETIME* user) {
+    struct timespec ts;
+    if (!user || clock_gettime(clock, &ts) != 0) return FALSE;
+    unsigned long long ticks = (unsigned long long)ts.tv_sec * 10000000ULL + (unsigned long long)ts.tv_nsec / 100;
+    FILETIME zero = { 0, 0 };
+    if (creation) *creation = zero;
+    if (exit) *exit = zero;
+    if (kernel) *kernel = zero;
+    user->dwLowDateTime = (DWORD)(ticks & 0xFFFFFFFFULL);
+    user->dwHighDateTime = (DWORD)(ticks >> 32);
+    return TRUE;
+}
+
+BOOL GetThreadTimes(HANDLE thread, FILETIME* creation, FILETIME* exit, FILETIME* kernel, FILETIME* user) {
+    if (thread != CURRENT_THREAD) return FALSE;
+    return cpu_times(CLOCK_THREAD_CPUTIME_ID, creation, exit, kernel, user);
+}
+
+BOOL GetProcessTimes(HANDLE process, FILETIME* creation, FILETIME* exit, FILETIME* kernel, FILETIME* user) {
+    if (process != CURRENT_PROCESS) return FALSE;
+    return cpu_times(CLOCK_PROCESS_CPUTIME_ID, creation, exit, kernel, user);
+}
+
+#endif // LINUX
@@ -0,0 +1,163 @@
+// Capture File Implementation
+#include "capture_file.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "platform.h"
+#include "metrics.h"
+
+#define CAPTURE_WRITE_BUFFER (1024*1024)    // stdio buffer, so a record is usually a memcpy
+
+struct CaptureWriter {
+    FILE* fp;
+    char path[512];
+    char* buffer;
+    long long started_us;
+    volatile LONG lock;                     // Readers of several channels append
+    int failed;
+    CaptureStats stats;
+};
+
+struct CaptureReader {
+    FILE* fp;
+    CaptureFileHeader header;
+    unsigned char* data;
+    int capacity;
+};
+
+CaptureWriter* capture_writer_open(const char* path, const char* did) {
+    if (!path || !*path) return NULL;
+    CaptureWriter* w = (CaptureWriter*)calloc(1, sizeof(CaptureWriter));
+    if (!w) return NULL;
+    w->fp = fopen(path, "wb");
+    if (!w->fp) {
+        printf("[Capture] ERROR: Cannot create %s\n", path);
+        free(w);
+        return NULL;
+    }
+    w->buffer = (char*)malloc(CAPTURE_WRITE_BUFFER);
+    if (w->buffer) setvbuf(w->fp, w->buffer, _IOFBF, CAPTURE_WRITE_BUFFER);
+    strncpy(w->path, path, sizeof(w->path) - 1);
+    w->started_us = metrics_now_us();
+
+    CaptureFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+    header.version = CAPTURE_VERSION;
+    header.header_len = sizeof(CaptureFileHeader);
+    header.started_unix_us = (int64_t)time(NULL) * 1000000;
+    strncpy(header.did, did ? did : "", sizeof(header.did) - 1);
+    if (fwrite(&header, sizeof(header), 1, w->fp) != 1) {
+        printf("[Capture] ERROR: Cannot write %s\n", path);
+        fclose(w->fp);
+        free(w->buffer);
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+int capture_writer_append(CaptureWriter* w, int channel, int kind, int generation,
+                          const void* data, int len, long long at_us) {
+    if (!w || len < 0 || len > CAPTURE_MAX_RECORD) return -1;
+    CaptureRecordHeader rec;
+    rec.len = (uint32_t)len;
+    rec.channel = (uint8_t)channel;
+    rec.kind = (uint8_t)kind;
+    rec.generation = (uint16_t)generation;
+    rec.t_us = at_us - w->started_us;
+
+    while (InterlockedCompareExchange(&w->lock, 1, 0) != 0) Sleep(0);
+    int ret = 0;
+    if (w->failed) {
+        w->stats.failed++;
+        ret = -1;
+    } else if (fwrite(&rec, sizeof(rec), 1, w->fp) != 1 || (len > 0 && fwrite(data, 1, len, w->fp) != (size_t)len)) {
+        // Disk full or similar: stop rather than leave a gap in the stream
+        w->failed = 1;
+        w->stats.failed++;
+        printf("[Capture] ERROR: Write to %s failed, capture stopped after %llu records\n", w->path, w->stats.records);
+        ret = -1;
+    } else {
+        w->stats.records++;
+        w->stats.bytes += (unsigned long long)len;
+    }
+    InterlockedExchange(&w->lock, 0);
+    return ret;
+}
+
+void capture_writer_get_stats(CaptureWriter* w, CaptureStats* stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    if (w) *stats = w->stats;
+}
+
+void capture_writer_close(CaptureWriter* w) {
+    if (!w) return;
+    fclose(w->fp);
+    free(w->buffer);
+    printf("[Capture] %s: %llu reads, %.2f MB captured%s\n", w->path, w->stats.records,
+           (double)w->stats.bytes / (1024 * 1024), w->failed ? " (incomplete, write failed)" : "");
+    free(w);
+}
+
+CaptureReader* capture_reader_open(const char* path) {
+    if (!path) return NULL;
+    CaptureReader* r = (CaptureReader*)calloc(1, sizeof(CaptureReader));
+    if (!r) return NULL;
+    r->fp = fopen(path, "rb");
+    if (!r->fp) {
+        printf("[Capture] ERROR: Cannot open %s\n", path);
+        free(r);
+        return NULL;
+    }
+    if (fread(&r->header, sizeof(r->header), 1, r->fp) != 1 ||
+        memcmp(r->header.magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0 ||
+        r->header.version != CAPTURE_VERSION || r->header.header_len < sizeof(CaptureFileHeader)) {
+        printf("[Capture] ERROR: %s is not a version %d capture\n", path, CAPTURE_VERSION);
+        fclose(r->fp);
+        free(r);
+        return NULL;
+    }
+    r->header.did[sizeof(r->header.did) - 1] = '\0';
+    fseek(r->fp, r->header.header_len, SEEK_SET);
+    return r;
+}
+
+const CaptureFileHeader* capture_reader_header(CaptureReader* r) {
+    return r ? &r->header : NULL;
+}
+
+int capture_reader_next(CaptureReader* r, CaptureRecordHeader* rec, const unsigned char** data) {
+    if (!r || !rec || !data) return -1;
+    size_t got = fread(rec, 1, sizeof(*rec), r->fp);
+    if (got == 0) return 0;
+    if (got < sizeof(*rec)) {
+        printf("[Capture] Capture ends inside a record header\n");
+        return 0;
+    }
+    if (rec->len > CAPTURE_MAX_RECORD || (rec->kind != CAPTURE_REC_DATA && rec->kind != CAPTURE_REC_RESET)) {
+        printf("[Capture] ERROR: Damaged record (kind %d, %u bytes)\n", rec->kind, rec->len);
+        return -1;
+    }
+    if ((int)rec->len > r->capacity) {
+        unsigned char* bigger = (unsigned char*)realloc(r->data, rec->len);
+        if (!bigger) return -1;
+        r->data = bigger;
+        r->capacity = (int)rec->len;
+    }
+    if (rec->len > 0 && fread(r->data, 1, rec->len, r->fp) != rec->len) {
+        printf("[Capture] Capture ends inside a %u byte record\n", rec->len);
+        return 0;
+    }
+    *data = r->data;
+    return 1;
+}
+
+void capture_reader_close(CaptureReader* r) {
+    if (!r) return;
+    fclose(r->fp);
+    free(r->data);
+    free(r);
+}
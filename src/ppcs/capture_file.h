@@ -0,0 +1,69 @@
+// Capture File Header
+#ifndef CAPTURE_FILE_H
+#define CAPTURE_FILE_H
+
+#include <stdint.h>
+
+// Raw receive capture: the bytes of every PPCS_Read, with the channel they
+// came in on and when, appended to one file per session. Replaying a
+// capture feeds the framer exactly the chunks the device produced, so field
+// problems can be reproduced and benchmarked with no device or network.
+//
+// Layout: CaptureFileHeader, then records of CaptureRecordHeader followed
+// by len data bytes. All fields little-endian.
+
+#define CAPTURE_MAGIC "PPCSCAP"         // 8 bytes with the NUL
+#define CAPTURE_VERSION 1
+#define CAPTURE_FILE_EXT ".ppcap"
+#define CAPTURE_MAX_RECORD (16*1024*1024)
+
+// Record kinds
+#define CAPTURE_REC_DATA  1             // Bytes returned by one PPCS_Read
+#define CAPTURE_REC_RESET 2             // Reader dropped its partial bytes: new session handle
+
+#pragma pack(1)
+typedef struct {
+    char magic[8];
+    uint16_t version;
+    uint16_t header_len;                // Records start here
+    uint32_t reserved;
+    int64_t started_unix_us;            // Wall clock when the capture began
+    char did[64];
+} CaptureFileHeader;
+
+typedef struct {
+    uint32_t len;                       // Data bytes following
+    uint8_t channel;
+    uint8_t kind;                       // CAPTURE_REC_*
+    uint16_t generation;                // Session handle generation (see ppcs_session_generation)
+    int64_t t_us;                       // Since the capture began, metrics_now_us() clock
+} CaptureRecordHeader;
+#pragma pack()
+
+typedef struct {
+    unsigned long long records;
+    unsigned long long bytes;           // Data bytes, headers excluded
+    unsigned long long failed;          // Records lost to a write error
+} CaptureStats;
+
+typedef struct CaptureWriter CaptureWriter;
+typedef struct CaptureReader CaptureReader;
+
+// Creates (truncates) path. Returns NULL if it cannot be written.
+CaptureWriter* capture_writer_open(const char* path, const char* did);
+// Append one record; any thread. at_us is a metrics_now_us() time.
+// Returns 0, or -1 once the file could not be written (capture stops).
+int capture_writer_append(CaptureWriter* writer, int channel, int kind, int generation,
+                          const void* data, int len, long long at_us);
+void capture_writer_get_stats(CaptureWriter* writer, CaptureStats* stats);
+// Flush and close; prints a summary line
+void capture_writer_close(CaptureWriter* writer);
+
+CaptureReader* capture_reader_open(const char* path);
+const CaptureFileHeader* capture_reader_header(CaptureReader* reader);
+// Next record. Returns 1 with *data valid until the next call, 0 at the end
+// of the file (a record cut short by a crash also ends it), -1 if damaged.
+int capture_reader_next(CaptureReader* reader, CaptureRecordHeader* record, const unsigned char** data);
+void capture_reader_close(CaptureReader* reader);
+
+#endif // CAPTURE_FILE_H
@@ -0,0 +1,170 @@
+// Command Writer Implementation
+#include "command_writer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "PPCS_Error.h"
+#include "async_log.h"
+#include "metrics.h"
+
+#define CMD_WRITER_IDLE_MS 100          // Wake-up interval with nothing queued
+#define CMD_WRITER_THROTTLE_MS 10       // Recheck interval while PPCS still holds max_buffered
+#define CMD_WRITER_NO_HANDLE_MS 50      // Recheck interval while the session is being recovered
+
+static int session_gone(INT32 ret) {
+    return ret == ERROR_PPCS_SESSION_CLOSED_REMOTE || ret == ERROR_PPCS_SESSION_CLOSED_TIMEOUT ||
+           ret == ERROR_PPCS_INVALID_SESSION_HANDLE;
+}
+
+// Copy queued packages from tail into the batch while they fit in room.
+// The first package always goes, so one larger than room is not stuck.
+static int writer_fill_batch(CommandWriter* w, unsigned int tail, unsigned int head, UINT32 room, int* count) {
+    int total = 0;
+    *count = 0;
+    for (unsigned int i = tail; i != head; i++) {
+        const CommandWriterSlot* slot = &w->slots[i & (CMD_WRITER_QUEUE_SIZE - 1)];
+        if (*count > 0 && ((UINT32)(total + slot->len) > room || total + slot->len > CMD_WRITER_COALESCE_MAX)) break;
+        memcpy(w->batch + total, slot->data, slot->len);
+        total += slot->len;
+        (*count)++;
+    }
+    return total;
+}
+
+static DWORD WINAPI command_writer_thread(LPVOID param) {
+    CommandWriter* w = (CommandWriter*)param;
+    while (w->run) {
+        unsigned int tail = atomic_load_explicit(&w->tail, memory_order_relaxed);
+        unsigned int head = atomic_load_explicit(&w->head, memory_order_acquire);
+        if (tail == head) {
+            WaitForSingleObject(w->wake, CMD_WRITER_IDLE_MS);
+            continue;
+        }
+        INT32 handle = w->get_handle(w->user);
+        if (handle < 0) {
+            Sleep(CMD_WRITER_NO_HANDLE_MS);
+            continue;
+        }
+
+        // Keep what PPCS holds unsent under max_buffered
+        UINT32 unsent = 0;
+        INT32 ret = PPCS_Check_Buffer(handle, w->channel, &unsent, NULL);
+        if (ret != ERROR_PPCS_SUCCESSFUL) {
+            // Closed under us: the reader sees it too and recovers the session
+            Sleep(CMD_WRITER_NO_HANDLE_MS);
+            continue;
+        }
+        if (unsent > w->stats.max_buffered) w->stats.max_buffered = unsent;
+        if (unsent >= w->max_buffered) {
+            w->stats.throttled++;
+            LOG_RATELIMITED(LOG_LEVEL_WARN, "Command", 1, "%s: %u bytes still unsent on channel %d, holding %u commands",
+                            w->name, unsent, w->channel, head - tail);
+            Sleep(CMD_WRITER_THROTTLE_MS);
+            continue;
+        }
+
+        int count = 0;
+        int total = writer_fill_batch(w, tail, head, w->max_buffered - unsent, &count);
+        ret = PPCS_Write(handle, w->channel, (CHAR*)w->batch, total);
+        if (ret < 0 && session_gone(ret)) {
+            // Kept for the recovered handle
+            LOG_DEBUG("Command", "%s: write failed (%d), keeping %d commands for the next handle", w->name, ret, count);
+            Sleep(CMD_WRITER_NO_HANDLE_MS);
+            continue;
+        }
+        if (ret < 0) {
+            LOG_ERROR("Command", "%s: PPCS_Write of %d commands (%d bytes) failed with code %d, dropped",
+                      w->name, count, total, ret);
+            w->stats.dropped += (unsigned long long)count;
+        } else {
+            long long now = metrics_now_us();
+            for (int i = 0; i < count; i++) {
+                metrics_record(MET_COMMAND_QUEUED, now - w->slots[(tail + i) & (CMD_WRITER_QUEUE_SIZE - 1)].queued_at);
+            }
+            w->stats.packages += (unsigned long long)count;
+            w->stats.writes++;
+            w->stats.bytes += (unsigned long long)total;
+            LOG_DEBUG("Command", "%s: wrote %d commands in %d bytes to handle 0x%08X", w->name, count, total, handle);
+        }
+        atomic_store_explicit(&w->tail, tail + (unsigned int)count, memory_order_release);
+    }
+    async_log_thread_detach();
+    return 0;
+}
+
+CommandWriter* command_writer_create(const char* name, UCHAR channel, int max_buffered,
+                                     CommandWriterHandleFn get_handle, void* user) {
+    if (!get_handle) return NULL;
+    CommandWriter* w = (CommandWriter*)calloc(1, sizeof(CommandWriter));
+    if (!w) return NULL;
+    strncpy(w->name, name ? name : "", sizeof(w->name) - 1);
+    w->channel = channel;
+    w->max_buffered = max_buffered > 0 ? (UINT32)max_buffered : CMD_WRITER_DEFAULT_MAX_BUFFERED;
+    w->get_handle = get_handle;
+    w->user = user;
+    atomic_init(&w->head, 0);
+    atomic_init(&w->tail, 0);
+    w->wake = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (!w->wake) {
+        free(w);
+        return NULL;
+    }
+    w->run = 1;
+    DWORD tid = 0;
+    w->thread = CreateThread(NULL, 0, command_writer_thread, w, 0, &tid);
+    if (!w->thread) {
+        printf("[Command] ERROR: Failed to start writer thread for %s\n", w->name);
+        CloseHandle(w->wake);
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+void command_writer_destroy(CommandWriter* w) {
+    if (!w) return;
+    w->run = 0;
+    SetEvent(w->wake);
+    // No timeout: the thread still uses w, and every wait in its loop is short
+    WaitForSingleObject(w->thread, INFINITE);
+    CloseHandle(w->thread);
+    CloseHandle(w->wake);
+    int left = command_writer_depth(w);
+    if (left > 0) printf("[Command] %s: %d queued commands not sent\n", w->name, left);
+    free(w);
+}
+
+int command_writer_submit(CommandWriter* w, const unsigned char* data, int len) {
+    if (!w || !data || len <= 0) return -1;
+    while (InterlockedCompareExchange(&w->submit_lock, 1, 0) != 0) Sleep(0);
+    int ret = -1;
+    unsigned int head = atomic_load_explicit(&w->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&w->tail, memory_order_acquire);
+    if (len <= CMD_WRITER_MAX_PACKAGE && head - tail < CMD_WRITER_QUEUE_SIZE) {
+        CommandWriterSlot* slot = &w->slots[head & (CMD_WRITER_QUEUE_SIZE - 1)];
+        memcpy(slot->data, data, len);
+        slot->len = len;
+        slot->queued_at = metrics_now_us();
+        atomic_store_explicit(&w->head, head + 1, memory_order_release);
+        w->stats.submitted++;
+        int depth = (int)(head + 1 - tail);
+        if (depth > w->stats.max_depth) w->stats.max_depth = depth;
+        ret = 0;
+    } else {
+        w->stats.rejected++;
+    }
+    InterlockedExchange(&w->submit_lock, 0);
+    if (ret == 0) SetEvent(w->wake);
+    return ret;
+}
+
+int command_writer_depth(CommandWriter* w) {
+    if (!w) return 0;
+    return (int)(atomic_load_explicit(&w->head, memory_order_acquire) - atomic_load_explicit(&w->tail, memory_order_acquire));
+}
+
+void command_writer_get_stats(CommandWriter* w, CommandWriterStats* stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    if (w) *stats = w->stats;
+}
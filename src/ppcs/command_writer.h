@@ -0,0 +1,76 @@
+// Command Writer Header
+#ifndef COMMAND_WRITER_H
+#define COMMAND_WRITER_H
+
+#include "platform.h"
+#include <stdatomic.h>
+#include "PPCS_API.h"
+
+// Outbound command queue with its own writer thread, so PPCS_Write never
+// runs on the UI thread. Before each write the thread asks PPCS_Check_Buffer
+// how much is still unsent on the channel and holds off while that is at
+// max_buffered (the PPCS demo keeps its write backlog around 128-256 KB).
+// Packages queued behind each other go out in one PPCS_Write.
+//
+// Submit copies the package and returns at once; any thread may submit.
+// While the session has no handle (being recovered) packages stay queued
+// and are written to the new handle.
+
+#define CMD_WRITER_QUEUE_SIZE 32            // Packages waiting to be written, power of two
+#define CMD_WRITER_MAX_PACKAGE 4096         // Largest package accepted
+#define CMD_WRITER_COALESCE_MAX 16384       // Bytes merged into one PPCS_Write
+#define CMD_WRITER_DEFAULT_MAX_BUFFERED (128*1024)
+
+// Current session handle, or -1 while there is none
+typedef INT32 (*CommandWriterHandleFn)(void* user);
+
+typedef struct {
+    unsigned long long submitted;
+    unsigned long long rejected;        // Queue full or package too large
+    unsigned long long packages;        // Written
+    unsigned long long writes;          // PPCS_Write calls that carried them
+    unsigned long long bytes;
+    unsigned long long throttled;       // Waits for the PPCS write buffer to drain
+    unsigned long long dropped;         // Lost to a write error other than a closed session
+    unsigned int max_buffered;          // Most unsent bytes PPCS_Check_Buffer reported
+    int max_depth;
+} CommandWriterStats;
+
+typedef struct {
+    int len;
+    long long queued_at;                // metrics_now_us() at submit
+    unsigned char data[CMD_WRITER_MAX_PACKAGE];
+} CommandWriterSlot;
+
+typedef struct {
+    char name[64];                      // For log lines (the DID)
+    UCHAR channel;
+    UINT32 max_buffered;
+    CommandWriterHandleFn get_handle;
+    void* user;
+
+    atomic_uint head;                   // Next slot to fill
+    atomic_uint tail;                   // Next slot to write
+    volatile LONG submit_lock;          // Serialises producers
+    CommandWriterSlot slots[CMD_WRITER_QUEUE_SIZE];
+    unsigned char batch[CMD_WRITER_COALESCE_MAX];
+
+    HANDLE thread;
+    HANDLE wake;                        // Auto-reset, set on submit and stop
+    volatile int run;
+    CommandWriterStats stats;           // Producer fields under submit_lock, the rest writer only
+} CommandWriter;
+
+// max_buffered <= 0 uses CMD_WRITER_DEFAULT_MAX_BUFFERED
+CommandWriter* command_writer_create(const char* name, UCHAR channel, int max_buffered,
+                                     CommandWriterHandleFn get_handle, void* user);
+// Stops the thread; packages still queued are dropped
+void command_writer_destroy(CommandWriter* writer);
+
+// Queue a built package. Returns 0, or -1 if it is too large or the queue is full.
+int command_writer_submit(CommandWriter* writer, const unsigned char* data, int len);
+
+int command_writer_depth(CommandWriter* writer);
+void command_writer_get_stats(CommandWriter* writer, CommandWriterStats* stats);
+
+#endif // COMMAND_WRITER_H
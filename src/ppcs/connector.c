@@ -0,0 +1,282 @@
+// Connector Implementation
+#include "connector.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "PPCS_Error.h"
+#include "async_log.h"
+#include "metrics.h"
+
+#define CONNECT_CACHE_MAX_ENTRIES 256
+#define CONNECT_CACHE_LINE_LEN 512
+#define CONNECT_CANCEL_POLL_MS 50           // How often a cancellable connect checks its caller still runs
+
+typedef struct ConnectRace ConnectRace;
+
+typedef struct {
+    ConnectRace* race;
+    int index;
+    int mode;
+    HANDLE thread;
+    INT32 result;               // Session handle, or the PPCS error
+    long long elapsed_us;
+} ConnectAttempt;
+
+struct ConnectRace {
+    const char* did;
+    const Config* config;
+    ConnectAttempt attempts[CONNECT_MAX_MODES];
+    int count;
+    int launched;
+    volatile LONG winner;       // Attempt index, -1 until one connects
+    volatile LONG finished;     // Attempts that have returned
+    HANDLE done;                // Auto-reset, set as each attempt returns
+};
+
+static volatile LONG s_cache_lock = 0;
+static volatile LONG s_race_lock = 0;      // One race at a time, see connector.h
+
+static int connect_cancelled(const volatile int* run) {
+    return run && !*run;
+}
+
+static const char* path_name(int path) {
+    switch (path) {
+        case 0: return "P2P";
+        case 1: return "relay";
+        case 2: return "TCP";
+        case 3: return "RP2P";
+        default: return "unknown";
+    }
+}
+
+int connector_parse_modes(const Config* config, int* modes, int max) {
+    int count = 0;
+    const char* p = config->ConnectModes;
+    while (*p && count < max) {
+        while (*p == ',' || *p == ' ' || *p == '\t') p++;
+        if (!*p) break;
+        char* end;
+        long mode = strtol(p, &end, 0);
+        if (end == p) break;
+        int known = 0;
+        for (int i = 0; i < count; i++) {
+            if (modes[i] == (int)mode) { known = 1; break; }
+        }
+        if (!known && mode >= 0 && mode <= 0x7F) modes[count++] = (int)mode;
+        p = end;
+    }
+    if (count == 0) modes[count++] = config->ConnectionMode;
+    return count;
+}
+
+static void cache_lock(void) {
+    while (InterlockedCompareExchange(&s_cache_lock, 1, 0) != 0) Sleep(0);
+}
+
+static void cache_unlock(void) {
+    InterlockedExchange(&s_cache_lock, 0);
+}
+
+// Cache lines: "<DID> <mode> <path> <connect ms>"
+static int cache_lookup(const char* file, const char* did, int* mode) {
+    if (!file[0]) return 0;
+    cache_lock();
+    FILE* f = fopen(file, "r");
+    int found = 0;
+    if (f) {
+        char line[CONNECT_CACHE_LINE_LEN];
+        char entry_did[MAX_CONFIG_VALUE_LEN];
+        int entry_mode;
+        while (!found && fgets(line, sizeof(line), f)) {
+            if (sscanf(line, "%255s %i", entry_did, &entry_mode) == 2 && strcmp(entry_did, did) == 0) {
+                *mode = entry_mode;
+                found = 1;
+            }
+        }
+        fclose(f);
+    }
+    cache_unlock();
+    return found;
+}
+
+static void cache_store(const char* file, const char* did, const ConnectResult* result) {
+    if (!file[0]) return;
+    cache_lock();
+    // Keep the other devices' lines; the file is small enough to rewrite
+    char (*lines)[CONNECT_CACHE_LINE_LEN] = malloc(CONNECT_CACHE_MAX_ENTRIES * CONNECT_CACHE_LINE_LEN);
+    int count = 0;
+    FILE* f = lines ? fopen(file, "r") : NULL;
+    if (f) {
+        char entry_did[MAX_CONFIG_VALUE_LEN];
+        while (count < CONNECT_CACHE_MAX_ENTRIES - 1 && fgets(lines[count], CONNECT_CACHE_LINE_LEN, f)) {
+            if (sscanf(lines[count], "%255s", entry_did) != 1 || strcmp(entry_did, did) == 0) continue;
+            count++;
+        }
+        fclose(f);
+    }
+    f = lines ? fopen(file, "w") : NULL;
+    if (f) {
+        for (int i = 0; i < count; i++) fputs(lines[i], f);
+        fprintf(f, "%s 0x%02X %d %lld\n", did, result->mode, result->path, result->connect_us / 1000);
+        fclose(f);
+    } else {
+        printf("[Connect] WARNING: Could not update %s\n", file);
+    }
+    free(lines);
+    cache_unlock();
+}
+
+static DWORD WINAPI connect_attempt_thread(LPVOID param) {
+    ConnectAttempt* attempt = (ConnectAttempt*)param;
+    ConnectRace* race = attempt->race;
+    long long start = metrics_now_us();
+    attempt->result = PPCS_ConnectByServer(race->did, (CHAR)attempt->mode, (UINT16)race->config->UDPPort,
+                                           (CHAR*)race->config->ServerString);
+    attempt->elapsed_us = metrics_now_us() - start;
+    if (attempt->result >= 0 && InterlockedCompareExchange(&race->winner, attempt->index, -1) != -1) {
+        // Connected after another mode won: this session is surplus
+        LOG_DEBUG("Connect", "%s: mode 0x%02X connected after the race was decided, closing", race->did, attempt->mode);
+        PPCS_Close(attempt->result);
+    }
+    InterlockedIncrement(&race->finished);
+    SetEvent(race->done);
+    async_log_thread_detach();
+    return 0;
+}
+
+// Start attempts up to index upto (exclusive)
+static void race_launch(ConnectRace* race, int upto) {
+    while (race->launched < upto) {
+        ConnectAttempt* attempt = &race->attempts[race->launched];
+        attempt->race = race;
+        attempt->index = race->launched;
+        attempt->result = ERROR_PPCS_NOT_INITIALIZED;
+        DWORD tid = 0;
+        attempt->thread = CreateThread(NULL, 0, connect_attempt_thread, attempt, 0, &tid);
+        race->launched++;
+        metrics_add(MET_CONNECT_ATTEMPTS, 1);
+        if (!attempt->thread) {
+            printf("[Connect] ERROR: Failed to start attempt for mode 0x%02X\n", attempt->mode);
+            InterlockedIncrement(&race->finished);
+        }
+    }
+}
+
+static INT32 connector_race(const char* did, const Config* config, ConnectResult* result, const volatile int* run) {
+    ConnectRace race;
+    memset(&race, 0, sizeof(race));
+    race.did = did;
+    race.config = config;
+    race.winner = -1;
+
+    int modes[CONNECT_MAX_MODES];
+    race.count = connector_parse_modes(config, modes, CONNECT_MAX_MODES);
+
+    // The last winner goes first, with a head start over the rest
+    int cached_mode;
+    int head_start_ms = 0;
+    if (cache_lookup(config->ConnectCacheFile, did, &cached_mode)) {
+        for (int i = 1; i < race.count; i++) {
+            if (modes[i] != cached_mode) continue;
+            memmove(&modes[1], &modes[0], i * sizeof(int));
+            modes[0] = cached_mode;
+            break;
+        }
+        if (modes[0] == cached_mode && race.count > 1) head_start_ms = config->ConnectStaggerMs;
+    }
+    for (int i = 0; i < race.count; i++) race.attempts[i].mode = modes[i];
+
+    race.done = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (!race.done) {
+        printf("[Connect] ERROR: Failed to create race event\n");
+        return -1;
+    }
+
+    if (race.count > 1) {
+        printf("[Connect] %s: racing %d modes, 0x%02X first%s\n", did, race.count, modes[0],
+               head_start_ms > 0 ? " (cached)" : "");
+    }
+    long long start = metrics_now_us();
+    long long stagger_at = start + (long long)head_start_ms * 1000;
+    race_launch(&race, head_start_ms > 0 ? 1 : race.count);
+    while (race.winner < 0 && !connect_cancelled(run)) {
+        if (race.finished == race.launched) {
+            if (race.launched == race.count) break;
+            race_launch(&race, race.count);     // The cached mode failed early
+            continue;
+        }
+        DWORD wait = INFINITE;
+        if (race.launched < race.count) {
+            long long left_ms = (stagger_at - metrics_now_us()) / 1000;
+            if (left_ms <= 0) {
+                race_launch(&race, race.count);
+                continue;
+            }
+            wait = (DWORD)left_ms;
+        }
+        if (run && wait > CONNECT_CANCEL_POLL_MS) wait = CONNECT_CANCEL_POLL_MS;
+        WaitForSingleObject(race.done, wait);
+    }
+
+    // Cancel the attempts still waiting; a late success closes its own session.
+    // One just launched may not be inside PPCS yet when the break goes out, so
+    // break again until all have returned. Under s_race_lock every pending
+    // connect in the process is one of ours.
+    if (race.finished < race.launched) PPCS_Connect_Break();
+    for (int i = 0; i < race.launched; i++) {
+        if (!race.attempts[i].thread) continue;
+        while (WaitForSingleObject(race.attempts[i].thread, CONNECT_CANCEL_POLL_MS) == WAIT_TIMEOUT) PPCS_Connect_Break();
+        CloseHandle(race.attempts[i].thread);
+    }
+    CloseHandle(race.done);
+
+    if (race.winner < 0 && connect_cancelled(run)) {
+        LOG_INFO("Connect", "%s: connect cancelled after %lld ms", did, (metrics_now_us() - start) / 1000);
+        return -1;
+    }
+    if (race.winner < 0) {
+        for (int i = 0; i < race.launched; i++) {
+            printf("[Connect] %s: mode 0x%02X failed after %lld ms\n", did, race.attempts[i].mode,
+                   race.attempts[i].elapsed_us / 1000);
+            print_error("PPCS_ConnectByServer", race.attempts[i].result);
+        }
+        metrics_add(MET_CONNECT_FAILURES, 1);
+        return -1;
+    }
+
+    ConnectAttempt* winner = &race.attempts[race.winner];
+    INT32 session_handle = winner->result;
+    st_PPCS_Session session_info;
+    INT32 ret = PPCS_Check(session_handle, &session_info);
+    if (ret != ERROR_PPCS_SUCCESSFUL) {
+        printf("[ERROR] PPCS_Check failed after connect: %d\n", ret);
+        print_error("PPCS_Check", ret);
+        PPCS_Close(session_handle);
+        metrics_add(MET_CONNECT_FAILURES, 1);
+        return -1;
+    }
+
+    ConnectResult won;
+    won.mode = winner->mode;
+    won.path = session_info.bMode;
+    won.connect_us = metrics_now_us() - start;
+    won.attempts = race.launched;
+    won.cached = head_start_ms > 0 && race.winner == 0;
+    metrics_record(MET_CONNECT_TIME, won.connect_us);
+    printf("[Connect] %s connected with mode 0x%02X over %s in %lld ms (%d of %d modes tried)\n",
+           did, won.mode, path_name(won.path), won.connect_us / 1000, won.attempts, race.count);
+    cache_store(config->ConnectCacheFile, did, &won);
+    if (result) *result = won;
+    return session_handle;
+}
+
+INT32 connector_connect(const char* did, const Config* config, ConnectResult* result, const volatile int* run) {
+    while (InterlockedCompareExchange(&s_race_lock, 1, 0) != 0) {
+        if (connect_cancelled(run)) return -1;
+        Sleep(10);
+    }
+    INT32 handle = connector_race(did, config, result, run);
+    InterlockedExchange(&s_race_lock, 0);
+    return handle;
+}
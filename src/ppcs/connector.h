@@ -0,0 +1,36 @@
+// Connector Header
+#ifndef CONNECTOR_H
+#define CONNECTOR_H
+
+#include "ppcs_core.h"
+
+// Connects by racing several PPCS connection modes at once (ConnectModes),
+// keeping the first session that comes up and breaking off the rest. The
+// mode that won for each DID is kept in ConnectCacheFile; on the next start
+// it is tried first and the others only follow after ConnectStaggerMs, so a
+// site where only relay works stops paying for the LAN and P2P timeouts.
+//
+// PPCS_Connect_Break cancels every pending connect in the process, so races
+// for different devices (e.g. two sessions recovering at once) run one at a
+// time.
+
+#define CONNECT_MAX_MODES 8
+
+typedef struct {
+    int mode;                   // bEnableLanSearch value that won
+    int path;                   // st_PPCS_Session.bMode: 0 P2P, 1 relay, 2 TCP, 3 RP2P
+    long long connect_us;       // Race start to a checked session
+    int attempts;               // Modes launched
+    int cached;                 // The winner of the last run was tried first
+} ConnectResult;
+
+// Returns the session handle, or -1 if no mode connected. result may be NULL.
+// With run set, the wait for another race and the race itself are given up
+// as soon as *run drops to 0, so a stopping reader is never held here.
+INT32 connector_connect(const char* did, const Config* config, ConnectResult* result, const volatile int* run);
+
+// Mode list from ConnectModes ("0x21,0x1E,0x5E"), or ConnectionMode alone
+// when it is empty. Returns the number of modes.
+int connector_parse_modes(const Config* config, int* modes, int max);
+
+#endif // CONNECTOR_H
@@ -0,0 +1,134 @@
+// Package Pool Implementation
+#include "package_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define POOL_CLASS_COUNT 6
+#define POOL_MAX_CACHED 8          // Idle buffers kept per size class
+#define POOL_DATA_ALIGN 64
+
+static const int s_class_size[POOL_CLASS_COUNT] = {
+    4 * 1024, 16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024, 4 * 1024 * 1024
+};
+
+typedef struct {
+    PackageBuf* free_list;
+    int cached;
+} PoolClass;
+
+static PoolClass s_classes[POOL_CLASS_COUNT];
+static atomic_flag s_pool_lock = ATOMIC_FLAG_INIT;
+
+static atomic_ullong s_bytes_received;
+static atomic_ullong s_bytes_copied;
+static atomic_ullong s_copy_calls;
+static atomic_ullong s_buf_allocs;
+static atomic_ullong s_buf_misses;
+
+static void pool_lock(void) { while (atomic_flag_test_and_set_explicit(&s_pool_lock, memory_order_acquire)) { } }
+static void pool_unlock(void) { atomic_flag_clear_explicit(&s_pool_lock, memory_order_release); }
+
+static int size_to_class(int size) {
+    for (int i = 0; i < POOL_CLASS_COUNT; i++) {
+        if (size <= s_class_size[i]) return i;
+    }
+    return -1;
+}
+
+static PackageBuf* buf_new(int size_class, int capacity) {
+    size_t head = (sizeof(PackageBuf) + POOL_DATA_ALIGN - 1) & ~(size_t)(POOL_DATA_ALIGN - 1);
+    PackageBuf* buf = (PackageBuf*)malloc(head + (size_t)capacity);
+    if (!buf) return NULL;
+    memset(buf, 0, sizeof(PackageBuf));
+    buf->size_class = size_class;
+    buf->capacity = capacity;
+    buf->data = (unsigned char*)buf + head;
+    return buf;
+}
+
+PackageBuf* package_buf_alloc(int size) {
+    if (size <= 0) return NULL;
+    int cls = size_to_class(size);
+    PackageBuf* buf = NULL;
+
+    if (cls >= 0) {
+        pool_lock();
+        buf = s_classes[cls].free_list;
+        if (buf) {
+            s_classes[cls].free_list = buf->next_free;
+            s_classes[cls].cached--;
+        }
+        pool_unlock();
+    }
+    if (!buf) {
+        buf = buf_new(cls, cls >= 0 ? s_class_size[cls] : size);
+        if (!buf) {
+            printf("[Pool] ERROR: Failed to allocate %d byte buffer\n", size);
+            return NULL;
+        }
+        atomic_fetch_add_explicit(&s_buf_misses, 1, memory_order_relaxed);
+    }
+    buf->next_free = NULL;
+    buf->len = 0;
+    atomic_store_explicit(&buf->refcount, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s_buf_allocs, 1, memory_order_relaxed);
+    return buf;
+}
+
+PackageBuf* package_buf_ref(PackageBuf* buf) {
+    if (buf) atomic_fetch_add_explicit(&buf->refcount, 1, memory_order_relaxed);
+    return buf;
+}
+
+void package_buf_release(PackageBuf* buf) {
+    if (!buf) return;
+    if (atomic_fetch_sub_explicit(&buf->refcount, 1, memory_order_acq_rel) != 1) return;
+
+    int cls = buf->size_class;
+    if (cls >= 0) {
+        pool_lock();
+        if (s_classes[cls].cached < POOL_MAX_CACHED) {
+            buf->next_free = s_classes[cls].free_list;
+            s_classes[cls].free_list = buf;
+            s_classes[cls].cached++;
+            buf = NULL;
+        }
+        pool_unlock();
+    }
+    free(buf);
+}
+
+void package_pool_trim(void) {
+    pool_lock();
+    for (int i = 0; i < POOL_CLASS_COUNT; i++) {
+        PackageBuf* buf = s_classes[i].free_list;
+        while (buf) {
+            PackageBuf* next = buf->next_free;
+            free(buf);
+            buf = next;
+        }
+        s_classes[i].free_list = NULL;
+        s_classes[i].cached = 0;
+    }
+    pool_unlock();
+}
+
+void package_pool_count_received(int bytes) {
+    if (bytes > 0) atomic_fetch_add_explicit(&s_bytes_received, (unsigned long long)bytes, memory_order_relaxed);
+}
+
+void package_pool_count_copy(int bytes) {
+    if (bytes <= 0) return;
+    atomic_fetch_add_explicit(&s_bytes_copied, (unsigned long long)bytes, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s_copy_calls, 1, memory_order_relaxed);
+}
+
+void package_pool_get_stats(PackageCopyStats* stats) {
+    if (!stats) return;
+    stats->bytes_received = atomic_load_explicit(&s_bytes_received, memory_order_relaxed);
+    stats->bytes_copied = atomic_load_explicit(&s_bytes_copied, memory_order_relaxed);
+    stats->copy_calls = atomic_load_explicit(&s_copy_calls, memory_order_relaxed);
+    stats->buf_allocs = atomic_load_explicit(&s_buf_allocs, memory_order_relaxed);
+    stats->buf_misses = atomic_load_explicit(&s_buf_misses, memory_order_relaxed);
+}
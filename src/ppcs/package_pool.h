@@ -0,0 +1,40 @@
+// Package Pool Header
+#ifndef PACKAGE_POOL_H
+#define PACKAGE_POOL_H
+
+#include <stdatomic.h>
+
+// Reference-counted buffers for reassembled payloads, recycled through
+// per-size-class free lists instead of malloc/free per frame.
+
+typedef struct PackageBuf {
+    atomic_int refcount;
+    int size_class;
+    int capacity;               // Usable bytes at data
+    int len;                    // Bytes filled by the owner
+    struct PackageBuf* next_free;
+    unsigned char* data;
+} PackageBuf;
+
+// Byte accounting for the PPCS_Read -> decoder path
+typedef struct {
+    unsigned long long bytes_received;  // Bytes delivered by PPCS_Read
+    unsigned long long bytes_copied;    // Payload bytes memcpy'd after that
+    unsigned long long copy_calls;
+    unsigned long long buf_allocs;      // PackageBuf allocations served
+    unsigned long long buf_misses;      // ...that had to hit malloc
+} PackageCopyStats;
+
+// Returns a buffer with refcount 1 and at least size bytes, or NULL
+PackageBuf* package_buf_alloc(int size);
+PackageBuf* package_buf_ref(PackageBuf* buf);
+void package_buf_release(PackageBuf* buf);
+
+// Free every cached buffer (call once all references are released)
+void package_pool_trim(void);
+
+void package_pool_count_received(int bytes);
+void package_pool_count_copy(int bytes);
+void package_pool_get_stats(PackageCopyStats* stats);
+
+#endif // PACKAGE_POOL_H
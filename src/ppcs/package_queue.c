@@ -0,0 +1,91 @@
+// Package Queue Implementation
+#include "package_queue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+PackageQueue* package_queue_create(int capacity) {
+    if (capacity < 2) capacity = 2;
+    unsigned int cap = 2;
+    while (cap < (unsigned int)capacity) cap <<= 1;
+
+    PackageQueue* queue = (PackageQueue*)malloc(sizeof(PackageQueue));
+    if (!queue) return NULL;
+    memset(queue, 0, sizeof(PackageQueue));
+    queue->slots = (PackageView*)calloc(cap, sizeof(PackageView));
+    if (!queue->slots) {
+        free(queue);
+        return NULL;
+    }
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    queue->capacity = cap;
+    queue->mask = cap - 1;
+    return queue;
+}
+
+void package_queue_destroy(PackageQueue* queue) {
+    if (!queue) return;
+    PackageView views[64];
+    int n;
+    while ((n = package_queue_pop_batch(queue, views, 64)) > 0) {
+        for (int i = 0; i < n; i++) package_view_release(&views[i]);
+    }
+    free(queue->slots);
+    free(queue);
+}
+
+int package_queue_push(PackageQueue* queue, const PackageView* view) {
+    if (!queue || !view) return -1;
+    unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    if (head - queue->cached_tail >= queue->capacity) {
+        queue->cached_tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+        if (head - queue->cached_tail >= queue->capacity) {
+            queue->full++;
+            return -1;
+        }
+    }
+    queue->slots[head & queue->mask] = *view;
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+
+    queue->pushed++;
+    int depth = (int)(head + 1 - queue->cached_tail);
+    if (depth > queue->max_depth) queue->max_depth = depth;
+    return 0;
+}
+
+int package_queue_pop_batch(PackageQueue* queue, PackageView* out, int max) {
+    if (!queue || !out || max <= 0) return 0;
+    unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    if (queue->cached_head == tail) {
+        queue->cached_head = atomic_load_explicit(&queue->head, memory_order_acquire);
+        if (queue->cached_head == tail) return 0;
+    }
+    unsigned int ready = queue->cached_head - tail;
+    int n = ready < (unsigned int)max ? (int)ready : max;
+    for (int i = 0; i < n; i++) {
+        out[i] = queue->slots[(tail + i) & queue->mask];
+    }
+    atomic_store_explicit(&queue->tail, tail + n, memory_order_release);
+
+    queue->popped += n;
+    queue->batches++;
+    return n;
+}
+
+int package_queue_count(PackageQueue* queue) {
+    if (!queue) return 0;
+    unsigned int head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    return (int)(head - tail);
+}
+
+void package_queue_get_stats(PackageQueue* queue, PackageQueueStats* stats) {
+    if (!queue || !stats) return;
+    // Counters are owned by one side each; a racy snapshot is fine for reporting
+    stats->pushed = queue->pushed;
+    stats->popped = queue->popped;
+    stats->full = queue->full;
+    stats->batches = queue->batches;
+    stats->max_depth = queue->max_depth;
+}
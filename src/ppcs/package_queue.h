@@ -0,0 +1,61 @@
+// Package Queue Header
+#ifndef PACKAGE_QUEUE_H
+#define PACKAGE_QUEUE_H
+
+#include <stdatomic.h>
+#include "stream_framer.h"
+
+// Bounded single-producer/single-consumer ring of package views.
+// The network reader is the only producer and the main loop the only
+// consumer, so head and tail are plain atomics with acquire/release
+// ordering and no lock. Each index sits on its own cache line.
+
+#define PACKAGE_QUEUE_CACHE_LINE 64
+
+typedef struct {
+    unsigned long long pushed;
+    unsigned long long popped;
+    unsigned long long full;            // Pushes rejected because the ring was full
+    unsigned long long batches;         // Non-empty pop_batch calls
+    int max_depth;                      // Highest depth seen by the producer
+} PackageQueueStats;
+
+typedef struct {
+    // Producer side
+    atomic_uint head;
+    unsigned int cached_tail;           // Producer's last view of tail
+    unsigned long long pushed;
+    unsigned long long full;
+    int max_depth;
+    char pad0[PACKAGE_QUEUE_CACHE_LINE];
+
+    // Consumer side
+    atomic_uint tail;
+    unsigned int cached_head;           // Consumer's last view of head
+    unsigned long long popped;
+    unsigned long long batches;
+    char pad1[PACKAGE_QUEUE_CACHE_LINE];
+
+    unsigned int capacity;              // Power of two
+    unsigned int mask;
+    PackageView* slots;
+} PackageQueue;
+
+// capacity is rounded up to a power of two
+PackageQueue* package_queue_create(int capacity);
+// Releases any views still queued
+void package_queue_destroy(PackageQueue* queue);
+
+// Producer: copy the view descriptor in. Returns 0, or -1 if the queue is full
+// (the view stays owned by the caller).
+int package_queue_push(PackageQueue* queue, const PackageView* view);
+
+// Consumer: move up to max ready views into out with one acquire of head.
+// Returns the number of views popped; each must be released by the caller.
+int package_queue_pop_batch(PackageQueue* queue, PackageView* out, int max);
+
+// Approximate depth; exact only from the producer or consumer thread
+int package_queue_count(PackageQueue* queue);
+void package_queue_get_stats(PackageQueue* queue, PackageQueueStats* stats);
+
+#endif // PACKAGE_QUEUE_H
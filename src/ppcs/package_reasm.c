@@ -0,0 +1,436 @@
+// Package Reassembly Implementation
+#include "package_reasm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "async_log.h"
+#include "metrics.h"
+
+#define REASM_MAX_INSTANCES 64          // Instances listed by package_reasm_print_stats
+
+typedef struct {
+    int used;
+    int cls;
+    int stream;
+    int pkg_id;
+    int skip;                   // Fragments are taken and thrown away
+    int damaged;                // Lost: fragments are taken until index 0, then dropped
+    int expected;               // Announced length, 0 if none
+    int last_index;             // Index of the last data fragment, -1 before the first
+    int step;                   // +1 or -1 once two data fragments were seen, 0 before
+    int fragments;
+    PackageBuf* buf;
+    long long last_at;          // Last fragment, for the timeout
+    long long read_at;
+    long long dequeued_at;
+    unsigned char meta[PACKAGE_REASM_META_MAX];
+    void* user;
+} ReasmEntry;
+
+struct PackageReasm {
+    char name[64];
+    int max_open;
+    int max_len;
+    int flags;
+    long long timeout_us;
+    int open;
+    ReasmStats stats;
+    ReasmEntry* entries;
+    PackageBuf** reserved;      // One per entry after package_reasm_reserve, else NULL
+};
+
+static PackageReasm* g_instances[REASM_MAX_INSTANCES];
+
+PackageReasm* package_reasm_create(const char* name, int max_open, int max_len, int timeout_ms, int flags) {
+    if (max_open <= 0 || max_len <= 0) return NULL;
+    PackageReasm* r = (PackageReasm*)calloc(1, sizeof(PackageReasm));
+    if (!r) return NULL;
+    r->entries = (ReasmEntry*)calloc((size_t)max_open, sizeof(ReasmEntry));
+    r->reserved = (PackageBuf**)calloc((size_t)max_open, sizeof(PackageBuf*));
+    if (!r->entries || !r->reserved) {
+        free(r->entries);
+        free(r->reserved);
+        free(r);
+        return NULL;
+    }
+    strncpy(r->name, name ? name : "reasm", sizeof(r->name) - 1);
+    r->max_open = max_open;
+    r->max_len = max_len;
+    r->flags = flags;
+    r->timeout_us = (long long)(timeout_ms > 0 ? timeout_ms : PACKAGE_REASM_TIMEOUT_MS) * 1000;
+    for (int i = 0; i < REASM_MAX_INSTANCES; i++) {
+        if (!g_instances[i]) {
+            g_instances[i] = r;
+            break;
+        }
+    }
+    return r;
+}
+
+static void reasm_clear(PackageReasm* r, ReasmEntry* e) {
+    package_buf_release(e->buf);
+    memset(e, 0, sizeof(*e));
+    r->open--;
+}
+
+void package_reasm_reset(PackageReasm* r) {
+    if (!r) return;
+    for (int i = 0; i < r->max_open; i++) {
+        if (r->entries[i].used) reasm_clear(r, &r->entries[i]);
+    }
+}
+
+void package_reasm_destroy(PackageReasm* r) {
+    if (!r) return;
+    package_reasm_reset(r);
+    package_reasm_reserve(r, 0, 0);
+    for (int i = 0; i < REASM_MAX_INSTANCES; i++) {
+        if (g_instances[i] == r) g_instances[i] = NULL;
+    }
+    free(r->entries);
+    free(r->reserved);
+    free(r);
+}
+
+int package_reasm_reserve(PackageReasm* r, int max_len, int size) {
+    if (!r || size < 0) return -1;
+    if (max_len > 0) r->max_len = max_len;
+    // Buffers still held by a consumer are freed when it releases them
+    for (int i = 0; i < r->max_open; i++) {
+        package_buf_release(r->reserved[i]);
+        r->reserved[i] = NULL;
+    }
+    if (size == 0) return 0;
+    for (int i = 0; i < r->max_open; i++) {
+        r->reserved[i] = package_buf_alloc(size);
+        if (!r->reserved[i]) {
+            package_reasm_reserve(r, 0, 0);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Keep the entry open so its remaining fragments are recognised, but drop the data
+static void reasm_damage(PackageReasm* r, ReasmEntry* e, unsigned long long* counter, const char* why) {
+    (*counter)++;
+    e->damaged = 1;
+    package_buf_release(e->buf);
+    e->buf = NULL;
+    LOG_RATELIMITED(LOG_LEVEL_WARN, "Reasm", 2, "%s: payload %d (class %d, stream %d) lost: %s after %d fragments",
+                    r->name, e->pkg_id, e->cls, e->stream, why, e->fragments);
+}
+
+static void reasm_expire(PackageReasm* r, long long now) {
+    if (r->open == 0) return;
+    for (int i = 0; i < r->max_open; i++) {
+        ReasmEntry* e = &r->entries[i];
+        if (!e->used || now - e->last_at <= r->timeout_us) continue;
+        if (!e->skip && !e->damaged) {
+            r->stats.expired++;
+            LOG_RATELIMITED(LOG_LEVEL_WARN, "Reasm", 2, "%s: payload %d (class %d, stream %d) expired after %d fragments",
+                            r->name, e->pkg_id, e->cls, e->stream, e->fragments);
+        }
+        reasm_clear(r, e);
+    }
+}
+
+// Free entry, or the least recently fed one when all are in use
+static ReasmEntry* reasm_slot(PackageReasm* r) {
+    ReasmEntry* oldest = NULL;
+    for (int i = 0; i < r->max_open; i++) {
+        ReasmEntry* e = &r->entries[i];
+        if (!e->used) {
+            r->open++;
+            if (r->open > r->stats.max_open) r->stats.max_open = r->open;
+            e->used = 1;
+            return e;
+        }
+        if (!oldest || e->last_at < oldest->last_at) oldest = e;
+    }
+    if (!oldest->skip && !oldest->damaged) {
+        r->stats.expired++;
+        LOG_RATELIMITED(LOG_LEVEL_WARN, "Reasm", 2, "%s: %d payloads open, dropped payload %d (class %d, stream %d)",
+                        r->name, r->max_open, oldest->pkg_id, oldest->cls, oldest->stream);
+    }
+    reasm_clear(r, oldest);
+    r->open++;
+    oldest->used = 1;
+    return oldest;
+}
+
+static ReasmEntry* reasm_find(PackageReasm* r, int cls, int pkg_id) {
+    if (r->open == 0) return NULL;
+    for (int i = 0; i < r->max_open; i++) {
+        ReasmEntry* e = &r->entries[i];
+        if (e->used && e->cls == cls && e->pkg_id == pkg_id) return e;
+    }
+    return NULL;
+}
+
+// Fragment indexes run by one towards 0, in either direction: learn the
+// direction from the first two and treat any other step as a lost fragment.
+static int reasm_index_ok(ReasmEntry* e, int index) {
+    if (e->last_index < 0) {
+        e->last_index = index;
+        return 1;
+    }
+    if (index == 0) return e->step != -1 || e->last_index == 1;
+    int delta = index - e->last_index;
+    if (e->step == 0) {
+        if (delta != 1 && delta != -1) return 0;
+        e->step = delta;
+    } else if (delta != e->step) {
+        return 0;
+    }
+    e->last_index = index;
+    return 1;
+}
+
+// The entry's reserved buffer, if it is large enough and its last payload was released
+static PackageBuf* reasm_take_reserved(PackageReasm* r, ReasmEntry* e, int size) {
+    PackageBuf* buf = r->reserved[e - r->entries];
+    if (!buf || size > buf->capacity || atomic_load_explicit(&buf->refcount, memory_order_acquire) != 1) return NULL;
+    buf->len = 0;
+    r->stats.reserved++;
+    return package_buf_ref(buf);
+}
+
+// Bytes kept free after a payload for its terminator or padding
+static int reasm_tail_room(const PackageReasm* r) {
+    if (r->flags & REASM_PAD) return PACKAGE_REASM_PADDING;
+    return (r->flags & REASM_TERMINATE) ? 1 : 0;
+}
+
+static int reasm_append(PackageReasm* r, ReasmEntry* e, const PackageView* pkg, int offset, int len) {
+    int reserve = reasm_tail_room(r);
+    if (!e->buf) {
+        int cap = e->expected > 0 && e->expected <= r->max_len ? e->expected : PACKAGE_REASM_INITIAL;
+        if (cap < len) cap = len;
+        if (cap > r->max_len) cap = r->max_len;
+        e->buf = reasm_take_reserved(r, e, cap + reserve);
+        if (!e->buf) e->buf = package_buf_alloc(cap + reserve);
+        if (!e->buf) return -1;
+    }
+    return package_view_append(pkg, offset, len, &e->buf, r->max_len);
+}
+
+// Zeroed terminator or padding after the payload, moving to a larger buffer if it is full
+static int reasm_terminate(PackageBuf** buf, int room) {
+    PackageBuf* b = *buf;
+    if (b->len + room > b->capacity) {
+        PackageBuf* bigger = package_buf_alloc(b->len + room);
+        if (!bigger) return -1;
+        memcpy(bigger->data, b->data, b->len);
+        package_pool_count_copy(b->len);
+        bigger->len = b->len;
+        package_buf_release(b);
+        *buf = b = bigger;
+    }
+    memset(b->data + b->len, 0, room);
+    return 0;
+}
+
+static void reasm_fill(ReasmPayload* out, const ReasmEntry* e) {
+    out->cls = e->cls;
+    out->stream = e->stream;
+    out->pkg_id = e->pkg_id;
+    out->fragments = e->fragments;
+    out->read_at = e->read_at;
+    out->dequeued_at = e->dequeued_at;
+    memcpy(out->meta, e->meta, sizeof(out->meta));
+    out->user = e->user;
+}
+
+static int reasm_short(PackageReasm* r, const ReasmEntry* e, int len) {
+    if (e->expected <= 0 || len >= e->expected) return 0;
+    r->stats.lost_short++;
+    LOG_RATELIMITED(LOG_LEVEL_WARN, "Reasm", 2, "%s: payload %d (class %d, stream %d) lost: %d of %d bytes in %d fragments",
+                    r->name, e->pkg_id, e->cls, e->stream, len, e->expected, e->fragments);
+    return 1;
+}
+
+// Index 0 arrived for an open entry
+static int reasm_finish(PackageReasm* r, ReasmEntry* e, ReasmPayload* out) {
+    int len = e->buf ? e->buf->len : 0;
+    if (e->damaged || reasm_short(r, e, len)) {
+        reasm_clear(r, e);
+        return REASM_DROPPED;
+    }
+    if (len == 0 || (reasm_tail_room(r) > 0 && reasm_terminate(&e->buf, reasm_tail_room(r)) < 0)) {
+        reasm_clear(r, e);
+        return REASM_PENDING;
+    }
+    reasm_fill(out, e);
+    out->buf = e->buf;
+    out->data = e->buf->data;
+    out->len = len;
+    e->buf = NULL;
+    reasm_clear(r, e);
+    r->stats.completed++;
+    r->stats.bytes += (unsigned long long)len;
+    return REASM_COMPLETE;
+}
+
+// Whole payload in one package: point into the ring when possible
+static int reasm_single(PackageReasm* r, ReasmEntry* e, const PackageView* pkg, int offset, int len,
+                        ReasmPayload* out) {
+    if (len > r->max_len) {
+        r->stats.overflows++;
+        return REASM_DROPPED;
+    }
+    if (reasm_short(r, e, len)) return REASM_DROPPED;
+    reasm_fill(out, e);
+    int room = reasm_tail_room(r);
+    const unsigned char* data = room > 0 ? NULL : package_view_data(pkg, offset, len);
+    if (data) {
+        out->buf = NULL;
+        out->data = data;
+    } else {
+        // Wraps the ring end, or needs a terminator or padding: gather it once
+        out->buf = package_buf_alloc(len + (room > 0 ? room : 1));
+        if (!out->buf) return REASM_DROPPED;
+        package_view_copy(pkg, offset, out->buf->data, len);
+        out->buf->len = len;
+        memset(out->buf->data + len, 0, room > 0 ? room : 1);
+        out->data = out->buf->data;
+    }
+    out->len = len;
+    r->stats.completed++;
+    r->stats.bytes += (unsigned long long)len;
+    return REASM_COMPLETE;
+}
+
+static int reasm_start(PackageReasm* r, int cls, int stream, const PackageView* pkg, int offset, int len,
+                       int expected_len, const void* meta, int meta_len, void* user, int skip, long long now,
+                       ReasmPayload* out) {
+    int index = pkg->header.u16PkgIndex;
+    if (skip) {
+        r->stats.skipped++;
+        if (index == 0) return REASM_PENDING;
+    }
+
+    ReasmEntry tmp;
+    memset(&tmp, 0, sizeof(tmp));
+    tmp.cls = cls;
+    tmp.stream = stream;
+    tmp.pkg_id = pkg->header.u16PkgId;
+    tmp.skip = skip;
+    tmp.expected = expected_len > 0 ? expected_len : 0;
+    tmp.last_index = len > 0 ? index : -1;
+    tmp.fragments = 1;
+    tmp.last_at = now;
+    tmp.read_at = pkg->read_at;
+    tmp.dequeued_at = pkg->dequeued_at;
+    if (meta && meta_len > 0) memcpy(tmp.meta, meta, meta_len < PACKAGE_REASM_META_MAX ? meta_len : PACKAGE_REASM_META_MAX);
+    tmp.user = user;
+
+    if (index == 0 && len > 0 && !skip) return reasm_single(r, &tmp, pkg, offset, len, out);
+
+    ReasmEntry* e = reasm_slot(r);
+    tmp.used = 1;
+    *e = tmp;
+    if (skip || len <= 0) return REASM_PENDING;
+    if (reasm_append(r, e, pkg, offset, len) < 0) {
+        reasm_damage(r, e, &r->stats.overflows, "too large");
+        return REASM_DROPPED;
+    }
+    return REASM_PENDING;
+}
+
+static long long reasm_now(const PackageView* pkg) {
+    return pkg->dequeued_at ? pkg->dequeued_at : metrics_now_us();
+}
+
+int package_reasm_begin(PackageReasm* r, int cls, int stream, const PackageView* pkg, int offset, int len,
+                        int expected_len, const void* meta, int meta_len, void* user, int skip, ReasmPayload* out) {
+    if (!r || !pkg || !out) return REASM_DROPPED;
+    long long now = reasm_now(pkg);
+    reasm_expire(r, now);
+    r->stats.fragments++;
+
+    // A stream starting over abandons the payload it left unfinished
+    for (int i = 0; !(r->flags & REASM_KEEP_OPEN) && r->open > 0 && i < r->max_open; i++) {
+        ReasmEntry* e = &r->entries[i];
+        if (!e->used || e->cls != cls || e->stream != stream) continue;
+        if (!e->skip && !e->damaged) {
+            r->stats.superseded++;
+            LOG_RATELIMITED(LOG_LEVEL_WARN, "Reasm", 2, "%s: payload %d (class %d, stream %d) lost: next one began after %d fragments",
+                            r->name, e->pkg_id, e->cls, e->stream, e->fragments);
+        }
+        reasm_clear(r, e);
+    }
+    return reasm_start(r, cls, stream, pkg, offset, len, expected_len, meta, meta_len, user, skip, now, out);
+}
+
+int package_reasm_add(PackageReasm* r, int cls, const PackageView* pkg, int offset, int len, ReasmPayload* out) {
+    if (!r || !pkg || !out) return REASM_DROPPED;
+    long long now = reasm_now(pkg);
+    reasm_expire(r, now);
+    r->stats.fragments++;
+
+    int index = pkg->header.u16PkgIndex;
+    ReasmEntry* e = reasm_find(r, cls, pkg->header.u16PkgId);
+    if (!e) {
+        if (r->flags & REASM_OPEN_ANY) return reasm_start(r, cls, 0, pkg, offset, len, 0, NULL, 0, NULL, 0, now, out);
+        r->stats.orphans++;
+        LOG_RATELIMITED(LOG_LEVEL_WARN, "Reasm", 2, "%s: no open payload for fragment %d of %d (class %d)",
+                        r->name, index, pkg->header.u16PkgId, cls);
+        return REASM_DROPPED;
+    }
+    e->last_at = now;
+    e->fragments++;
+    if (e->skip) {
+        r->stats.skipped++;
+        if (index == 0) reasm_clear(r, e);
+        return REASM_PENDING;
+    }
+    if (!e->damaged && len > 0) {
+        if (!reasm_index_ok(e, index)) {
+            reasm_damage(r, e, &r->stats.lost_gap, "fragment index skipped");
+        } else if (reasm_append(r, e, pkg, offset, len) < 0) {
+            reasm_damage(r, e, &r->stats.overflows, "too large");
+        }
+    }
+    if (index == 0) return reasm_finish(r, e, out);
+    return e->damaged ? REASM_DROPPED : REASM_PENDING;
+}
+
+void package_reasm_payload_release(ReasmPayload* payload) {
+    if (!payload) return;
+    package_buf_release(payload->buf);
+    payload->buf = NULL;
+    payload->data = NULL;
+    payload->len = 0;
+}
+
+int package_reasm_open_count(PackageReasm* r) {
+    return r ? r->open : 0;
+}
+
+int package_reasm_has(PackageReasm* r, int cls, int pkg_id) {
+    return r && reasm_find(r, cls, pkg_id) != NULL;
+}
+
+unsigned long long package_reasm_lost(const ReasmStats* s) {
+    return s->lost_gap + s->lost_short + s->superseded + s->expired + s->overflows;
+}
+
+void package_reasm_get_stats(PackageReasm* r, ReasmStats* stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    if (r) *stats = r->stats;
+}
+
+void package_reasm_print_stats(void) {
+    for (int i = 0; i < REASM_MAX_INSTANCES; i++) {
+        PackageReasm* r = g_instances[i];
+        if (!r || r->stats.fragments == 0) continue;
+        const ReasmStats* s = &r->stats;
+        unsigned long long lost = package_reasm_lost(s);
+        printf("[Reasm] %s: %llu payloads from %llu fragments (%.2f MB, %llu in reserved buffers), lost %llu (%.3f%%): %llu gap / %llu short / %llu superseded / %llu expired / %llu too large, %llu orphan and %llu skipped fragments, max %d open\n",
+               r->name, s->completed, s->fragments, (double)s->bytes / (1024 * 1024), s->reserved, lost,
+               s->completed + lost ? 100.0 * lost / (s->completed + lost) : 0.0, s->lost_gap, s->lost_short,
+               s->superseded, s->expired, s->overflows, s->orphans, s->skipped, s->max_open);
+    }
+}
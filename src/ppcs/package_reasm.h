@@ -0,0 +1,106 @@
+// Package Reassembly Header
+#ifndef PACKAGE_REASM_H
+#define PACKAGE_REASM_H
+
+#include "stream_framer.h"
+#include "package_pool.h"
+
+// Fragment reassembly shared by every package class. A payload is opened by
+// its first package (the one with the sub-header), keyed by class, stream
+// and u16PkgId, and completed by the fragment with u16PkgIndex 0. Several
+// payloads may be open at once, so streams interleaved on the wire no longer
+// corrupt each other; a stream starting a new payload abandons its previous
+// unfinished one.
+//
+// A payload is dropped as lost when its fragment indexes skip, when it ends
+// shorter than the length announced in the sub-header, or when no fragment
+// arrives for timeout_ms. Buffers come from the package pool and grow as
+// fragments arrive, unless the instance reserves its own (see
+// package_reasm_reserve); a payload in a single package is delivered
+// straight from the receive ring.
+//
+// One instance per consumer, used from the dispatching (main loop) thread.
+
+#define PACKAGE_REASM_META_MAX 32       // Sub-header bytes kept with an open payload
+#define PACKAGE_REASM_INITIAL 16384     // First buffer when no length is announced
+#define PACKAGE_REASM_TIMEOUT_MS 3000   // Idle time before an open payload is dropped
+#define PACKAGE_REASM_PADDING 64        // Zeroed bytes after a REASM_PAD payload (AV_INPUT_BUFFER_PADDING_SIZE)
+
+// Flags for package_reasm_create
+#define REASM_OPEN_ANY   0x01           // A fragment with no open payload opens one (no sub-header classes)
+#define REASM_TERMINATE  0x02           // Completed payloads are gathered and NUL-terminated
+#define REASM_KEEP_OPEN  0x04           // A stream may have several payloads open; a new one does not abandon the last
+#define REASM_PAD        0x08           // Completed payloads are in a buffer, followed by PACKAGE_REASM_PADDING zero bytes
+
+// package_reasm_begin/package_reasm_add results
+#define REASM_PENDING    0              // Fragment taken, nothing to deliver (more to come, or skipped)
+#define REASM_COMPLETE   1              // out holds the payload; release it
+#define REASM_DROPPED    (-1)           // Fragment of a lost payload, or with no open payload
+
+typedef struct {
+    int cls;                            // PKG_TYPE_*
+    int stream;
+    int pkg_id;
+    const unsigned char* data;
+    int len;
+    PackageBuf* buf;                    // Holds data; NULL if data points into the package (valid while it is held)
+    int fragments;
+    long long read_at;                  // Timestamps of the first fragment
+    long long dequeued_at;
+    unsigned char meta[PACKAGE_REASM_META_MAX];
+    void* user;
+} ReasmPayload;
+
+typedef struct {
+    unsigned long long completed;
+    unsigned long long fragments;
+    unsigned long long bytes;           // Payload bytes delivered
+    unsigned long long lost_gap;        // Dropped: a fragment index was skipped
+    unsigned long long lost_short;      // Dropped: ended shorter than the announced length
+    unsigned long long superseded;      // Dropped: the stream started a new payload first
+    unsigned long long expired;         // Dropped: no fragment for timeout_ms, or no free slot
+    unsigned long long orphans;         // Fragments with no open payload
+    unsigned long long overflows;       // Dropped: larger than max_len
+    unsigned long long skipped;         // Fragments of payloads begun with skip set
+    unsigned long long reserved;        // Payloads built in a reserved buffer
+    int max_open;
+} ReasmStats;
+
+typedef struct PackageReasm PackageReasm;
+
+// max_open payloads at once, each up to max_len bytes; timeout_ms <= 0 uses
+// PACKAGE_REASM_TIMEOUT_MS. Create and destroy on the main thread.
+PackageReasm* package_reasm_create(const char* name, int max_open, int max_len, int timeout_ms, int flags);
+void package_reasm_destroy(PackageReasm* reasm);
+// Drop every open payload, e.g. when the session they came from was reopened
+void package_reasm_reset(PackageReasm* reasm);
+
+// First package of a payload: data at offset..offset+len of pkg, the length
+// the sub-header announces (0 if none), and the sub-header bytes to keep.
+// A package with only the sub-header (len 0) opens the payload even if its
+// index is 0. With skip set the payload is only tracked so that its
+// fragments are taken and thrown away. Empty payloads are never delivered.
+int package_reasm_begin(PackageReasm* reasm, int cls, int stream, const PackageView* pkg, int offset, int len,
+                        int expected_len, const void* meta, int meta_len, void* user, int skip, ReasmPayload* out);
+
+// Later fragment of the payload with pkg's u16PkgId
+int package_reasm_add(PackageReasm* reasm, int cls, const PackageView* pkg, int offset, int len, ReasmPayload* out);
+
+// Resize for a new stream format: payloads up to max_len (kept if <= 0),
+// and one buffer of reserve_len bytes per slot, allocated now and reused
+// for every payload that fits once its consumer has released it, so the
+// stream reassembles without touching the pool. reserve_len 0 gives the
+// buffers back. Returns -1 if they cannot be allocated.
+int package_reasm_reserve(PackageReasm* reasm, int max_len, int reserve_len);
+
+void package_reasm_payload_release(ReasmPayload* payload);
+int package_reasm_open_count(PackageReasm* reasm);
+// Whether a payload with this u16PkgId is open, to route fragments between instances
+int package_reasm_has(PackageReasm* reasm, int cls, int pkg_id);
+void package_reasm_get_stats(PackageReasm* reasm, ReasmStats* stats);
+// Payloads dropped for any reason
+unsigned long long package_reasm_lost(const ReasmStats* stats);
+// One line per instance still alive
+void package_reasm_print_stats(void);
+
+#endif // PACKAGE_REASM_H
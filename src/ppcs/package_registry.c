@@ -0,0 +1,94 @@
+// Package Registry Implementation
+#include "package_registry.h"
+#include <stdio.h>
+#include <string.h>
+#include "async_log.h"
+
+static PackageClass s_classes[PKG_REGISTRY_MAX];       // Indexed by type
+// Magics and their types packed together: classification scans these only
+static uint32_t s_magics[PKG_REGISTRY_MAX];
+static int s_magic_types[PKG_REGISTRY_MAX];
+static int s_count = 0;
+
+int package_registry_register(uint32_t magic, int type, const char* name, int sub_header_len, PackageHandler handler) {
+    if (type <= 0 || type >= PKG_REGISTRY_MAX || s_classes[type].type) {
+        printf("[Registry] ERROR: Package type %d is invalid or already registered\n", type);
+        return -1;
+    }
+    if (package_registry_classify(magic)) {
+        printf("[Registry] ERROR: Magic 0x%08X is already registered\n", magic);
+        return -1;
+    }
+    PackageClass* cls = &s_classes[type];
+    cls->magic = magic;
+    cls->type = type;
+    cls->name = name ? name : "?";
+    cls->sub_header_len = sub_header_len;
+    cls->handler = handler;
+    s_magics[s_count] = magic;
+    s_magic_types[s_count] = type;
+    s_count++;
+    return 0;
+}
+
+int package_registry_classify(uint32_t magic) {
+    for (int i = 0; i < s_count; i++) {
+        if (s_magics[i] == magic) return s_magic_types[i];
+    }
+    return 0;
+}
+
+int package_registry_classify_prefix(const unsigned char* prefix) {
+    uint32_t magic;
+    memcpy(&magic, prefix, sizeof(magic));
+    return package_registry_classify(magic);
+}
+
+const PackageClass* package_registry_get(int type) {
+    if (type <= 0 || type >= PKG_REGISTRY_MAX || !s_classes[type].type) return NULL;
+    return &s_classes[type];
+}
+
+const char* package_registry_name(int type) {
+    const PackageClass* cls = package_registry_get(type);
+    return cls ? cls->name : "UNKNOWN";
+}
+
+int package_registry_magics(uint32_t* magics, int max) {
+    int n = s_count < max ? s_count : max;
+    memcpy(magics, s_magics, n * sizeof(uint32_t));
+    return n;
+}
+
+int package_registry_payload_offset(const PackageView* pkg) {
+    const PackageClass* cls = package_registry_get(pkg->type);
+    int offset = PKG_HEADER_TOTAL_LEN;
+    if (cls && pkg->header.u8PkgSubHead == 1) offset += cls->sub_header_len;
+    return offset;
+}
+
+int package_registry_dispatch(const PackageView* pkg, const PackageContext* ctx) {
+    PackageClass* cls = (PackageClass*)package_registry_get(pkg->type);
+    if (!cls || !cls->handler) {
+        LOG_RATELIMITED(LOG_LEVEL_WARN, "Registry", 2, "%s sent package type %d with no handler",
+                        ctx && ctx->did ? ctx->did : "?", pkg->type);
+        return -1;
+    }
+    cls->packages++;
+    cls->bytes += (unsigned long long)pkg->len;
+    if (pkg->header.u8PkgSubHead == 1 && pkg->len < PKG_MIN_LEN + cls->sub_header_len) {
+        cls->truncated++;
+        LOG_RATELIMITED(LOG_LEVEL_WARN, "Registry", 2, "%s package 0x%04X too short for its sub-header (%d bytes)",
+                        cls->name, pkg->header.u16PkgId, pkg->len);
+        return -1;
+    }
+    return cls->handler(pkg, ctx);
+}
+
+void package_registry_print_stats(void) {
+    for (int i = 0; i < s_count; i++) {
+        const PackageClass* cls = &s_classes[s_magic_types[i]];
+        printf("[Registry] %-9s %llu packages, %llu bytes, %llu truncated\n",
+               cls->name, cls->packages, cls->bytes, cls->truncated);
+    }
+}
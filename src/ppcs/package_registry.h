@@ -0,0 +1,61 @@
+// Package Registry Header
+#ifndef PACKAGE_REGISTRY_H
+#define PACKAGE_REGISTRY_H
+
+#include <stdint.h>
+#include "stream_framer.h"
+
+// One table for everything keyed by a package's 4-byte prefix. The framer
+// classifies each package once by its magic (the prefix read as a uint32)
+// and carries the result in PackageView.type; the consumer dispatches on
+// that type and never looks at the prefix bytes again.
+//
+// Subsystems register their package class at startup, before any session
+// starts reading; the table is not locked.
+
+#define PKG_REGISTRY_MAX 8          // Classes, type ids 1..PKG_REGISTRY_MAX-1
+
+// The session a package came from, as handlers see it
+typedef struct {
+    const char* did;
+    void* app;                      // AppContext* of the session
+    void* video_mgr;                // VideoStreamManager* of the session
+} PackageContext;
+
+typedef int (*PackageHandler)(const PackageView* pkg, const PackageContext* ctx);
+
+typedef struct {
+    uint32_t magic;                 // PKG_*_MAGIC
+    int type;                       // PKG_TYPE_*
+    const char* name;
+    int sub_header_len;             // Bytes after the common header when u8PkgSubHead is 1
+    PackageHandler handler;
+    // Dispatch counters, consumer thread only
+    unsigned long long packages;
+    unsigned long long bytes;
+    unsigned long long truncated;   // Too short for their sub-header, not handed on
+} PackageClass;
+
+// Returns 0, or -1 if the magic or type is already taken or out of range
+int package_registry_register(uint32_t magic, int type, const char* name, int sub_header_len, PackageHandler handler);
+
+// Type for a magic, 0 if none is registered
+int package_registry_classify(uint32_t magic);
+// Same for prefix bytes; they need not be aligned
+int package_registry_classify_prefix(const unsigned char* prefix);
+
+const PackageClass* package_registry_get(int type);
+const char* package_registry_name(int type);
+// Registered magics in registration order, for the framer's resync scan
+int package_registry_magics(uint32_t* magics, int max);
+
+// Offset of the payload: the common header, plus the sub-header if present
+int package_registry_payload_offset(const PackageView* pkg);
+
+// Hand a package to its class handler. Returns the handler's result, or
+// -1 if the class has no handler or the package is truncated.
+int package_registry_dispatch(const PackageView* pkg, const PackageContext* ctx);
+
+void package_registry_print_stats(void);
+
+#endif // PACKAGE_REGISTRY_H
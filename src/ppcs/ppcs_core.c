@@ -2,18 +2,89 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <windows.h>
+#include "platform.h"
 #include "PPCS_API.h"
 #include "PPCS_Error.h"
 #include "protocol_defs.h"
+#include "stream_framer.h"
+#include "package_registry.h"
+#include "package_queue.h"
+#include "async_log.h"
+#include "metrics.h"
+#include "connector.h"
+#include "capture_file.h"
 
 // Use unified protocol definitions
 typedef PackageHeader_t TAG_PKG_HEADER_S;
 typedef PackageTail_t TAG_PKG_TAIL_S;
 
-// Globals for package queue and network thread
-typedef struct PackageNode { unsigned char* data; int len; struct PackageNode* next; } PackageNode;
-static PackageNode* g_pkg_head = NULL; static PackageNode* g_pkg_tail = NULL; static CRITICAL_SECTION g_pkg_cs; static HANDLE g_pkg_event = NULL; static HANDLE g_net_thread = NULL; static volatile int g_net_thread_run = 0;
+#define NET_RECV_BUFFER_SIZE (4*1024*1024)
+#define NET_READ_CHUNK_SIZE 4096          // Request size while nothing is pending
+#define NET_READ_IDLE_TIMEOUT_MS 50        // Short wait used only when the buffer is empty
+#define NET_READ_BULK_TIMEOUT_MS 10        // Pending bytes are already buffered by the API
+#define NET_QUEUE_CAPACITY 4096            // Per lane
+// Share of a pop batch given to bulk packages once commands are drained
+#define LANE_VIDEO_WEIGHT 3
+#define LANE_BULK_WEIGHT 1
+#define INGEST_STREAM_COUNT 5              // Video stream types 1..5
+#define NET_RECOVERY_POLL_MS 50            // Readers idle in these steps while a session reconnects
+
+// Session state; only the reader that moves it to RECOVERING reconnects
+#define SESSION_UP 0
+#define SESSION_RECOVERING 1
+#define SESSION_FAILED 2                   // Recovery gave up; readers idle until stopped
+
+// Per-stream shedding state, reader thread only
+typedef struct {
+    int waiting_for_iframe;     // Shedding: drop every frame until the next I-frame
+    int dropping_frame;         // The frame with drop_pkg_id is being discarded
+    uint16_t drop_pkg_id;
+    uint16_t frame_pkg_id;      // Frame currently being delivered, to place corrupt fragments
+} IngestShedState;
+
+// One PPCS channel of a session: its own reader thread, framer and lanes,
+// so a download on one channel never blocks the framing of another
+typedef struct {
+    struct PPCSSession* session;
+    UCHAR channel;
+    HANDLE thread;
+    StreamFramer* framer;
+    PackageQueue* lanes[PKG_LANE_COUNT];
+    NetReadStats read_stats;
+    IngestShedState shed_state[INGEST_STREAM_COUNT];
+    IngestDropStats drop_stats[INGEST_STREAM_COUNT];
+} NetChannel;
+
+// One connected device: a reader per mapped channel, all feeding one consumer
+struct PPCSSession {
+    INT32 handle;
+    char did[MAX_CONFIG_VALUE_LEN];
+    NetChannel channels[PPCS_MAX_CHANNELS];
+    int channel_count;
+    int pop_next;                                   // Channel rotation for the consumer
+    int checksum_mode;                              // CHECKSUM_*
+    HANDLE pkg_event;
+    volatile int net_thread_run;
+    PackageLaneStats lane_stats[PKG_LANE_COUNT];    // Delay fields: consumer thread only
+
+    // Ingest budget: bytes pinned by queued/in-flight views and queued package count
+    int ingest_max_bytes;
+    int ingest_max_packets;
+    volatile LONG ingest_bytes;
+
+    // Recovery: handle is replaced under the readers, generation tells them
+    const Config* config;
+    volatile LONG state;                            // SESSION_*
+    volatile LONG generation;
+    long long lost_at;
+    SessionRecoveryStats recovery;                  // Written by the recovering reader
+
+    CommandWriter* writer;                          // Outbound commands, on the command channel
+    CaptureWriter* capture;                         // Every read of every channel, when CaptureFile is set
+};
+
+// Channel used by each package class (commands also send on theirs)
+static UCHAR g_channel_map[PKG_LANE_COUNT] = { 0, 0, 0 };
 
 int read_config_value(const char* config_file, const char* key, char* value, int max_len) {
     FILE *fp = fopen(config_file, "r");
@@ -38,11 +109,36 @@ void init_config(Config *config) {
     strcpy(config->TargetDID, "");
     strcpy(config->ServerString, "");
     config->MaxNumSess = 5;
+    config->RecoveryMinMs = 500;
+    config->RecoveryMaxMs = 30000;
+    config->RecoveryMaxAttempts = 0;
     config->SessAliveSec = 6;
     config->UDPPort = 0;
     config->ConnectionMode = 0x7A;
+    strcpy(config->ConnectModes, "");
+    config->ConnectStaggerMs = 300;
+    strcpy(config->ConnectCacheFile, "connect_cache.txt");
     config->ReadTimeout = 5000;
+    config->CmdWriteMaxBuffered = CMD_WRITER_DEFAULT_MAX_BUFFERED;
+    config->CommandTimeoutMs = 5000;
+    config->CommandRetries = 2;
+    config->IngestMaxBytes = INGEST_DEFAULT_MAX_BYTES;
+    config->IngestMaxPackets = INGEST_DEFAULT_MAX_PACKETS;
+    config->FleetShowVideo = 0;
+    config->FleetAutoLive = 1;
+    config->CmdChannel = 0;
+    config->VideoChannel = 0;
+    config->BulkChannel = 0;
+    config->ChecksumMode = CHECKSUM_COUNT;
+    config->DecodeMode = 1;
+    config->DecodeThreads = 1;
+    config->DecodeThreadType = 3;
+    config->DecodeLowDelay = 0;
+    config->LogLevel = LOG_LEVEL_INFO;
     strcpy(config->APILogFile, "");
+    strcpy(config->MetricsFile, "");
+    config->MetricsIntervalSec = 60;
+    strcpy(config->CaptureFile, "");
     char value[256];
     if (read_config_value(CONFIG_FILE, "InitString", value, sizeof(value))) {
         strncpy(config->InitString, value, sizeof(config->InitString) - 1);
@@ -64,17 +160,83 @@ void init_config(Config *config) {
         config->UDPPort = atoi(value);
     if (read_config_value(CONFIG_FILE, "ConnectionMode", value, sizeof(value)))
         config->ConnectionMode = (int)strtol(value, NULL, 0);
+    if (read_config_value(CONFIG_FILE, "ConnectModes", value, sizeof(value))) {
+        strncpy(config->ConnectModes, value, sizeof(config->ConnectModes) - 1);
+        config->ConnectModes[sizeof(config->ConnectModes) - 1] = '\0';
+    }
+    if (read_config_value(CONFIG_FILE, "ConnectStaggerMs", value, sizeof(value)))
+        config->ConnectStaggerMs = atoi(value);
+    if (read_config_value(CONFIG_FILE, "ConnectCacheFile", value, sizeof(value))) {
+        strncpy(config->ConnectCacheFile, value, sizeof(config->ConnectCacheFile) - 1);
+        config->ConnectCacheFile[sizeof(config->ConnectCacheFile) - 1] = '\0';
+    }
     if (read_config_value(CONFIG_FILE, "ReadTimeout", value, sizeof(value)))
         config->ReadTimeout = atoi(value);
+    if (read_config_value(CONFIG_FILE, "CmdWriteMaxBuffered", value, sizeof(value)))
+        config->CmdWriteMaxBuffered = atoi(value);
+    if (read_config_value(CONFIG_FILE, "CommandTimeoutMs", value, sizeof(value)))
+        config->CommandTimeoutMs = atoi(value);
+    if (read_config_value(CONFIG_FILE, "CommandRetries", value, sizeof(value)))
+        config->CommandRetries = atoi(value);
+    if (read_config_value(CONFIG_FILE, "IngestMaxBytes", value, sizeof(value)))
+        config->IngestMaxBytes = atoi(value);
+    if (read_config_value(CONFIG_FILE, "IngestMaxPackets", value, sizeof(value)))
+        config->IngestMaxPackets = atoi(value);
     if (read_config_value(CONFIG_FILE, "APILogFile", value, sizeof(value))) {
         strncpy(config->APILogFile, value, sizeof(config->APILogFile) - 1);
         config->APILogFile[sizeof(config->APILogFile) - 1] = '\0';
     }
+    char fleet[MAX_FLEET_VALUE_LEN];
+    if (read_config_value(CONFIG_FILE, "FleetDIDs", fleet, sizeof(fleet))) {
+        strncpy(config->FleetDIDs, fleet, sizeof(config->FleetDIDs) - 1);
+        config->FleetDIDs[sizeof(config->FleetDIDs) - 1] = '\0';
+    }
+    if (read_config_value(CONFIG_FILE, "FleetShowVideo", value, sizeof(value)))
+        config->FleetShowVideo = atoi(value);
+    if (read_config_value(CONFIG_FILE, "FleetAutoLive", value, sizeof(value)))
+        config->FleetAutoLive = atoi(value);
+    if (read_config_value(CONFIG_FILE, "CmdChannel", value, sizeof(value)))
+        config->CmdChannel = atoi(value);
+    if (read_config_value(CONFIG_FILE, "VideoChannel", value, sizeof(value)))
+        config->VideoChannel = atoi(value);
+    if (read_config_value(CONFIG_FILE, "BulkChannel", value, sizeof(value)))
+        config->BulkChannel = atoi(value);
+    if (read_config_value(CONFIG_FILE, "ChecksumMode", value, sizeof(value)))
+        config->ChecksumMode = atoi(value);
+    if (read_config_value(CONFIG_FILE, "DecodeMode", value, sizeof(value)))
+        config->DecodeMode = atoi(value);
+    if (read_config_value(CONFIG_FILE, "DecodeThreads", value, sizeof(value)))
+        config->DecodeThreads = atoi(value);
+    if (read_config_value(CONFIG_FILE, "DecodeThreadType", value, sizeof(value)))
+        config->DecodeThreadType = atoi(value);
+    if (read_config_value(CONFIG_FILE, "DecodeLowDelay", value, sizeof(value)))
+        config->DecodeLowDelay = atoi(value);
+    if (read_config_value(CONFIG_FILE, "LogLevel", value, sizeof(value))) {
+        int level = async_log_parse_level(value);
+        if (level >= 0) config->LogLevel = level;
+        else printf("[WARNING] Unknown LogLevel '%s', using info\n", value);
+    }
+    if (read_config_value(CONFIG_FILE, "RecoveryMinMs", value, sizeof(value)))
+        config->RecoveryMinMs = atoi(value);
+    if (read_config_value(CONFIG_FILE, "RecoveryMaxMs", value, sizeof(value)))
+        config->RecoveryMaxMs = atoi(value);
+    if (read_config_value(CONFIG_FILE, "RecoveryMaxAttempts", value, sizeof(value)))
+        config->RecoveryMaxAttempts = atoi(value);
+    if (read_config_value(CONFIG_FILE, "MetricsFile", value, sizeof(value))) {
+        strncpy(config->MetricsFile, value, sizeof(config->MetricsFile) - 1);
+        config->MetricsFile[sizeof(config->MetricsFile) - 1] = '\0';
+    }
+    if (read_config_value(CONFIG_FILE, "MetricsIntervalSec", value, sizeof(value)))
+        config->MetricsIntervalSec = atoi(value);
+    if (read_config_value(CONFIG_FILE, "CaptureFile", value, sizeof(value))) {
+        strncpy(config->CaptureFile, value, sizeof(config->CaptureFile) - 1);
+        config->CaptureFile[sizeof(config->CaptureFile) - 1] = '\0';
+    }
 }
 
-int validate_config(Config *config) { if (strlen(config->InitString)==0) { printf("[ERROR] InitString not configured in %s\n", CONFIG_FILE); return 0;} if (strlen(config->TargetDID)==0) { printf("[ERROR] TargetDID not configured in %s\n", CONFIG_FILE); return 0;} if (config->MaxNumSess <1 || config->MaxNumSess>512) { printf("[WARNING] MaxNumSess out of range, using default 5\n"); config->MaxNumSess=5;} if (config->SessAliveSec <6 || config->SessAliveSec >30) { printf("[WARNING] SessAliveSec out of range, using default 6\n"); config->SessAliveSec=6;} return 1; }
+int validate_config(Config *config) { if (strlen(config->InitString)==0) { printf("[ERROR] InitString not configured in %s\n", CONFIG_FILE); return 0;} if (strlen(config->TargetDID)==0) { printf("[ERROR] TargetDID not configured in %s\n", CONFIG_FILE); return 0;} if (config->MaxNumSess <1 || config->MaxNumSess>512) { printf("[WARNING] MaxNumSess out of range, using default 5\n"); config->MaxNumSess=5;} if (config->SessAliveSec <6 || config->SessAliveSec >30) { printf("[WARNING] SessAliveSec out of range, using default 6\n"); config->SessAliveSec=6;} if (config->IngestMaxBytes < 256*1024 || config->IngestMaxBytes > NET_RECV_BUFFER_SIZE) { printf("[WARNING] IngestMaxBytes out of range, using default %d\n", INGEST_DEFAULT_MAX_BYTES); config->IngestMaxBytes=INGEST_DEFAULT_MAX_BYTES;} if (config->IngestMaxPackets < 64) { printf("[WARNING] IngestMaxPackets out of range, using default %d\n", INGEST_DEFAULT_MAX_PACKETS); config->IngestMaxPackets=INGEST_DEFAULT_MAX_PACKETS;} if (config->CmdWriteMaxBuffered < 16*1024 || config->CmdWriteMaxBuffered > 1024*1024) { printf("[WARNING] CmdWriteMaxBuffered out of range, using %d\n", CMD_WRITER_DEFAULT_MAX_BUFFERED); config->CmdWriteMaxBuffered=CMD_WRITER_DEFAULT_MAX_BUFFERED;} if (config->CommandTimeoutMs < 100 || config->CommandTimeoutMs > 120000) { printf("[WARNING] CommandTimeoutMs out of range, using 5000\n"); config->CommandTimeoutMs=5000;} if (config->CommandRetries < 0 || config->CommandRetries > 10) { printf("[WARNING] CommandRetries out of range, using 2\n"); config->CommandRetries=2;} if (config->CmdChannel < 0 || config->CmdChannel >= PPCS_MAX_CHANNELS) { printf("[WARNING] CmdChannel out of range, using 0\n"); config->CmdChannel=0;} if (config->VideoChannel < 0 || config->VideoChannel >= PPCS_MAX_CHANNELS) { printf("[WARNING] VideoChannel out of range, using 0\n"); config->VideoChannel=0;} if (config->BulkChannel < 0 || config->BulkChannel >= PPCS_MAX_CHANNELS) { printf("[WARNING] BulkChannel out of range, using 0\n"); config->BulkChannel=0;} if (config->ConnectStaggerMs < 0 || config->ConnectStaggerMs > 10000) { printf("[WARNING] ConnectStaggerMs out of range, using 300\n"); config->ConnectStaggerMs=300;} if (config->RecoveryMinMs < 0) config->RecoveryMinMs=0; if (config->RecoveryMaxMs < config->RecoveryMinMs) { printf("[WARNING] RecoveryMaxMs below RecoveryMinMs, using %d\n", config->RecoveryMinMs); config->RecoveryMaxMs=config->RecoveryMinMs;} if (config->ChecksumMode < CHECKSUM_OFF || config->ChecksumMode > CHECKSUM_DROP) { printf("[WARNING] ChecksumMode out of range, using %d\n", CHECKSUM_COUNT); config->ChecksumMode=CHECKSUM_COUNT;} if (config->DecodeMode != 0 && config->DecodeMode != 1) { printf("[WARNING] DecodeMode out of range, using 1\n"); config->DecodeMode=1;} if (config->DecodeThreads < 0 || config->DecodeThreads > 16) { printf("[WARNING] DecodeThreads out of range, using 0 (auto)\n"); config->DecodeThreads=0;} if (config->DecodeThreadType < 1 || config->DecodeThreadType > 3) { printf("[WARNING] DecodeThreadType out of range, using 3\n"); config->DecodeThreadType=3;} return 1; }
 
-void print_config(Config *config) { printf("[Configuration Loaded]\n"); printf("  InitString: %s\n", config->InitString); printf("  TargetDID: %s\n", config->TargetDID); printf("  ServerString: %s\n", strlen(config->ServerString) > 0 ? config->ServerString : "(default server)"); printf("  MaxNumSess: %d\n", config->MaxNumSess); printf("  SessAliveSec: %d\n", config->SessAliveSec); printf("  ConnectionMode: 0x%02X\n", config->ConnectionMode); printf("  ReadTimeout: %d ms\n", config->ReadTimeout); if (strlen(config->APILogFile) > 0) printf("  APILogFile: %s\n", config->APILogFile); printf("\n"); }
+void print_config(Config *config) { printf("[Configuration Loaded]\n"); printf("  InitString: %s\n", config->InitString); printf("  TargetDID: %s\n", config->TargetDID); printf("  ServerString: %s\n", strlen(config->ServerString) > 0 ? config->ServerString : "(default server)"); printf("  MaxNumSess: %d\n", config->MaxNumSess); printf("  SessAliveSec: %d\n", config->SessAliveSec); printf("  ConnectionMode: 0x%02X\n", config->ConnectionMode); if (strlen(config->ConnectModes) > 0) printf("  ConnectModes: %s (cached winner leads by %d ms)\n", config->ConnectModes, config->ConnectStaggerMs); printf("  ReadTimeout: %d ms\n", config->ReadTimeout); printf("  CmdWriteMaxBuffered: %d bytes\n", config->CmdWriteMaxBuffered); printf("  Commands: %d ms timeout, %d retries for queries\n", config->CommandTimeoutMs, config->CommandRetries); printf("  IngestBudget: %d bytes, %d packets\n", config->IngestMaxBytes, config->IngestMaxPackets); printf("  Channels: cmd %d, video %d, bulk %d\n", config->CmdChannel, config->VideoChannel, config->BulkChannel); printf("  LogLevel: %d\n", config->LogLevel); if (config->RecoveryMinMs > 0) printf("  Recovery: backoff %d..%d ms, %s\n", config->RecoveryMinMs, config->RecoveryMaxMs, config->RecoveryMaxAttempts > 0 ? "limited attempts" : "no attempt limit"); else printf("  Recovery: off\n"); printf("  ChecksumMode: %s\n", config->ChecksumMode == CHECKSUM_DROP ? "drop" : (config->ChecksumMode == CHECKSUM_COUNT ? "count" : "off")); printf("  DecodeMode: %s\n", config->DecodeMode ? "whole access units" : "parser"); printf("  DecodeThreads: %s%d, %s threading%s\n", config->DecodeThreads == 0 ? "auto " : "", config->DecodeThreads, config->DecodeThreadType == 1 ? "frame" : (config->DecodeThreadType == 2 ? "slice" : "frame or slice"), config->DecodeLowDelay ? ", low delay" : ""); if (strlen(config->APILogFile) > 0) printf("  APILogFile: %s\n", config->APILogFile); if (strlen(config->MetricsFile) > 0) printf("  MetricsFile: %s (every %d s)\n", config->MetricsFile, config->MetricsIntervalSec); if (strlen(config->CaptureFile) > 0) printf("  CaptureFile: %s_<DID>%s\n", config->CaptureFile, CAPTURE_FILE_EXT); if (strlen(config->FleetDIDs) > 0) printf("  FleetDIDs: %s (video windows %s)\n", config->FleetDIDs, config->FleetShowVideo ? "on" : "off"); printf("\n"); }
 
 const char* get_connection_mode(CHAR bMode) { switch(bMode) { case 0: return "LAN"; case 1: return "LAN-TCP"; case 2: return "P2P"; case 3: return "Relay"; case 4: return "TCP"; case 5: return "RP2P"; default: return "Unknown"; } }
 
@@ -85,235 +247,677 @@ void print_error(const char* function_name, INT32 error_code) { printf("[ERROR]
 void print_api_info() { UINT32 version = PPCS_GetAPIVersion(); printf("=====================================\n"); printf("PPCS API Version: %d.%d.%d.%d\n", (version >> 24) & 0xFF, (version >> 16) & 0xFF, (version >> 8) & 0xFF, version & 0xFF); printf("=====================================\n\n"); }
 
 // Package queue utilities
-static void push_package_to_queue(unsigned char* data, int len) {
-    PackageNode* node = (PackageNode*)malloc(sizeof(PackageNode)); if (!node) { free(data); return; }
-    node->data = data; node->len = len; node->next = NULL;
-    EnterCriticalSection(&g_pkg_cs);
-    if (g_pkg_tail) { g_pkg_tail->next = node; g_pkg_tail = node; } else { g_pkg_head = g_pkg_tail = node; }
-    LeaveCriticalSection(&g_pkg_cs);
-    if (g_pkg_event) SetEvent(g_pkg_event);
+static int package_lane(int type) {
+    switch (type) {
+    case PKG_TYPE_JSON: return PKG_LANE_CMD;
+    case PKG_TYPE_VIDEO: return PKG_LANE_VIDEO;
+    default: return PKG_LANE_BULK;   // Images and timelapse downloads
+    }
 }
 
-static PackageNode* pop_package_from_queue(void) { PackageNode* node = NULL; EnterCriticalSection(&g_pkg_cs); if (g_pkg_head) { node = g_pkg_head; g_pkg_head = g_pkg_head->next; if (!g_pkg_head) g_pkg_tail = NULL; } LeaveCriticalSection(&g_pkg_cs); return node; }
+static int ingest_over_budget(PPCSSession* s) {
+    if (s->ingest_bytes > s->ingest_max_bytes) return 1;
+    return ppcs_session_queue_depth(s) > s->ingest_max_packets;
+}
 
-// Network reader thread
-static DWORD WINAPI network_reader_thread(LPVOID lpParam) {
-    INT32 session_handle = (INT32)(intptr_t)lpParam;
-    unsigned char* recv_buffer = (unsigned char*)malloc(1024*1024);
-    if (!recv_buffer) {
-        printf("[Network] ERROR: Failed to allocate receive buffer\n");
+// Decide whether a video package is shed. Only whole frames are dropped: once
+// over budget, P-frames are discarded until the next I-frame, and a frame that
+// was admitted keeps all of its fragments. Other package classes never get here.
+static int ingest_should_drop(NetChannel* ch, const PackageView* view) {
+    PPCSSession* s = ch->session;
+    if (view->header.u8PkgSubHead != 1) {
+        // Continuation fragment: follows the decision made for its frame start
+        for (int i = 0; i < INGEST_STREAM_COUNT; i++) {
+            IngestShedState* st = &ch->shed_state[i];
+            if (st->dropping_frame && st->drop_pkg_id == view->header.u16PkgId) {
+                ch->drop_stats[i].packages_dropped++;
+                ch->drop_stats[i].bytes_dropped += (unsigned int)view->len;
+                if (view->header.u16PkgIndex == 0) st->dropping_frame = 0;
+                return 1;
+            }
+        }
         return 0;
     }
+
+    VideoStreamHeader_t vh;
+    if (package_view_read(view, PKG_HEADER_TOTAL_LEN, &vh, sizeof(vh)) < 0) return 0;
+    if (vh.s8StreamType < 1 || vh.s8StreamType > INGEST_STREAM_COUNT) return 0;
+    int idx = vh.s8StreamType - 1;
+    IngestShedState* st = &ch->shed_state[idx];
+    IngestDropStats* ds = &ch->drop_stats[idx];
+    st->dropping_frame = 0;
+    st->frame_pkg_id = view->header.u16PkgId;
+
+    if (vh.s8FrameType == 1) {
+        // A keyframe always resumes the stream, even while over budget
+        if (st->waiting_for_iframe) {
+            printf("[Network] %s stream %d: resumed at I-frame after shedding\n", s->did, vh.s8StreamType);
+            st->waiting_for_iframe = 0;
+        }
+        return 0;
+    }
+    if (!st->waiting_for_iframe) {
+        if (vh.s8FrameType != 2 || !ingest_over_budget(s)) return 0;
+        st->waiting_for_iframe = 1;
+        ds->shed_events++;
+        printf("[Network] %s stream %d: ingest over budget (%ld bytes), dropping P-frames until next I-frame\n",
+               s->did, vh.s8StreamType, (long)s->ingest_bytes);
+    }
+    ds->frames_dropped++;
+    ds->packages_dropped++;
+    ds->bytes_dropped += (unsigned int)view->len;
+    if (view->header.u16PkgIndex != 0) {
+        st->dropping_frame = 1;
+        st->drop_pkg_id = view->header.u16PkgId;
+    }
+    return 1;
+}
+
+// A video package failed its checksum: drop the rest of its frame and every
+// frame after it up to the next I-frame, since they would decode against it
+static void ingest_drop_corrupt(NetChannel* ch, const PackageView* view) {
+    int idx = -1;
+    if (view->header.u8PkgSubHead == 1) {
+        VideoStreamHeader_t vh;
+        if (package_view_read(view, PKG_HEADER_TOTAL_LEN, &vh, sizeof(vh)) == 0 &&
+            vh.s8StreamType >= 1 && vh.s8StreamType <= INGEST_STREAM_COUNT) {
+            idx = vh.s8StreamType - 1;
+        }
+    } else {
+        for (int i = 0; i < INGEST_STREAM_COUNT; i++) {
+            if (ch->shed_state[i].frame_pkg_id == view->header.u16PkgId) { idx = i; break; }
+        }
+    }
+    if (idx < 0) return;    // Stream unknown (corrupt sub-header): only this package goes
+
+    IngestShedState* st = &ch->shed_state[idx];
+    IngestDropStats* ds = &ch->drop_stats[idx];
+    if (!st->waiting_for_iframe) {
+        st->waiting_for_iframe = 1;
+        ds->shed_events++;
+        ds->corrupt_events++;
+        LOG_WARN("Network", "%s stream %d: checksum mismatch on package 0x%04X, dropping until next I-frame",
+                 ch->session->did, idx + 1, view->header.u16PkgId);
+    }
+    ds->frames_dropped++;
+    ds->packages_dropped++;
+    ds->bytes_dropped += (unsigned int)view->len;
+    st->dropping_frame = view->header.u16PkgIndex != 0;
+    st->drop_pkg_id = view->header.u16PkgId;
+}
+
+// Single producer: the reader waits for the consumer rather than dropping a package
+static int push_package_to_queue(NetChannel* ch, PackageView* view) {
+    PPCSSession* s = ch->session;
+    PackageQueue* lane = ch->lanes[package_lane(view->type)];
+    view->queued_at = metrics_now_us();
+    metrics_record(MET_READ_TO_FRAMED, view->queued_at - view->read_at);
+    InterlockedExchangeAdd(&s->ingest_bytes, view->len);
+    metrics_add(MET_INGEST_BYTES, view->len);
+    while (package_queue_push(lane, view) != 0) {
+        if (!s->net_thread_run) { ppcs_session_free_package(s, view); return -1; }
+        SetEvent(s->pkg_event);
+        Sleep(1);
+    }
+    return 0;
+}
+
+// Backoff delay with equal jitter: half fixed, half random, so sessions
+// lost together do not reconnect in lockstep
+static int recovery_jitter(unsigned int* seed, int delay_ms) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    int half = delay_ms / 2;
+    return half + (int)(*seed % (unsigned int)(half + 1));
+}
+
+// Reopen a session whose handle PPCS reported closed. Runs on the reader
+// that saw the close first; readers of other channels idle until the new
+// handle is published, then discard the partial bytes of the old one.
+static void session_recover(NetChannel* ch, INT32 reason) {
+    PPCSSession* s = ch->session;
+    if (InterlockedCompareExchange(&s->state, SESSION_RECOVERING, SESSION_UP) != SESSION_UP) return;
+    long long lost_at = metrics_now_us();
+    s->lost_at = lost_at;
+    s->recovery.losses++;
+    metrics_add(MET_SESSIONS_LOST, 1);
+
+    INT32 dead = s->handle;
+    s->handle = -1;
+    PPCS_Close(dead);   // Frees the slot counted against MaxNumSess
+
+    const Config* config = s->config;
+    if (!config || config->RecoveryMinMs <= 0) {
+        printf("[Network] %s: session closed (%s), recovery disabled\n", s->did, get_error_msg(reason));
+        InterlockedExchange(&s->state, SESSION_FAILED);
+        return;
+    }
+    printf("[Network] %s: session closed (%s), reconnecting\n", s->did, get_error_msg(reason));
+
+    unsigned int seed = (unsigned int)lost_at ^ (unsigned int)(UINT_PTR)s;
+    int delay = config->RecoveryMinMs;
+    for (int attempt = 1; s->net_thread_run; attempt++) {
+        if (config->RecoveryMaxAttempts > 0 && attempt > config->RecoveryMaxAttempts) {
+            printf("[Network] %s: giving up after %d reconnect attempts\n", s->did, config->RecoveryMaxAttempts);
+            s->recovery.failed = 1;
+            InterlockedExchange(&s->state, SESSION_FAILED);
+            return;
+        }
+        int wait = recovery_jitter(&seed, delay);
+        LOG_INFO("Network", "%s: reconnect attempt %d in %d ms", s->did, attempt, wait);
+        for (int waited = 0; waited < wait && s->net_thread_run; waited += NET_RECOVERY_POLL_MS) Sleep(NET_RECOVERY_POLL_MS);
+        if (!s->net_thread_run) break;
+
+        s->recovery.attempts++;
+        INT32 handle = connector_connect(s->did, config, NULL, &s->net_thread_run);
+        if (handle >= 0 && !s->net_thread_run) {
+            PPCS_Close(handle);     // Stopped meanwhile: nobody would close it
+            break;
+        }
+        if (handle >= 0) {
+            double ms = (metrics_now_us() - lost_at) / 1000.0;
+            s->recovery.recoveries++;
+            s->recovery.last_ms = ms;
+            if (ms > s->recovery.max_ms) s->recovery.max_ms = ms;
+            metrics_add(MET_SESSIONS_RECOVERED, 1);
+            metrics_record_since(MET_RECOVERY_TIME, lost_at);
+            // Publish the handle before the state: readers load it once they see UP
+            s->handle = handle;
+            InterlockedIncrement(&s->generation);
+            InterlockedExchange(&s->state, SESSION_UP);
+            SetEvent(s->pkg_event);     // Let the consumer re-issue its stream commands
+            printf("[Network] %s: session recovered in %.0f ms (handle 0x%08X, attempt %d)\n",
+                   s->did, ms, handle, attempt);
+            return;
+        }
+        delay = delay < config->RecoveryMaxMs / 2 ? delay * 2 : config->RecoveryMaxMs;
+    }
+    // Stopped while reconnecting: leave the state as it is for session_stop_threads
+}
+
+// Network reader thread
+static DWORD WINAPI network_reader_thread(LPVOID lpParam) {
+    NetChannel* ch = (NetChannel*)lpParam;
+    PPCSSession* s = ch->session;
+    INT32 session_handle = s->handle;
+    LONG generation = s->generation;
+    StreamFramer* framer = ch->framer;
     
-    printf("[Network] ========== NETWORK THREAD STARTED ==========\n");
-    printf("[Network] Session Handle: 0x%08X\n", session_handle);
-    printf("[Network] Buffer Size: 1MB, Timeout: 500ms\n");
-    printf("[Network] =============================================\n");
+    LOG_INFO("Network", "========== NETWORK THREAD STARTED ==========");
+    LOG_INFO("Network", "Device: %s, Session Handle: 0x%08X, Channel: %d", s->did, session_handle, ch->channel);
+    LOG_INFO("Network", "Buffer Size: %dMB, Idle Timeout: %dms", NET_RECV_BUFFER_SIZE / (1024*1024), NET_READ_IDLE_TIMEOUT_MS);
+    LOG_INFO("Network", "=============================================");
     
-    int buffer_data_len = 0;
-    g_net_thread_run = 1;
     unsigned long recv_count = 0;
     unsigned long pkg_count = 0;
+    unsigned long long skipped_reported = 0;
     
-    while (g_net_thread_run) {
-        unsigned char temp_buffer[4096];
-        INT32 read_len = sizeof(temp_buffer);
-        INT32 ret = PPCS_Read(session_handle, 0, (char*)temp_buffer, &read_len, 500);
+    while (s->net_thread_run) {
+        if (s->state != SESSION_UP) {
+            Sleep(NET_RECOVERY_POLL_MS);
+            continue;
+        }
+        if (s->generation != generation) {
+            // New handle: the bytes left over belong to a stream that ended mid-package
+            generation = s->generation;
+            session_handle = s->handle;
+            LOG_INFO("Network", "%s channel %d: switching to handle 0x%08X, dropping %d buffered bytes",
+                     s->did, ch->channel, session_handle, stream_framer_used(framer));
+            stream_framer_discard(framer);
+            memset(ch->shed_state, 0, sizeof(ch->shed_state));
+            if (s->capture) capture_writer_append(s->capture, ch->channel, CAPTURE_REC_RESET, (int)generation, NULL, 0, metrics_now_us());
+        }
+        // Read straight into the ring's free space
+        unsigned char* write_ptr = NULL;
+        INT32 read_len = stream_framer_write_ptr(framer, &write_ptr);
+        if (read_len <= 0) {
+            // Consumer still holds every block: wait for views to be released
+            Sleep(1);
+            continue;
+        }
+        // Size the read from what the API already holds, so a whole frame
+        // arrives in one call; only block briefly when nothing is pending
+        UINT32 write_size = 0, pending = 0;
+        UINT32 timeout_ms = NET_READ_IDLE_TIMEOUT_MS;
+        ch->read_stats.check_calls++;
+        if (PPCS_Check_Buffer(session_handle, ch->channel, &write_size, &pending) == ERROR_PPCS_SUCCESSFUL && pending > 0) {
+            if ((UINT32)read_len > pending) read_len = (INT32)pending;
+            timeout_ms = NET_READ_BULK_TIMEOUT_MS;
+            ch->read_stats.bulk_reads++;
+        } else {
+            if (read_len > NET_READ_CHUNK_SIZE) read_len = NET_READ_CHUNK_SIZE;
+            ch->read_stats.idle_reads++;
+        }
+        INT32 ret = PPCS_Read(session_handle, ch->channel, (char*)write_ptr, &read_len, timeout_ms);
+        ch->read_stats.read_calls++;
+        if ((ret == ERROR_PPCS_SUCCESSFUL || ret == ERROR_PPCS_TIME_OUT) && read_len > 0) {
+            ch->read_stats.bytes += (unsigned long long)read_len;
+            if ((unsigned int)read_len > ch->read_stats.max_bytes_per_call) ch->read_stats.max_bytes_per_call = (unsigned int)read_len;
+        }
         
         if ((ret == ERROR_PPCS_SUCCESSFUL || ret == ERROR_PPCS_TIME_OUT) && read_len > 0) {
             recv_count++;
-            /*printf("[Network] ========== DATA RECEIVED #%lu ==========\n", recv_count);
-            printf("[Network] PPCS_Read returned: %d (SUCCESS=%d, TIMEOUT=%d)\n", ret, ERROR_PPCS_SUCCESSFUL, ERROR_PPCS_TIME_OUT);
-            printf("[Network] Bytes received: %d\n", read_len);
-            printf("[Network] Hex (first 64 bytes): ");
-            for (int i = 0; i < read_len && i < 64; i++) {
-                printf("%02X ", temp_buffer[i]);
-            }
-            if (read_len > 64) printf("...");
-            printf("\n");
-            printf("[Network] ASCII (first 64 bytes): ");
-            for (int i = 0; i < read_len && i < 64; i++) {
-                if (temp_buffer[i] >= 32 && temp_buffer[i] < 127) {
-                    printf("%c", temp_buffer[i]);
-                } else {
-                    printf(".");
-                }
-            }
-            printf("\n");*/
+            long long read_at = metrics_now_us();
+            if (s->capture) capture_writer_append(s->capture, ch->channel, CAPTURE_REC_DATA, (int)generation, write_ptr, read_len, read_at);
+            stream_framer_commit(framer, read_len);
+            package_pool_count_received(read_len);
+            metrics_add(MET_BYTES_READ, read_len);
+            LOG_RATELIMITED(LOG_LEVEL_DEBUG, "Network", 20, "Buffer updated: total %d bytes", stream_framer_used(framer));
             
-            if (buffer_data_len + read_len <= 1024*1024) {
-                memcpy(recv_buffer + buffer_data_len, temp_buffer, read_len);
-                buffer_data_len += read_len;
-                printf("[Network] Buffer updated: total %d bytes\n", buffer_data_len);
-            } else {
-                printf("[Network] ERROR: Buffer overflow, resetting\n");
-                buffer_data_len = 0;
-                continue;
-            }
-            
-            // Parse packages from buffer
+            // Parse packages in place from the ring
             int parsed_count = 0;
-            while (buffer_data_len >= 40) {
-                int is_json = (memcmp(recv_buffer, "#nsj", 4) == 0);
-                int is_video = (memcmp(recv_buffer, "$div", 4) == 0);
-                int is_image = (memcmp(recv_buffer, "$gmi", 4) == 0);
-                int is_timelapse = (memcmp(recv_buffer, "@lif", 4) == 0);
+            PackageView view;
+            while (stream_framer_next(framer, &view)) {
+                view.read_at = read_at;
+                view.generation = (int)generation;
+                metrics_add(MET_PACKAGES_READ, 1);
+                LOG_RATELIMITED(LOG_LEVEL_DEBUG, "Network", 50, "Package found: type=%s, id=0x%04X, cmd=0x%04X, len=%d, index=%d, total=%d",
+                                package_registry_name(view.type),
+                                view.header.u16PkgId, view.header.u16PkgCmd, view.header.u16PkgLen, view.header.u16PkgIndex, view.len);
                 
-                if (!is_json && !is_video && !is_image && !is_timelapse) {
-                    printf("[Network] Invalid package header at offset 0, skipping 1 byte\n");
-                    memmove(recv_buffer, recv_buffer + 1, buffer_data_len - 1);
-                    buffer_data_len--;
+                if (!view.checksum_ok && s->checksum_mode == CHECKSUM_DROP) {
+                    LOG_RATELIMITED(LOG_LEVEL_WARN, "Network", 10, "Checksum mismatch: type=%d, id=0x%04X, index=%d, len=%d, dropped",
+                                    view.type, view.header.u16PkgId, view.header.u16PkgIndex, view.len);
+                    if (view.type == PKG_TYPE_VIDEO) ingest_drop_corrupt(ch, &view);
+                    ch->read_stats.checksum_drops++;
+                    package_view_release(&view);
                     continue;
                 }
-                
-                if (buffer_data_len < 4 + sizeof(TAG_PKG_HEADER_S)) {
-                    printf("[Network] Incomplete header, need %d bytes, have %d\n", 4 + (int)sizeof(TAG_PKG_HEADER_S), buffer_data_len);
-                    break;
-                }
-                
-                TAG_PKG_HEADER_S* header = (TAG_PKG_HEADER_S*)(recv_buffer + 4);
-                int pkg_len = 4 + sizeof(TAG_PKG_HEADER_S) + header->u16PkgLen + sizeof(TAG_PKG_TAIL_S);
-                
-                printf("[Network] Package found: type=%s, id=0x%04X, cmd=0x%04X, len=%d, index=%d, total=%d\n",
-                       is_json ? "JSON" : (is_video ? "VIDEO" : "IMAGE"),
-                       header->u16PkgId, header->u16PkgCmd, header->u16PkgLen, header->u16PkgIndex, pkg_len);
-                
-                if (pkg_len <= 32 || pkg_len > 1024*1024) {
-                    printf("[Network] ERROR: Invalid package length %d, skipping\n", pkg_len);
-                    memmove(recv_buffer, recv_buffer + 4, buffer_data_len - 4);
-                    buffer_data_len -= 4;
+
+                // Shed video under memory pressure; commands and downloads are never dropped
+                if (view.type == PKG_TYPE_VIDEO && ingest_should_drop(ch, &view)) {
+                    package_view_release(&view);
                     continue;
                 }
                 
-                if (buffer_data_len < pkg_len) {
-                    printf("[Network] Incomplete package, need %d bytes, have %d\n", pkg_len, buffer_data_len);
-                    break;
-                }
-                
-                unsigned char* pkg = (unsigned char*)malloc(pkg_len);
-                if (pkg) {
-                    memcpy(pkg, recv_buffer, pkg_len);
-                    push_package_to_queue(pkg, pkg_len);
+                // The view pins its ring blocks until the consumer releases it
+                if (push_package_to_queue(ch, &view) == 0) {
                     pkg_count++;
-                    printf("[Network] Package #%lu queued successfully\n", pkg_count);
+                    LOG_RATELIMITED(LOG_LEVEL_TRACE, "Network", 50, "Package #%lu queued successfully", pkg_count);
                 } else {
-                    printf("[Network] ERROR: Failed to allocate memory for package\n");
+                    LOG_WARN("Network", "Queue full at shutdown, package dropped");
                 }
-                
-                memmove(recv_buffer, recv_buffer + pkg_len, buffer_data_len - pkg_len);
-                buffer_data_len -= pkg_len;
                 parsed_count++;
             }
+            // One wake-up per read; the consumer drains everything in a batch
+            if (parsed_count > 0) SetEvent(s->pkg_event);
+            
+            StreamFramerStats fstats;
+            stream_framer_get_stats(framer, &fstats);
+            if (fstats.skipped_bytes != skipped_reported) {
+                LOG_RATELIMITED(LOG_LEVEL_WARN, "Network", 5, "Resync: skipped %llu invalid bytes (%lu resyncs, %lu false magics so far)",
+                                fstats.skipped_bytes - skipped_reported, fstats.resyncs, fstats.rejected_magics);
+                skipped_reported = fstats.skipped_bytes;
+            }
             
             if (parsed_count > 0) {
-                printf("[Network] Parsed %d packages in this receive\n", parsed_count);
+                LOG_RATELIMITED(LOG_LEVEL_DEBUG, "Network", 20, "Parsed %d packages in this receive", parsed_count);
             }
-            printf("[Network] =========================================\n");
         } else if (ret == ERROR_PPCS_TIME_OUT && read_len == 0) {
             // Timeout with no data - this is normal, just continue
             // printf("[Network] Read timeout (no data)\n");
         } else if (ret != ERROR_PPCS_SUCCESSFUL && ret != ERROR_PPCS_TIME_OUT) {
-            printf("[Network] ERROR: PPCS_Read failed with code %d\n", ret);
+            LOG_ERROR("Network", "PPCS_Read failed with code %d", ret);
             print_error("PPCS_Read", ret);
-            // Session closed or other fatal error - exit thread
+            // Session closed: reconnect, or wait while another channel's reader does
             if (ret == ERROR_PPCS_SESSION_CLOSED_REMOTE || 
                 ret == ERROR_PPCS_SESSION_CLOSED_TIMEOUT || 
-                ret == ERROR_PPCS_SESSION_CLOSED_CALLED) {
-                printf("[Debug] Fatal error in PPCS_Read: %d. Attempting recovery.\n", ret);
-                // Attempt recovery instead of exiting
-                Sleep(1000); // Wait before retrying
+                ret == ERROR_PPCS_SESSION_CLOSED_CALLED ||
+                ret == ERROR_PPCS_INVALID_SESSION_HANDLE) {
+                if (s->generation == generation) session_recover(ch, ret);
                 continue;
             } else {
-                printf("[Debug] Non-fatal error in PPCS_Read: %d. Continuing thread.\n", ret);
+                LOG_DEBUG("Network", "Non-fatal error in PPCS_Read: %d. Continuing thread.", ret);
                 continue;
             }
         }
     }
     
-    printf("[Network] ========== NETWORK THREAD STOPPED ==========\n");
-    printf("[Network] Total received: %lu bytes\n", recv_count);
-    printf("[Network] Total packages queued: %lu\n", pkg_count);
-    printf("[Network] =============================================\n");
+    LOG_INFO("Network", "========== NETWORK THREAD STOPPED (channel %d) ==========", ch->channel);
+    LOG_INFO("Network", "Total received: %llu bytes in %lu reads", ch->read_stats.bytes, recv_count);
+    LOG_INFO("Network", "Total packages queued: %lu", pkg_count);
+    LOG_INFO("Network", "=============================================");
+    async_log_thread_detach();
     
-    free(recv_buffer);
     return 0;
 }
 
 // Connect helper
 INT32 connect_to_device(const char* target_did, Config *config) {
-    INT32 session_handle; st_PPCS_Session session_info;
-    CHAR bEnableLanSearch = (CHAR)config->ConnectionMode;
-    session_handle = PPCS_ConnectByServer(target_did, bEnableLanSearch, config->UDPPort, config->ServerString);
-    if (session_handle < 0) { print_error("PPCS_ConnectByServer", session_handle); return -1; }
-    INT32 ret = PPCS_Check(session_handle, &session_info);
-    if (ret == ERROR_PPCS_SUCCESSFUL) { /* print info omitted */ } 
-    else { 
-        printf("[ERROR] PPCS_Check failed after connect: %d\n", ret);
-        print_error("PPCS_Check", ret); 
-        PPCS_Close(session_handle); 
-        return -1; 
-    }
-    return session_handle;
-}
-
-// Expose queue pop for main to consume
-PackageNode* ppcs_pop_package(void) {
-    PackageNode* node = pop_package_from_queue();
-    if (node) {
-        //printf("[Queue] ========== PACKAGE DEQUEUED ==========\n");
-        //printf("[Queue] Package size: %d bytes\n", node->len);
-        //printf("[Queue] Packet type: ");
+    return connector_connect(target_did, config, NULL, NULL);
+}
+
+static void log_dequeued_package(const PackageView* view) {
+    //printf("[Queue] ========== PACKAGE DEQUEUED ==========\n");
+    //printf("[Queue] Package size: %d bytes\n", view->len);
+    //printf("[Queue] Packet type: ");
+    
+    if (view->type == PKG_TYPE_JSON) {
+        LOG_DEBUG("Queue", "JSON COMMAND id=0x%04X cmd=0x%04X len=%d",
+                  view->header.u16PkgId, view->header.u16PkgCmd, view->header.u16PkgLen);
         
-        if (node->len >= 4) {
-            if (memcmp(node->data, "#nsj", 4) == 0) {
-                printf("JSON COMMAND\n");
-                if (node->len >= 28) {
-                    typedef struct {
-                        unsigned short s16PkgIdent;
-                        unsigned short u16PkgLen;
-                        unsigned short u16PkgId;
-                        unsigned short u16PkgIndex;
-                        unsigned short u16PkgKey;
-                        unsigned short u16PkgCmd;
-                        unsigned char  u8PkgSubHead;
-                        unsigned char  u8Reserve[3];
-                        unsigned long long u64PkgUserData;
-                    } TAG_PKG_HEADER_S;
-                    TAG_PKG_HEADER_S* header = (TAG_PKG_HEADER_S*)(node->data + 4);
-                    printf("[Queue] - Package ID: 0x%04X\n", header->u16PkgId);
-                    printf("[Queue] - Package Command: 0x%04X\n", header->u16PkgCmd);
-                    printf("[Queue] - Data Length: %d bytes\n", header->u16PkgLen);
-                    
-                    if (header->u16PkgLen > 0 && header->u16PkgLen < 8192) {
-                        printf("[Queue] - Data: %s\n", (char*)(node->data + 4 + 28));
-                    }
-                }
-            } else if (memcmp(node->data, "$div", 4) == 0) {
-                //printf("VIDEO FRAME\n");
-            } else if (memcmp(node->data, "$gmi", 4) == 0) {
-                //printf("IMAGE DATA\n");
-            } else {
-                //printf("UNKNOWN\n");
-            }
+        int data_len = view->header.u16PkgLen;
+        if (LOG_ENABLED(LOG_LEVEL_TRACE) && data_len > 0 && data_len < 8192) {
+            const unsigned char* data = package_view_data(view, PKG_HEADER_TOTAL_LEN, data_len);
+            if (data) LOG_TRACE("Queue", "- Data: %.*s", data_len, (const char*)data);
         }
-        //printf("[Queue] ===================================\n");
+    } else if (view->type == PKG_TYPE_VIDEO) {
+        //printf("VIDEO FRAME\n");
+    } else if (view->type == PKG_TYPE_IMAGE) {
+        //printf("IMAGE DATA\n");
+    } else {
+        //printf("UNKNOWN\n");
     }
-    return node;
+    //printf("[Queue] ===================================\n");
 }
 
-// Start/stop network thread and init queue
-int ppcs_start_network(INT32 session_handle) {
-    InitializeCriticalSection(&g_pkg_cs);
-    g_pkg_event = CreateEvent(NULL, FALSE, FALSE, NULL);
-    DWORD tid = 0;
-    g_net_thread = CreateThread(NULL, 0, network_reader_thread, (LPVOID)(intptr_t)session_handle, 0, &tid);
-    if (!g_net_thread) return -1;
-    return 0;
+// Pop one class across every channel, starting at a rotating channel
+static int pop_lane(PPCSSession* s, int lane, PackageView* views, int max, long long now) {
+    if (max <= 0) return 0;
+    int n = 0;
+    for (int c = 0; c < s->channel_count && n < max; c++) {
+        NetChannel* ch = &s->channels[(s->pop_next + c) % s->channel_count];
+        n += package_queue_pop_batch(ch->lanes[lane], views + n, max - n);
+    }
+    PackageLaneStats* st = &s->lane_stats[lane];
+    for (int i = 0; i < n; i++) {
+        views[i].dequeued_at = now;
+        metrics_record(MET_FRAMED_TO_DEQUEUED, now - views[i].queued_at);
+        double delay_ms = (double)(now - views[i].queued_at) / 1000.0;
+        st->delay_count++;
+        st->delay_total_ms += delay_ms;
+        if (delay_ms > st->delay_max_ms) st->delay_max_ms = delay_ms;
+    }
+    return n;
+}
+
+// Expose queue pop for main to consume: drains up to max ready packages at once.
+// Commands have strict priority; the rest of the batch is split between video
+// and bulk by weight, and either class takes whatever the other leaves unused.
+int ppcs_session_pop_packages(PPCSSession* s, PackageView* views, int max) {
+    if (!s) return 0;
+    long long now = metrics_now_us();
+    int n = pop_lane(s, PKG_LANE_CMD, views, max, now);
+    int room = max - n;
+    if (room > 0) {
+        int bulk_share = room * LANE_BULK_WEIGHT / (LANE_VIDEO_WEIGHT + LANE_BULK_WEIGHT);
+        if (bulk_share < 1) bulk_share = 1;
+        n += pop_lane(s, PKG_LANE_VIDEO, views + n, room - bulk_share, now);
+        n += pop_lane(s, PKG_LANE_BULK, views + n, max - n, now);
+        n += pop_lane(s, PKG_LANE_VIDEO, views + n, max - n, now);
+    }
+    for (int i = 0; i < n; i++) log_dequeued_package(&views[i]);
+    if (s->channel_count > 1) s->pop_next = (s->pop_next + 1) % s->channel_count;
+    return n;
+}
+
+// Release the ring blocks pinned by a dequeued package
+void ppcs_session_free_package(PPCSSession* s, PackageView* view) {
+    if (!view || !view->owner) return;
+    if (s) InterlockedExchangeAdd(&s->ingest_bytes, -view->len);
+    metrics_add(MET_INGEST_BYTES, -view->len);
+    package_view_release(view);
+}
+
+// Counters are written by the reader thread; a racy snapshot is fine for reporting
+void ppcs_session_get_drop_stats(PPCSSession* s, int stream_type, IngestDropStats* stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    if (!s || stream_type < 1 || stream_type > INGEST_STREAM_COUNT) return;
+    for (int c = 0; c < s->channel_count; c++) {
+        const IngestDropStats* d = &s->channels[c].drop_stats[stream_type - 1];
+        stats->frames_dropped += d->frames_dropped;
+        stats->packages_dropped += d->packages_dropped;
+        stats->bytes_dropped += d->bytes_dropped;
+        stats->shed_events += d->shed_events;
+        stats->corrupt_events += d->corrupt_events;
+    }
+}
+
+static void add_read_stats(NetReadStats* total, const NetReadStats* r) {
+    total->read_calls += r->read_calls;
+    total->bytes += r->bytes;
+    total->check_calls += r->check_calls;
+    total->bulk_reads += r->bulk_reads;
+    total->idle_reads += r->idle_reads;
+    if (r->max_bytes_per_call > total->max_bytes_per_call) total->max_bytes_per_call = r->max_bytes_per_call;
+    total->checksum_drops += r->checksum_drops;
+}
+
+// Snapshot of the readers' counters summed over channels (each written only by its reader)
+void ppcs_session_get_read_stats(PPCSSession* s, NetReadStats* stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    if (!s) return;
+    for (int c = 0; c < s->channel_count; c++) add_read_stats(stats, &s->channels[c].read_stats);
+}
+
+// Framer counters summed over channels. Read racily from another thread:
+// good enough for reporting, not for exact accounting.
+void ppcs_session_get_framer_stats(PPCSSession* s, StreamFramerStats* stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    if (!s) return;
+    for (int c = 0; c < s->channel_count; c++) {
+        StreamFramerStats f;
+        stream_framer_get_stats(s->channels[c].framer, &f);
+        stats->bytes_in += f.bytes_in;
+        stats->packages += f.packages;
+        stats->skipped_bytes += f.skipped_bytes;
+        stats->bad_length += f.bad_length;
+        stats->overflows += f.overflows;
+        stats->resyncs += f.resyncs;
+        stats->rejected_magics += f.rejected_magics;
+        stats->checksums += f.checksums;
+        for (int t = 0; t <= PKG_TYPE_TIMELAPSE; t++) stats->checksum_failures[t] += f.checksum_failures[t];
+    }
+}
+
+int ppcs_session_channel_count(PPCSSession* s) {
+    return s ? s->channel_count : 0;
+}
+
+// Read counters of the index-th reader; returns its PPCS channel, or -1
+int ppcs_session_get_channel_stats(PPCSSession* s, int index, NetReadStats* stats) {
+    if (stats) memset(stats, 0, sizeof(*stats));
+    if (!s || index < 0 || index >= s->channel_count) return -1;
+    if (stats) *stats = s->channels[index].read_stats;
+    return s->channels[index].channel;
+}
+
+// Current handle for the writer; recovery may replace it
+static INT32 session_writer_handle(void* user) {
+    return ppcs_session_handle((PPCSSession*)user);
+}
+
+int ppcs_session_send(PPCSSession* s, const unsigned char* package, int len) {
+    if (!s || !s->writer) return -1;
+    return command_writer_submit(s->writer, package, len);
+}
+
+void ppcs_session_get_write_stats(PPCSSession* s, CommandWriterStats* stats) {
+    command_writer_get_stats(s ? s->writer : NULL, stats);
+}
+
+// Auto-reset event signalled whenever the reader queues packages
+HANDLE ppcs_session_event(PPCSSession* s) {
+    return s ? s->pkg_event : NULL;
+}
+
+INT32 ppcs_session_handle(PPCSSession* s) {
+    return s && s->state == SESSION_UP ? s->handle : -1;
+}
+
+int ppcs_session_generation(PPCSSession* s) {
+    return s ? (int)s->generation : 0;
+}
+
+long long ppcs_session_lost_at(PPCSSession* s) {
+    return s ? s->lost_at : 0;
+}
+
+void ppcs_session_get_recovery_stats(PPCSSession* s, SessionRecoveryStats* stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    if (s) *stats = s->recovery;
+}
+
+const char* ppcs_session_did(PPCSSession* s) {
+    return s ? s->did : "";
+}
+
+int ppcs_session_queue_depth(PPCSSession* s) {
+    if (!s) return 0;
+    int depth = 0;
+    for (int c = 0; c < s->channel_count; c++) {
+        for (int i = 0; i < PKG_LANE_COUNT; i++) depth += package_queue_count(s->channels[c].lanes[i]);
+    }
+    return depth;
+}
+
+void ppcs_session_get_lane_stats(PPCSSession* s, int lane, PackageLaneStats* stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    if (!s || lane < 0 || lane >= PKG_LANE_COUNT) return;
+    *stats = s->lane_stats[lane];
+    for (int c = 0; c < s->channel_count; c++) {
+        PackageQueueStats q;
+        if (!s->channels[c].lanes[lane]) continue;
+        package_queue_get_stats(s->channels[c].lanes[lane], &q);
+        stats->queue.pushed += q.pushed;
+        stats->queue.popped += q.popped;
+        stats->queue.full += q.full;
+        stats->queue.batches += q.batches;
+        if (q.max_depth > stats->queue.max_depth) stats->queue.max_depth = q.max_depth;
+    }
+}
+
+void ppcs_set_channel_map(const Config* config) {
+    if (!config) return;
+    g_channel_map[PKG_LANE_CMD] = (UCHAR)config->CmdChannel;
+    g_channel_map[PKG_LANE_VIDEO] = (UCHAR)config->VideoChannel;
+    g_channel_map[PKG_LANE_BULK] = (UCHAR)config->BulkChannel;
+}
+
+UCHAR ppcs_channel_for(int lane) {
+    if (lane < 0 || lane >= PKG_LANE_COUNT) return 0;
+    return g_channel_map[lane];
+}
+
+const char* ppcs_lane_name(int lane) {
+    switch (lane) {
+    case PKG_LANE_CMD: return "CMD";
+    case PKG_LANE_VIDEO: return "VIDEO";
+    case PKG_LANE_BULK: return "BULK";
+    default: return "?";
+    }
+}
+
+static void session_free(PPCSSession* s) {
+    // Releases any views still queued before the ring they point into goes away
+    for (int c = 0; c < s->channel_count; c++) {
+        NetChannel* ch = &s->channels[c];
+        for (int i = 0; i < PKG_LANE_COUNT; i++) package_queue_destroy(ch->lanes[i]);
+        stream_framer_destroy(ch->framer);
+    }
+    if (s->pkg_event) CloseHandle(s->pkg_event);
+    capture_writer_close(s->capture);
+    free(s);
+}
+
+static void session_stop_threads(PPCSSession* s) {
+    command_writer_destroy(s->writer);
+    s->writer = NULL;
+    s->net_thread_run = 0;
+    if (s->pkg_event) SetEvent(s->pkg_event);
+    // The session is freed after this, so wait for every reader to exit.
+    // One inside a reconnect sees net_thread_run drop and cancels its own
+    // connect; PPCS_Connect_Break() would abort other devices' races too.
+    for (int c = 0; c < s->channel_count; c++) {
+        NetChannel* ch = &s->channels[c];
+        if (!ch->thread) continue;
+        WaitForSingleObject(ch->thread, INFINITE);
+        CloseHandle(ch->thread);
+        ch->thread = NULL;
+    }
+}
+
+// Start a reader thread, receive ring and lanes per mapped channel of a connected session
+PPCSSession* ppcs_session_start(INT32 session_handle, const char* did, const Config* config) {
+    PPCSSession* s = (PPCSSession*)calloc(1, sizeof(PPCSSession));
+    if (!s) return NULL;
+    s->handle = session_handle;
+    s->config = config;
+    strncpy(s->did, did ? did : "", sizeof(s->did) - 1);
+    s->ingest_max_bytes = config ? config->IngestMaxBytes : INGEST_DEFAULT_MAX_BYTES;
+    s->ingest_max_packets = config ? config->IngestMaxPackets : INGEST_DEFAULT_MAX_PACKETS;
+    s->checksum_mode = config ? config->ChecksumMode : CHECKSUM_COUNT;
+
+    // One reader per distinct channel in the map
+    for (int lane = 0; lane < PKG_LANE_COUNT; lane++) {
+        UCHAR channel = g_channel_map[lane];
+        int known = 0;
+        for (int c = 0; c < s->channel_count; c++) {
+            if (s->channels[c].channel == channel) { known = 1; break; }
+        }
+        if (known) continue;
+        NetChannel* ch = &s->channels[s->channel_count++];
+        ch->session = s;
+        ch->channel = channel;
+        // The ring outlives the reader thread: queued views point into it
+        ch->framer = stream_framer_create(NET_RECV_BUFFER_SIZE);
+        if (!ch->framer) {
+            printf("[Network] ERROR: Failed to allocate receive buffer for %s channel %d\n", s->did, channel);
+            session_free(s);
+            return NULL;
+        }
+        stream_framer_set_verify(ch->framer, s->checksum_mode != CHECKSUM_OFF);
+        for (int i = 0; i < PKG_LANE_COUNT; i++) {
+            ch->lanes[i] = package_queue_create(NET_QUEUE_CAPACITY);
+            if (!ch->lanes[i]) {
+                printf("[Network] ERROR: Failed to allocate %s package queue for %s channel %d\n", ppcs_lane_name(i), s->did, channel);
+                session_free(s);
+                return NULL;
+            }
+        }
+    }
+    s->pkg_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (!s->pkg_event) {
+        session_free(s);
+        return NULL;
+    }
+    s->writer = command_writer_create(s->did, g_channel_map[PKG_LANE_CMD], config ? config->CmdWriteMaxBuffered : 0,
+                                      session_writer_handle, s);
+    if (!s->writer) {
+        session_free(s);
+        return NULL;
+    }
+    if (config && config->CaptureFile[0]) {
+        // Capture failing to open is reported but does not stop the session
+        char path[sizeof(config->CaptureFile) + 1 + sizeof(s->did) + sizeof(CAPTURE_FILE_EXT)];
+        snprintf(path, sizeof(path), "%s_%s%s", config->CaptureFile, s->did, CAPTURE_FILE_EXT);
+        s->capture = capture_writer_open(path, s->did);
+        if (s->capture) printf("[Network] %s: capturing received bytes to %s\n", s->did, path);
+    }
+    s->net_thread_run = 1;
+    for (int c = 0; c < s->channel_count; c++) {
+        NetChannel* ch = &s->channels[c];
+        DWORD tid = 0;
+        ch->thread = CreateThread(NULL, 0, network_reader_thread, ch, 0, &tid);
+        if (!ch->thread) {
+            printf("[Network] ERROR: Failed to start reader thread for %s channel %d\n", s->did, ch->channel);
+            session_stop_threads(s);
+            session_free(s);
+            return NULL;
+        }
+    }
+    return s;
 }
 
-void ppcs_stop_network(void) {
-    if (g_net_thread) { g_net_thread_run = 0; if (g_pkg_event) SetEvent(g_pkg_event); WaitForSingleObject(g_net_thread, 2000); CloseHandle(g_net_thread); g_net_thread = NULL; }
-    while (1) { PackageNode* n = pop_package_from_queue(); if (!n) break; if (n->data) free(n->data); free(n); }
-    if (g_pkg_event) { CloseHandle(g_pkg_event); g_pkg_event = NULL; }
-    DeleteCriticalSection(&g_pkg_cs);
+// Stop the reader and free the session state; the PPCS handle is left open
+void ppcs_session_stop(PPCSSession* s) {
+    if (!s) return;
+    session_stop_threads(s);
+    session_free(s);
 }
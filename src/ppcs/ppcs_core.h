@@ -1,11 +1,25 @@
 #ifndef PPCS_CORE_H
 #define PPCS_CORE_H
 
-#include <windows.h>
+#include "platform.h"
 #include "PPCS_API.h"
+#include "stream_framer.h"
+#include "package_queue.h"
+#include "command_writer.h"
 
 #define CONFIG_FILE "config.conf"
 #define MAX_CONFIG_VALUE_LEN 256
+#define MAX_FLEET_VALUE_LEN 1024    // Comma-separated DID list
+#define PPCS_MAX_CHANNELS 8         // PPCS channels 0..7
+
+// ChecksumMode: what to do with packages whose u16Check does not match
+#define CHECKSUM_OFF   0            // Not verified
+#define CHECKSUM_COUNT 1            // Verified and counted, still delivered
+#define CHECKSUM_DROP  2            // Dropped; a corrupt video frame sheds to the next I-frame
+
+// Default ingest budget; beyond it video is shed down to the next I-frame
+#define INGEST_DEFAULT_MAX_BYTES (2*1024*1024)
+#define INGEST_DEFAULT_MAX_PACKETS 2048
 
 typedef struct {
     char InitString[MAX_CONFIG_VALUE_LEN];
@@ -15,21 +29,120 @@ typedef struct {
     int SessAliveSec;
     int UDPPort;
     int ConnectionMode;
+    char ConnectModes[MAX_CONFIG_VALUE_LEN];    // Modes raced at connect, empty for ConnectionMode alone
+    int ConnectStaggerMs;       // Head start for the mode that won last time
+    char ConnectCacheFile[MAX_CONFIG_VALUE_LEN];    // Winning mode per DID, empty to disable
     int ReadTimeout;
+    int CmdWriteMaxBuffered;    // Unsent bytes on the command channel before the writer holds off
+    int CommandTimeoutMs;       // Wait for a response before a command is retried or given up
+    int CommandRetries;         // Resends of an unanswered query
+    int IngestMaxBytes;         // Bytes held by undelivered packages before shedding video
+    int IngestMaxPackets;       // Queued packages before shedding video
     char APILogFile[MAX_CONFIG_VALUE_LEN];
+    char FleetDIDs[MAX_FLEET_VALUE_LEN];    // Extra devices to monitor alongside TargetDID
+    int FleetShowVideo;         // Open decode/display windows for fleet devices too
+    int FleetAutoLive;          // Send live start to fleet devices once connected
+    int CmdChannel;             // PPCS channel for commands and their responses
+    int VideoChannel;           // PPCS channel carrying live/playback video
+    int BulkChannel;            // PPCS channel carrying images and timelapse downloads
+    int ChecksumMode;           // CHECKSUM_OFF / CHECKSUM_COUNT / CHECKSUM_DROP
+    int DecodeMode;             // 1: frames go to the codec as whole access units, 0: through the parser
+    int DecodeThreads;          // Decoder threads per stream, 0 = from the core count
+    int DecodeThreadType;       // 1 frame, 2 slice, 3 frame where the codec has it (DECODE_THREAD_*)
+    int DecodeLowDelay;         // 1: no frame threading, pictures out as early as possible
+    int LogLevel;               // LOG_LEVEL_* for the async logger
+    int RecoveryMinMs;          // First reconnect delay after a session closes, 0 disables recovery
+    int RecoveryMaxMs;          // Backoff ceiling
+    int RecoveryMaxAttempts;    // Reconnects before giving up, 0 for no limit
+    char MetricsFile[MAX_CONFIG_VALUE_LEN];     // JSON lines of metrics snapshots, empty to disable
+    int MetricsIntervalSec;     // Seconds between periodic snapshots, 0 for exit/on demand only
+    char CaptureFile[MAX_CONFIG_VALUE_LEN];     // Raw reads go to <prefix>_<DID>.ppcap, empty to disable
 } Config;
 
-// Package node for queue
-typedef struct PackageNode { unsigned char* data; int len; struct PackageNode* next; } PackageNode;
+// Reader counters: how well reads are batched
+typedef struct {
+    unsigned long long read_calls;      // PPCS_Read calls
+    unsigned long long bytes;           // Bytes those calls returned
+    unsigned long long check_calls;     // PPCS_Check_Buffer calls
+    unsigned long long bulk_reads;      // Reads sized from pending bytes
+    unsigned long long idle_reads;      // Short-timeout reads with nothing pending
+    unsigned int max_bytes_per_call;
+    unsigned long long checksum_drops;  // Packages dropped for a bad checksum
+} NetReadStats;
+
+// Receive queues by package class, popped in priority order
+typedef enum {
+    PKG_LANE_CMD = 0,       // "#nsj" command responses: strict priority
+    PKG_LANE_VIDEO,         // "$div" live/playback video
+    PKG_LANE_BULK,          // "$gmi" images, "@lif" timelapse downloads
+    PKG_LANE_COUNT
+} PackageLane;
+
+typedef struct {
+    PackageQueueStats queue;
+    unsigned long long delay_count;     // Packages popped
+    double delay_total_ms;              // Sum of time spent queued
+    double delay_max_ms;
+} PackageLaneStats;
+
+// Video shed by the ingest budget, per stream type
+typedef struct {
+    unsigned long long frames_dropped;
+    unsigned long long packages_dropped;
+    unsigned long long bytes_dropped;
+    unsigned long shed_events;          // Times the stream entered wait-for-I-frame
+    unsigned long corrupt_events;       // ...of those, caused by a bad checksum
+} IngestDropStats;
+
+// Reconnects after PPCS reports the session closed
+typedef struct {
+    unsigned long losses;               // Sessions seen closed
+    unsigned long recoveries;           // ...and reopened
+    unsigned long attempts;             // Connects tried while recovering
+    double last_ms;                     // Loss to new handle, last recovery
+    double max_ms;
+    int failed;                         // Gave up after RecoveryMaxAttempts
+} SessionRecoveryStats;
 
 void init_config(Config *config);
 int validate_config(Config *config);
 void print_config(Config *config);
 void print_api_info(void);
 INT32 connect_to_device(const char* target_did, Config *config);
-int ppcs_start_network(INT32 session_handle);
-void ppcs_stop_network(void);
-PackageNode* ppcs_pop_package(void);
+
+// Network state of one connected device: reader thread, receive ring and lanes
+typedef struct PPCSSession PPCSSession;
+
+PPCSSession* ppcs_session_start(INT32 session_handle, const char* did, const Config* config);
+void ppcs_session_stop(PPCSSession* session);
+// Pops up to max queued packages; each view must be released with ppcs_session_free_package()
+int ppcs_session_pop_packages(PPCSSession* session, PackageView* views, int max);
+void ppcs_session_free_package(PPCSSession* session, PackageView* view);
+HANDLE ppcs_session_event(PPCSSession* session);
+// Current PPCS handle, -1 while the session is being recovered
+INT32 ppcs_session_handle(PPCSSession* session);
+// Bumped each time recovery swaps in a new handle; matches PackageView.generation
+int ppcs_session_generation(PPCSSession* session);
+// metrics_now_us() when the last loss was seen, 0 if never
+long long ppcs_session_lost_at(PPCSSession* session);
+void ppcs_session_get_recovery_stats(PPCSSession* session, SessionRecoveryStats* stats);
+const char* ppcs_session_did(PPCSSession* session);
+int ppcs_session_queue_depth(PPCSSession* session);
+void ppcs_session_get_lane_stats(PPCSSession* session, int lane, PackageLaneStats* stats);
+void ppcs_session_get_drop_stats(PPCSSession* session, int stream_type, IngestDropStats* stats);
+void ppcs_session_get_read_stats(PPCSSession* session, NetReadStats* stats);
+void ppcs_session_get_framer_stats(PPCSSession* session, StreamFramerStats* stats);
+int ppcs_session_channel_count(PPCSSession* session);
+int ppcs_session_get_channel_stats(PPCSSession* session, int index, NetReadStats* stats);
+// Queue a built command package for the session's writer thread; never blocks.
+// Returns 0, or -1 if the package is too large or the queue is full.
+int ppcs_session_send(PPCSSession* session, const unsigned char* package, int len);
+void ppcs_session_get_write_stats(PPCSSession* session, CommandWriterStats* stats);
+const char* ppcs_lane_name(int lane);
+
+// Channel map from config (call before starting sessions); lane is PKG_LANE_*
+void ppcs_set_channel_map(const Config* config);
+UCHAR ppcs_channel_for(int lane);
 void print_error(const char* function_name, INT32 error_code);
 
 #endif // PPCS_CORE_H
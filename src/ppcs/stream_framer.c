@@ -0,0 +1,428 @@
+// Stream Framer Implementation
+#include "stream_framer.h"
+#include "package_registry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define FRAMER_BLOCK_SHIFT 16      // 64 KB blocks
+#define FRAMER_BLOCK_SIZE (1u << FRAMER_BLOCK_SHIFT)
+
+struct StreamFramer {
+    unsigned char* buf;
+    unsigned int capacity;     // Power of two, multiple of FRAMER_BLOCK_SIZE
+    unsigned int mask;
+    unsigned int head;         // Total bytes written (wraps naturally)
+    unsigned int tail;         // Total bytes parsed
+    unsigned int reclaim;      // Everything before this may be overwritten
+    int block_count;
+    atomic_int* block_refs;    // Outstanding views per block
+    int resyncing;             // Sync was lost; candidates get the stricter checks
+    int verify;                // Check u16Check on every package
+    int ident_known;
+    uint16_t ident;            // s16PkgIdent of the first in-sync package
+    StreamFramerStats stats;
+};
+
+StreamFramer* stream_framer_create(int capacity) {
+    if (capacity < PKG_MIN_LEN) return NULL;
+    unsigned int cap = FRAMER_BLOCK_SIZE;
+    while (cap < (unsigned int)capacity) cap <<= 1;
+
+    StreamFramer* framer = (StreamFramer*)malloc(sizeof(StreamFramer));
+    if (!framer) return NULL;
+    memset(framer, 0, sizeof(StreamFramer));
+    framer->block_count = (int)(cap >> FRAMER_BLOCK_SHIFT);
+    framer->buf = (unsigned char*)malloc(cap);
+    framer->block_refs = (atomic_int*)calloc(framer->block_count, sizeof(atomic_int));
+    if (!framer->buf || !framer->block_refs) {
+        free(framer->buf);
+        free(framer->block_refs);
+        free(framer);
+        return NULL;
+    }
+    for (int i = 0; i < framer->block_count; i++) atomic_init(&framer->block_refs[i], 0);
+    framer->capacity = cap;
+    framer->mask = cap - 1;
+    return framer;
+}
+
+void stream_framer_destroy(StreamFramer* framer) {
+    if (!framer) return;
+    free(framer->buf);
+    free(framer->block_refs);
+    free(framer);
+}
+
+void stream_framer_reset(StreamFramer* framer) {
+    if (!framer) return;
+    framer->head = framer->tail = framer->reclaim = 0;
+    framer->resyncing = 0;
+}
+
+// Advance the reclaim offset over blocks that are parsed and no longer referenced
+static void framer_reclaim(StreamFramer* framer) {
+    while (framer->reclaim != framer->tail) {
+        int block = (int)((framer->reclaim & framer->mask) >> FRAMER_BLOCK_SHIFT);
+        if (atomic_load_explicit(&framer->block_refs[block], memory_order_acquire) != 0) break;
+        unsigned int block_end = (framer->reclaim | (FRAMER_BLOCK_SIZE - 1)) + 1;
+        if ((int)(block_end - framer->tail) > 0) {
+            framer->reclaim = framer->tail;
+        } else {
+            framer->reclaim = block_end;
+        }
+    }
+}
+
+void stream_framer_discard(StreamFramer* framer) {
+    if (!framer) return;
+    framer->tail = framer->head;
+    framer->resyncing = 0;
+    framer_reclaim(framer);
+}
+
+int stream_framer_used(const StreamFramer* framer) {
+    return framer ? (int)(framer->head - framer->tail) : 0;
+}
+
+int stream_framer_free(StreamFramer* framer) {
+    if (!framer) return 0;
+    framer_reclaim(framer);
+    return (int)(framer->capacity - (framer->head - framer->reclaim));
+}
+
+void stream_framer_get_stats(const StreamFramer* framer, StreamFramerStats* stats) {
+    if (framer && stats) *stats = framer->stats;
+}
+
+void stream_framer_set_verify(StreamFramer* framer, int enable) {
+    if (framer) framer->verify = enable ? 1 : 0;
+}
+
+uint16_t package_checksum(const unsigned char* data, int len) {
+    if (!data || len <= 0) return 0;
+    unsigned int sum = 0;
+    int i = 0;
+#ifdef __SSE2__
+    // psadbw against zero adds 8 bytes per 64-bit lane; 16-bit wrap is applied at the end
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+    }
+    sum = (unsigned int)_mm_cvtsi128_si32(acc) + (unsigned int)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#endif
+    for (; i < len; i++) sum += data[i];
+    return (uint16_t)sum;
+}
+
+int package_build(const char* prefix, const PackageHeader_t* header, const void* sub_header, int sub_len,
+                  const void* data, int len, unsigned char* out, int max_len) {
+    if (!prefix || !header || !out || sub_len < 0 || len < 0 || sub_len + len > 0xFFFF) return -1;
+    int total = PKG_MIN_LEN + sub_len + len;
+    if (total > max_len) return -1;
+    memcpy(out, prefix, PKG_PREFIX_LEN);
+    PackageHeader_t h = *header;
+    if (h.s16PkgIdent == 0) h.s16PkgIdent = PKG_IDENT_DEFAULT;
+    h.u16PkgLen = (uint16_t)(sub_len + len);
+    memcpy(out + PKG_PREFIX_LEN, &h, sizeof(h));
+    int offset = PKG_HEADER_TOTAL_LEN;
+    if (sub_len > 0) memcpy(out + offset, sub_header, sub_len);
+    offset += sub_len;
+    if (len > 0) memcpy(out + offset, data, len);
+    offset += len;
+    PackageTail_t tail;
+    tail.u8Zero = 0;
+    tail.u8Res = 0;
+    tail.u16Check = package_checksum(out, offset);
+    memcpy(out + offset, &tail, sizeof(tail));
+    return total;
+}
+
+int stream_framer_prefix_type(const unsigned char* prefix) {
+    return package_registry_classify_prefix(prefix);
+}
+
+int stream_framer_find_magic(const unsigned char* data, int len) {
+    if (!data) return -1;
+    int last = len - PKG_PREFIX_LEN;   // Last position a whole magic fits at
+    int i = 0;
+    uint32_t magics[PKG_REGISTRY_MAX];
+    int count = package_registry_magics(magics, PKG_REGISTRY_MAX);
+    if (count == 0) return -1;
+#ifdef __SSE2__
+    // Match the first two bytes of every registered magic at 16 positions
+    // per step, then confirm the candidates; garbage rarely gets past the
+    // two-byte filter
+    __m128i first[PKG_REGISTRY_MAX], second[PKG_REGISTRY_MAX];
+    for (int k = 0; k < count; k++) {
+        first[k] = _mm_set1_epi8((char)(magics[k] & 0xFF));
+        second[k] = _mm_set1_epi8((char)((magics[k] >> 8) & 0xFF));
+    }
+    for (; i + 17 <= len; i += 16) {
+        __m128i b0 = _mm_loadu_si128((const __m128i*)(data + i));
+        __m128i b1 = _mm_loadu_si128((const __m128i*)(data + i + 1));
+        __m128i m = _mm_setzero_si128();
+        for (int k = 0; k < count; k++) {
+            m = _mm_or_si128(m, _mm_and_si128(_mm_cmpeq_epi8(b0, first[k]), _mm_cmpeq_epi8(b1, second[k])));
+        }
+        unsigned int bits = (unsigned int)_mm_movemask_epi8(m);
+        while (bits) {
+            int pos = i + __builtin_ctz(bits);
+            if (pos > last) return -1;
+            if (package_registry_classify_prefix(data + pos)) return pos;
+            bits &= bits - 1;
+        }
+    }
+#endif
+    for (; i <= last; i++) {
+        if (package_registry_classify_prefix(data + i)) return i;
+    }
+    return -1;
+}
+
+int stream_framer_write_ptr(StreamFramer* framer, unsigned char** ptr) {
+    if (!framer || !ptr) return 0;
+    framer_reclaim(framer);
+    unsigned int free_bytes = framer->capacity - (framer->head - framer->reclaim);
+    unsigned int pos = framer->head & framer->mask;
+    unsigned int contiguous = framer->capacity - pos;
+    *ptr = framer->buf + pos;
+    return (int)(contiguous < free_bytes ? contiguous : free_bytes);
+}
+
+void stream_framer_commit(StreamFramer* framer, int len) {
+    if (!framer || len <= 0) return;
+    framer->head += (unsigned int)len;
+    framer->stats.bytes_in += (unsigned int)len;
+}
+
+int stream_framer_push(StreamFramer* framer, const unsigned char* data, int len) {
+    if (!framer || !data || len <= 0) return 0;
+    if (len > stream_framer_free(framer)) {
+        framer->stats.overflows++;
+        return -1;
+    }
+    while (len > 0) {
+        unsigned char* dst;
+        int n = stream_framer_write_ptr(framer, &dst);
+        if (n > len) n = len;
+        memcpy(dst, data, n);
+        stream_framer_commit(framer, n);
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Copy n bytes starting at absolute offset off (handles wrap-around)
+static void ring_peek(const StreamFramer* framer, unsigned int off, void* dst, unsigned int n) {
+    unsigned int pos = off & framer->mask;
+    unsigned int first = framer->capacity - pos;
+    if (first >= n) {
+        memcpy(dst, framer->buf + pos, n);
+    } else {
+        memcpy(dst, framer->buf + pos, first);
+        memcpy((unsigned char*)dst + first, framer->buf, n - first);
+    }
+}
+
+// Skip unsynchronised bytes up to the next magic, keeping a partial one at the end
+static void framer_resync(StreamFramer* framer) {
+    while (framer->head - framer->tail >= PKG_PREFIX_LEN) {
+        unsigned int avail = framer->head - framer->tail;
+        unsigned int pos = framer->tail & framer->mask;
+        unsigned int n = framer->capacity - pos;
+        if (n > avail) n = avail;
+        if (n < PKG_PREFIX_LEN) {
+            // A magic may straddle the end of the ring
+            unsigned char prefix[PKG_PREFIX_LEN];
+            ring_peek(framer, framer->tail, prefix, PKG_PREFIX_LEN);
+            if (stream_framer_prefix_type(prefix)) return;
+            framer->tail++;
+            framer->stats.skipped_bytes++;
+            continue;
+        }
+        int found = stream_framer_find_magic(framer->buf + pos, (int)n);
+        unsigned int skip = found >= 0 ? (unsigned int)found : n - (PKG_PREFIX_LEN - 1);
+        framer->tail += skip;
+        framer->stats.skipped_bytes += skip;
+        if (found >= 0 || n == avail) return;
+    }
+}
+
+// Stricter test for a package found by resync: expected ident and a zero tail
+// byte. Before any ident has been seen, a package with an unexpected ident is
+// only taken when another magic follows right after it.
+static int framer_accept_candidate(StreamFramer* framer, const PackageHeader_t* header, unsigned int pkg_len) {
+    unsigned int avail = framer->head - framer->tail;
+    int chained = 0;
+    if (framer->ident_known) {
+        if (header->s16PkgIdent != framer->ident) return 0;
+    } else if (header->s16PkgIdent != PKG_IDENT_DEFAULT) {
+        if (avail < pkg_len + PKG_PREFIX_LEN) return 1;    // Decided once more data is in
+        unsigned char prefix[PKG_PREFIX_LEN];
+        ring_peek(framer, framer->tail + pkg_len, prefix, PKG_PREFIX_LEN);
+        if (!stream_framer_prefix_type(prefix)) return 0;
+        chained = 1;
+    }
+    if (avail >= pkg_len) {
+        PackageTail_t tail;
+        ring_peek(framer, framer->tail + pkg_len - (unsigned int)sizeof(PackageTail_t), &tail, sizeof(tail));
+        if (tail.u8Zero != 0) return 0;
+    }
+    if (chained) {
+        framer->ident = header->s16PkgIdent;
+        framer->ident_known = 1;
+    }
+    return 1;
+}
+
+int stream_framer_next(StreamFramer* framer, PackageView* view) {
+    if (!framer || !view) return 0;
+
+    while (framer->head - framer->tail >= PKG_HEADER_TOTAL_LEN) {
+        unsigned char prefix[PKG_PREFIX_LEN];
+        ring_peek(framer, framer->tail, prefix, PKG_PREFIX_LEN);
+        int type = stream_framer_prefix_type(prefix);
+        if (!type) {
+            // Lost sync: jump to the next magic instead of stepping bytewise
+            framer->resyncing = 1;
+            framer_resync(framer);
+            continue;
+        }
+
+        PackageHeader_t header;
+        ring_peek(framer, framer->tail + PKG_PREFIX_LEN, &header, sizeof(header));
+        unsigned int pkg_len = PKG_MIN_LEN + header.u16PkgLen;
+        if (pkg_len > framer->capacity) {
+            // Cannot be a real package: skip the prefix and resync
+            framer->tail += PKG_PREFIX_LEN;
+            framer->stats.skipped_bytes += PKG_PREFIX_LEN;
+            framer->stats.bad_length++;
+            framer->resyncing = 1;
+            continue;
+        }
+        if (framer->resyncing) {
+            if (!framer_accept_candidate(framer, &header, pkg_len)) {
+                // Magic bytes inside garbage or payload: step past and keep scanning
+                framer->tail++;
+                framer->stats.skipped_bytes++;
+                framer->stats.rejected_magics++;
+                continue;
+            }
+        }
+        if (framer->head - framer->tail < pkg_len) return 0;
+        if (framer->resyncing && !framer->ident_known && header.s16PkgIdent != PKG_IDENT_DEFAULT) {
+            return 0;   // Waiting for the bytes after it (see framer_accept_candidate)
+        }
+        if (framer->resyncing) {
+            framer->resyncing = 0;
+            framer->stats.resyncs++;
+        } else if (!framer->ident_known) {
+            framer->ident = header.s16PkgIdent;
+            framer->ident_known = 1;
+        }
+
+        unsigned int pos = framer->tail & framer->mask;
+        unsigned int first = framer->capacity - pos;
+        if (first > pkg_len) first = pkg_len;
+        view->seg[0] = framer->buf + pos;
+        view->seg_len[0] = (int)first;
+        view->seg[1] = framer->buf;
+        view->seg_len[1] = (int)(pkg_len - first);
+        view->len = (int)pkg_len;
+        view->type = type;
+        view->header = header;
+        view->owner = framer;
+
+        // Pin every block the package touches
+        int first_block = (int)(pos >> FRAMER_BLOCK_SHIFT);
+        int last_block = (int)(((framer->tail + pkg_len - 1) & framer->mask) >> FRAMER_BLOCK_SHIFT);
+        int count = last_block - first_block + 1;
+        if (count <= 0) count += framer->block_count;
+        view->first_block = first_block;
+        view->block_count = count;
+        for (int i = 0; i < count; i++) {
+            atomic_fetch_add_explicit(&framer->block_refs[(first_block + i) % framer->block_count], 1, memory_order_relaxed);
+        }
+
+        // Sum while the bytes are still cache-hot from PPCS_Read
+        view->checksum_ok = 1;
+        if (framer->verify) {
+            int body = (int)pkg_len - (int)sizeof(PackageTail_t);
+            int n0 = view->seg_len[0] < body ? view->seg_len[0] : body;
+            uint16_t sum = (uint16_t)(package_checksum(view->seg[0], n0) + package_checksum(view->seg[1], body - n0));
+            PackageTail_t tail;
+            ring_peek(framer, framer->tail + (unsigned int)body, &tail, sizeof(tail));
+            framer->stats.checksums++;
+            if (sum != tail.u16Check) {
+                view->checksum_ok = 0;
+                framer->stats.checksum_failures[type]++;
+            }
+        }
+
+        framer->tail += pkg_len;
+        framer->stats.packages++;
+        return 1;
+    }
+    return 0;
+}
+
+void package_view_release(PackageView* view) {
+    if (!view || !view->owner) return;
+    StreamFramer* framer = view->owner;
+    for (int i = 0; i < view->block_count; i++) {
+        atomic_fetch_sub_explicit(&framer->block_refs[(view->first_block + i) % framer->block_count], 1, memory_order_release);
+    }
+    view->owner = NULL;
+}
+
+const unsigned char* package_view_data(const PackageView* view, int offset, int len) {
+    if (!view || offset < 0 || len < 0 || offset + len > view->len) return NULL;
+    if (offset + len <= view->seg_len[0]) return view->seg[0] + offset;
+    if (offset >= view->seg_len[0]) return view->seg[1] + (offset - view->seg_len[0]);
+    return NULL;
+}
+
+int package_view_read(const PackageView* view, int offset, void* dst, int len) {
+    if (!view || !dst || offset < 0 || len < 0 || offset + len > view->len) return -1;
+    unsigned char* out = (unsigned char*)dst;
+    if (offset < view->seg_len[0]) {
+        int n = view->seg_len[0] - offset;
+        if (n > len) n = len;
+        memcpy(out, view->seg[0] + offset, n);
+        out += n;
+        len -= n;
+        offset = view->seg_len[0];
+    }
+    if (len > 0) memcpy(out, view->seg[1] + (offset - view->seg_len[0]), len);
+    return 0;
+}
+
+void package_view_copy(const PackageView* view, int offset, unsigned char* dst, int len) {
+    if (package_view_read(view, offset, dst, len) == 0) package_pool_count_copy(len);
+}
+
+int package_view_append(const PackageView* view, int offset, int len, PackageBuf** buf, int max_len) {
+    if (!view || !buf || !*buf || len <= 0) return -1;
+    PackageBuf* dst = *buf;
+    if (dst->len + len > max_len) return -1;
+    if (dst->len + len > dst->capacity) {
+        // Size hint was too small: move to a larger pooled buffer
+        PackageBuf* bigger = package_buf_alloc(dst->len + len);
+        if (!bigger) return -1;
+        memcpy(bigger->data, dst->data, dst->len);
+        package_pool_count_copy(dst->len);
+        bigger->len = dst->len;
+        package_buf_release(dst);
+        *buf = dst = bigger;
+    }
+    package_view_copy(view, offset, dst->data + dst->len, len);
+    dst->len += len;
+    return 0;
+}
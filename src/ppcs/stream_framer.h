@@ -0,0 +1,110 @@
+// Stream Framer Header
+#ifndef STREAM_FRAMER_H
+#define STREAM_FRAMER_H
+
+#include "protocol_defs.h"
+#include "package_pool.h"
+
+// Circular receive buffer that cuts the PPCS byte stream into packages.
+// Packages are parsed in place by offset; nothing is ever memmoved.
+//
+// The ring is split into fixed blocks, each with a reference count. A
+// PackageView handed out by stream_framer_next() pins the blocks it covers,
+// so it can travel to the consumer thread without copying; the space is
+// only written again after package_view_release().
+
+typedef struct StreamFramer StreamFramer;
+
+// A package located inside the ring. When it wraps around the end of the
+// ring the bytes are split over seg[0] and seg[1]; seg_len[1] is 0 otherwise.
+typedef struct {
+    const unsigned char* seg[2];
+    int seg_len[2];
+    int len;                    // Total package length (prefix..tail)
+    int type;                   // PKG_TYPE_*, classified once by the framer
+    PackageHeader_t header;     // Copy of the header (safe when it was split)
+    StreamFramer* owner;        // NULL once released
+    int first_block;
+    int block_count;
+    // Pipeline timestamps in metrics_now_us() microseconds, set by the queue owner
+    long long read_at;          // PPCS_Read that completed the package returned
+    long long queued_at;
+    long long dequeued_at;
+    int checksum_ok;            // 0 if verification is on and u16Check did not match
+    int generation;             // Session handle the package arrived on (see ppcs_session_generation)
+} PackageView;
+
+typedef struct {
+    unsigned long long bytes_in;        // Bytes committed into the ring
+    unsigned long long packages;        // Complete packages handed out
+    unsigned long long skipped_bytes;   // Bytes dropped while resynchronising
+    unsigned long bad_length;           // Headers rejected for their length
+    unsigned long overflows;            // Pushes rejected for lack of space
+    unsigned long resyncs;              // Times sync was lost and found again
+    unsigned long rejected_magics;      // Magic matches rejected by the header checks
+    unsigned long long checksums;       // Packages verified
+    unsigned long checksum_failures[PKG_TYPE_TIMELAPSE + 1];   // Indexed by PKG_TYPE_*
+} StreamFramerStats;
+
+// capacity is rounded up to a power of two
+StreamFramer* stream_framer_create(int capacity);
+void stream_framer_destroy(StreamFramer* framer);
+// Drop buffered bytes; only valid while no views are outstanding
+void stream_framer_reset(StreamFramer* framer);
+// Drop bytes not yet handed out, e.g. a partial package left by a closed
+// session. Outstanding views stay valid.
+void stream_framer_discard(StreamFramer* framer);
+
+// Direct-read interface: get contiguous writable space, read into it, commit.
+// Returns the number of writable bytes at *ptr (0 when the ring is full).
+int stream_framer_write_ptr(StreamFramer* framer, unsigned char** ptr);
+void stream_framer_commit(StreamFramer* framer, int len);
+
+// Copy received bytes in. Returns 0, or -1 if they do not fit (nothing copied).
+int stream_framer_push(StreamFramer* framer, const unsigned char* data, int len);
+
+// Find the next complete package. Returns 1 and fills view (which must be
+// released), 0 if more data is needed.
+int stream_framer_next(StreamFramer* framer, PackageView* view);
+
+int stream_framer_used(const StreamFramer* framer);
+int stream_framer_free(StreamFramer* framer);
+void stream_framer_get_stats(const StreamFramer* framer, StreamFramerStats* stats);
+
+// Verify the tail checksum of every package handed out (off by default)
+void stream_framer_set_verify(StreamFramer* framer, int enable);
+
+// 16-bit byte sum used for PackageTail_t.u16Check (prefix through payload)
+uint16_t package_checksum(const unsigned char* data, int len);
+
+// Write one package into out: prefix (PKG_*_PREFIX_STR), header with
+// u16PkgLen set to sub_len + len (s16PkgIdent PKG_IDENT_DEFAULT if left 0),
+// the sub-header, the payload, and a tail with the checksum. Returns the
+// package length, or -1 if it does not fit max_len or u16PkgLen.
+int package_build(const char* prefix, const PackageHeader_t* header, const void* sub_header, int sub_len,
+                  const void* data, int len, unsigned char* out, int max_len);
+
+// Returns PKG_TYPE_* for a 4-byte prefix, 0 if unknown (see package_registry.h)
+int stream_framer_prefix_type(const unsigned char* prefix);
+
+// Offset of the first registered package magic in data[0..len), or -1.
+// Positions past len - PKG_PREFIX_LEN are not checked.
+int stream_framer_find_magic(const unsigned char* data, int len);
+
+// Unpin the ring blocks held by a view. Safe to call from any thread, once.
+void package_view_release(PackageView* view);
+
+// Pointer to len bytes at offset inside the package if they are contiguous, else NULL
+const unsigned char* package_view_data(const PackageView* view, int offset, int len);
+
+// Copy len bytes at offset into dst; counted as a payload copy
+void package_view_copy(const PackageView* view, int offset, unsigned char* dst, int len);
+
+// Append len payload bytes at offset to *buf, growing it from the pool when
+// needed. Returns 0, or -1 if the result would exceed max_len (nothing copied).
+int package_view_append(const PackageView* view, int offset, int len, PackageBuf** buf, int max_len);
+
+// Copy a small protocol structure (sub-header) at offset; not counted
+int package_view_read(const PackageView* view, int offset, void* dst, int len);
+
+#endif // STREAM_FRAMER_H
@@ -14,6 +14,11 @@
 #include "app_context.h"
 #include "protocol_defs.h"
 #include "timelapse_manager.h"
+#include "async_log.h"
+#include "metrics.h"
+#include "package_registry.h"
+#include "command_tracker.h"
+#include "package_reasm.h"
 
 #if 0
 // Deprecated local JSON command defines kept for reference (use command_handler.h enum instead)
@@ -22,114 +27,36 @@
 #define MAX_CMD_JSON_REASM (64 * 1024)
 #define CMD_JSON_REASM_SLOTS 8
 
-typedef struct {
-    unsigned short pkg_id;
-    size_t used;
-    size_t cap;
-    char* buf;
-    int active;
-} CmdJsonReasmSlot;
-
-static CmdJsonReasmSlot g_cmd_json_slots[CMD_JSON_REASM_SLOTS] = {0};
-
-static CmdJsonReasmSlot* get_cmd_json_slot(unsigned short pkg_id) {
-    CmdJsonReasmSlot* empty = NULL;
-    for (int i = 0; i < CMD_JSON_REASM_SLOTS; i++) {
-        if (g_cmd_json_slots[i].active && g_cmd_json_slots[i].pkg_id == pkg_id) return &g_cmd_json_slots[i];
-        if (!g_cmd_json_slots[i].active && empty == NULL) empty = &g_cmd_json_slots[i];
-    }
-    if (empty) {
-        memset(empty, 0, sizeof(*empty));
-        empty->pkg_id = pkg_id;
-        empty->active = 1;
-        return empty;
-    }
-    CmdJsonReasmSlot* slot = &g_cmd_json_slots[0];
-    slot->pkg_id = pkg_id;
-    slot->used = 0;
-    slot->active = 1;
-    return slot;
-}
-
-static void reset_cmd_json_slot(CmdJsonReasmSlot* slot) {
-    if (!slot) return;
-    slot->used = 0;
-    slot->active = 0;
-    slot->pkg_id = 0;
-}
-
-int cmd_json_reasm_append(unsigned short pkg_id,
-                           unsigned short pkg_index,
-                           const char* fragment,
-                           int fragment_len,
-                           const char** out_json,
-                           int* out_len) {
-    if (!fragment || fragment_len <= 0) return 0;
-    CmdJsonReasmSlot* slot = get_cmd_json_slot(pkg_id);
-    if (!slot) return 0;
-    size_t needed = slot->used + (size_t)fragment_len + 1;
-    if (needed > MAX_CMD_JSON_REASM) { reset_cmd_json_slot(slot); return 0; }
-    if (slot->cap < needed) {
-        size_t new_cap = slot->cap ? slot->cap : 4096;
-        while (new_cap < needed) new_cap *= 2;
-        if (new_cap > MAX_CMD_JSON_REASM) new_cap = MAX_CMD_JSON_REASM;
-        char* new_buf = (char*)realloc(slot->buf, new_cap);
-        if (!new_buf) { reset_cmd_json_slot(slot); return 0; }
-        slot->buf = new_buf; slot->cap = new_cap;
-    }
-    memcpy(slot->buf + slot->used, fragment, (size_t)fragment_len);
-    slot->used += (size_t)fragment_len;
-    slot->buf[slot->used] = '\0';
-    if (pkg_index != 0) return 0;
-    if (out_json) *out_json = slot->buf;
-    if (out_len) *out_len = (int)slot->used;
-    slot->active = 0; slot->pkg_id = 0; slot->used = 0;
-    return 1;
+// The session's reassembler for responses split over several packages,
+// made with its first JSON package; any fragment opens its payload
+static PackageReasm* session_json_reasm(const PackageContext* ctx) {
+    AppContext* app = ctx ? (AppContext*)ctx->app : NULL;
+    if (!app) return NULL;
+    if (!app->reasm[PKG_TYPE_JSON]) {
+        char name[64];
+        snprintf(name, sizeof(name), "json %s", ctx->did ? ctx->did : "");
+        app->reasm[PKG_TYPE_JSON] = package_reasm_create(name, CMD_JSON_REASM_SLOTS, MAX_CMD_JSON_REASM, 0,
+                                                         REASM_OPEN_ANY | REASM_TERMINATE);
+    }
+    return app->reasm[PKG_TYPE_JSON];
 }
 
 unsigned short calculate_checksum(const unsigned char* data, int len) {
-    unsigned short checksum = 0;
-    for (int i = 0; i < len; i++) checksum += data[i];
-    return checksum;
+    return package_checksum(data, len);
 }
 
 int build_command_package(const char* json_data, unsigned char* package, int max_len, unsigned short pkg_id, unsigned short pkg_cmd) {
-    // Use unified protocol definitions
-    typedef PackageHeader_t TAG_PKG_HEADER_S;
-    typedef PackageTail_t TAG_PKG_TAIL_S;
-
-    const char* PKG_JSON_PREFIX = "#nsj";
-    const unsigned short PKG_IDENT = 0x876e;
-    int json_len = (int)strlen(json_data);
-    int total_len = 4 + sizeof(TAG_PKG_HEADER_S) + json_len + sizeof(TAG_PKG_TAIL_S);
-    if (total_len > max_len) return -1;
-    int offset = 0;
-    memcpy(package + offset, PKG_JSON_PREFIX, 4); offset += 4;
-    TAG_PKG_HEADER_S* header = (TAG_PKG_HEADER_S*)(package + offset); memset(header,0,sizeof(TAG_PKG_HEADER_S));
-    header->s16PkgIdent = PKG_IDENT; header->u16PkgLen = (unsigned short)json_len; header->u16PkgId = pkg_id; header->u16PkgIndex = 0; header->u16PkgKey = 0; header->u16PkgCmd = pkg_cmd; header->u8PkgSubHead = 0;
-    offset += sizeof(TAG_PKG_HEADER_S);
-    memcpy(package + offset, json_data, json_len); offset += json_len;
-    TAG_PKG_TAIL_S* tail = (TAG_PKG_TAIL_S*)(package + offset); tail->u8Zero = 0; tail->u8Res = 0; tail->u16Check = calculate_checksum(package, offset);
-    offset += sizeof(TAG_PKG_TAIL_S);
-    return offset;
+    PackageHeader_t header;
+    memset(&header, 0, sizeof(header));
+    header.u16PkgId = pkg_id;
+    header.u16PkgCmd = pkg_cmd;
+    return package_build(PKG_JSON_PREFIX_STR, &header, NULL, 0, json_data, (int)strlen(json_data), package, max_len);
 }
 
-// Handle command package (parsing & record list handling)
-int handle_command_package(const unsigned char* package, int pkg_len) {
-    if (pkg_len < 4) return -1;
-    const char* PKG_JSON_PREFIX = "#nsj";
-    if (memcmp(package, PKG_JSON_PREFIX, 4) != 0) return -1;
-    // Use unified protocol definitions
-    typedef PackageHeader_t TAG_PKG_HEADER_S;
-    int offset = 4;
-    TAG_PKG_HEADER_S* header = (TAG_PKG_HEADER_S*)(package + offset);
-    offset += sizeof(TAG_PKG_HEADER_S);
-    int json_len = header->u16PkgLen;
-    if (json_len < 0 || offset + json_len > pkg_len) return -1;
-    const char* assembled_json = NULL; int assembled_len = 0;
-    int is_complete = cmd_json_reasm_append(header->u16PkgId, header->u16PkgIndex, (const char*)(package+offset), json_len, &assembled_json, &assembled_len);
-    if (!is_complete) return 0;
-    const char* json_response = assembled_json;
+// Handle a reassembled JSON response (parsing & record list handling)
+static int handle_command_response(PPCSSession* net, const PackageHeader_t* header, const char* json_response,
+                                   int assembled_len) {
+    CommandStatus status = command_tracker_response(net, header->u16PkgId, json_response);
     printf("[Command] JSON response reassembled (length=%d):\n", assembled_len);
     printf("[Response] %s\n", json_response);
     // If record list response, parse
@@ -220,11 +147,29 @@ int handle_command_package(const unsigned char* package, int pkg_len) {
         cJSON_Delete(root);
         return 0;
     }
-    if (strstr(json_response, "\"code\":200") != NULL) { printf("[SUCCESS] Command executed successfully\n"); return 0; }
-    if (strstr(json_response, "\"ack\":true") != NULL) { printf("[INFO] Command acknowledged\n"); return 0; }
+    if (status == CMD_STATUS_OK) printf("[SUCCESS] Command 0x%04X executed successfully\n", header->u16PkgCmd);
+    else if (status == CMD_STATUS_FAILED) printf("[Command] Command 0x%04X failed on the device\n", header->u16PkgCmd);
     return 0;
 }
 
+// Handle command package: reassemble, then parse the complete response
+int handle_command_package(const PackageView* pkg, const PackageContext* ctx) {
+    if (!pkg || pkg->len < PKG_MIN_LEN) return -1;
+    if (pkg->type != PKG_TYPE_JSON) return -1;
+    PackageReasm* json_reasm = session_json_reasm(ctx);
+    if (!json_reasm) return -1;
+    int offset = PKG_HEADER_TOTAL_LEN;
+    const PackageHeader_t* header = &pkg->header;
+    int json_len = header->u16PkgLen;
+    if (json_len <= 0 || offset + json_len > pkg->len) return json_len == 0 ? 0 : -1;
+    ReasmPayload json;
+    int ret = package_reasm_add(json_reasm, PKG_TYPE_JSON, pkg, offset, json_len, &json);
+    if (ret != REASM_COMPLETE) return ret < 0 ? -1 : 0;
+    ret = handle_command_response(((AppContext*)ctx->app)->net, header, (const char*)json.data, json.len);
+    package_reasm_payload_release(&json);
+    return ret;
+}
+
 // ---------------- Record list implementation (migrated) ----------------
 typedef struct {
     char start_time[64];
@@ -277,39 +222,78 @@ static unsigned short s_global_seq = 0;
 static const char* g_client_id = "Android_1c775ac30545f25a";
 static const char* g_client_user = "29566628-5071-47e7-b5f5-9cc3849c9ade";
 
-// Forward
-int send_command(INT32 session_handle, const char* json_data, unsigned short pkg_id, unsigned short pkg_cmd) {
-    unsigned char package[4096];
+// Queries: the device answers the same way however often they arrive
+static int command_is_retriable(unsigned short pkg_cmd) {
+    switch (pkg_cmd) {
+        case JSON_CMD_HEARTBEAT:
+        case JSON_CMD_SETTINGS_GET:
+        case JSON_CMD_SDCARD_GET:
+        case JSON_CMD_VIDEO_GET_PARAMS:
+        case JSON_CMD_REMOTE_MOTION_GET:
+        case JSON_CMD_RECORD_SETTINGS_GET:
+        case JSON_CMD_RECORD_LIST_GET:
+        case JSON_CMD_TIMELAPSE_LIST_GET:
+        case JSON_CMD_VPD_DATA_GET:
+        case JSON_CMD_VPD_CONFIG_GET:
+        case JSON_CMD_VPD_CALIBRATION_GET:
+        case JSON_CMD_HISTORY_DATA_GET:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Build the package and queue it for the session's writer thread, tracked
+// until answered; returns without waiting for PPCS_Write
+static int send_command_tracked(AppContext* ctx, const char* json_data, unsigned short pkg_id, unsigned short pkg_cmd,
+                                const CommandOptions* options, CommandRequest** out) {
+    unsigned char package[CMD_WRITER_MAX_PACKAGE];
     int pkg_len = build_command_package(json_data, package, sizeof(package), pkg_id, pkg_cmd);
     if (pkg_len < 0) {
         printf("[Command] ERROR: Failed to build command package\n");
         return -1;
     }
     
-    printf("[Command] ========== SENDING COMMAND ==========\n");
-    printf("[Command] Package ID: 0x%04X\n", pkg_id);
-    printf("[Command] Package Command: 0x%04X\n", pkg_cmd);
-    printf("[Command] JSON Data: %s\n", json_data);
-    printf("[Command] Package Length: %d bytes\n", pkg_len);
-    printf("[Command] Package Hex: ");
-    for (int i = 0; i < pkg_len && i < 64; i++) {
-        printf("%02X ", package[i]);
-    }
-    if (pkg_len > 64) printf("...");
-    printf("\n");
+    LOG_DEBUG("Command", "Sending id=0x%04X cmd=0x%04X len=%d: %s", pkg_id, pkg_cmd, pkg_len, json_data);
+    if (LOG_ENABLED(LOG_LEVEL_TRACE)) {
+        char hex[64 * 3 + 4];
+        int n = 0;
+        for (int i = 0; i < pkg_len && i < 64; i++) n += snprintf(hex + n, sizeof(hex) - n, "%02X ", package[i]);
+        if (pkg_len > 64) snprintf(hex + n, sizeof(hex) - n, "...");
+        LOG_TRACE("Command", "Package Hex: %s", hex);
+    }
     
-    INT32 ret = PPCS_Write(session_handle, 0, (char*)package, pkg_len);
-    if (ret < 0) {
-        printf("[Command] ERROR: PPCS_Write failed with code %d\n", ret);
-        print_error("PPCS_Write", ret);
+    if (command_tracker_send(ctx->net, package, pkg_len, pkg_id, pkg_cmd, json_data,
+                             command_is_retriable(pkg_cmd), options, out) < 0) {
+        LOG_ERROR("Command", "Command queue full or unavailable, id=0x%04X cmd=0x%04X not sent", pkg_id, pkg_cmd);
         return -1;
     }
     
-    printf("[Command] SUCCESS: Sent %d bytes to session 0x%08X\n", ret, session_handle);
-    printf("[Command] ======================================\n");
+    LOG_DEBUG("Command", "Queued %d bytes for session 0x%08X", pkg_len, ctx->session_handle);
     return 0;
 }
 
+int send_command(AppContext* ctx, const char* json_data, unsigned short pkg_id, unsigned short pkg_cmd) {
+    return send_command_tracked(ctx, json_data, pkg_id, pkg_cmd, NULL, NULL);
+}
+
+CommandRequest* command_request(void* app_context, unsigned short pkg_cmd, const char* def, const char* data_json,
+                                const CommandOptions* options) {
+    AppContext* ctx = (AppContext*)app_context;
+    if (!ctx) return NULL;
+    char json_request[CMD_WRITER_MAX_PACKAGE];
+    int n = snprintf(json_request, sizeof(json_request), "{\"version\":\"1.0\",\"ack\":false,\"seq\":%d,\"cmd\":%d,\"def\":\"%s\",\"id\":\"%s\",\"user\":\"%s\"%s%s}",
+                     s_global_seq++, pkg_cmd, def ? def : "", g_client_id, g_client_user,
+                     data_json ? ",\"data\":" : "", data_json ? data_json : "");
+    if (n < 0 || n >= (int)sizeof(json_request)) {
+        printf("[Command] ERROR: Request for cmd 0x%04X too large\n", pkg_cmd);
+        return NULL;
+    }
+    CommandRequest* request = NULL;
+    if (send_command_tracked(ctx, json_request, s_global_pkg_id++, pkg_cmd, options, &request) < 0) return NULL;
+    return request;
+}
+
 void on_live_button_clicked(void* user_data) {
     AppContext* ctx = (AppContext*)user_data;
     if (!ctx) {
@@ -327,7 +311,7 @@ void on_live_button_clicked(void* user_data) {
     snprintf(json_request, sizeof(json_request), "{\"version\":\"1.0\",\"ack\":false,\"seq\":%d,\"cmd\":%d,\"def\":\"JSON_CMD_VIDEO_START\",\"id\":\"%s\",\"user\":\"%s\"}", s_global_seq++, JSON_CMD_VIDEO_START, g_client_id, g_client_user);
     printf("[Live] JSON: %s\n", json_request);
     
-    if (send_command(ctx->session_handle, json_request, s_global_pkg_id++, JSON_CMD_VIDEO_START) == 0) {
+    if (send_command(ctx, json_request, s_global_pkg_id++, JSON_CMD_VIDEO_START) == 0) {
         ctx->live_started = 1;
         printf("[Live] SUCCESS: Live stream started flag set\n");
     } else {
@@ -353,7 +337,7 @@ void on_live_stop_clicked(void* user_data) {
     snprintf(json_request, sizeof(json_request), "{\"version\":\"1.0\",\"ack\":false,\"seq\":%d,\"cmd\":%d,\"def\":\"JSON_CMD_VIDEO_STOP\",\"id\":\"%s\",\"user\":\"%s\"}", s_global_seq++, JSON_CMD_VIDEO_STOP, g_client_id, g_client_user);
     printf("[Live] JSON: %s\n", json_request);
     
-    if (send_command(ctx->session_handle, json_request, s_global_pkg_id++, JSON_CMD_VIDEO_STOP) == 0) {
+    if (send_command(ctx, json_request, s_global_pkg_id++, JSON_CMD_VIDEO_STOP) == 0) {
         if (ctx->video_mgr) {
             // Stop the main/live stream only: destroy decoder and close display
             video_manager_stop_stream(ctx->video_mgr, 1);
@@ -386,7 +370,7 @@ void on_playback_button_clicked(void* user_data) {
     "{\"version\":\"1.0\",\"ack\":false,\"seq\":%d,\"cmd\":%d,\"def\":\"JSON_CMD_PLAYBACK_START\",\"id\":\"%s\",\"user\":\"%s\",\"data\":{\"startTime\":%lld,\"endTime\":%lld}}", s_global_seq++, JSON_CMD_PLAYBACK_START, g_client_id, g_client_user, start_ts, end_ts);
     printf("[Playback] JSON: %s\n", json_request);
     
-    if (send_command(ctx->session_handle, json_request, s_global_pkg_id++, JSON_CMD_PLAYBACK_START) == 0) {
+    if (send_command(ctx, json_request, s_global_pkg_id++, JSON_CMD_PLAYBACK_START) == 0) {
         ctx->playback_started = 1;
         printf("[Playback] SUCCESS: Playback started flag set\n");
     } else {
@@ -395,6 +379,21 @@ void on_playback_button_clicked(void* user_data) {
     printf("[Playback] =========================================================\n");
 }
 
+void command_handler_resume_streams(void* user_data) {
+    AppContext* ctx = (AppContext*)user_data;
+    if (!ctx) return;
+    if (ctx->live_started) {
+        printf("[Live] Re-issuing live start on the new session\n");
+        ctx->live_started = 0;
+        on_live_button_clicked(ctx);
+    }
+    if (ctx->playback_started) {
+        printf("[Playback] Re-issuing playback start on the new session\n");
+        ctx->playback_started = 0;
+        on_playback_button_clicked(ctx);
+    }
+}
+
 void on_record_list_button_clicked(void* user_data) {
     AppContext* ctx = (AppContext*)user_data;
     if (!ctx) {
@@ -413,7 +412,7 @@ void on_record_list_button_clicked(void* user_data) {
     printf("[RecordList] JSON: %s\n", json_request);
     printf("[RecordList] Query Time Range: %lld to %lld (last 12 hours)\n", start_ts, end_ts);
     
-    if (send_command(ctx->session_handle, json_request, s_global_pkg_id++, 0x207) == 0) {
+    if (send_command(ctx, json_request, s_global_pkg_id++, 0x207) == 0) {
         printf("[RecordList] SUCCESS: Record list query sent\n");
     } else {
         printf("[RecordList] ERROR: Failed to send record list query\n");
@@ -439,7 +438,7 @@ void on_ota_upgrade_clicked(void* user_data) {
 
     printf("[OTA] JSON: %s\n", json_request);
 
-    if (send_command(ctx->session_handle, json_request, s_global_pkg_id++, JSON_CMD_OTA) == 0) {
+    if (send_command(ctx, json_request, s_global_pkg_id++, JSON_CMD_OTA) == 0) {
         printf("[OTA] SUCCESS: OTA upgrade request sent\n");
     } else {
         printf("[OTA] ERROR: Failed to send OTA upgrade request\n");
@@ -462,7 +461,7 @@ void on_snapshot_img_clicked(void* user_data) {
         s_global_seq++, JSON_CMD_SNAPSHOT_IMG, g_client_id, g_client_user);
     printf("[Snapshot] send JSON: %s\n", json_request);
     
-    if (send_command(ctx->session_handle, json_request, s_global_pkg_id++, JSON_CMD_SNAPSHOT_IMG) == 0) {
+    if (send_command(ctx, json_request, s_global_pkg_id++, JSON_CMD_SNAPSHOT_IMG) == 0) {
         printf("[Snapshot] SUCCESS: Snapshot command sent\n");
     } else {
         printf("[Snapshot] ERROR: Failed to send snapshot command\n");
@@ -487,7 +486,7 @@ void on_get_device_config_clicked(void* user_data) {
 
     printf("[DeviceConfig] JSON: %s\n", json_request);
 
-    if (send_command(ctx->session_handle, json_request, s_global_pkg_id++, CMD_GET_DEVICE_CONFIG) == 0) {
+    if (send_command(ctx, json_request, s_global_pkg_id++, CMD_GET_DEVICE_CONFIG) == 0) {
         printf("[DeviceConfig] SUCCESS: Device config request sent\n");
     } else {
         printf("[DeviceConfig] ERROR: Failed to send device config request\n");
@@ -513,7 +512,7 @@ void on_telnet_enable_clicked(void* user_data) {
 
     printf("[Telnet] JSON: %s\n", json_request);
 
-    if (send_command(ctx->session_handle, json_request, s_global_pkg_id++, JSON_CMD_TELNET_ENABLE_REQUEST) == 0) {
+    if (send_command(ctx, json_request, s_global_pkg_id++, JSON_CMD_TELNET_ENABLE_REQUEST) == 0) {
         printf("[Telnet] SUCCESS: Telnet enable request sent\n");
     } else {
         printf("[Telnet] ERROR: Failed to send telnet enable request\n");
@@ -544,7 +543,7 @@ void on_get_sdcard_info_clicked(void* user_data) {
 
     printf("[SDCard] JSON: %s\n", json_request);
 
-    int send_result = send_command(ctx->session_handle, json_request, s_global_pkg_id++, CMD_GET_SDCARD_INFO);
+    int send_result = send_command(ctx, json_request, s_global_pkg_id++, CMD_GET_SDCARD_INFO);
     if (send_result == 0) {
         printf("[SDCard] SUCCESS: SD card info request sent\n");
     } else {
@@ -571,7 +570,7 @@ void on_format_sdcard_clicked(void* user_data) {
 
     printf("[SDCard] JSON: %s\n", json_request);
 
-    if (send_command(ctx->session_handle, json_request, s_global_pkg_id++, CMD_SDCARD_FORMAT) == 0) {
+    if (send_command(ctx, json_request, s_global_pkg_id++, CMD_SDCARD_FORMAT) == 0) {
         printf("[SDCard] SUCCESS: SD card format request sent\n");
     } else {
         printf("[SDCard] ERROR: Failed to send SD card format request\n");
@@ -597,7 +596,7 @@ void on_eject_sdcard_clicked(void* user_data) {
 
     printf("[SDCard] JSON: %s\n", json_request);
 
-    if (send_command(ctx->session_handle, json_request, s_global_pkg_id++, CMD_SDCARD_POP) == 0) {
+    if (send_command(ctx, json_request, s_global_pkg_id++, CMD_SDCARD_POP) == 0) {
         printf("[SDCard] SUCCESS: SD card eject request sent\n");
     } else {
         printf("[SDCard] ERROR: Failed to send SD card eject request\n");
@@ -624,7 +623,7 @@ void on_get_timelapse_list_clicked(void* user_data) {
 
     printf("[Timelapse] JSON: %s\n", json_request);
 
-    if (send_command(ctx->session_handle, json_request, s_global_pkg_id++, CMD_GET_TIMELAPSE_LIST) == 0) {
+    if (send_command(ctx, json_request, s_global_pkg_id++, CMD_GET_TIMELAPSE_LIST) == 0) {
         printf("[Timelapse] SUCCESS: Timelapse list request sent\n");
     } else {
         printf("[Timelapse] ERROR: Failed to send timelapse list request\n");
@@ -654,7 +653,7 @@ void on_download_timelapse_clicked(AppContext* app_context) {
 
     printf("[Timelapse] JSON: %s\n", json_request);
 
-    if (send_command(ctx->session_handle, json_request, s_global_pkg_id++, CMD_TIMELAPSE_DOWNLOAD) == 0) {
+    if (send_command(ctx, json_request, s_global_pkg_id++, CMD_TIMELAPSE_DOWNLOAD) == 0) {
         printf("[Timelapse] SUCCESS: Timelapse download request sent\n");
     } else {
         printf("[Timelapse] ERROR: Failed to send timelapse download request\n");
@@ -683,7 +682,7 @@ void on_download_timelapse_end_clicked(void* user_data) {
 
     printf("[Timelapse] JSON: %s\n", json_request);
 
-    if (send_command(ctx->session_handle, json_request, s_global_pkg_id++, JSON_CMD_TIMELAPSE_DOWNLOAD_END) == 0) {
+    if (send_command(ctx, json_request, s_global_pkg_id++, JSON_CMD_TIMELAPSE_DOWNLOAD_END) == 0) {
         printf("[Timelapse] SUCCESS: Timelapse download end request sent\n");
     } else {
         printf("[Timelapse] ERROR: Failed to send timelapse download end request\n");
@@ -709,7 +708,7 @@ void on_start_timelapse_clicked(void* user_data) {
 
     printf("[Timelapse] JSON: %s\n", json_request);
 
-    if (send_command(ctx->session_handle, json_request, s_global_pkg_id++, CMD_TIMELAPSE_START) == 0) {
+    if (send_command(ctx, json_request, s_global_pkg_id++, CMD_TIMELAPSE_START) == 0) {
         ctx->timelapse_recording = 1;
         printf("[Timelapse] SUCCESS: Timelapse start command sent\n");
     } else {
@@ -736,7 +735,7 @@ void on_stop_timelapse_clicked(void* user_data) {
 
     printf("[Timelapse] JSON: %s\n", json_request);
 
-    if (send_command(ctx->session_handle, json_request, s_global_pkg_id++, CMD_TIMELAPSE_STOP) == 0) {
+    if (send_command(ctx, json_request, s_global_pkg_id++, CMD_TIMELAPSE_STOP) == 0) {
         ctx->timelapse_recording = 0;
         printf("[Timelapse] SUCCESS: Timelapse stop command sent\n");
     } else {
@@ -832,6 +831,11 @@ void on_command_triggered(int command_id, void* user_data) {
             printf("[Command] Handler: on_telnet_enable_clicked\n");
             on_telnet_enable_clicked(user_data);
             break;
+        case CMD_DUMP_METRICS:
+            printf("[Command] Handler: metrics_dump\n");
+            if (metrics_dump(NULL) == 0) printf("[Command] Metrics snapshot written\n");
+            else printf("[Command] ERROR: Metrics snapshot not written (MetricsFile unset?)\n");
+            break;
         default:
             printf("[Command] ERROR: Unknown command: 0x%X\n", command_id);
             break;
@@ -839,3 +843,11 @@ void on_command_triggered(int command_id, void* user_data) {
     printf("[Command] ============================================\n");
 }
 
+
+static int command_package_handler(const PackageView* pkg, const PackageContext* ctx) {
+    return handle_command_package(pkg, ctx);
+}
+
+void command_handler_register_packages(void) {
+    package_registry_register(PKG_JSON_MAGIC, PKG_TYPE_JSON, "json", 0, command_package_handler);
+}
@@ -1,6 +1,10 @@
 #ifndef COMMAND_HANDLER_H
 #define COMMAND_HANDLER_H
 
+#include "stream_framer.h"
+#include "package_registry.h"
+#include "command_tracker.h"
+
 typedef enum {
     JSON_CMD_HEARTBEAT               = 0x01,  // 心跳包
     JSON_CMD_SETTINGS_GET            = 0x02,  // 获取设备设置
@@ -71,12 +75,22 @@ typedef enum {
     JSON_CMD_TELNET_ENABLE_REQUEST   = 0x5001  // Telnet 临时开启请求（客户端→设备）
 } ELD_CMD_CODE;
 
-int handle_command_package(const unsigned char* package, int pkg_len);
+int handle_command_package(const PackageView* pkg, const PackageContext* ctx);
+// Register "#nsj" with the package registry; call before sessions start
+void command_handler_register_packages(void);
 int build_command_package(const char* json_data, unsigned char* package, int max_len, unsigned short pkg_id, unsigned short pkg_cmd);
 
 // App callbacks exposed to control panel
 void on_command_triggered(int command_id, void* user_data);
 void on_telnet_enable_clicked(void* user_data);
+// After a reconnect: send the start command again for live/playback streams that were running
+void command_handler_resume_streams(void* user_data);
+// Send cmd with the standard envelope (next seq and package id) and an
+// optional "data" object, without waiting. app_context is the session's
+// AppContext. Returns the request to wait on or poll (release it when
+// done), or NULL if it could not be queued.
+CommandRequest* command_request(void* app_context, unsigned short pkg_cmd, const char* def, const char* data_json,
+                                const CommandOptions* options);
 
 // Record list utilities
 void init_record_list(void);
@@ -0,0 +1,350 @@
+// Command Tracker Implementation
+#include "command_tracker.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "async_log.h"
+#include "metrics.h"
+
+struct CommandRequest {
+    PPCSSession* net;
+    unsigned char* package;         // Kept for resends
+    int len;
+    unsigned short pkg_id;
+    unsigned short pkg_cmd;
+    int seq;                        // -1 if the request carried none
+    int timeout_ms;
+    int retries;
+    int attempts;
+    long long sent_at;              // Last attempt
+    long long deadline;
+    CommandDoneFn callback;
+    void* user;
+
+    volatile LONG refs;
+    volatile LONG status;           // CommandStatus
+    char* response;
+    int owns_response;
+    int code;
+    long long rtt_us;
+    HANDLE done;                    // Manual-reset, only when the caller holds a reference
+};
+
+static CommandRequest* s_slots[CMD_TRACKER_SLOTS];
+static int s_in_flight = 0;
+static CommandCodeStats s_codes[CMD_TRACKER_CODES];
+static int s_code_count = 0;
+static volatile LONG s_lock = 0;
+static int s_timeout_ms = CMD_DEFAULT_TIMEOUT_MS;
+static int s_retries = CMD_DEFAULT_RETRIES;
+
+static void tracker_lock(void) {
+    while (InterlockedCompareExchange(&s_lock, 1, 0) != 0) Sleep(0);
+}
+
+static void tracker_unlock(void) {
+    InterlockedExchange(&s_lock, 0);
+}
+
+// Integer value of "key": in a flat JSON text, without a full parse
+static int json_find_int(const char* json, const char* key, int* out) {
+    char pattern[32];
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    const char* p = json ? strstr(json, pattern) : NULL;
+    if (!p) return 0;
+    p += strlen(pattern);
+    while (*p == ' ') p++;
+    if ((*p < '0' || *p > '9') && *p != '-') return 0;
+    *out = atoi(p);
+    return 1;
+}
+
+// Stats slot for a command code, under the lock; NULL once the table is full
+static CommandCodeStats* code_stats(unsigned short code) {
+    for (int i = 0; i < s_code_count; i++) {
+        if (s_codes[i].code == code) return &s_codes[i];
+    }
+    if (s_code_count == CMD_TRACKER_CODES) return NULL;
+    CommandCodeStats* stats = &s_codes[s_code_count++];
+    memset(stats, 0, sizeof(*stats));
+    stats->code = code;
+    return stats;
+}
+
+// Take a request out of the table, under the lock
+static void slot_remove(int index) {
+    s_slots[index] = NULL;
+    s_in_flight--;
+}
+
+void command_request_release(CommandRequest* r) {
+    if (!r || InterlockedDecrement(&r->refs) != 0) return;
+    if (r->owns_response) free(r->response);
+    if (r->done) CloseHandle(r->done);
+    free(r->package);
+    free(r);
+}
+
+// Finish a request already removed from the table: stats, callback, waiters
+static void request_complete(CommandRequest* r, CommandStatus status, const char* json, int code) {
+    tracker_lock();
+    CommandCodeStats* stats = code_stats(r->pkg_cmd);
+    if (stats) {
+        if (status == CMD_STATUS_OK) stats->ok++;
+        else if (status == CMD_STATUS_FAILED) stats->failed++;
+        else if (status == CMD_STATUS_TIMEOUT) stats->timeouts++;
+        if (r->rtt_us > 0) {
+            stats->rtt_total_us += r->rtt_us;
+            if (r->rtt_us > stats->rtt_max_us) stats->rtt_max_us = r->rtt_us;
+        }
+    }
+    tracker_unlock();
+
+    r->code = code;
+    if (json) {
+        // Only a caller holding a reference can read it after the callback
+        r->response = (char*)json;
+        if (r->refs > 1) {
+            size_t len = strlen(json) + 1;
+            r->response = (char*)malloc(len);
+            if (r->response) memcpy(r->response, json, len);
+            r->owns_response = 1;
+        }
+    }
+    InterlockedExchange(&r->status, status);
+    if (r->callback) r->callback(r, r->user);
+    if (!r->owns_response) r->response = NULL;
+    if (r->done) SetEvent(r->done);
+    command_request_release(r);
+}
+
+void command_tracker_init(int timeout_ms, int retries) {
+    if (timeout_ms > 0) s_timeout_ms = timeout_ms;
+    if (retries >= 0) s_retries = retries;
+}
+
+int command_tracker_send(PPCSSession* net, const unsigned char* package, int len, unsigned short pkg_id,
+                         unsigned short pkg_cmd, const char* json, int retriable,
+                         const CommandOptions* options, CommandRequest** out) {
+    if (out) *out = NULL;
+    if (!net || !package || len <= 0) return -1;
+    CommandRequest* r = (CommandRequest*)calloc(1, sizeof(CommandRequest));
+    if (!r) return -1;
+    r->package = (unsigned char*)malloc(len);
+    r->done = out ? CreateEvent(NULL, TRUE, FALSE, NULL) : NULL;
+    if (!r->package || (out && !r->done)) {
+        free(r->package);
+        free(r);
+        return -1;
+    }
+    memcpy(r->package, package, len);
+    r->net = net;
+    r->len = len;
+    r->pkg_id = pkg_id;
+    r->pkg_cmd = pkg_cmd;
+    if (!json_find_int(json, "seq", &r->seq)) r->seq = -1;
+    r->timeout_ms = options && options->timeout_ms > 0 ? options->timeout_ms : s_timeout_ms;
+    r->retries = options && options->retries >= 0 ? options->retries : (retriable ? s_retries : 0);
+    r->callback = options ? options->callback : NULL;
+    r->user = options ? options->user : NULL;
+    r->refs = out ? 2 : 1;
+    r->status = CMD_STATUS_PENDING;
+    r->code = -1;
+    r->attempts = 1;
+    r->sent_at = metrics_now_us();
+    r->deadline = r->sent_at + (long long)r->timeout_ms * 1000;
+
+    tracker_lock();
+    int index = -1;
+    for (int i = 0; i < CMD_TRACKER_SLOTS; i++) {
+        if (!s_slots[i]) { index = i; break; }
+    }
+    if (index >= 0) {
+        s_slots[index] = r;
+        s_in_flight++;
+        CommandCodeStats* stats = code_stats(pkg_cmd);
+        if (stats) stats->sent++;
+    }
+    tracker_unlock();
+    if (index < 0) {
+        LOG_RATELIMITED(LOG_LEVEL_WARN, "Command", 1, "%d commands already in flight, cmd=0x%04X not sent",
+                        CMD_TRACKER_SLOTS, pkg_cmd);
+        r->refs = 1;
+        command_request_release(r);
+        return -1;
+    }
+
+    if (ppcs_session_send(net, package, len) < 0) {
+        tracker_lock();
+        if (s_slots[index] == r) slot_remove(index);
+        CommandCodeStats* stats = code_stats(pkg_cmd);
+        if (stats) stats->sent--;
+        tracker_unlock();
+        r->refs = 1;
+        command_request_release(r);
+        return -1;
+    }
+    metrics_add(MET_COMMANDS_SENT, 1);
+    if (out) *out = r;
+    return 0;
+}
+
+CommandStatus command_tracker_response(PPCSSession* net, unsigned short pkg_id, const char* json) {
+    int seq = -1;
+    int has_seq = json_find_int(json, "seq", &seq);
+    int code = -1;
+    json_find_int(json, "code", &code);
+    metrics_add(MET_COMMAND_RESPONSES, 1);
+
+    CommandRequest* r = NULL;
+    tracker_lock();
+    for (int i = 0; i < CMD_TRACKER_SLOTS; i++) {
+        CommandRequest* slot = s_slots[i];
+        if (!slot || slot->net != net) continue;
+        if (has_seq && slot->seq >= 0 ? slot->seq == seq : slot->pkg_id == pkg_id) {
+            r = slot;
+            slot_remove(i);
+            break;
+        }
+    }
+    tracker_unlock();
+    if (!r) {
+        metrics_add(MET_COMMAND_UNMATCHED, 1);
+        return CMD_STATUS_PENDING;
+    }
+    r->rtt_us = metrics_now_us() - r->sent_at;
+    metrics_record(MET_COMMAND_RTT, r->rtt_us);
+    CommandStatus status = (code < 0 || code == 200) ? CMD_STATUS_OK : CMD_STATUS_FAILED;
+    LOG_DEBUG("Command", "cmd=0x%04X seq=%d answered with code %d in %.1f ms (attempt %d)",
+              r->pkg_cmd, r->seq, code, r->rtt_us / 1000.0, r->attempts);
+    request_complete(r, status, json, code);
+    return status;
+}
+
+int command_tracker_poll(void) {
+    CommandRequest* resend[CMD_TRACKER_SLOTS];
+    CommandRequest* expired[CMD_TRACKER_SLOTS];
+    int resend_count = 0, expired_count = 0;
+    long long now = metrics_now_us();
+    long long next = -1;
+
+    tracker_lock();
+    for (int i = 0; i < CMD_TRACKER_SLOTS; i++) {
+        CommandRequest* r = s_slots[i];
+        if (!r) continue;
+        if (r->deadline <= now) {
+            if (r->attempts > r->retries) {
+                slot_remove(i);
+                expired[expired_count++] = r;
+                continue;
+            }
+            r->attempts++;
+            r->sent_at = now;
+            r->deadline = now + (long long)r->timeout_ms * 1000;
+            CommandCodeStats* stats = code_stats(r->pkg_cmd);
+            if (stats) stats->retries++;
+            // Referenced until sent: a response may complete it meanwhile
+            InterlockedIncrement(&r->refs);
+            resend[resend_count++] = r;
+        }
+        if (next < 0 || r->deadline < next) next = r->deadline;
+    }
+    tracker_unlock();
+
+    for (int i = 0; i < resend_count; i++) {
+        CommandRequest* r = resend[i];
+        LOG_INFO("Command", "cmd=0x%04X seq=%d unanswered after %d ms, sending again (attempt %d of %d)",
+                 r->pkg_cmd, r->seq, r->timeout_ms, r->attempts, r->retries + 1);
+        metrics_add(MET_COMMAND_RETRIES, 1);
+        if (ppcs_session_send(r->net, r->package, r->len) < 0) {
+            LOG_WARN("Command", "cmd=0x%04X: command queue full, retry not sent", r->pkg_cmd);
+        }
+        command_request_release(r);
+    }
+    for (int i = 0; i < expired_count; i++) {
+        CommandRequest* r = expired[i];
+        printf("[Command] WARNING: cmd=0x%04X seq=%d timed out after %d attempt%s\n",
+               r->pkg_cmd, r->seq, r->attempts, r->attempts > 1 ? "s" : "");
+        metrics_add(MET_COMMAND_TIMEOUTS, 1);
+        request_complete(r, CMD_STATUS_TIMEOUT, NULL, -1);
+    }
+    if (next < 0) return -1;
+    long long wait_ms = (next - now + 999) / 1000;
+    return wait_ms > 0 ? (int)wait_ms : 0;
+}
+
+// Cancel every request of net, or all of them when net is NULL
+static void tracker_cancel(PPCSSession* net) {
+    CommandRequest* cancelled[CMD_TRACKER_SLOTS];
+    int count = 0;
+    tracker_lock();
+    for (int i = 0; i < CMD_TRACKER_SLOTS; i++) {
+        CommandRequest* r = s_slots[i];
+        if (!r || (net && r->net != net)) continue;
+        slot_remove(i);
+        cancelled[count++] = r;
+    }
+    tracker_unlock();
+    for (int i = 0; i < count; i++) request_complete(cancelled[i], CMD_STATUS_CANCELLED, NULL, -1);
+}
+
+void command_tracker_cancel_session(PPCSSession* net) {
+    if (net) tracker_cancel(net);
+}
+
+void command_tracker_shutdown(void) {
+    tracker_cancel(NULL);
+}
+
+CommandStatus command_request_status(CommandRequest* r) {
+    return r ? (CommandStatus)r->status : CMD_STATUS_CANCELLED;
+}
+
+CommandStatus command_request_wait(CommandRequest* r, DWORD timeout_ms) {
+    if (!r) return CMD_STATUS_CANCELLED;
+    if (r->done) WaitForSingleObject(r->done, timeout_ms);
+    return (CommandStatus)r->status;
+}
+
+const char* command_request_response(CommandRequest* r) {
+    return r ? r->response : NULL;
+}
+
+int command_request_code(CommandRequest* r) {
+    return r ? r->code : -1;
+}
+
+unsigned short command_request_cmd(CommandRequest* r) {
+    return r ? r->pkg_cmd : 0;
+}
+
+int command_request_attempts(CommandRequest* r) {
+    return r ? r->attempts : 0;
+}
+
+long long command_request_rtt_us(CommandRequest* r) {
+    return r ? r->rtt_us : 0;
+}
+
+int command_tracker_in_flight(void) {
+    return s_in_flight;
+}
+
+int command_tracker_get_code_stats(int index, CommandCodeStats* stats) {
+    if (!stats) return 0;
+    tracker_lock();
+    int found = index >= 0 && index < s_code_count;
+    if (found) *stats = s_codes[index];
+    tracker_unlock();
+    return found;
+}
+
+void command_tracker_print_stats(void) {
+    CommandCodeStats stats;
+    for (int i = 0; command_tracker_get_code_stats(i, &stats); i++) {
+        unsigned long long answered = stats.ok + stats.failed;
+        printf("[Command] cmd=0x%04X: %llu sent, %llu ok, %llu failed, %llu timed out, %llu retries, rtt avg %.1f ms max %.1f ms\n",
+               stats.code, stats.sent, stats.ok, stats.failed, stats.timeouts, stats.retries,
+               answered ? stats.rtt_total_us / 1000.0 / answered : 0.0, stats.rtt_max_us / 1000.0);
+    }
+}
@@ -0,0 +1,97 @@
+// Command Tracker Header
+#ifndef COMMAND_TRACKER_H
+#define COMMAND_TRACKER_H
+
+#include "platform.h"
+#include "ppcs_core.h"
+
+// In-flight command table. Every command sent is kept here until the device
+// answers it, matched within the session it was sent on by the "seq" of the
+// response when it carries one and by the package id otherwise. A command
+// with no answer within its timeout is sent again if it was marked
+// retriable, else completed as timed out.
+//
+// Callers that want the outcome take a CommandRequest: a callback, run on
+// the main loop thread, and/or command_request_wait() from another thread.
+// Responses are dispatched by the main loop, so never wait on it there.
+
+#define CMD_TRACKER_SLOTS 64            // Commands in flight across all sessions
+#define CMD_TRACKER_CODES 64            // Command codes with their own stats
+#define CMD_DEFAULT_TIMEOUT_MS 5000
+#define CMD_DEFAULT_RETRIES 2
+
+typedef enum {
+    CMD_STATUS_PENDING = 0,
+    CMD_STATUS_OK,                  // Answered with code 200 (or no code)
+    CMD_STATUS_FAILED,              // Answered with another code
+    CMD_STATUS_TIMEOUT,             // No answer after the last attempt
+    CMD_STATUS_CANCELLED            // Session stopped or tracker shut down
+} CommandStatus;
+
+typedef struct CommandRequest CommandRequest;
+
+// status is final; the response text (NULL unless answered) is valid during the call
+typedef void (*CommandDoneFn)(CommandRequest* request, void* user);
+
+typedef struct {
+    int timeout_ms;                 // Per attempt, 0 for the configured default
+    int retries;                    // Resends after a timeout, -1 for the default of the command
+    CommandDoneFn callback;
+    void* user;
+} CommandOptions;
+
+typedef struct {
+    unsigned short code;            // pkg_cmd
+    unsigned long long sent;
+    unsigned long long ok;
+    unsigned long long failed;
+    unsigned long long timeouts;
+    unsigned long long retries;
+    long long rtt_total_us;
+    long long rtt_max_us;
+} CommandCodeStats;
+
+// Defaults for CommandOptions left at 0/-1 (call before sessions start)
+void command_tracker_init(int timeout_ms, int retries);
+// Cancels whatever is still in flight; call before sessions are destroyed
+void command_tracker_shutdown(void);
+
+// Record the command and queue the package to net's writer. retriable marks
+// commands safe to send twice (queries); others get no retries by default.
+// With out set, the caller holds a reference and must release it.
+// Returns 0, or -1 if the table is full or the package could not be queued.
+int command_tracker_send(PPCSSession* net, const unsigned char* package, int len, unsigned short pkg_id,
+                         unsigned short pkg_cmd, const char* json, int retriable,
+                         const CommandOptions* options, CommandRequest** out);
+
+// Response from the device behind net (main loop thread). Only commands sent
+// on net can match: devices number their packages independently. Returns the
+// status it completed a request with, or CMD_STATUS_PENDING if nothing matched.
+CommandStatus command_tracker_response(PPCSSession* net, unsigned short pkg_id, const char* json);
+
+// Retry or time out expired commands (main loop thread). Returns ms until
+// the next deadline, or -1 if nothing is in flight.
+int command_tracker_poll(void);
+
+// Cancel the commands of one session (before it is stopped)
+void command_tracker_cancel_session(PPCSSession* net);
+
+CommandStatus command_request_status(CommandRequest* request);
+// Blocks until the request completes or timeout_ms passes; not from the main loop
+CommandStatus command_request_wait(CommandRequest* request, DWORD timeout_ms);
+// Response text once answered, NULL otherwise
+const char* command_request_response(CommandRequest* request);
+// "code" of the response, -1 if none
+int command_request_code(CommandRequest* request);
+unsigned short command_request_cmd(CommandRequest* request);
+int command_request_attempts(CommandRequest* request);
+// Last send to response, 0 if not answered
+long long command_request_rtt_us(CommandRequest* request);
+void command_request_release(CommandRequest* request);
+
+int command_tracker_in_flight(void);
+// Stats for the index-th command code seen; returns 0 past the last one
+int command_tracker_get_code_stats(int index, CommandCodeStats* stats);
+void command_tracker_print_stats(void);
+
+#endif // COMMAND_TRACKER_H
@@ -64,13 +64,31 @@ typedef struct {
 #pragma pack()
 
 /* Protocol Prefixes */
-#define PKG_VIDEO_PREFIX_STR    "$gvi"   /* Video package prefix */
-#define PKG_IMAGE_PREFIX_STR    "$gmi"   /* Image package prefix */
-#define PKG_JSON_PREFIX_STR     "#nsj"   /* JSON command prefix */
+#define PKG_VIDEO_PREFIX_STR     "$div"   /* Video package prefix */
+#define PKG_IMAGE_PREFIX_STR     "$gmi"   /* Image package prefix */
+#define PKG_JSON_PREFIX_STR      "#nsj"   /* JSON command prefix */
+#define PKG_TIMELAPSE_PREFIX_STR "@lif"   /* Timelapse package prefix */
+#define PKG_PREFIX_LEN           4
+
+/* Prefixes as the uint32 the framer compares (little-endian load) */
+#define PKG_MAGIC(a, b, c, d)    ((uint32_t)(uint8_t)(a) | ((uint32_t)(uint8_t)(b) << 8) | \
+                                  ((uint32_t)(uint8_t)(c) << 16) | ((uint32_t)(uint8_t)(d) << 24))
+#define PKG_VIDEO_MAGIC          PKG_MAGIC('$', 'd', 'i', 'v')
+#define PKG_IMAGE_MAGIC          PKG_MAGIC('$', 'g', 'm', 'i')
+#define PKG_JSON_MAGIC           PKG_MAGIC('#', 'n', 's', 'j')
+#define PKG_TIMELAPSE_MAGIC      PKG_MAGIC('@', 'l', 'i', 'f')
+
+/* Value of s16PkgIdent in packages we build (and the usual device value) */
+#define PKG_IDENT_DEFAULT        0x876e
 
 /* Package Types */
 #define PKG_TYPE_VIDEO      0x01     /* Video data */
 #define PKG_TYPE_IMAGE      0x02     /* Image/snapshot data */
 #define PKG_TYPE_JSON       0x03     /* JSON command */
+#define PKG_TYPE_TIMELAPSE  0x04     /* Timelapse file data */
+
+/* Framing sizes: prefix + header + payload(u16PkgLen) + tail */
+#define PKG_HEADER_TOTAL_LEN  (PKG_PREFIX_LEN + (int)sizeof(PackageHeader_t))
+#define PKG_MIN_LEN           (PKG_HEADER_TOTAL_LEN + (int)sizeof(PackageTail_t))
 
 #endif // PROTOCOL_DEFS_H
@@ -0,0 +1,1008 @@
+// PPCS Device Emulator
+//
+// Plays the camera side of the protocol on the loopback PPCS library, for
+// repeatable load generation with no camera: live and playback video as
+// "$div" fragments, snapshots as "$gmi", timelapse downloads as "@lif", and
+// "#nsj" answers to the client's JSON commands.
+//
+// Video comes from an H.264/H.265 elementary stream (-i), split into access
+// units, or is synthesised at the bitrate of each stream. Frames are paced
+// at the stream's fps; when the client stops draining, the unsent backlog
+// grows and the emulator drops frames to the next I-frame as a camera
+// would, so the drop counters mark the client's saturation point.
+//
+//   ppcs_device_emu -s 1:3840x2160@30:16000 -s 2:640x360@15:512 -a -t 60
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "platform.h"
+#include "PPCS_API.h"
+#include "ppcs_loopback.h"
+#include "protocol_defs.h"
+#include "stream_framer.h"
+#include "package_registry.h"
+#include "command_handler.h"
+#include "timelapse_manager.h"
+#include "async_log.h"
+#include "metrics.h"
+#include "cJSON.h"
+
+#define EMU_MAX_STREAMS 5                   // Stream types 1..5
+#define EMU_MAX_DEVICES 16
+#define EMU_MAX_SESSIONS 8                  // Clients per device
+#define EMU_MAX_JOBS 16
+#define EMU_FRAME_MAX (4*1024*1024)         // Largest access unit
+#define EMU_CMD_RING (256*1024)
+#define EMU_JSON_MAX (64*1024)
+#define EMU_DEFAULT_DID "EMUDEV-000001-LOADX"
+#define EMU_DEFAULT_FRAGMENT 8192           // Payload bytes per package
+#define EMU_DEFAULT_BACKLOG_KB 2048         // Unsent video before frames are dropped
+#define EMU_LISTEN_SEC 1                    // Listen timeout, to notice shutdown
+#define EMU_CMD_READ_TIMEOUT_MS 100
+
+// Bulk jobs, run by the stream thread between video frames
+#define EMU_JOB_SNAPSHOT 1
+#define EMU_JOB_TIMELAPSE 2
+
+typedef struct {
+    int type;                               // s8StreamType
+    int width;
+    int height;
+    int fps;
+    int kbps;                               // Synthetic source only
+} EmuStreamConfig;
+
+typedef struct {
+    const unsigned char* data;
+    int len;
+    int key;
+} EmuAccessUnit;
+
+typedef struct {
+    int codec;                              // s8EncodeType: 1 H.264, 2 H.265
+    unsigned char* file;                    // Elementary stream, NULL when synthetic
+    EmuAccessUnit* units;
+    int count;
+    int keys;
+    unsigned char* noise[2];                // Synthetic P and I frame bodies
+} EmuSource;
+
+typedef struct {
+    const char* did;
+    int devices;
+    const char* input;
+    int codec;
+    EmuStreamConfig streams[EMU_MAX_STREAMS];
+    int stream_count;
+    int fragment;
+    int backlog_kb;
+    int interleave;                         // Mix the packages of frames due together
+    int autostart;                          // Stream on connect, without VIDEO_START
+    const char* snapshot;
+    int timelapse_frames;
+    int run_sec;
+    int report_sec;
+    int cmd_channel;
+    int video_channel;
+    int bulk_channel;
+    int log_level;
+} EmuOptions;
+
+typedef struct {
+    EmuStreamConfig cfg;
+    volatile LONG running;
+    long long next_due_us;
+    unsigned long long frame_no;
+    int unit;                               // Next access unit of a file source
+    int wait_key;                           // Dropped under backpressure: hold to the next I-frame
+    // Built packages of the current frame
+    unsigned char* out;
+    int out_len;
+    int* pkg_offsets;
+    int pkg_count;
+    // Stream thread only
+    unsigned long long frames;
+    unsigned long long bytes;
+    unsigned long long dropped;
+} EmuStream;
+
+typedef struct {
+    int kind;                               // EMU_JOB_*
+    int task_id;
+    int start_time;
+} EmuJob;
+
+typedef struct EmuDevice EmuDevice;
+
+typedef struct {
+    EmuDevice* dev;
+    INT32 handle;
+    int index;
+    volatile LONG run;
+    HANDLE cmd_thread;
+    HANDLE stream_thread;
+    EmuStream streams[EMU_MAX_STREAMS];
+    EmuJob jobs[EMU_MAX_JOBS];
+    int job_head;
+    int job_tail;
+    volatile LONG jobs_lock;                // Command thread queues, stream thread runs
+    unsigned short video_pkg_id;            // One sequence for all streams: fragments are routed by id
+    unsigned short bulk_pkg_id;
+    unsigned char* merge;                   // Interleaved packages of several frames
+    unsigned char* bulk_out;
+    unsigned char* json_out;
+    long long started_us;
+    long long ended_us;
+    unsigned long long commands;
+    unsigned long long bulk_bytes;
+    unsigned int max_backlog;
+} EmuSession;
+
+struct EmuDevice {
+    char did[64];
+    HANDLE thread;
+    EmuSession* sessions[EMU_MAX_SESSIONS];
+    int session_count;
+    int sessions_total;
+};
+
+static EmuOptions g_opt;
+static EmuSource g_source;
+static EmuDevice g_devices[EMU_MAX_DEVICES];
+static volatile LONG g_run = 1;
+static int g_out_max;                       // Built size of the largest frame
+static int g_max_packages;
+
+// ---------------- Source ----------------
+
+// Start of the next NAL unit at or after pos, -1 if none; *body is past the start code
+static int find_nal(const unsigned char* data, int len, int pos, int* body) {
+    for (int i = pos; i + 3 <= len; i++) {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+            int start = (i > pos && data[i - 1] == 0) ? i - 1 : i;
+            *body = i + 3;
+            return start;
+        }
+    }
+    return -1;
+}
+
+// Split an elementary stream into access units: a new one starts at a
+// parameter set, AUD or SEI, or at the first slice of a picture, once the
+// current unit holds a picture
+static int load_elementary_stream(const char* path, int codec) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        printf("[Emulator] ERROR: Cannot open %s\n", path);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    g_source.file = (unsigned char*)malloc(size > 0 ? size : 1);
+    if (!g_source.file || fread(g_source.file, 1, size, f) != (size_t)size) {
+        fclose(f);
+        printf("[Emulator] ERROR: Cannot read %s\n", path);
+        return -1;
+    }
+    fclose(f);
+    const unsigned char* data = g_source.file;
+    int len = (int)size;
+    int capacity = 1024;
+    g_source.units = (EmuAccessUnit*)malloc(capacity * sizeof(EmuAccessUnit));
+    int au_start = -1, au_has_picture = 0, au_key = 0;
+    int body;
+    int nal = find_nal(data, len, 0, &body);
+    while (nal >= 0 && g_source.units) {
+        int next_body;
+        int next = find_nal(data, len, body, &next_body);
+        int is_vcl, first_slice, is_key, opens;
+        if (codec == 2) {
+            int type = body < len ? (data[body] >> 1) & 0x3F : -1;
+            is_vcl = type >= 0 && type <= 31;
+            first_slice = is_vcl && body + 2 < len && (data[body + 2] & 0x80);
+            is_key = type >= 16 && type <= 21;
+            opens = (type >= 32 && type <= 35) || type == 39;
+        } else {
+            int type = body < len ? data[body] & 0x1F : -1;
+            is_vcl = type == 1 || type == 5;
+            first_slice = is_vcl && body + 1 < len && (data[body + 1] & 0x80);
+            is_key = type == 5;
+            opens = type == 6 || type == 7 || type == 8 || type == 9;
+        }
+        if (au_start < 0) au_start = nal;
+        if (au_has_picture && (opens || first_slice)) {
+            if (g_source.count == capacity) {
+                capacity *= 2;
+                EmuAccessUnit* bigger = (EmuAccessUnit*)realloc(g_source.units, capacity * sizeof(EmuAccessUnit));
+                if (!bigger) break;
+                g_source.units = bigger;
+            }
+            EmuAccessUnit* au = &g_source.units[g_source.count++];
+            au->data = data + au_start;
+            au->len = nal - au_start;
+            au->key = au_key;
+            g_source.keys += au_key;
+            au_start = nal;
+            au_has_picture = 0;
+            au_key = 0;
+        }
+        if (is_vcl) au_has_picture = 1;
+        if (is_key) au_key = 1;
+        nal = next;
+        body = next_body;
+    }
+    if (au_start >= 0 && au_has_picture && g_source.units && g_source.count < capacity) {
+        EmuAccessUnit* au = &g_source.units[g_source.count++];
+        au->data = data + au_start;
+        au->len = len - au_start;
+        au->key = au_key;
+        g_source.keys += au_key;
+    }
+    for (int i = 0; i < g_source.count; i++) {
+        if (g_source.units[i].len > EMU_FRAME_MAX) {
+            printf("[Emulator] ERROR: Access unit %d of %s is %d bytes, over %d\n", i, path, g_source.units[i].len, EMU_FRAME_MAX);
+            return -1;
+        }
+    }
+    if (g_source.count == 0 || g_source.keys == 0) {
+        printf("[Emulator] ERROR: No %s pictures%s in %s\n", codec == 2 ? "H.265" : "H.264",
+               g_source.count ? " with an I-frame" : "", path);
+        return -1;
+    }
+    printf("[Emulator] %s: %d access units (%d I-frames), %.2f MB\n", path, g_source.count, g_source.keys,
+           (double)len / (1024 * 1024));
+    return 0;
+}
+
+// Synthetic frames: a start code and NAL header of the right type, then noise
+static int make_noise(int codec) {
+    for (int key = 0; key < 2; key++) {
+        unsigned char* p = (unsigned char*)malloc(EMU_FRAME_MAX);
+        if (!p) return -1;
+        unsigned int seed = 0x9E3779B9u + key;
+        for (int i = 0; i < EMU_FRAME_MAX; i++) {
+            seed = seed * 1664525u + 1013904223u;
+            p[i] = (unsigned char)(seed >> 24);
+        }
+        p[0] = 0; p[1] = 0; p[2] = 0; p[3] = 1;
+        if (codec == 2) {
+            p[4] = key ? 0x26 : 0x02;       // IDR_W_RADL / TRAIL_R
+            p[5] = 0x01;
+            p[6] |= 0x80;                   // first_slice_segment_in_pic_flag
+        } else {
+            p[4] = key ? 0x65 : 0x41;       // IDR / non-IDR slice
+            p[5] |= 0x80;                   // first_mb_in_slice = 0
+        }
+        g_source.noise[key] = p;
+    }
+    return 0;
+}
+
+// Next frame of a stream
+static EmuAccessUnit next_unit(EmuStream* st) {
+    EmuAccessUnit au;
+    if (g_source.file) {
+        au = g_source.units[st->unit];
+        st->unit = (st->unit + 1) % g_source.count;
+        return au;
+    }
+    // GOP of two seconds, I-frames four times the size of P-frames
+    int gop = st->cfg.fps * 2 > 1 ? st->cfg.fps * 2 : 2;
+    double avg = (double)st->cfg.kbps * 1000.0 / 8.0 / (st->cfg.fps > 0 ? st->cfg.fps : 1);
+    double p_size = avg * gop / (gop + 3);
+    au.key = st->frame_no % (unsigned long long)gop == 0;
+    au.len = (int)(au.key ? p_size * 4 : p_size);
+    if (au.len < 16) au.len = 16;
+    if (au.len > EMU_FRAME_MAX) au.len = EMU_FRAME_MAX;
+    au.data = g_source.noise[au.key];
+    return au;
+}
+
+// ---------------- Packets ----------------
+
+// Cut one payload into packages on out: the first carries the sub-header,
+// indices count down to 0 on the last. Returns the bytes built, -1 on overflow.
+static int build_fragments(const char* prefix, unsigned short pkg_id, unsigned short pkg_cmd,
+                           const void* sub_header, int sub_len, const unsigned char* data, int len,
+                           int header_only, unsigned char* out, int max_len, int* offsets, int* count) {
+    int frag = g_opt.fragment;
+    int first = header_only ? 0 : (len < frag - sub_len ? len : frag - sub_len);
+    int packages = 1 + (len - first + frag - 1) / frag;
+    PackageHeader_t header;
+    memset(&header, 0, sizeof(header));
+    header.u16PkgId = pkg_id;
+    header.u16PkgCmd = pkg_cmd;
+    int built = 0, pos = 0;
+    for (int i = 0; i < packages; i++) {
+        header.u16PkgIndex = (uint16_t)(packages - 1 - i);
+        header.u8PkgSubHead = (i == 0 && sub_len > 0) ? 1 : 0;
+        int n = i == 0 ? first : (len - pos < frag ? len - pos : frag);
+        int ret = package_build(prefix, &header, i == 0 ? sub_header : NULL, i == 0 ? sub_len : 0,
+                                data + pos, n, out + built, max_len - built);
+        if (ret < 0) return -1;
+        if (offsets) offsets[i] = built;
+        built += ret;
+        pos += n;
+    }
+    if (count) *count = packages;
+    return built;
+}
+
+// First of the two threads to see the session fail ends it
+static void session_end(EmuSession* s, const char* reason, int ret) {
+    if (InterlockedExchange(&s->run, 0)) {
+        s->ended_us = metrics_now_us();
+        printf("[Emulator] %s #%d: %s (%d)\n", s->dev->did, s->index, reason, ret);
+    }
+}
+
+static int session_write(EmuSession* s, int channel, const unsigned char* data, int len) {
+    INT32 ret = PPCS_Write(s->handle, (UCHAR)channel, (CHAR*)data, len);
+    if (ret < 0) {
+        session_end(s, "write failed, ending session", ret);
+        return -1;
+    }
+    return 0;
+}
+
+// ---------------- Commands ----------------
+
+static void queue_job(EmuSession* s, int kind, int task_id, int start_time) {
+    while (InterlockedCompareExchange(&s->jobs_lock, 1, 0) != 0) Sleep(0);
+    if (s->job_head - s->job_tail < EMU_MAX_JOBS) {
+        EmuJob* job = &s->jobs[s->job_head % EMU_MAX_JOBS];
+        job->kind = kind;
+        job->task_id = task_id;
+        job->start_time = start_time;
+        s->job_head++;
+    }
+    InterlockedExchange(&s->jobs_lock, 0);
+}
+
+static int pop_job(EmuSession* s, EmuJob* job) {
+    int found = 0;
+    while (InterlockedCompareExchange(&s->jobs_lock, 1, 0) != 0) Sleep(0);
+    if (s->job_tail != s->job_head) {
+        *job = s->jobs[s->job_tail % EMU_MAX_JOBS];
+        s->job_tail++;
+        found = 1;
+    }
+    InterlockedExchange(&s->jobs_lock, 0);
+    return found;
+}
+
+static void set_streams(EmuSession* s, int playback, int on) {
+    for (int i = 0; i < g_opt.stream_count; i++) {
+        EmuStream* st = &s->streams[i];
+        if ((st->cfg.type == 3) != playback) continue;
+        if (on && !st->running) {
+            st->next_due_us = metrics_now_us();
+            st->wait_key = 1;               // Start on an I-frame
+        }
+        InterlockedExchange(&st->running, on);
+    }
+}
+
+static int json_int(const cJSON* object, const char* name, int fallback) {
+    const cJSON* item = cJSON_GetObjectItemCaseSensitive(object, name);
+    return cJSON_IsNumber(item) ? item->valueint : fallback;
+}
+
+// Reply with the client's package id; long replies span several packages
+static void send_reply(EmuSession* s, unsigned short pkg_id, int cmd, int seq, const char* def, const char* data_json) {
+    static const int max_reply = EMU_JSON_MAX;
+    char* json = (char*)malloc(max_reply);
+    if (!json) return;
+    int n = snprintf(json, max_reply, "{\"version\":\"1.0\",\"ack\":true,\"seq\":%d,\"cmd\":%d,\"def\":\"%s\",\"code\":200,\"msg\":\"success\"%s%s}",
+                     seq, cmd, def, data_json ? ",\"data\":" : "", data_json ? data_json : "");
+    if (n > 0 && n < max_reply) {
+        int len = build_fragments(PKG_JSON_PREFIX_STR, pkg_id, (unsigned short)cmd, NULL, 0, (const unsigned char*)json, n,
+                                  0, s->json_out, EMU_JSON_MAX * 2, NULL, NULL);
+        if (len > 0) session_write(s, g_opt.cmd_channel, s->json_out, len);
+    }
+    free(json);
+}
+
+// Records every 30 minutes over the asked range, 10 minutes each
+static char* record_list_json(const cJSON* data) {
+    long long start = 0, end = 0;
+    const cJSON* item = cJSON_GetObjectItemCaseSensitive(data, "startTime");
+    if (cJSON_IsNumber(item)) start = (long long)item->valuedouble;
+    item = cJSON_GetObjectItemCaseSensitive(data, "endTime");
+    if (cJSON_IsNumber(item)) end = (long long)item->valuedouble;
+    if (end <= start) end = start + 86400;
+    const EmuStreamConfig* main_cfg = &g_opt.streams[0];
+    int kbps = main_cfg->kbps > 0 ? main_cfg->kbps : 2000;
+    char* out = (char*)malloc(EMU_JSON_MAX / 2);
+    if (!out) return NULL;
+    int n = snprintf(out, EMU_JSON_MAX / 2, "{\"recordList\":[");
+    int count = 0;
+    for (long long t = start; t < end && count < 100; t += 1800, count++) {
+        n += snprintf(out + n, EMU_JSON_MAX / 2 - n,
+                      "%s{\"startTime\":%lld,\"endTime\":%lld,\"recType\":1,\"size\":%u,\"frameRate\":%d,\"codeType\":%d}",
+                      count ? "," : "", t, t + 600, (unsigned int)((long long)kbps * 600 / 8 * 1000),
+                      main_cfg->fps, g_source.codec);
+    }
+    snprintf(out + n, EMU_JSON_MAX / 2 - n, "]}");
+    return out;
+}
+
+static void handle_command(EmuSession* s, const PackageHeader_t* header, const char* json) {
+    cJSON* root = cJSON_Parse(json);
+    if (!root) {
+        LOG_RATELIMITED(LOG_LEVEL_WARN, "Emulator", 5, "%s: unparsable command 0x%04X", s->dev->did, header->u16PkgCmd);
+        return;
+    }
+    int cmd = json_int(root, "cmd", header->u16PkgCmd);
+    int seq = json_int(root, "seq", 0);
+    const cJSON* def_item = cJSON_GetObjectItemCaseSensitive(root, "def");
+    const char* def = cJSON_IsString(def_item) && def_item->valuestring ? def_item->valuestring : "";
+    const cJSON* data = cJSON_GetObjectItemCaseSensitive(root, "data");
+    s->commands++;
+    LOG_DEBUG("Emulator", "%s #%d: command 0x%04X (%s) seq %d", s->dev->did, s->index, cmd, def, seq);
+
+    char* owned = NULL;
+    const char* reply = NULL;
+    char small[512];
+    switch (cmd) {
+        case JSON_CMD_VIDEO_START:
+            set_streams(s, 0, 1);
+            break;
+        case JSON_CMD_VIDEO_STOP:
+            set_streams(s, 0, 0);
+            break;
+        case JSON_CMD_PLAYBACK_START:
+            set_streams(s, 1, 1);
+            break;
+        case JSON_CMD_PLAYBACK_STOP:
+            set_streams(s, 1, 0);
+            break;
+        case JSON_CMD_RECORD_LIST_GET:
+            reply = owned = record_list_json(data);
+            break;
+        case JSON_CMD_SNAPSHOT_IMG:
+            queue_job(s, EMU_JOB_SNAPSHOT, 0, 0);
+            break;
+        case JSON_CMD_TIMELAPSE_LIST_GET:
+            snprintf(small, sizeof(small), "{\"list\":[{\"taskId\":1,\"startTime\":%lld,\"endTime\":%lld,\"frames\":%d}]}",
+                     (long long)time(NULL) - 3600, (long long)time(NULL), g_opt.timelapse_frames);
+            reply = small;
+            break;
+        case JSON_CMD_TIMELAPSE_DOWNLOAD:
+            queue_job(s, EMU_JOB_TIMELAPSE, json_int(data, "taskId", 1), json_int(data, "startTime", (int)time(NULL)));
+            break;
+        case JSON_CMD_SETTINGS_GET:
+            snprintf(small, sizeof(small),
+                     "{\"devName\":\"%s\",\"devType\":1,\"devMacAddr\":\"02:00:00:00:00:%02X\",\"firmwareVersion\":\"emulator\","
+                     "\"hardwareVersion\":\"loopback\",\"sdcode\":{\"sdStatus\":1,\"capacity\":32768,\"usage\":1024}}",
+                     s->dev->did, (unsigned int)(s->dev - g_devices) & 0xFF);
+            reply = small;
+            break;
+        default:
+            break;
+    }
+    send_reply(s, header->u16PkgId, cmd, seq, def, reply);
+    free(owned);
+    cJSON_Delete(root);
+}
+
+static int emu_json_handler(const PackageView* pkg, const PackageContext* ctx) {
+    EmuSession* s = (EmuSession*)ctx->app;
+    int len = pkg->header.u16PkgLen;
+    if (!s || len <= 0 || PKG_HEADER_TOTAL_LEN + len > pkg->len) return -1;
+    char* json = (char*)malloc(len + 1);
+    if (!json) return -1;
+    package_view_read(pkg, PKG_HEADER_TOTAL_LEN, json, len);
+    json[len] = '\0';
+    handle_command(s, &pkg->header, json);
+    free(json);
+    return 0;
+}
+
+static DWORD WINAPI command_thread(LPVOID param) {
+    EmuSession* s = (EmuSession*)param;
+    StreamFramer* framer = stream_framer_create(EMU_CMD_RING);
+    PackageContext ctx = { s->dev->did, s, NULL };
+    while (framer && s->run && g_run) {
+        unsigned char* ptr = NULL;
+        int room = stream_framer_write_ptr(framer, &ptr);
+        if (room <= 0) {
+            stream_framer_discard(framer);
+            continue;
+        }
+        // Read what is pending, or block for the first byte of the next command
+        UINT32 pending = 0;
+        PPCS_Check_Buffer(s->handle, (UCHAR)g_opt.cmd_channel, NULL, &pending);
+        INT32 n = pending > 0 ? (pending < (UINT32)room ? (INT32)pending : room) : 1;
+        INT32 ret = PPCS_Read(s->handle, (UCHAR)g_opt.cmd_channel, (CHAR*)ptr, &n, EMU_CMD_READ_TIMEOUT_MS);
+        if (n > 0) {
+            stream_framer_commit(framer, n);
+            PackageView view;
+            while (stream_framer_next(framer, &view)) {
+                package_registry_dispatch(&view, &ctx);
+                package_view_release(&view);
+            }
+        }
+        if (ret != ERROR_PPCS_SUCCESSFUL && ret != ERROR_PPCS_TIME_OUT) {
+            session_end(s, "client gone", ret);
+            break;
+        }
+    }
+    stream_framer_destroy(framer);
+    async_log_thread_detach();
+    return 0;
+}
+
+// ---------------- Streaming ----------------
+
+// Build a stream's next frame into st->out. Returns 1 if built, 0 if
+// dropped for backpressure, -1 on error.
+static int build_video_frame(EmuSession* s, EmuStream* st, UINT32 backlog) {
+    EmuAccessUnit au = next_unit(st);
+    st->frame_no++;
+    if (backlog > (UINT32)g_opt.backlog_kb * 1024) st->wait_key = 1;
+    if (st->wait_key && !au.key) {
+        st->dropped++;
+        return 0;
+    }
+    st->wait_key = 0;
+    VideoStreamHeader_t vh;
+    memset(&vh, 0, sizeof(vh));
+    time_t now = time(NULL);
+    struct tm* tm_info = localtime(&now);
+    vh.s8StreamType = (char)st->cfg.type;
+    vh.s8EncodeType = (char)g_source.codec;
+    vh.s8FrameType = au.key ? 1 : 2;
+    vh.s8Ch = 0;
+    vh.u8Hour = (unsigned char)tm_info->tm_hour;
+    vh.u8Minute = (unsigned char)tm_info->tm_min;
+    vh.u8Sec = (unsigned char)tm_info->tm_sec;
+    vh.u8FrameRate = (unsigned char)st->cfg.fps;
+    vh.s32FrameLen = au.len;
+    vh.u16VideoWidth = (unsigned short)st->cfg.width;
+    vh.u16VideoHeight = (unsigned short)st->cfg.height;
+    vh.u64Pts = st->frame_no * 1000 / (unsigned long long)(st->cfg.fps > 0 ? st->cfg.fps : 1);
+    st->out_len = build_fragments(PKG_VIDEO_PREFIX_STR, s->video_pkg_id++, 0, &vh, sizeof(vh), au.data, au.len, 0,
+                                  st->out, g_out_max, st->pkg_offsets, &st->pkg_count);
+    if (st->out_len < 0) return -1;
+    st->frames++;
+    st->bytes += (unsigned long long)au.len;
+    return 1;
+}
+
+// Packages of several frames taken in turn, as concurrent streams arrive from a camera
+static int merge_frames(EmuSession* s, EmuStream** built, int count) {
+    int len = 0;
+    for (int round = 0; ; round++) {
+        int any = 0;
+        for (int i = 0; i < count; i++) {
+            EmuStream* st = built[i];
+            if (round >= st->pkg_count) continue;
+            int start = st->pkg_offsets[round];
+            int end = round + 1 < st->pkg_count ? st->pkg_offsets[round + 1] : st->out_len;
+            memcpy(s->merge + len, st->out + start, end - start);
+            len += end - start;
+            any = 1;
+        }
+        if (!any) break;
+    }
+    return len;
+}
+
+static void run_snapshot(EmuSession* s) {
+    const EmuStreamConfig* cfg = &g_opt.streams[0];
+    unsigned char* image = NULL;
+    int len = 0;
+    if (g_opt.snapshot) {
+        FILE* f = fopen(g_opt.snapshot, "rb");
+        if (f) {
+            fseek(f, 0, SEEK_END);
+            len = (int)ftell(f);
+            fseek(f, 0, SEEK_SET);
+            image = len > 0 && len <= EMU_FRAME_MAX ? (unsigned char*)malloc(len) : NULL;
+            if (image && fread(image, 1, len, f) != (size_t)len) len = 0;
+            fclose(f);
+        }
+    }
+    if (!image) {
+        // A JPEG-shaped blob of about a tenth of a byte per pixel
+        len = cfg->width * cfg->height / 10;
+        if (len < 1024) len = 1024;
+        if (len > EMU_FRAME_MAX) len = EMU_FRAME_MAX;
+        image = (unsigned char*)malloc(len);
+        if (!image) return;
+        memcpy(image, g_source.noise[0] ? g_source.noise[0] : g_source.units[0].data, len < 64 ? len : 64);
+        for (int i = 64; i < len; i++) image[i] = (unsigned char)(i * 31);
+        image[0] = 0xFF; image[1] = 0xD8; image[len - 2] = 0xFF; image[len - 1] = 0xD9;
+    }
+    ImageStreamHeader_t ih;
+    memset(&ih, 0, sizeof(ih));
+    ih.s8ImageType = 1;
+    ih.s8EncodeType = 1;                    // JPG
+    ih.u16Width = (uint16_t)cfg->width;
+    ih.u16Height = (uint16_t)cfg->height;
+    ih.s32ImageLen = len;
+    ih.u64Pts = (uint64_t)time(NULL) * 1000;
+    // The header package carries no image data; the data follows at index n-1..0
+    int built = build_fragments(PKG_IMAGE_PREFIX_STR, s->bulk_pkg_id++, JSON_CMD_SNAPSHOT_IMG, &ih, sizeof(ih),
+                                image, len, 1, s->bulk_out, g_out_max, NULL, NULL);
+    if (built > 0 && session_write(s, g_opt.bulk_channel, s->bulk_out, built) == 0) s->bulk_bytes += (unsigned long long)len;
+    free(image);
+}
+
+// One frame of a download per call; returns 1 while frames remain
+static int run_timelapse_frame(EmuSession* s, const EmuJob* job, int frame) {
+    TAG_PKG_FILE_HEADER_S fh;
+    memset(&fh, 0, sizeof(fh));
+    fh.s32TaskId = job->task_id;
+    fh.s32StartTime = job->start_time;
+    fh.s8FileType = g_source.codec == 2 ? 1 : 2;    // 1 H.265, 2 H.264
+    int built;
+    if (frame >= g_opt.timelapse_frames) {
+        // Empty frame ends the download
+        fh.s8FrameType = (int8_t)0xFF;
+        built = build_fragments(PKG_TIMELAPSE_PREFIX_STR, s->bulk_pkg_id++, JSON_CMD_TIMELAPSE_DOWNLOAD, &fh, sizeof(fh),
+                                NULL, 0, 0, s->bulk_out, g_out_max, NULL, NULL);
+        if (built > 0) session_write(s, g_opt.bulk_channel, s->bulk_out, built);
+        return 0;
+    }
+    EmuStream scratch;
+    memset(&scratch, 0, sizeof(scratch));
+    scratch.cfg = g_opt.streams[0];
+    scratch.frame_no = (unsigned long long)frame;
+    scratch.unit = g_source.count ? frame % g_source.count : 0;
+    EmuAccessUnit au = next_unit(&scratch);
+    fh.s8FrameType = au.key ? 1 : 2;
+    fh.s32FileLength = au.len;
+    built = build_fragments(PKG_TIMELAPSE_PREFIX_STR, s->bulk_pkg_id++, JSON_CMD_TIMELAPSE_DOWNLOAD, &fh, sizeof(fh),
+                            au.data, au.len, 0, s->bulk_out, g_out_max, NULL, NULL);
+    if (built > 0 && session_write(s, g_opt.bulk_channel, s->bulk_out, built) == 0) s->bulk_bytes += (unsigned long long)au.len;
+    return 1;
+}
+
+static DWORD WINAPI stream_thread(LPVOID param) {
+    EmuSession* s = (EmuSession*)param;
+    EmuJob job = { 0 };
+    int job_active = 0, job_frame = 0;
+    while (s->run && g_run) {
+        long long now = metrics_now_us();
+        UINT32 backlog = 0;
+        if (PPCS_Check_Buffer(s->handle, (UCHAR)g_opt.video_channel, &backlog, NULL) < 0) break;
+        if (backlog > s->max_backlog) s->max_backlog = backlog;
+
+        // Every stream whose frame is due, built together
+        EmuStream* built[EMU_MAX_STREAMS];
+        int built_count = 0;
+        long long next_due = now + 100000;
+        for (int i = 0; i < g_opt.stream_count; i++) {
+            EmuStream* st = &s->streams[i];
+            if (!st->running) continue;
+            if (st->next_due_us <= now) {
+                long long period = 1000000LL / (st->cfg.fps > 0 ? st->cfg.fps : 1);
+                st->next_due_us += period;
+                if (now - st->next_due_us > 1000000) st->next_due_us = now + period;     // Stalled: don't burst
+                int ret = build_video_frame(s, st, backlog);
+                if (ret < 0) session_end(s, "frame too large to build", ret);
+                else if (ret > 0) built[built_count++] = st;
+            }
+            if (st->next_due_us < next_due) next_due = st->next_due_us;
+        }
+        if (built_count > 1 && g_opt.interleave) {
+            int len = merge_frames(s, built, built_count);
+            session_write(s, g_opt.video_channel, s->merge, len);
+        } else {
+            for (int i = 0; i < built_count; i++) session_write(s, g_opt.video_channel, built[i]->out, built[i]->out_len);
+        }
+
+        // Bulk transfers a frame at a time, between video frames
+        if (!job_active && pop_job(s, &job)) {
+            job_active = 1;
+            job_frame = 0;
+        }
+        if (job_active) {
+            if (job.kind == EMU_JOB_SNAPSHOT) {
+                run_snapshot(s);
+                job_active = 0;
+            } else if (!run_timelapse_frame(s, &job, job_frame++)) {
+                job_active = 0;
+            }
+            continue;
+        }
+        long long wait = next_due - metrics_now_us();
+        if (wait > 1000) Sleep((DWORD)(wait / 1000));
+    }
+    async_log_thread_detach();
+    return 0;
+}
+
+// ---------------- Sessions and devices ----------------
+
+static void session_destroy(EmuSession* s) {
+    if (!s) return;
+    InterlockedExchange(&s->run, 0);
+    if (s->cmd_thread) {
+        WaitForSingleObject(s->cmd_thread, INFINITE);
+        CloseHandle(s->cmd_thread);
+    }
+    if (s->stream_thread) {
+        WaitForSingleObject(s->stream_thread, INFINITE);
+        CloseHandle(s->stream_thread);
+    }
+    PPCS_Close(s->handle);
+    for (int i = 0; i < EMU_MAX_STREAMS; i++) {
+        free(s->streams[i].out);
+        free(s->streams[i].pkg_offsets);
+    }
+    free(s->merge);
+    free(s->bulk_out);
+    free(s->json_out);
+    free(s);
+}
+
+static EmuSession* session_create(EmuDevice* dev, INT32 handle) {
+    EmuSession* s = (EmuSession*)calloc(1, sizeof(EmuSession));
+    if (!s) return NULL;
+    s->dev = dev;
+    s->handle = handle;
+    s->index = ++dev->sessions_total;
+    s->run = 1;
+    s->started_us = metrics_now_us();
+    int ok = 1;
+    for (int i = 0; i < g_opt.stream_count; i++) {
+        s->streams[i].cfg = g_opt.streams[i];
+        s->streams[i].out = (unsigned char*)malloc(g_out_max);
+        s->streams[i].pkg_offsets = (int*)malloc(g_max_packages * sizeof(int));
+        if (!s->streams[i].out || !s->streams[i].pkg_offsets) ok = 0;
+    }
+    s->merge = (unsigned char*)malloc((size_t)g_out_max * EMU_MAX_STREAMS);
+    s->bulk_out = (unsigned char*)malloc(g_out_max);
+    s->json_out = (unsigned char*)malloc(EMU_JSON_MAX * 2);
+    if (!ok || !s->merge || !s->bulk_out || !s->json_out) {
+        session_destroy(s);
+        return NULL;
+    }
+    if (g_opt.autostart) {
+        set_streams(s, 0, 1);
+        set_streams(s, 1, 1);
+    }
+    DWORD tid;
+    s->cmd_thread = CreateThread(NULL, 0, command_thread, s, 0, &tid);
+    s->stream_thread = CreateThread(NULL, 0, stream_thread, s, 0, &tid);
+    if (!s->cmd_thread || !s->stream_thread) {
+        session_destroy(s);
+        return NULL;
+    }
+    return s;
+}
+
+static void print_session_stats(EmuSession* s) {
+    double elapsed_s = ((s->ended_us ? s->ended_us : metrics_now_us()) - s->started_us) / 1e6;
+    printf("[Emulator] %s #%d%s: %llu commands, %.2f MB bulk, video backlog peak %u KB\n", s->dev->did, s->index,
+           s->run ? "" : " (ended)", s->commands, (double)s->bulk_bytes / (1024 * 1024), s->max_backlog / 1024);
+    for (int i = 0; i < g_opt.stream_count; i++) {
+        EmuStream* st = &s->streams[i];
+        if (st->frames == 0 && st->dropped == 0) continue;
+        printf("[Emulator]   stream %d %dx%d@%d: %llu frames (%.1f fps), %.2f Mbps, %llu dropped for backpressure\n",
+               st->cfg.type, st->cfg.width, st->cfg.height, st->cfg.fps, st->frames,
+               elapsed_s > 0 ? st->frames / elapsed_s : 0.0,
+               elapsed_s > 0 ? (double)st->bytes * 8 / 1e6 / elapsed_s : 0.0, st->dropped);
+    }
+}
+
+static DWORD WINAPI device_thread(LPVOID param) {
+    EmuDevice* dev = (EmuDevice*)param;
+    printf("[Emulator] %s listening on port %d\n", dev->did, ppcs_loopback_port(dev->did));
+    while (g_run) {
+        INT32 handle = PPCS_Listen(dev->did, EMU_LISTEN_SEC, 0, 1, "");
+        if (handle < 0) {
+            if (handle != ERROR_PPCS_TIME_OUT && handle != ERROR_PPCS_USER_LISTEN_BREAK) {
+                printf("[Emulator] %s: PPCS_Listen failed (%d)\n", dev->did, handle);
+                Sleep(1000);
+            }
+            continue;
+        }
+        // Reuse the slot of a client that has gone
+        int slot = -1;
+        for (int i = 0; i < dev->session_count && slot < 0; i++) {
+            if (!dev->sessions[i]->run) {
+                print_session_stats(dev->sessions[i]);
+                session_destroy(dev->sessions[i]);
+                dev->sessions[i] = NULL;
+                slot = i;
+            }
+        }
+        if (slot < 0 && dev->session_count < EMU_MAX_SESSIONS) slot = dev->session_count++;
+        EmuSession* s = slot >= 0 ? session_create(dev, handle) : NULL;
+        if (!s) {
+            printf("[Emulator] %s: cannot take another client\n", dev->did);
+            PPCS_Close(handle);
+            if (slot >= 0 && slot == dev->session_count - 1) dev->session_count--;
+            continue;
+        }
+        dev->sessions[slot] = s;
+        printf("[Emulator] %s #%d: client connected (handle %d)\n", dev->did, s->index, handle);
+    }
+    async_log_thread_detach();
+    return 0;
+}
+
+// ---------------- Options ----------------
+
+static void print_usage(const char* argv0) {
+    printf("Usage: %s [options]\n", argv0);
+    printf("  -d DID         Device ID (default %s)\n", EMU_DEFAULT_DID);
+    printf("  -n COUNT       Emulate COUNT devices, DIDs numbered up from -d\n");
+    printf("  -i FILE        H.264/H.265 elementary stream to send (default: synthetic)\n");
+    printf("  -c h264|h265   Codec of -i or of the synthetic stream (default h265)\n");
+    printf("  -s T:WxH@FPS:KBPS  Stream type T (1 main, 2 sub, 3 playback, 4, 5); repeatable\n");
+    printf("  -f BYTES       Payload bytes per package (default %d)\n", EMU_DEFAULT_FRAGMENT);
+    printf("  -b KB          Unsent video before frames are dropped (default %d)\n", EMU_DEFAULT_BACKLOG_KB);
+    printf("  -I             Interleave the packages of frames sent together\n");
+    printf("  -a             Stream on connect instead of waiting for VIDEO_START/PLAYBACK_START\n");
+    printf("  -j FILE        JPEG sent for JSON_CMD_SNAPSHOT_IMG (default: synthetic)\n");
+    printf("  -T FRAMES      Frames per timelapse download (default 30)\n");
+    printf("  -m C,V,B       Command, video and bulk channels (default 0,0,0)\n");
+    printf("  -t SECONDS     Stop after SECONDS (default: run until killed)\n");
+    printf("  -r SECONDS     Statistics interval (default 5)\n");
+    printf("  -L LEVEL       Log level: error, warn, info, debug, trace\n");
+}
+
+static int parse_stream(const char* spec, EmuStreamConfig* cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    if (sscanf(spec, "%d:%dx%d@%d:%d", &cfg->type, &cfg->width, &cfg->height, &cfg->fps, &cfg->kbps) < 4) return -1;
+    if (cfg->type < 1 || cfg->type > EMU_MAX_STREAMS || cfg->width <= 0 || cfg->height <= 0 ||
+        cfg->fps <= 0 || cfg->fps > 240) return -1;
+    if (cfg->kbps <= 0) cfg->kbps = (int)((long long)cfg->width * cfg->height * cfg->fps / 10000);   // 0.1 bit per pixel
+    return 0;
+}
+
+static int parse_options(int argc, char* argv[], EmuOptions* opt) {
+    memset(opt, 0, sizeof(*opt));
+    opt->did = EMU_DEFAULT_DID;
+    opt->devices = 1;
+    opt->codec = 2;
+    opt->fragment = EMU_DEFAULT_FRAGMENT;
+    opt->backlog_kb = EMU_DEFAULT_BACKLOG_KB;
+    opt->timelapse_frames = 30;
+    opt->report_sec = 5;
+    opt->log_level = LOG_LEVEL_INFO;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(arg, "-I") == 0) { opt->interleave = 1; continue; }
+        if (strcmp(arg, "-a") == 0) { opt->autostart = 1; continue; }
+        if (!value || arg[0] != '-' || arg[2] != '\0') return -1;
+        i++;
+        switch (arg[1]) {
+            case 'd': opt->did = value; break;
+            case 'n': opt->devices = atoi(value); break;
+            case 'i': opt->input = value; break;
+            case 'c':
+                if (_stricmp(value, "h264") == 0) opt->codec = 1;
+                else if (_stricmp(value, "h265") == 0 || _stricmp(value, "hevc") == 0) opt->codec = 2;
+                else return -1;
+                break;
+            case 's':
+                if (opt->stream_count == EMU_MAX_STREAMS || parse_stream(value, &opt->streams[opt->stream_count]) < 0) return -1;
+                for (int j = 0; j < opt->stream_count; j++) {
+                    if (opt->streams[j].type == opt->streams[opt->stream_count].type) return -1;
+                }
+                opt->stream_count++;
+                break;
+            case 'f': opt->fragment = atoi(value); break;
+            case 'b': opt->backlog_kb = atoi(value); break;
+            case 'j': opt->snapshot = value; break;
+            case 'T': opt->timelapse_frames = atoi(value); break;
+            case 't': opt->run_sec = atoi(value); break;
+            case 'r': opt->report_sec = atoi(value); break;
+            case 'm':
+                if (sscanf(value, "%d,%d,%d", &opt->cmd_channel, &opt->video_channel, &opt->bulk_channel) != 3) return -1;
+                break;
+            case 'L':
+                opt->log_level = async_log_parse_level(value);
+                if (opt->log_level < 0) return -1;
+                break;
+            default:
+                return -1;
+        }
+    }
+    if (opt->stream_count == 0) parse_stream("1:1920x1080@25:4000", &opt->streams[opt->stream_count++]);
+    if (opt->devices < 1 || opt->devices > EMU_MAX_DEVICES) return -1;
+    if (opt->fragment < 256 || opt->fragment > 60000 || opt->backlog_kb < 64 || opt->timelapse_frames < 0) return -1;
+    if (opt->report_sec <= 0) opt->report_sec = 5;
+    int channels[3] = { opt->cmd_channel, opt->video_channel, opt->bulk_channel };
+    for (int i = 0; i < 3; i++) {
+        if (channels[i] < 0 || channels[i] >= PPCS_LOOPBACK_CHANNELS) return -1;
+    }
+    return 0;
+}
+
+// DID of device i: the number group counted up, e.g. EMUDEV-000002-LOADX
+static void device_did(const char* base, int index, char* out, int size) {
+    const char* first = strchr(base, '-');
+    const char* second = first ? strchr(first + 1, '-') : NULL;
+    if (index == 0 || !second) {
+        if (index == 0) snprintf(out, size, "%s", base);
+        else snprintf(out, size, "%s-%d", base, index);
+        return;
+    }
+    int digits = (int)(second - first - 1);
+    snprintf(out, size, "%.*s-%0*d%s", (int)(first - base), base, digits, atoi(first + 1) + index, second);
+}
+
+int main(int argc, char* argv[]) {
+    if (parse_options(argc, argv, &g_opt) != 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    metrics_now_us();
+    async_log_init(g_opt.log_level);
+    g_source.codec = g_opt.codec;
+    if (g_opt.input ? load_elementary_stream(g_opt.input, g_opt.codec) : make_noise(g_opt.codec)) {
+        async_log_shutdown();
+        return 1;
+    }
+    // Room for the largest frame cut into the smallest packages
+    g_max_packages = EMU_FRAME_MAX / g_opt.fragment + 2;
+    g_out_max = EMU_FRAME_MAX + g_max_packages * (PKG_MIN_LEN + (int)sizeof(VideoStreamHeader_t));
+
+    INT32 ret = PPCS_Initialize((CHAR*)"{}");
+    if (ret != ERROR_PPCS_SUCCESSFUL && ret != ERROR_PPCS_ALREADY_INITIALIZED) {
+        printf("[Emulator] ERROR: PPCS_Initialize failed (%d)\n", ret);
+        async_log_shutdown();
+        return 1;
+    }
+    package_registry_register(PKG_JSON_MAGIC, PKG_TYPE_JSON, "json", 0, emu_json_handler);
+
+    for (int i = 0; i < g_opt.stream_count; i++) {
+        const EmuStreamConfig* cfg = &g_opt.streams[i];
+        printf("[Emulator] Stream %d: %dx%d@%d, %s%s\n", cfg->type, cfg->width, cfg->height, cfg->fps,
+               g_opt.input ? g_opt.input : "synthetic", g_opt.autostart ? ", on connect" : "");
+    }
+    for (int i = 0; i < g_opt.devices; i++) {
+        EmuDevice* dev = &g_devices[i];
+        device_did(g_opt.did, i, dev->did, sizeof(dev->did));
+        DWORD tid;
+        dev->thread = CreateThread(NULL, 0, device_thread, dev, 0, &tid);
+    }
+
+    long long start = metrics_now_us();
+    long long next_report = start + (long long)g_opt.report_sec * 1000000;
+    while (g_opt.run_sec <= 0 || metrics_now_us() - start < (long long)g_opt.run_sec * 1000000) {
+        Sleep(100);
+        long long now = metrics_now_us();
+        if (now < next_report) continue;
+        next_report += (long long)g_opt.report_sec * 1000000;
+        for (int i = 0; i < g_opt.devices; i++) {
+            for (int j = 0; j < g_devices[i].session_count; j++) {
+                EmuSession* s = g_devices[i].sessions[j];
+                if (s && s->run) print_session_stats(s);
+            }
+        }
+    }
+
+    InterlockedExchange(&g_run, 0);
+    PPCS_Listen_Break();
+    for (int i = 0; i < g_opt.devices; i++) {
+        EmuDevice* dev = &g_devices[i];
+        if (dev->thread) {
+            WaitForSingleObject(dev->thread, INFINITE);
+            CloseHandle(dev->thread);
+        }
+        for (int j = 0; j < dev->session_count; j++) {
+            EmuSession* s = dev->sessions[j];
+            if (!s) continue;
+            print_session_stats(s);
+            session_destroy(s);
+        }
+    }
+    PPCS_DeInitialize();
+    async_log_shutdown();
+    free(g_source.file);
+    free(g_source.units);
+    free(g_source.noise[0]);
+    free(g_source.noise[1]);
+    return 0;
+}
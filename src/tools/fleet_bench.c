@@ -0,0 +1,344 @@
+// PPCS Fleet Benchmark
+//
+// Drives the client's network core headless against emulated cameras on
+// the loopback PPCS library: for each device count it connects that many
+// devices, starts their readers and drains them round-robin with a fair
+// share per session, as the client's main loop does, dispatching every
+// package to the registered handlers. Packages/s and MB/s are measured
+// after a warm-up; the ingest drops and lost frames show where the client
+// stops keeping up. Start the emulator with at least as many devices and
+// with -a, so the cameras stream as soon as they are connected.
+//
+//   ppcs_device_emu -n 8 -a -s 1:1920x1080@25:4000
+//   ppcs_fleet_bench -n 1,2,4,8 -t 10
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "platform.h"
+#include "PPCS_API.h"
+#include "PPCS_Error.h"
+#include "ppcs_core.h"
+#include "app_context.h"
+#include "package_registry.h"
+#include "video_manager.h"
+#include "image_handler.h"
+#include "timelapse_manager.h"
+#include "async_log.h"
+#include "metrics.h"
+
+#define FLEET_MAX_DEVICES 16
+#define FLEET_MAX_RUNS 16
+#define FLEET_DEFAULT_DID "EMUDEV-000001-LOADX"
+#define FLEET_BATCH_SIZE 64                 // Views popped per call, as the session manager does
+#define FLEET_BUDGET 1024                   // Packages per drain round, shared over the sessions
+#define FLEET_IDLE_WAIT_MS 1
+
+typedef struct {
+    const char* did;
+    int counts[FLEET_MAX_RUNS];             // Devices per run
+    int run_count;
+    int run_sec;
+    int warmup_sec;
+    int decode;                             // Decode video instead of recording it
+    const char* prefix;
+    int log_level;
+} FleetOptions;
+
+typedef struct {
+    char did[MAX_CONFIG_VALUE_LEN];
+    PPCSSession* net;
+    AppContext app_ctx;
+    PackageContext pkg_ctx;
+    unsigned long long packages;
+    unsigned long long bytes;
+} FleetDevice;
+
+typedef struct {
+    int devices;
+    double seconds;
+    unsigned long long packages;
+    unsigned long long bytes;
+    double cpu_ms;
+    int max_depth;
+    unsigned long long frames;
+    unsigned long long frames_lost;
+    unsigned long long packages_dropped;    // Shed by the ingest budget
+} FleetRun;
+
+static FleetOptions g_opt;
+static unsigned long long g_json_packages = 0;
+
+// No command tracker or GUI here: command responses are only counted
+static int fleet_json_handler(const PackageView* pkg, const PackageContext* ctx) {
+    (void)pkg;
+    (void)ctx;
+    g_json_packages++;
+    return 0;
+}
+
+static void print_usage(const char* argv0) {
+    printf("Usage: %s [options]\n", argv0);
+    printf("  -d DID         First device DID; device i counts the number group up (default %s)\n", FLEET_DEFAULT_DID);
+    printf("  -n N,...       Device counts, one run each (default 1,2,4,8)\n");
+    printf("  -t SECONDS     Measured time per run (default 10)\n");
+    printf("  -w SECONDS     Warm-up before measuring (default 2)\n");
+    printf("  -D             Decode video (without display) instead of recording it\n");
+    printf("  -o PREFIX      Output file prefix for recorded video (default fleet)\n");
+    printf("  -L LEVEL       Log level: error, warn, info, debug, trace (default warn)\n");
+}
+
+static int parse_options(int argc, char* argv[], FleetOptions* opt) {
+    memset(opt, 0, sizeof(*opt));
+    opt->did = FLEET_DEFAULT_DID;
+    opt->run_sec = 10;
+    opt->warmup_sec = 2;
+    opt->prefix = "fleet";
+    opt->log_level = LOG_LEVEL_WARN;
+    const char* counts = "1,2,4,8";
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(arg, "-D") == 0) { opt->decode = 1; continue; }
+        if (!value || arg[0] != '-' || arg[2] != '\0') return -1;
+        i++;
+        switch (arg[1]) {
+            case 'd': opt->did = value; break;
+            case 'n': counts = value; break;
+            case 't': opt->run_sec = atoi(value); break;
+            case 'w': opt->warmup_sec = atoi(value); break;
+            case 'o': opt->prefix = value; break;
+            case 'L':
+                opt->log_level = async_log_parse_level(value);
+                if (opt->log_level < 0) return -1;
+                break;
+            default:
+                return -1;
+        }
+    }
+    const char* p = counts;
+    while (*p) {
+        char* end = NULL;
+        long n = strtol(p, &end, 10);
+        if (end == p || n < 1 || n > FLEET_MAX_DEVICES || opt->run_count == FLEET_MAX_RUNS) return -1;
+        opt->counts[opt->run_count++] = (int)n;
+        if (*end == ',') end++;
+        else if (*end != '\0') return -1;
+        p = end;
+    }
+    if (opt->run_count == 0 || opt->run_sec <= 0 || opt->warmup_sec < 0) return -1;
+    return 0;
+}
+
+// DID of device i: the number group counted up, e.g. EMUDEV-000002-LOADX (as the emulator numbers them)
+static void device_did(const char* base, int index, char* out, int size) {
+    const char* first = strchr(base, '-');
+    const char* second = first ? strchr(first + 1, '-') : NULL;
+    if (index == 0 || !second) {
+        if (index == 0) snprintf(out, size, "%s", base);
+        else snprintf(out, size, "%s-%d", base, index);
+        return;
+    }
+    int digits = (int)(second - first - 1);
+    snprintf(out, size, "%.*s-%0*d%s", (int)(first - base), base, digits, atoi(first + 1) + index, second);
+}
+
+static void fleet_device_close(FleetDevice* dev) {
+    INT32 handle = dev->net ? ppcs_session_handle(dev->net) : dev->app_ctx.session_handle;
+    ppcs_session_stop(dev->net);
+    if (dev->app_ctx.video_mgr) destroy_video_stream_manager(dev->app_ctx.video_mgr);
+    for (int i = 0; i < PKG_REGISTRY_MAX; i++) package_reasm_destroy(dev->app_ctx.reasm[i]);
+    if (handle >= 0) PPCS_Close(handle);
+    memset(dev, 0, sizeof(*dev));
+}
+
+static int fleet_device_open(FleetDevice* dev, int index, Config* config) {
+    memset(dev, 0, sizeof(*dev));
+    device_did(g_opt.did, index, dev->did, sizeof(dev->did));
+    INT32 handle = connect_to_device(dev->did, config);
+    if (handle < 0) {
+        printf("[Fleet] ERROR: Failed to connect to %s\n", dev->did);
+        return -1;
+    }
+    dev->app_ctx.session_handle = handle;
+
+    char prefix[MAX_CONFIG_VALUE_LEN + 64];
+    snprintf(prefix, sizeof(prefix), "%s_%s", g_opt.prefix, dev->did);
+    dev->app_ctx.video_mgr = create_video_stream_manager(prefix);
+    if (dev->app_ctx.video_mgr) {
+        VideoDecoderThreading threading = { config->DecodeThreads, config->DecodeThreadType, config->DecodeLowDelay };
+        video_manager_set_headless(dev->app_ctx.video_mgr, !g_opt.decode);
+        video_manager_set_decode_only(dev->app_ctx.video_mgr, 1);
+        video_manager_set_decode_mode(dev->app_ctx.video_mgr, config->DecodeMode ? DECODE_MODE_AU : DECODE_MODE_PARSER);
+        video_manager_set_decoder_threading(dev->app_ctx.video_mgr, &threading);
+    }
+    dev->pkg_ctx.did = dev->did;
+    dev->pkg_ctx.app = &dev->app_ctx;
+    dev->pkg_ctx.video_mgr = dev->app_ctx.video_mgr;
+
+    dev->net = ppcs_session_start(handle, dev->did, config);
+    if (!dev->net) {
+        printf("[Fleet] ERROR: Failed to start network for %s\n", dev->did);
+        fleet_device_close(dev);
+        return -1;
+    }
+    dev->app_ctx.net = dev->net;
+    return 0;
+}
+
+static int drain_device(FleetDevice* dev, int budget) {
+    PackageView batch[FLEET_BATCH_SIZE];
+    int processed = 0;
+    while (processed < budget) {
+        int want = budget - processed;
+        if (want > FLEET_BATCH_SIZE) want = FLEET_BATCH_SIZE;
+        int count = ppcs_session_pop_packages(dev->net, batch, want);
+        if (count == 0) break;
+        for (int i = 0; i < count; i++) {
+            dev->bytes += (unsigned long long)batch[i].len;
+            package_registry_dispatch(&batch[i], &dev->pkg_ctx);
+            ppcs_session_free_package(dev->net, &batch[i]);
+        }
+        dev->packages += count;
+        processed += count;
+    }
+    return processed;
+}
+
+// Equal share per device; what a quiet one leaves is spread over the rest
+static int drain_fleet(FleetDevice* devices, int count, int* next) {
+    int processed = 0;
+    for (int n = 0; n < count && processed < FLEET_BUDGET; n++) {
+        int remaining = count - n;
+        int want = (FLEET_BUDGET - processed + remaining - 1) / remaining;
+        processed += drain_device(&devices[(*next + n) % count], want);
+    }
+    *next = (*next + 1) % count;
+    return processed;
+}
+
+static void drain_for(FleetDevice* devices, int count, long long until, int* max_depth) {
+    int next = 0;
+    while (metrics_now_us() < until) {
+        if (drain_fleet(devices, count, &next) > 0) {
+            if (max_depth) {
+                int depth = 0;
+                for (int i = 0; i < count; i++) depth += ppcs_session_queue_depth(devices[i].net);
+                if (depth > *max_depth) *max_depth = depth;
+            }
+            continue;
+        }
+        // Nothing queued anywhere: sleep on the device due next, bounded so the others are not missed
+        WaitForSingleObject(ppcs_session_event(devices[next].net), FLEET_IDLE_WAIT_MS);
+    }
+}
+
+// Counters summed over the fleet since the devices were connected
+static void fleet_totals(FleetDevice* devices, int count, FleetRun* totals) {
+    for (int i = 0; i < count; i++) {
+        FleetDevice* dev = &devices[i];
+        totals->packages += dev->packages;
+        totals->bytes += dev->bytes;
+        for (int type = 1; type <= 5; type++) {
+            unsigned long long frames = 0, lost = 0;
+            if (video_manager_get_loss(dev->app_ctx.video_mgr, type, &frames, &lost) == 0) {
+                totals->frames += frames;
+                totals->frames_lost += lost;
+            }
+            IngestDropStats drops;
+            ppcs_session_get_drop_stats(dev->net, type, &drops);
+            totals->packages_dropped += drops.packages_dropped;
+        }
+    }
+}
+
+static int run_fleet(int count, Config* config, FleetRun* run) {
+    FleetDevice devices[FLEET_MAX_DEVICES];
+    memset(run, 0, sizeof(*run));
+    int opened = 0;
+    for (; opened < count; opened++) {
+        if (fleet_device_open(&devices[opened], opened, config) < 0) break;
+    }
+    if (opened < count) {
+        for (int i = 0; i < opened; i++) fleet_device_close(&devices[i]);
+        return -1;
+    }
+
+    drain_for(devices, count, metrics_now_us() + (long long)g_opt.warmup_sec * 1000000, NULL);
+    FleetRun warm;
+    memset(&warm, 0, sizeof(warm));
+    fleet_totals(devices, count, &warm);
+    long long started = metrics_now_us();
+    long long cpu_started = metrics_process_cpu_us();
+    drain_for(devices, count, started + (long long)g_opt.run_sec * 1000000, &run->max_depth);
+    run->seconds = (metrics_now_us() - started) / 1000000.0;
+    run->cpu_ms = (metrics_process_cpu_us() - cpu_started) / 1000.0;
+
+    fleet_totals(devices, count, run);
+    run->devices = count;
+    run->packages -= warm.packages;
+    run->bytes -= warm.bytes;
+    run->frames -= warm.frames;
+    run->frames_lost -= warm.frames_lost;
+    run->packages_dropped -= warm.packages_dropped;
+    for (int i = 0; i < count; i++) {
+        LOG_INFO("Fleet", "%s: %llu packages, %llu bytes", devices[i].did, devices[i].packages, devices[i].bytes);
+        fleet_device_close(&devices[i]);
+    }
+    return 0;
+}
+
+static void print_run(const FleetRun* run) {
+    double pps = run->seconds > 0 ? run->packages / run->seconds : 0.0;
+    printf("[Fleet] %2d devices %10.0f packages/s %8.1f MB/s %9.0f per device  CPU %5.1f%%  depth max %5d  "
+           "%llu frames, %llu lost, %llu packages shed\n",
+           run->devices, pps, run->seconds > 0 ? run->bytes / run->seconds / 1e6 : 0.0, pps / run->devices,
+           run->seconds > 0 ? run->cpu_ms / (run->seconds * 10.0) : 0.0, run->max_depth,
+           run->frames, run->frames_lost, run->packages_dropped);
+}
+
+int main(int argc, char* argv[]) {
+    if (parse_options(argc, argv, &g_opt) != 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    metrics_now_us();
+    Config config;
+    init_config(&config);
+    // Measure the core, not the disk
+    config.CaptureFile[0] = '\0';
+    config.ConnectCacheFile[0] = '\0';
+    async_log_init(g_opt.log_level);
+    ppcs_set_channel_map(&config);
+    package_registry_register(PKG_JSON_MAGIC, PKG_TYPE_JSON, "json", 0, fleet_json_handler);
+    video_manager_register_packages();
+    image_handler_register_packages();
+    timelapse_manager_register_packages();
+
+    INT32 ret = PPCS_Initialize((CHAR*)"{}");
+    if (ret != ERROR_PPCS_SUCCESSFUL && ret != ERROR_PPCS_ALREADY_INITIALIZED) {
+        printf("[Fleet] ERROR: PPCS_Initialize failed (%d)\n", ret);
+        async_log_shutdown();
+        return 1;
+    }
+
+    FleetRun runs[FLEET_MAX_RUNS];
+    int done = 0;
+    for (int i = 0; i < g_opt.run_count; i++) {
+        printf("[Fleet] %d device(s) from %s: %d s warm-up, %d s measured, video %s\n", g_opt.counts[i], g_opt.did,
+               g_opt.warmup_sec, g_opt.run_sec, g_opt.decode ? "decoded" : "recorded");
+        if (run_fleet(g_opt.counts[i], &config, &runs[done]) < 0) {
+            printf("[Fleet] ERROR: Run with %d device(s) failed; is the emulator running with -n %d or more?\n",
+                   g_opt.counts[i], g_opt.counts[i]);
+            break;
+        }
+        print_run(&runs[done++]);
+    }
+
+    if (done > 1) {
+        printf("[Fleet] Summary (%llu command responses)\n", g_json_packages);
+        for (int i = 0; i < done; i++) print_run(&runs[i]);
+    }
+    PPCS_DeInitialize();
+    async_log_shutdown();
+    return done == g_opt.run_count ? 0 : 1;
+}
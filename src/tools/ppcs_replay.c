@@ -0,0 +1,635 @@
+// PPCS Capture Replay
+//
+// Feeds a receive capture (see capture_file.h) back through the framer and
+// the package handlers exactly as the reader threads saw it: same chunks,
+// same channels, same session generations. Runs as fast as possible by
+// default, which makes it a repeatable benchmark of framing, reassembly
+// and decoding; -r paces the records at their captured times instead.
+// -B replays it once per decoder threading profile and compares them; -F
+// times the framer alone against the flat buffer it replaced, and what
+// checksum verification adds to it.
+//
+//   ppcs_replay [-r] [-x speed] [-H] [-v] [-d mode] [-t threads] [-o prefix] [-m metrics.jsonl] [-L level] file.ppcap
+//   ppcs_replay -B 1,0:frame,0:slice,0:frame:lowdelay file.ppcap
+//   ppcs_replay -F 20 file.ppcap
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "platform.h"
+#include "capture_file.h"
+#include "stream_framer.h"
+#include "package_registry.h"
+#include "package_reasm.h"
+#include "package_pool.h"
+#include "video_manager.h"
+#include "image_handler.h"
+#include "timelapse_manager.h"
+#include "app_context.h"
+#include "async_log.h"
+#include "metrics.h"
+
+#define REPLAY_RING_SIZE (4*1024*1024)      // Same as the reader's receive ring
+#define REPLAY_CHANNELS 256
+#define REPLAY_JSON_SLOTS 8
+#define REPLAY_JSON_MAX (64 * 1024)
+#define REPLAY_MAX_PROFILES 16
+#define LEGACY_BUFFER_SIZE (1024*1024)      // The reader's flat buffer before the ring
+
+typedef struct {
+    int realtime;                   // Pace records at their captured times
+    double speed;                   // Pace multiplier with -r
+    int headless;                   // Record video only, no decoding
+    int verify;                     // Verify package checksums
+    int decode_mode;                // DECODE_MODE_*
+    VideoDecoderThreading threading;
+    // -B: one replay per profile, decoding only
+    VideoDecoderThreading profiles[REPLAY_MAX_PROFILES];
+    char profile_names[REPLAY_MAX_PROFILES][32];
+    int profile_count;
+    int framer_passes;              // -F: framer benchmark, passes over the capture
+    const char* prefix;             // Output file prefix
+    const char* metrics_file;
+    int log_level;
+    const char* path;
+} ReplayOptions;
+
+typedef struct {
+    unsigned long long records;
+    unsigned long long resets;
+    unsigned long long bytes;
+    unsigned long long packages;
+    unsigned long long overflows;   // Records that did not fit the ring
+    unsigned long long handler_errors;
+    unsigned long long checksum_failures;
+    unsigned long long json_responses;
+    long long captured_us;          // Time stamp of the last record
+} ReplayStats;
+
+typedef struct {
+    double wall_ms;
+    double cpu_ms;                  // Whole process: codec threads included
+    long long captured_us;
+    VideoDecoderStats decode;       // Summed over the streams' decoders
+} ReplayRun;
+
+static PackageReasm* g_json_reasm = NULL;
+static ReplayStats g_stats;
+
+// The client's JSON handler drives the GUI and the command tracker, neither
+// of which exists here; responses are reassembled and logged instead
+static int replay_json_handler(const PackageView* pkg, const PackageContext* ctx) {
+    if (!pkg || pkg->len < PKG_MIN_LEN || !g_json_reasm) return -1;
+    int json_len = pkg->header.u16PkgLen;
+    if (json_len <= 0 || PKG_HEADER_TOTAL_LEN + json_len > pkg->len) return json_len == 0 ? 0 : -1;
+    ReasmPayload json;
+    int ret = package_reasm_add(g_json_reasm, PKG_TYPE_JSON, pkg, PKG_HEADER_TOTAL_LEN, json_len, &json);
+    if (ret != REASM_COMPLETE) return ret < 0 ? -1 : 0;
+    g_stats.json_responses++;
+    LOG_DEBUG("Replay", "%s: response to 0x%04X, %d bytes: %.*s", ctx ? ctx->did : "",
+              pkg->header.u16PkgCmd, json.len, json.len > 200 ? 200 : json.len, (const char*)json.data);
+    package_reasm_payload_release(&json);
+    return 0;
+}
+
+static void print_usage(const char* argv0) {
+    printf("Usage: %s [options] file%s\n", argv0, CAPTURE_FILE_EXT);
+    printf("  -r           Replay at the captured pace instead of as fast as possible\n");
+    printf("  -x SPEED     Pace multiplier with -r (default 1.0)\n");
+    printf("  -H           Headless: record video to files without decoding\n");
+    printf("  -v           Verify package checksums\n");
+    printf("  -d MODE      Decode whole access units (au, default) or through the parser (parser)\n");
+    printf("  -t THREADS[:frame|slice|auto][:lowdelay]\n");
+    printf("               Decoder threading; 0 threads = from the core count (default 1)\n");
+    printf("  -B PROFILE,...  Replay once per -t profile, decoding without display, and compare\n");
+    printf("               fps, CPU and packet-to-picture latency\n");
+    printf("  -F PASSES    Framer benchmark: frame the capture PASSES times from memory, with the\n");
+    printf("               ring framer and with the flat buffer it replaced, and report bytes/s;\n");
+    printf("               then with checksums verified, by package_checksum() and by a byte loop\n");
+    printf("  -o PREFIX    Output file prefix (default replay_<did>)\n");
+    printf("  -m FILE      Write a metrics snapshot to FILE at the end\n");
+    printf("  -L LEVEL     Log level: error, warn, info, debug, trace (default info)\n");
+}
+
+// THREADS[:frame|slice|auto][:lowdelay], up to end or a comma
+static int parse_threading(const char* spec, VideoDecoderThreading* threading, const char** next) {
+    memset(threading, 0, sizeof(*threading));
+    threading->thread_type = DECODE_THREAD_AUTO;
+    char* end = NULL;
+    long count = strtol(spec, &end, 10);
+    if (end == spec || count < 0 || count > 64) return -1;
+    threading->thread_count = (int)count;
+    while (*end == ':') {
+        const char* field = end + 1;
+        size_t len = strcspn(field, ":,");
+        if (len == 5 && strncmp(field, "frame", len) == 0) threading->thread_type = DECODE_THREAD_FRAME;
+        else if (len == 5 && strncmp(field, "slice", len) == 0) threading->thread_type = DECODE_THREAD_SLICE;
+        else if (len == 4 && strncmp(field, "auto", len) == 0) threading->thread_type = DECODE_THREAD_AUTO;
+        else if (len == 8 && strncmp(field, "lowdelay", len) == 0) threading->low_delay = 1;
+        else return -1;
+        end = (char*)field + len;
+    }
+    if (*end != '\0' && *end != ',') return -1;
+    if (next) *next = end;
+    return 0;
+}
+
+static int parse_profiles(const char* list, ReplayOptions* opt) {
+    const char* spec = list;
+    while (*spec) {
+        if (opt->profile_count == REPLAY_MAX_PROFILES) return -1;
+        const char* end = NULL;
+        if (parse_threading(spec, &opt->profiles[opt->profile_count], &end) != 0) return -1;
+        snprintf(opt->profile_names[opt->profile_count], sizeof(opt->profile_names[0]), "%.*s", (int)(end - spec), spec);
+        opt->profile_count++;
+        spec = *end == ',' ? end + 1 : end;
+    }
+    return opt->profile_count > 0 ? 0 : -1;
+}
+
+static int parse_options(int argc, char* argv[], ReplayOptions* opt) {
+    memset(opt, 0, sizeof(*opt));
+    opt->speed = 1.0;
+    opt->log_level = LOG_LEVEL_INFO;
+    opt->decode_mode = DECODE_MODE_AU;
+    opt->threading.thread_count = 1;
+    opt->threading.thread_type = DECODE_THREAD_AUTO;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        int has_value = i + 1 < argc;
+        if (strcmp(arg, "-r") == 0) opt->realtime = 1;
+        else if (strcmp(arg, "-H") == 0) opt->headless = 1;
+        else if (strcmp(arg, "-v") == 0) opt->verify = 1;
+        else if (strcmp(arg, "-x") == 0 && has_value) opt->speed = atof(argv[++i]);
+        else if (strcmp(arg, "-o") == 0 && has_value) opt->prefix = argv[++i];
+        else if (strcmp(arg, "-d") == 0 && has_value) {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "au") == 0) opt->decode_mode = DECODE_MODE_AU;
+            else if (strcmp(mode, "parser") == 0) opt->decode_mode = DECODE_MODE_PARSER;
+            else return -1;
+        }
+        else if (strcmp(arg, "-t") == 0 && has_value) {
+            const char* end = NULL;
+            if (parse_threading(argv[++i], &opt->threading, &end) != 0 || *end) return -1;
+        } else if (strcmp(arg, "-B") == 0 && has_value) {
+            if (parse_profiles(argv[++i], opt) != 0) return -1;
+        }
+        else if (strcmp(arg, "-F") == 0 && has_value) {
+            opt->framer_passes = atoi(argv[++i]);
+            if (opt->framer_passes <= 0) return -1;
+        }
+        else if (strcmp(arg, "-m") == 0 && has_value) opt->metrics_file = argv[++i];
+        else if (strcmp(arg, "-L") == 0 && has_value) {
+            opt->log_level = async_log_parse_level(argv[++i]);
+            if (opt->log_level < 0) return -1;
+        } else if (arg[0] == '-' || opt->path) return -1;
+        else opt->path = arg;
+    }
+    if (!opt->path || opt->speed <= 0) return -1;
+    if (opt->profile_count > 0 && opt->headless) return -1;     // Nothing to compare without decoding
+    return 0;
+}
+
+// Wait until the record's captured time, scaled by speed, has passed
+static void pace_record(const ReplayOptions* opt, long long start_us, long long t_us) {
+    long long due = start_us + (long long)((double)t_us / opt->speed);
+    long long now = metrics_now_us();
+    if (due - now >= 1000) Sleep((DWORD)((due - now) / 1000));
+}
+
+static void replay_data(StreamFramer* framer, const CaptureRecordHeader* rec, const unsigned char* data,
+                        const PackageContext* ctx) {
+    long long read_at = metrics_now_us();
+    if (stream_framer_push(framer, data, (int)rec->len) < 0) {
+        // Every view is released below, so only a damaged capture gets here
+        g_stats.overflows++;
+        LOG_RATELIMITED(LOG_LEVEL_WARN, "Replay", 5, "Channel %d: %u byte record does not fit, %d bytes buffered; dropped",
+                        rec->channel, rec->len, stream_framer_used(framer));
+        return;
+    }
+    package_pool_count_received((int)rec->len);
+    metrics_add(MET_BYTES_READ, rec->len);
+    PackageView view;
+    while (stream_framer_next(framer, &view)) {
+        view.read_at = read_at;
+        view.queued_at = read_at;
+        view.dequeued_at = metrics_now_us();
+        view.generation = rec->generation;
+        metrics_add(MET_PACKAGES_READ, 1);
+        g_stats.packages++;
+        if (!view.checksum_ok) g_stats.checksum_failures++;
+        if (package_registry_dispatch(&view, ctx) < 0) g_stats.handler_errors++;
+        package_view_release(&view);
+    }
+}
+
+static void print_framer_stats(int channel, StreamFramer* framer) {
+    StreamFramerStats fs;
+    stream_framer_get_stats(framer, &fs);
+    printf("[Replay] Channel %d framer: %llu bytes, %llu packages, %llu skipped in %lu resyncs, %lu bad lengths, %lu overflows\n",
+           channel, fs.bytes_in, fs.packages, fs.skipped_bytes, fs.resyncs, fs.bad_length, fs.overflows);
+    if (fs.checksums > 0) {
+        unsigned long failures = 0;
+        for (int t = 0; t <= PKG_TYPE_TIMELAPSE; t++) failures += fs.checksum_failures[t];
+        printf("[Replay] Channel %d checksums: %llu verified, %lu mismatches\n", channel, fs.checksums, failures);
+    }
+}
+
+static void print_histogram(const char* name, MetricId id) {
+    MetricsHistogramSummary h;
+    metrics_get_histogram(id, &h);
+    if (h.count == 0) return;
+    printf("[Replay] %s: %llu samples, p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+           name, h.count, h.p50 / 1000.0, h.p90 / 1000.0, h.p99 / 1000.0, h.max / 1000.0);
+}
+
+// Replay the capture once; with report set, print what each stage saw
+static int replay_capture(const ReplayOptions* opt, const VideoDecoderThreading* threading, int report, ReplayRun* run) {
+    memset(run, 0, sizeof(*run));
+    CaptureReader* reader = capture_reader_open(opt->path);
+    if (!reader) return 1;
+    const CaptureFileHeader* header = capture_reader_header(reader);
+    if (report) {
+        time_t started = (time_t)(header->started_unix_us / 1000000);
+        printf("[Replay] %s: device %s, captured %s", opt->path, header->did[0] ? header->did : "(unknown)", ctime(&started));
+    }
+
+    char prefix[128];
+    if (opt->prefix) snprintf(prefix, sizeof(prefix), "%s", opt->prefix);
+    else snprintf(prefix, sizeof(prefix), "replay_%s", header->did[0] ? header->did : "capture");
+    VideoStreamManager* video_mgr = create_video_stream_manager(prefix);
+    if (!video_mgr) {
+        capture_reader_close(reader);
+        return 1;
+    }
+    video_manager_set_headless(video_mgr, opt->headless);
+    video_manager_set_decode_mode(video_mgr, opt->decode_mode);
+    video_manager_set_decoder_threading(video_mgr, threading);
+    video_manager_set_decode_only(video_mgr, !report);
+    AppContext app;
+    memset(&app, 0, sizeof(app));
+    app.session_handle = -1;
+    app.video_mgr = video_mgr;
+    PackageContext ctx = { header->did, &app, video_mgr };
+
+    StreamFramer* framers[REPLAY_CHANNELS];
+    memset(framers, 0, sizeof(framers));
+    memset(&g_stats, 0, sizeof(g_stats));
+    int generation = -1;
+    int result = 0;
+    long long start_us = metrics_now_us();
+    long long cpu_start = metrics_process_cpu_us();
+
+    CaptureRecordHeader rec;
+    const unsigned char* data = NULL;
+    int ret;
+    while ((ret = capture_reader_next(reader, &rec, &data)) > 0) {
+        if (opt->realtime) pace_record(opt, start_us, rec.t_us);
+        g_stats.records++;
+        g_stats.captured_us = rec.t_us;
+        StreamFramer* framer = framers[rec.channel];
+        if (!framer) {
+            framer = framers[rec.channel] = stream_framer_create(REPLAY_RING_SIZE);
+            if (!framer) {
+                result = 1;
+                break;
+            }
+            stream_framer_set_verify(framer, opt->verify);
+        }
+        if (generation < 0) generation = rec.generation;
+        if (rec.kind == CAPTURE_REC_RESET) {
+            // The reader dropped its partial package; the first channel to
+            // see a new handle resumes the streams, as the session sync does
+            g_stats.resets++;
+            stream_framer_discard(framer);
+            if (rec.generation != generation) {
+                generation = rec.generation;
+                video_manager_resume(video_mgr, metrics_now_us());
+                for (int i = 0; i < PKG_REGISTRY_MAX; i++) package_reasm_reset(app.reasm[i]);
+            }
+            continue;
+        }
+        g_stats.bytes += rec.len;
+        replay_data(framer, &rec, data, &ctx);
+    }
+    if (ret < 0) result = 1;
+
+    // Process CPU, so codec threads count as well as this one
+    run->wall_ms = (double)(metrics_now_us() - start_us) / 1000.0;
+    run->cpu_ms = (double)(metrics_process_cpu_us() - cpu_start) / 1000.0;
+    for (int type = 1; type <= 5; type++) {
+        VideoDecoderStats ds;
+        if (video_manager_get_decoder_stats(video_mgr, type, &ds) != 0) continue;
+        run->decode.frames_in += ds.frames_in;
+        run->decode.pictures += ds.pictures;
+        run->decode.latency_us += ds.latency_us;
+        if (ds.latency_max_us > run->decode.latency_max_us) run->decode.latency_max_us = ds.latency_max_us;
+        if (ds.max_delay > run->decode.max_delay) run->decode.max_delay = ds.max_delay;
+        if (ds.threads > run->decode.threads) run->decode.threads = ds.threads;
+        run->decode.thread_type |= ds.thread_type;
+    }
+
+    if (report) {
+        printf("[Replay] %llu reads (%.2f MB, %llu session resets) spanning %.1f s of capture\n",
+               g_stats.records - g_stats.resets, (double)g_stats.bytes / (1024 * 1024), g_stats.resets,
+               (double)g_stats.captured_us / 1000000.0);
+        printf("[Replay] %llu packages, %llu JSON responses, %llu handler errors, %llu checksum mismatches, %llu records dropped\n",
+               g_stats.packages, g_stats.json_responses, g_stats.handler_errors, g_stats.checksum_failures, g_stats.overflows);
+        printf("[Replay] Wall %.0f ms, CPU %.0f ms: %.1f MB/s, %.0f packages/s\n", run->wall_ms, run->cpu_ms,
+               run->wall_ms > 0 ? (double)g_stats.bytes / (1024 * 1024) * 1000.0 / run->wall_ms : 0.0,
+               run->wall_ms > 0 ? (double)g_stats.packages * 1000.0 / run->wall_ms : 0.0);
+        print_histogram("Dequeued to reassembled", MET_DEQUEUED_TO_REASSEMBLED);
+        print_histogram("Reassembled to decoded", MET_REASSEMBLED_TO_DECODED);
+        for (int i = 0; i < REPLAY_CHANNELS; i++) {
+            if (framers[i]) print_framer_stats(i, framers[i]);
+        }
+        package_registry_print_stats();
+        package_reasm_print_stats();
+    }
+    run->captured_us = g_stats.captured_us;
+
+    destroy_video_stream_manager(video_mgr);
+    for (int i = 0; i < PKG_REGISTRY_MAX; i++) package_reasm_destroy(app.reasm[i]);
+    for (int i = 0; i < REPLAY_CHANNELS; i++) stream_framer_destroy(framers[i]);
+    capture_reader_close(reader);
+    return result;
+}
+
+// Replay the capture once per threading profile and compare decoding
+static int run_benchmark(const ReplayOptions* opt) {
+    ReplayRun runs[REPLAY_MAX_PROFILES];
+    int result = 0;
+    for (int i = 0; i < opt->profile_count && result == 0; i++) {
+        printf("[Bench] Profile %s...\n", opt->profile_names[i]);
+        result = replay_capture(opt, &opt->profiles[i], 0, &runs[i]);
+        package_pool_trim();
+    }
+    if (result != 0) return result;
+
+    // fps: pictures per second of wall time, as fast as the decoder goes.
+    // Latency: packet sent to picture out, so frame threads show as delay.
+    printf("[Bench] %s, %.1f s of capture, decoded without display\n", opt->path, runs[0].captured_us / 1000000.0);
+    printf("[Bench] %-20s %-12s %8s %8s %8s %8s %9s %9s %6s\n",
+           "profile", "threads", "pictures", "fps", "realtime", "CPU ms", "lat avg", "lat max", "delay");
+    for (int i = 0; i < opt->profile_count; i++) {
+        const ReplayRun* run = &runs[i];
+        const VideoDecoderStats* ds = &run->decode;
+        char threads[32];
+        snprintf(threads, sizeof(threads), "%d %s", ds->threads,
+                 ds->thread_type & DECODE_THREAD_FRAME ? "frame" : (ds->thread_type & DECODE_THREAD_SLICE ? "slice" : "none"));
+        double seconds = run->wall_ms / 1000.0;
+        printf("[Bench] %-20s %-12s %8llu %8.1f %7.2fx %8.0f %6.1f ms %6.1f ms %6d\n", opt->profile_names[i], threads,
+               ds->pictures, seconds > 0 ? ds->pictures / seconds : 0.0,
+               seconds > 0 ? (double)run->captured_us / 1000000.0 / seconds : 0.0, run->cpu_ms,
+               ds->pictures ? (double)ds->latency_us / ds->pictures / 1000.0 : 0.0, ds->latency_max_us / 1000.0, ds->max_delay);
+    }
+    return 0;
+}
+
+// -F: the capture held in memory, so only framing is timed
+typedef struct {
+    int channel;
+    int kind;
+    int len;
+    unsigned char* data;
+} FramerRecord;
+
+typedef struct {
+    unsigned char* buffer;
+    int used;
+} LegacyFramer;
+
+typedef struct {
+    unsigned long long packages;
+    unsigned long long bytes;
+    unsigned long long checksum_failures;
+} FramerPass;
+
+// Checksum verification in a ring pass
+#define FRAMER_SUM_OFF 0
+#define FRAMER_SUM_KERNEL 1                 // The framer's own, package_checksum()
+#define FRAMER_SUM_BYTES 2                  // The byte loop package_checksum() replaced
+
+static int load_records(const char* path, FramerRecord** out, int* count, unsigned long long* bytes) {
+    CaptureReader* reader = capture_reader_open(path);
+    if (!reader) return -1;
+    FramerRecord* records = NULL;
+    int n = 0, capacity = 0, ret;
+    *bytes = 0;
+    CaptureRecordHeader rec;
+    const unsigned char* data = NULL;
+    while ((ret = capture_reader_next(reader, &rec, &data)) > 0) {
+        if (n == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            FramerRecord* bigger = (FramerRecord*)realloc(records, capacity * sizeof(FramerRecord));
+            if (!bigger) break;
+            records = bigger;
+        }
+        FramerRecord* r = &records[n];
+        r->channel = rec.channel;
+        r->kind = rec.kind;
+        r->len = (int)rec.len;
+        r->data = (unsigned char*)malloc(rec.len ? rec.len : 1);
+        if (!r->data) break;
+        memcpy(r->data, data, rec.len);
+        if (rec.kind == CAPTURE_REC_DATA) *bytes += rec.len;
+        n++;
+    }
+    capture_reader_close(reader);
+    *out = records;
+    *count = n;
+    return ret < 0 ? -1 : 0;
+}
+
+// The reader loop as it was before the ring framer: append to a flat
+// buffer, memmove one byte per resync step and once per package, and
+// hand each package over as a malloc'd copy
+static int legacy_frame(LegacyFramer* f, const unsigned char* data, int len) {
+    int packages = 0;
+    if (f->used + len > LEGACY_BUFFER_SIZE) {
+        f->used = 0;
+        return 0;
+    }
+    memcpy(f->buffer + f->used, data, len);
+    f->used += len;
+    while (f->used >= PKG_MIN_LEN) {
+        if (!stream_framer_prefix_type(f->buffer)) {
+            memmove(f->buffer, f->buffer + 1, f->used - 1);
+            f->used--;
+            continue;
+        }
+        PackageHeader_t header;
+        memcpy(&header, f->buffer + PKG_PREFIX_LEN, sizeof(header));
+        int pkg_len = PKG_MIN_LEN + header.u16PkgLen;
+        if (pkg_len > LEGACY_BUFFER_SIZE) {
+            memmove(f->buffer, f->buffer + PKG_PREFIX_LEN, f->used - PKG_PREFIX_LEN);
+            f->used -= PKG_PREFIX_LEN;
+            continue;
+        }
+        if (f->used < pkg_len) break;
+        unsigned char* pkg = (unsigned char*)malloc(pkg_len);
+        if (pkg) {
+            memcpy(pkg, f->buffer, pkg_len);
+            free(pkg);
+            packages++;
+        }
+        memmove(f->buffer, f->buffer + pkg_len, f->used - pkg_len);
+        f->used -= pkg_len;
+    }
+    return packages;
+}
+
+static void legacy_pass(const FramerRecord* records, int count, FramerPass* pass) {
+    LegacyFramer* framers[REPLAY_CHANNELS];
+    memset(framers, 0, sizeof(framers));
+    for (int i = 0; i < count; i++) {
+        const FramerRecord* r = &records[i];
+        LegacyFramer* f = framers[r->channel];
+        if (!f) {
+            f = framers[r->channel] = (LegacyFramer*)calloc(1, sizeof(LegacyFramer));
+            if (f) f->buffer = (unsigned char*)malloc(LEGACY_BUFFER_SIZE);
+            if (!f || !f->buffer) break;
+        }
+        if (r->kind == CAPTURE_REC_RESET) {
+            f->used = 0;
+            continue;
+        }
+        pass->bytes += r->len;
+        pass->packages += legacy_frame(f, r->data, r->len);
+    }
+    for (int i = 0; i < REPLAY_CHANNELS; i++) {
+        if (!framers[i]) continue;
+        free(framers[i]->buffer);
+        free(framers[i]);
+    }
+}
+
+// The checksum as it was before the psadbw kernel
+static uint16_t byte_checksum(const unsigned char* data, int len) {
+    unsigned int sum = 0;
+    for (int i = 0; i < len; i++) sum += data[i];
+    return (uint16_t)sum;
+}
+
+static int byte_checksum_ok(const PackageView* view) {
+    int body = view->len - (int)sizeof(PackageTail_t);
+    int n0 = view->seg_len[0] < body ? view->seg_len[0] : body;
+    uint16_t sum = (uint16_t)(byte_checksum(view->seg[0], n0) + byte_checksum(view->seg[1], body - n0));
+    PackageTail_t tail;
+    package_view_read(view, body, &tail, sizeof(tail));
+    return sum == tail.u16Check;
+}
+
+static void ring_pass(const FramerRecord* records, int count, int checksum, FramerPass* pass) {
+    StreamFramer* framers[REPLAY_CHANNELS];
+    memset(framers, 0, sizeof(framers));
+    for (int i = 0; i < count; i++) {
+        const FramerRecord* r = &records[i];
+        StreamFramer* f = framers[r->channel];
+        if (!f) {
+            if (!(f = framers[r->channel] = stream_framer_create(REPLAY_RING_SIZE))) break;
+            stream_framer_set_verify(f, checksum == FRAMER_SUM_KERNEL);
+        }
+        if (r->kind == CAPTURE_REC_RESET) {
+            stream_framer_discard(f);
+            continue;
+        }
+        if (stream_framer_push(f, r->data, r->len) < 0) continue;
+        pass->bytes += r->len;
+        PackageView view;
+        while (stream_framer_next(f, &view)) {
+            pass->packages++;
+            if (checksum == FRAMER_SUM_BYTES) view.checksum_ok = byte_checksum_ok(&view);
+            if (!view.checksum_ok) pass->checksum_failures++;
+            package_view_release(&view);
+        }
+    }
+    for (int i = 0; i < REPLAY_CHANNELS; i++) stream_framer_destroy(framers[i]);
+}
+
+static void print_framer_result(const char* name, const FramerPass* pass, long long us, const FramerPass* base, long long base_us) {
+    double seconds = us / 1000000.0;
+    printf("[Framer] %-24s %10llu packages %9.1f MB/s %11.0f packages/s", name, pass->packages,
+           seconds > 0 ? pass->bytes / (1024.0 * 1024.0) / seconds : 0.0, seconds > 0 ? pass->packages / seconds : 0.0);
+    if (base && us > 0 && base->bytes > 0) printf("  %.2fx", (double)base_us / us * pass->bytes / base->bytes);
+    printf("\n");
+}
+
+static long long time_ring_passes(const FramerRecord* records, int count, int passes, int checksum, FramerPass* pass) {
+    memset(pass, 0, sizeof(*pass));
+    long long started = metrics_now_us();
+    for (int p = 0; p < passes; p++) ring_pass(records, count, checksum, pass);
+    return metrics_now_us() - started;
+}
+
+// Frame the capture with each framer, then with the ring framer verifying
+// checksums with each kernel; handlers, pool copies and decoding are left out
+static int run_framer_benchmark(const ReplayOptions* opt) {
+    FramerRecord* records = NULL;
+    int count = 0;
+    unsigned long long bytes = 0;
+    if (load_records(opt->path, &records, &count, &bytes) != 0) return 1;
+    printf("[Framer] %s: %d records, %.2f MB, %d passes each\n", opt->path, count, bytes / (1024.0 * 1024.0), opt->framer_passes);
+
+    FramerPass legacy, ring, kernel, bytewise;
+    memset(&legacy, 0, sizeof(legacy));
+    long long started = metrics_now_us();
+    for (int p = 0; p < opt->framer_passes; p++) legacy_pass(records, count, &legacy);
+    long long legacy_us = metrics_now_us() - started;
+    long long ring_us = time_ring_passes(records, count, opt->framer_passes, FRAMER_SUM_OFF, &ring);
+    long long kernel_us = time_ring_passes(records, count, opt->framer_passes, FRAMER_SUM_KERNEL, &kernel);
+    long long bytes_us = time_ring_passes(records, count, opt->framer_passes, FRAMER_SUM_BYTES, &bytewise);
+
+    print_framer_result("flat buffer (memmove)", &legacy, legacy_us, NULL, 0);
+    print_framer_result("ring framer", &ring, ring_us, &legacy, legacy_us);
+#ifdef __SSE2__
+    print_framer_result("ring + checksum (psadbw)", &kernel, kernel_us, &legacy, legacy_us);
+#else
+    print_framer_result("ring + checksum", &kernel, kernel_us, &legacy, legacy_us);
+#endif
+    print_framer_result("ring + checksum (bytes)", &bytewise, bytes_us, &legacy, legacy_us);
+    if (ring.packages != legacy.packages) {
+        printf("[Framer] Note: the framers cut %llu and %llu packages; the flat buffer has no resync checks\n",
+               legacy.packages, ring.packages);
+    }
+    if (ring_us > 0) {
+        printf("[Framer] Checksum cost over framing alone: %+.1f%% with package_checksum(), %+.1f%% with the byte loop"
+               " (%llu and %llu failures)\n", (kernel_us - ring_us) * 100.0 / ring_us, (bytes_us - ring_us) * 100.0 / ring_us,
+               kernel.checksum_failures, bytewise.checksum_failures);
+    }
+    for (int i = 0; i < count; i++) free(records[i].data);
+    free(records);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    ReplayOptions opt;
+    if (parse_options(argc, argv, &opt) != 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    metrics_now_us();
+    async_log_init(opt.log_level);
+    if (opt.metrics_file) metrics_set_path(opt.metrics_file);
+    g_json_reasm = package_reasm_create("json", REPLAY_JSON_SLOTS, REPLAY_JSON_MAX, 0, REASM_OPEN_ANY | REASM_TERMINATE);
+    package_registry_register(PKG_JSON_MAGIC, PKG_TYPE_JSON, "json", 0, replay_json_handler);
+    video_manager_register_packages();
+    image_handler_register_packages();
+    timelapse_manager_register_packages();
+
+    int result;
+    if (opt.framer_passes > 0) {
+        result = run_framer_benchmark(&opt);
+    } else if (opt.profile_count > 0) {
+        result = run_benchmark(&opt);
+    } else {
+        ReplayRun run;
+        result = replay_capture(&opt, &opt.threading, 1, &run);
+    }
+    if (opt.metrics_file && metrics_dump(NULL) == 0) printf("[Replay] Metrics snapshot written to %s\n", opt.metrics_file);
+    async_log_shutdown();
+    package_reasm_destroy(g_json_reasm);
+    package_pool_trim();
+    return result;
+}
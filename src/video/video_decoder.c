@@ -2,12 +2,20 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "async_log.h"
+#include "metrics.h"
 
 // FFmpeg 头文件（需要从官网下载的开发包）
 #include <libavcodec/avcodec.h>
 #include <libavutil/imgutils.h>
 #include <libswscale/swscale.h>
 
+// The codec reads this far past an access unit it is given in place
+_Static_assert(VIDEO_DECODER_PADDING >= AV_INPUT_BUFFER_PADDING_SIZE,
+               "VIDEO_DECODER_PADDING is smaller than AV_INPUT_BUFFER_PADDING_SIZE");
+
+#define DECODER_SENT_RING 64        // Send times kept for pictures still inside the codec
+
 // 解码器结构
 struct VideoDecoder {
     AVCodec* codec;
@@ -23,6 +31,15 @@ struct VideoDecoder {
     
     int codec_type;
     int initialized;
+    int mode;                      // DECODE_MODE_*
+    int parser_fallback;           // AU mode gave up after too many unaligned frames: parser from then on
+    int misaligned_run;            // Unaligned frames in a row
+    int parser_pending;            // The parser may hold bytes of the last unaligned frame
+    VideoDecoderStats stats;
+    // Packets carry a sequence number through the codec (AV_CODEC_FLAG_COPY_OPAQUE),
+    // so a picture finds its own send time however many frames the threads hold
+    long long sent_at[DECODER_SENT_RING];
+    intptr_t sent_seq;
     
     // 缩放配置
     int scale_enabled;             // 是否启用缩放
@@ -89,12 +106,15 @@ VideoDecoder* video_decoder_create(int codec_type,
     }
     
     // 打开解码器
+    decoder->codec_ctx->flags |= AV_CODEC_FLAG_COPY_OPAQUE;
     if (avcodec_open2(decoder->codec_ctx, decoder->codec, NULL) < 0) {
         printf("[Decoder] Failed to open codec\n");
         avcodec_free_context(&decoder->codec_ctx);
         free(decoder);
         return NULL;
     }
+    decoder->stats.threads = decoder->codec_ctx->thread_count;
+    decoder->stats.thread_type = decoder->codec_ctx->active_thread_type;
     
     // 创建解析器
     decoder->parser = av_parser_init(codec_id);
@@ -126,21 +146,120 @@ VideoDecoder* video_decoder_create(int codec_type,
 }
 
 /**
- * 输入编码数据到解码器
+ * 取出解码器中所有可用的帧并回调，返回帧数
  */
-int video_decoder_decode(VideoDecoder* decoder, 
-                        const unsigned char* data, 
-                        int len, 
-                        int64_t pts) {
-    if (!decoder || !decoder->initialized) {
-        return -1;
+static int decoder_receive_frames(VideoDecoder* decoder) {
+    int total_decoded = 0;
+    int ret;
+    // 尝试接收所有可用的解码帧
+    while (1) {
+        ret = avcodec_receive_frame(decoder->codec_ctx, decoder->frame);
+        
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            // 需要更多数据或已结束
+            break;
+        } else if (ret < 0) {
+            LOG_RATELIMITED(LOG_LEVEL_WARN, "Decoder", 5, "Error receiving frame: %d", ret);
+            break;
+        }
+        
+        // 成功解码一帧
+        total_decoded++;
+        decoder->stats.pictures++;
+        long long sent_at = 0;
+        intptr_t seq = (intptr_t)decoder->frame->opaque;
+        if (seq > 0 && decoder->sent_seq - seq < DECODER_SENT_RING) {
+            sent_at = decoder->sent_at[seq % DECODER_SENT_RING];
+            long long latency = metrics_now_us() - sent_at;
+            decoder->stats.latency_us += latency;
+            if (latency > decoder->stats.latency_max_us) decoder->stats.latency_max_us = latency;
+            if (decoder->sent_seq - seq > decoder->stats.max_delay) decoder->stats.max_delay = (int)(decoder->sent_seq - seq);
+        }
+        
+        // 如果设置了回调函数，立即调用
+        if (decoder->callback) {
+            VideoFrame vframe;
+            AVFrame* output_frame = decoder->frame;
+            
+            // 如果启用了缩放，执行缩放操作
+            if (decoder->scale_enabled && decoder->scaled_frame) {
+                // 确保 sws_ctx 已初始化
+                if (!decoder->sws_ctx) {
+                    decoder->sws_ctx = sws_getContext(
+                        decoder->frame->width, decoder->frame->height, decoder->frame->format,
+                        decoder->target_width, decoder->target_height, AV_PIX_FMT_YUV420P,
+                        SWS_BILINEAR, NULL, NULL, NULL
+                    );
+                    
+                    if (!decoder->sws_ctx) {
+                        printf("[Decoder] Failed to create scaling context\n");
+                    } else {
+                        printf("[Decoder] Created scaling context: %dx%d -> %dx%d\n",
+                               decoder->frame->width, decoder->frame->height,
+                               decoder->target_width, decoder->target_height);
+                    }
+                }
+                
+                if (decoder->sws_ctx) {
+                    // 执行缩放
+                    sws_scale(decoder->sws_ctx,
+                             (const uint8_t* const*)decoder->frame->data,
+                             decoder->frame->linesize,
+                             0, decoder->frame->height,
+                             decoder->scaled_frame->data,
+                             decoder->scaled_frame->linesize);
+                    
+                    output_frame = decoder->scaled_frame;
+                }
+            }
+            
+            // 填充回调帧数据
+            vframe.width = output_frame->width;
+            vframe.height = output_frame->height;
+            vframe.pts = decoder->frame->pts;
+            vframe.sent_at = sent_at;
+            
+            vframe.data[0] = output_frame->data[0];
+            vframe.data[1] = output_frame->data[1];
+            vframe.data[2] = output_frame->data[2];
+            
+            vframe.linesize[0] = output_frame->linesize[0];
+            vframe.linesize[1] = output_frame->linesize[1];
+            vframe.linesize[2] = output_frame->linesize[2];
+            
+            decoder->callback(&vframe, decoder->user_data);
+        }
     }
-    
+    return total_decoded;
+}
+
+/**
+ * 发送一个数据包并接收解码帧
+ */
+static int decoder_send_packet(VideoDecoder* decoder, AVPacket* packet) {
+    decoder->sent_seq++;
+    decoder->sent_at[decoder->sent_seq % DECODER_SENT_RING] = metrics_now_us();
+    packet->opaque = (void*)decoder->sent_seq;
+    int ret = avcodec_send_packet(decoder->codec_ctx, packet);
+    if (ret < 0) {
+        if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+            LOG_RATELIMITED(LOG_LEVEL_WARN, "Decoder", 5, "Error sending packet: %d", ret);
+        }
+        return 0;
+    }
+    return decoder_receive_frames(decoder);
+}
+
+/**
+ * 通过解析器输入编码数据（解析器复制数据并自行分帧）
+ */
+static int decoder_parse(VideoDecoder* decoder, const unsigned char* data, int len, int64_t pts) {
     // 使用解析器解析数据流
     const uint8_t* parse_data = (const uint8_t*)data;
     int parse_size = len;
     int total_decoded = 0;
-    
+    decoder->stats.bytes_copied += (unsigned long long)len;
+
     while (parse_size > 0) {
         // 解析出一个完整的帧
         int ret = av_parser_parse2(
@@ -156,7 +275,7 @@ int video_decoder_decode(VideoDecoder* decoder,
         );
         
         if (ret < 0) {
-            printf("[Decoder] Error parsing frame: %d\n", ret);
+            LOG_RATELIMITED(LOG_LEVEL_WARN, "Decoder", 5, "Error parsing frame: %d", ret);
             return ret;
         }
         
@@ -166,90 +285,160 @@ int video_decoder_decode(VideoDecoder* decoder,
         // 如果解析出了完整的包，进行解码
         if (decoder->packet->size > 0) {
             decoder->packet->pts = pts;
-            
-            // 发送数据包到解码器
-            ret = avcodec_send_packet(decoder->codec_ctx, decoder->packet);
-            if (ret < 0) {
-                if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
-                    printf("[Decoder] Error sending packet: %d\n", ret);
-                }
-                continue;
-            }
-            
-            // 尝试接收所有可用的解码帧
-            while (1) {
-                ret = avcodec_receive_frame(decoder->codec_ctx, decoder->frame);
-                
-                if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                    // 需要更多数据或已结束
-                    break;
-                } else if (ret < 0) {
-                    printf("[Decoder] Error receiving frame: %d\n", ret);
-                    break;
-                }
-                
-                // 成功解码一帧
-                total_decoded++;
-                
-                // 如果设置了回调函数，立即调用
-                if (decoder->callback) {
-                    VideoFrame vframe;
-                    AVFrame* output_frame = decoder->frame;
-                    
-                    // 如果启用了缩放，执行缩放操作
-                    if (decoder->scale_enabled && decoder->scaled_frame) {
-                        // 确保 sws_ctx 已初始化
-                        if (!decoder->sws_ctx) {
-                            decoder->sws_ctx = sws_getContext(
-                                decoder->frame->width, decoder->frame->height, decoder->frame->format,
-                                decoder->target_width, decoder->target_height, AV_PIX_FMT_YUV420P,
-                                SWS_BILINEAR, NULL, NULL, NULL
-                            );
-                            
-                            if (!decoder->sws_ctx) {
-                                printf("[Decoder] Failed to create scaling context\n");
-                            } else {
-                                printf("[Decoder] Created scaling context: %dx%d -> %dx%d\n",
-                                       decoder->frame->width, decoder->frame->height,
-                                       decoder->target_width, decoder->target_height);
-                            }
-                        }
-                        
-                        if (decoder->sws_ctx) {
-                            // 执行缩放
-                            sws_scale(decoder->sws_ctx,
-                                     (const uint8_t* const*)decoder->frame->data,
-                                     decoder->frame->linesize,
-                                     0, decoder->frame->height,
-                                     decoder->scaled_frame->data,
-                                     decoder->scaled_frame->linesize);
-                            
-                            output_frame = decoder->scaled_frame;
-                        }
-                    }
-                    
-                    // 填充回调帧数据
-                    vframe.width = output_frame->width;
-                    vframe.height = output_frame->height;
-                    vframe.pts = decoder->frame->pts;
-                    
-                    vframe.data[0] = output_frame->data[0];
-                    vframe.data[1] = output_frame->data[1];
-                    vframe.data[2] = output_frame->data[2];
-                    
-                    vframe.linesize[0] = output_frame->linesize[0];
-                    vframe.linesize[1] = output_frame->linesize[1];
-                    vframe.linesize[2] = output_frame->linesize[2];
-                    
-                    decoder->callback(&vframe, decoder->user_data);
-                }
-            }
+            total_decoded += decoder_send_packet(decoder, decoder->packet);
         }
     }
     
     return total_decoded;
 }
 
+/**
+ * 输入编码数据到解码器
+ */
+int video_decoder_decode(VideoDecoder* decoder, 
+                        const unsigned char* data, 
+                        int len, 
+                        int64_t pts) {
+    if (!decoder || !decoder->initialized) {
+        return -1;
+    }
+    long long started = metrics_now_us();
+    long long cpu_started = metrics_thread_cpu_us();
+    decoder->stats.frames_in++;
+    decoder->stats.bytes_in += (unsigned long long)len;
+    int ret = decoder_parse(decoder, data, len, pts);
+    decoder->stats.cpu_us += metrics_thread_cpu_us() - cpu_started;
+    decoder->stats.wall_us += metrics_now_us() - started;
+    return ret;
+}
+
+void video_decoder_set_mode(VideoDecoder* decoder, int mode) {
+    if (!decoder) return;
+    decoder->mode = mode == DECODE_MODE_AU ? DECODE_MODE_AU : DECODE_MODE_PARSER;
+}
+
+/**
+ * 设置解码线程（重新打开解码器）
+ */
+int video_decoder_set_threading(VideoDecoder* decoder, const VideoDecoderThreading* threading) {
+    if (!decoder || !decoder->initialized || !threading || decoder->stats.frames_in > 0) {
+        return -1;
+    }
+    // Thread settings only take effect in avcodec_open2
+    AVCodecContext* ctx = avcodec_alloc_context3(decoder->codec);
+    if (!ctx) {
+        printf("[Decoder] Failed to allocate codec context\n");
+        return -1;
+    }
+    ctx->flags |= AV_CODEC_FLAG_COPY_OPAQUE;
+    ctx->thread_count = threading->thread_count < 0 ? 0 : threading->thread_count;
+    ctx->thread_type = threading->thread_type & (FF_THREAD_FRAME | FF_THREAD_SLICE);
+    if (threading->low_delay) ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    if (avcodec_open2(ctx, decoder->codec, NULL) < 0) {
+        printf("[Decoder] Failed to open codec with %d threads\n", threading->thread_count);
+        avcodec_free_context(&ctx);
+        return -1;
+    }
+    avcodec_free_context(&decoder->codec_ctx);
+    decoder->codec_ctx = ctx;
+    decoder->stats.threads = ctx->thread_count;
+    decoder->stats.thread_type = ctx->active_thread_type;
+    printf("[Decoder] %d thread(s), %s threading%s\n", ctx->thread_count,
+           ctx->active_thread_type == FF_THREAD_FRAME ? "frame" : (ctx->active_thread_type == FF_THREAD_SLICE ? "slice" : "no"),
+           threading->low_delay ? ", low delay" : "");
+    return 0;
+}
+
+// Whatever the parser still holds goes out before an access unit sent directly
+static int decoder_parser_flush(VideoDecoder* decoder, int64_t pts) {
+    decoder->parser_pending = 0;
+    int ret = av_parser_parse2(decoder->parser, decoder->codec_ctx, &decoder->packet->data, &decoder->packet->size,
+                               NULL, 0, AV_NOPTS_VALUE, AV_NOPTS_VALUE, 0);
+    if (ret < 0 || decoder->packet->size <= 0) return 0;
+    decoder->packet->pts = pts;
+    return decoder_send_packet(decoder, decoder->packet);
+}
+
+// A frame the device cut on an access unit starts with a start code (or SOI)
+static int decoder_au_aligned(const VideoDecoder* decoder, const unsigned char* data, int len) {
+    if (decoder->codec_type == 3) return len >= 2 && data[0] == 0xFF && data[1] == 0xD8;
+    return len >= 4 && data[0] == 0 && data[1] == 0 && (data[2] == 1 || (data[2] == 0 && data[3] == 1));
+}
+
+/**
+ * 输入一个完整的访问单元（AU），不经过解析器
+ */
+int video_decoder_decode_au(VideoDecoder* decoder, const unsigned char* data, int len, int64_t pts,
+                            DecoderBufferFree release, void* opaque) {
+    if (!decoder || !decoder->initialized || !data || len <= 0) {
+        if (release) release(opaque, (uint8_t*)data);
+        return -1;
+    }
+    long long started = metrics_now_us();
+    long long cpu_started = metrics_thread_cpu_us();
+    decoder->stats.frames_in++;
+    decoder->stats.bytes_in += (unsigned long long)len;
+    int ret;
+    if (decoder->mode == DECODE_MODE_AU && !decoder->parser_fallback) {
+        // An unaligned frame goes through the parser on its own; a stream
+        // that keeps sending them is not cut on access units at all
+        if (decoder_au_aligned(decoder, data, len)) {
+            decoder->misaligned_run = 0;
+        } else if (++decoder->misaligned_run >= DECODER_MISALIGNED_MAX) {
+            decoder->parser_fallback = 1;
+            printf("[Decoder] %d frames in a row do not start on an access unit, using the parser from now on\n",
+                   decoder->misaligned_run);
+        } else {
+            LOG_RATELIMITED(LOG_LEVEL_WARN, "Decoder", 5, "Frame does not start on an access unit, parsing it (%d in a row)",
+                            decoder->misaligned_run);
+        }
+    }
+    if (decoder->mode != DECODE_MODE_AU || decoder->parser_fallback || decoder->misaligned_run > 0) {
+        if (decoder->mode == DECODE_MODE_AU) {
+            if (decoder->parser_fallback) decoder->stats.au_parser++;
+            else decoder->stats.au_fallback++;
+        }
+        ret = decoder_parse(decoder, data, len, pts);
+        decoder->parser_pending = 1;
+        if (release) release(opaque, (uint8_t*)data);
+    } else {
+        if (decoder->parser_pending) decoder_parser_flush(decoder, pts);
+        // The reassembly buffer is the packet: the codec holds a reference
+        // (across its threads) and frees it through release
+        AVPacket* packet = decoder->packet;
+        av_packet_unref(packet);
+        if (release) {
+            packet->buf = av_buffer_create((uint8_t*)data, len + VIDEO_DECODER_PADDING, release, opaque, AV_BUFFER_FLAG_READONLY);
+            if (!packet->buf) release(opaque, (uint8_t*)data);
+        }
+        if (!packet->buf) {
+            ret = av_new_packet(packet, len);
+            if (ret < 0) {
+                LOG_RATELIMITED(LOG_LEVEL_WARN, "Decoder", 5, "Failed to allocate packet: %d", ret);
+                return ret;
+            }
+            memcpy(packet->data, data, len);
+            decoder->stats.bytes_copied += (unsigned long long)len;
+        } else {
+            packet->data = (uint8_t*)data;
+        }
+        packet->size = len;
+        packet->pts = pts;
+        decoder->stats.au_direct++;
+        ret = decoder_send_packet(decoder, packet);
+        av_packet_unref(packet);
+    }
+    decoder->stats.cpu_us += metrics_thread_cpu_us() - cpu_started;
+    decoder->stats.wall_us += metrics_now_us() - started;
+    return ret;
+}
+
+void video_decoder_get_stats(VideoDecoder* decoder, VideoDecoderStats* stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    if (decoder) *stats = decoder->stats;
+}
+
 /**
  * 获取解码后的帧
  */
@@ -270,6 +459,7 @@ int video_decoder_get_frame(VideoDecoder* decoder, VideoFrame* frame) {
     frame->width = decoder->frame->width;
     frame->height = decoder->frame->height;
     frame->pts = decoder->frame->pts;
+    frame->sent_at = 0;
     
     frame->data[0] = decoder->frame->data[0];
     frame->data[1] = decoder->frame->data[1];
@@ -363,6 +553,17 @@ void video_decoder_destroy(VideoDecoder* decoder) {
     if (!decoder) return;
     
     printf("[Decoder] Destroying decoder...\n");
+    const VideoDecoderStats* st = &decoder->stats;
+    if (st->frames_in > 0) {
+        printf("[Decoder] %s mode: %llu frames (%llu as whole AUs, %llu unaligned ones parsed, %llu parsed after giving up on AUs), %llu pictures, %.2f of %.2f MB copied, CPU %.1f us/frame, wall %.1f us/frame\n",
+               decoder->mode == DECODE_MODE_AU ? "AU" : "Parser", st->frames_in, st->au_direct, st->au_fallback, st->au_parser,
+               st->pictures, (double)st->bytes_copied / (1024 * 1024), (double)st->bytes_in / (1024 * 1024),
+               (double)st->cpu_us / st->frames_in, (double)st->wall_us / st->frames_in);
+        if (st->pictures > 0) {
+            printf("[Decoder] %d thread(s): packet to picture %.1f ms average, %.1f ms max, up to %d packets behind\n",
+                   st->threads, (double)st->latency_us / st->pictures / 1000.0, st->latency_max_us / 1000.0, st->max_delay);
+        }
+    }
     
     if (decoder->parser) {
         av_parser_close(decoder->parser);
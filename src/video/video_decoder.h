@@ -2,6 +2,7 @@
 #ifndef VIDEO_DECODER_H
 #define VIDEO_DECODER_H
 #include <stdint.h>
+#include "package_reasm.h"
 
 typedef struct VideoDecoder VideoDecoder;
 
@@ -11,13 +12,69 @@ typedef struct VideoFrame {
     int width;             // 프레임 너비
     int height;            // 프레임 높이
     int64_t pts;           // 프레젠테이션 타임스탬프
+    long long sent_at;     // When its packet went to the codec (metrics_now_us), 0 if unknown
 } VideoFrame;
 
 // 콜백 함수 타입
 typedef void (*FrameCallback)(VideoFrame* frame, void* user_data);
 
+// How encoded frames reach the codec
+#define DECODE_MODE_PARSER 0    // Through av_parser_parse2, which finds frame boundaries (and copies)
+#define DECODE_MODE_AU     1    // One access unit per call, sent as is; the parser is the fallback
+#define DECODER_MISALIGNED_MAX 8    // Unaligned frames in a row before AU mode gives up on a stream
+
+// Zeroed bytes that must follow an access unit given to video_decoder_decode_au:
+// those a REASM_PAD reassembler leaves after every payload
+#define VIDEO_DECODER_PADDING PACKAGE_REASM_PADDING
+
+// Frees a buffer given to video_decoder_decode_au once the codec is done with
+// it; may run on a codec thread. Same signature as av_buffer_create's.
+typedef void (*DecoderBufferFree)(void* opaque, uint8_t* data);
+
+// Decoder threading (FF_THREAD_* values)
+#define DECODE_THREAD_FRAME 1   // A frame per thread: scales with cores, each extra thread adds a frame of delay
+#define DECODE_THREAD_SLICE 2   // The slices of one frame in parallel: no delay, but only multi-slice streams gain
+#define DECODE_THREAD_AUTO  3   // Frame threading where the codec has it, else slice
+
+typedef struct {
+    int thread_count;   // 0: FFmpeg picks from the core count, 1: decode on the calling thread only
+    int thread_type;    // DECODE_THREAD_*
+    int low_delay;      // Output pictures as early as possible; FFmpeg then never uses frame threading
+} VideoDecoderThreading;
+
+typedef struct {
+    unsigned long long frames_in;       // Decode calls
+    unsigned long long au_direct;       // ...sent as one packet, without the parser
+    unsigned long long au_fallback;     // ...in AU mode, unaligned and parsed on their own
+    unsigned long long au_parser;       // ...in AU mode, parsed after too many unaligned frames in a row
+    unsigned long long bytes_in;
+    unsigned long long bytes_copied;    // Copied by the parser or into a packet
+    unsigned long long pictures;
+    long long cpu_us;                   // CPU time of the calling thread in decode calls (not codec threads)
+    long long wall_us;
+    long long latency_us;               // Sum over pictures of packet sent to picture out
+    long long latency_max_us;
+    int max_delay;                      // Most packets sent after the one a picture came from
+    int threads;                        // As opened: thread count and FF_THREAD_* in use
+    int thread_type;
+} VideoDecoderStats;
+
 VideoDecoder* video_decoder_create(int codec_type, FrameCallback frame_callback, void* user_data);
 int video_decoder_decode(VideoDecoder* decoder, const unsigned char* data, int len, int64_t pts);
+// DECODE_MODE_*; decoders start in DECODE_MODE_PARSER
+void video_decoder_set_mode(VideoDecoder* decoder, int mode);
+// Reopens the codec with this threading; only before the first frame.
+// Decoders start with FFmpeg's defaults (one thread).
+int video_decoder_set_threading(VideoDecoder* decoder, const VideoDecoderThreading* threading);
+// One whole frame, followed by VIDEO_DECODER_PADDING zero bytes. With
+// release set the decoder takes ownership: in AU mode the buffer itself
+// becomes the packet (no copy) and release is called when the codec drops
+// it; otherwise it is released before returning. A frame that does not start
+// on a start code (or JPEG SOI) goes through the parser instead; after
+// DECODER_MISALIGNED_MAX of them in a row the decoder stays on the parser.
+int video_decoder_decode_au(VideoDecoder* decoder, const unsigned char* data, int len, int64_t pts,
+                            DecoderBufferFree release, void* opaque);
+void video_decoder_get_stats(VideoDecoder* decoder, VideoDecoderStats* stats);
 void video_decoder_destroy(VideoDecoder* decoder);
 int video_decoder_set_scale(VideoDecoder* decoder, int w, int h);
 
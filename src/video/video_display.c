@@ -3,6 +3,39 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+
+#ifdef LINUX
+
+// No window system on Linux builds (replay, benchmarks): every stream is
+// decoded without being shown
+VideoDisplay* video_display_create(const char* title, int width, int height) {
+    printf("[Display] No display on this platform, %s (%dx%d) decodes without a window\n",
+           title ? title : "stream", width, height);
+    return NULL;
+}
+
+int video_display_render(VideoDisplay* display, VideoFrame* frame) {
+    (void)display;
+    (void)frame;
+    return -1;
+}
+
+int video_display_poll_events(VideoDisplay* display) {
+    (void)display;
+    return 0;
+}
+
+void video_display_set_title(VideoDisplay* display, const char* title) {
+    (void)display;
+    (void)title;
+}
+
+void video_display_destroy(VideoDisplay* display) {
+    (void)display;
+}
+
+#else
+
 #include <windows.h>
 
 // FFmpeg 用于 YUV 转 RGB
@@ -315,4 +348,6 @@ void video_display_destroy(VideoDisplay* display) {
     
     free(display);
     printf("[Display] Window destroyed\n");
-}
\ No newline at end of file
+}
+
+#endif // LINUX
@@ -6,8 +6,17 @@
 #include "video_decoder.h"
 #include "video_display.h"
 #include "protocol_defs.h"
-
-#define MAX_VIDEO_FRAME_SIZE (1024*1024)
+#include "package_registry.h"
+#include "async_log.h"
+#include "metrics.h"
+
+// Reassembly per stream. A frame may be as large as the raw picture; each
+// slot reserves half a byte per pixel, which holds all but unusual I-frames.
+#define VIDEO_REASM_SLOTS 3                 // Frames of one stream in flight at once
+#define VIDEO_FRAME_MIN_LEN (1024*1024)
+#define VIDEO_FRAME_MAX_LEN (32*1024*1024)
+#define VIDEO_RESERVE_MIN (256*1024)
+#define VIDEO_RESERVE_MAX (8*1024*1024)
 
 // Use unified protocol definitions
 typedef PackageHeader_t PKG_HEADER_S;
@@ -18,7 +27,11 @@ VideoStreamManager* create_video_stream_manager(const char* output_file_prefix)
     if (!mgr) return NULL;
     memset(mgr, 0, sizeof(VideoStreamManager));
     mgr->active_stream_count = 0;
-    printf("[VideoMgr] Stream manager created\n");
+    mgr->decode_mode = DECODE_MODE_AU;
+    mgr->threading.thread_count = 1;
+    mgr->threading.thread_type = DECODE_THREAD_AUTO;
+    strncpy(mgr->output_prefix, output_file_prefix ? output_file_prefix : "output_video", sizeof(mgr->output_prefix) - 1);
+    printf("[VideoMgr] Stream manager created (%s)\n", mgr->output_prefix);
     return mgr;
 }
 
@@ -29,6 +42,7 @@ VideoStream* create_video_stream(int stream_type, const char* output_file_prefix
     stream->stream_type = stream_type;
     stream->codec_type = codec_type;
     stream->running = 1; // Initialize stream as active
+    strncpy(stream->output_prefix, output_file_prefix, sizeof(stream->output_prefix) - 1);
 
     const char* extension = (codec_type == 3) ? "jpg" : "h265";
     if (codec_type == 3) {
@@ -51,7 +65,7 @@ void save_video_frame(VideoStream* stream, const unsigned char* frame_data, int
     if (!stream) return;
     if (stream->codec_type == 3) {
         char filename[256];
-        snprintf(filename, sizeof(filename), "output_video_stream%d_frame%06d.jpg", stream->stream_type, stream->frame_count);
+        snprintf(filename, sizeof(filename), "%s_stream%d_frame%06d.jpg", stream->output_prefix, stream->stream_type, stream->frame_count);
         FILE* jpg_file = fopen(filename, "wb");
         if (!jpg_file) {
             printf("[Stream%d] ERROR: Failed to create JPEG file: %s\n", stream->stream_type, filename);
@@ -63,12 +77,12 @@ void save_video_frame(VideoStream* stream, const unsigned char* frame_data, int
             printf("[Stream%d] ERROR: Failed to write JPEG frame to %s\n", stream->stream_type, filename);
             return;
         }
-        printf("[Stream%d] JPEG saved: %s (%d bytes)\n", stream->stream_type, filename, frame_size);
+        LOG_RATELIMITED(LOG_LEVEL_DEBUG, "Video", 5, "Stream%d: JPEG saved: %s (%d bytes)", stream->stream_type, filename, frame_size);
     } else {
         if (!stream->output_file) return;
         size_t written = fwrite(frame_data, 1, frame_size, stream->output_file);
         if (written != frame_size) {
-            printf("[Stream%d] ERROR: Failed to write video frame\n", stream->stream_type);
+            LOG_RATELIMITED(LOG_LEVEL_ERROR, "Video", 5, "Stream%d: Failed to write video frame", stream->stream_type);
             return;
         }
     }
@@ -80,10 +94,44 @@ void destroy_video_stream(VideoStream* stream) {
     if (stream->display) video_display_destroy(stream->display);
     if (stream->decoder) video_decoder_destroy(stream->decoder);
     if (stream->output_file) fclose(stream->output_file);
-    printf("[Stream%d] Statistics: %d frames, %.2f MB\n", stream->stream_type, stream->frame_count, (float)stream->total_bytes / (1024*1024));
+    ReasmStats rs;
+    package_reasm_get_stats(stream->reasm, &rs);
+    unsigned long long lost = package_reasm_lost(&rs);
+    printf("[Stream%d] Statistics: %d frames, %.2f MB, %llu lost (%.3f%%)\n", stream->stream_type, stream->frame_count,
+           (float)stream->total_bytes / (1024*1024), lost, rs.completed + lost ? 100.0 * lost / (rs.completed + lost) : 0.0);
+    package_reasm_destroy(stream->reasm);
     free(stream);
 }
 
+// Size a stream's reassembly for its resolution; created on its first frame
+static int video_stream_size_reasm(VideoStreamManager* mgr, VideoStream* stream, int width, int height) {
+    if (stream->reasm && width == stream->reasm_width && height == stream->reasm_height) return 0;
+    long long pixels = (long long)width * height;
+    long long max_len = pixels * 3 / 2;
+    long long reserve = pixels / 2;
+    if (max_len < VIDEO_FRAME_MIN_LEN) max_len = VIDEO_FRAME_MIN_LEN;
+    if (max_len > VIDEO_FRAME_MAX_LEN) max_len = VIDEO_FRAME_MAX_LEN;
+    if (reserve < VIDEO_RESERVE_MIN) reserve = VIDEO_RESERVE_MIN;
+    if (reserve > VIDEO_RESERVE_MAX) reserve = VIDEO_RESERVE_MAX;
+    if (!stream->reasm) {
+        char name[160];
+        snprintf(name, sizeof(name), "video %s stream%d", mgr->output_prefix, stream->stream_type);
+        // Padded, so a frame can go to the decoder in the buffer it was built in
+        stream->reasm = package_reasm_create(name, VIDEO_REASM_SLOTS, (int)max_len, 0, REASM_KEEP_OPEN | REASM_PAD);
+        if (!stream->reasm) return -1;
+    }
+    // Without the reserve, frames are still built in pool buffers
+    if (package_reasm_reserve(stream->reasm, (int)max_len, (int)reserve) < 0) {
+        printf("[Stream%d] Warning: Failed to reserve frame buffers\n", stream->stream_type);
+    }
+    stream->reasm_width = width;
+    stream->reasm_height = height;
+    printf("[Stream%d] Reassembly for %dx%d: %d frames in flight, %.2f MB reserved each, up to %.2f MB per frame\n",
+           stream->stream_type, width, height, VIDEO_REASM_SLOTS, (double)reserve / (1024 * 1024),
+           (double)max_len / (1024 * 1024));
+    return 0;
+}
+
 VideoStream* get_or_create_stream(VideoStreamManager* mgr, int stream_type, const char* output_file_prefix, int codec_type) {
     if (!mgr || stream_type < 1 || stream_type > 5) return NULL;
     // Prevent recreation of stream after stop
@@ -103,6 +151,9 @@ VideoStream* get_or_create_stream(VideoStreamManager* mgr, int stream_type, cons
 
 void destroy_video_stream_manager(VideoStreamManager* mgr) {
     if (!mgr) return;
+    if (mgr->orphan_fragments) {
+        printf("[VideoMgr] %llu fragments matched no open frame (%s)\n", mgr->orphan_fragments, mgr->output_prefix);
+    }
     for (int i = 0; i < 5; i++) {
         if (mgr->streams[i]) {
             destroy_video_stream(mgr->streams[i]);
@@ -113,17 +164,50 @@ void destroy_video_stream_manager(VideoStreamManager* mgr) {
     printf("[VideoMgr] Stream manager destroyed\n");
 }
 
+void video_manager_set_headless(VideoStreamManager* mgr, int headless) {
+    if (mgr) mgr->headless = headless;
+}
+
+void video_manager_set_decode_mode(VideoStreamManager* mgr, int mode) {
+    if (mgr) mgr->decode_mode = mode;
+}
+
+void video_manager_set_decoder_threading(VideoStreamManager* mgr, const VideoDecoderThreading* threading) {
+    if (mgr && threading) mgr->threading = *threading;
+}
+
+void video_manager_set_decode_only(VideoStreamManager* mgr, int decode_only) {
+    if (mgr) mgr->decode_only = decode_only;
+}
+
 // Video frame decode callback - to be called by video_decoder
 void on_frame_decoded(VideoFrame* frame, void* user_data) {
     VideoFrame* vf = frame;
     VideoStream* stream = (VideoStream*)user_data;
-    if (!stream || !stream->display) return;
+    if (!stream) return;
+    // With decoder delay (frame threads) the picture belongs to an earlier
+    // frame. Its own send time includes the frames it waited behind; its read
+    // time is estimated from the newest frame's, moved back by the send gap
+    long long sent_at = vf->sent_at ? vf->sent_at : stream->decode_started_at;
+    long long read_at = stream->frame_read_at - (stream->decode_started_at - sent_at);
+    metrics_add(MET_FRAMES_DECODED, 1);
+    metrics_record_since(MET_REASSEMBLED_TO_DECODED, sent_at);
+    if (!stream->display) return;
+    long long decoded_at = metrics_now_us();
     if (stream->frame_count % 30 == 0) {
-        printf("[Stream%d] Decoded frame: %dx%d, PTS: %lld\n", stream->stream_type, vf->width, vf->height, vf->pts);
+        LOG_DEBUG("Video", "Stream%d: Decoded frame: %dx%d, PTS: %lld", stream->stream_type, vf->width, vf->height, (long long)vf->pts);
     }
     int ret = video_display_render(stream->display, vf);
-    if (ret < 0 && stream->frame_count % 30 == 0) {
-        printf("[Stream%d] Failed to render frame: %d\n", stream->stream_type, ret);
+    if (ret < 0) {
+        LOG_RATELIMITED(LOG_LEVEL_WARN, "Video", 2, "Stream%d: Failed to render frame: %d", stream->stream_type, ret);
+    } else {
+        metrics_add(MET_FRAMES_RENDERED, 1);
+        metrics_record_since(MET_DECODED_TO_RENDERED, decoded_at);
+        metrics_record_since(MET_READ_TO_RENDERED, read_at);
+        if (stream->resume_lost_at) {
+            metrics_record_since(MET_RECOVERY_TO_VIDEO, stream->resume_lost_at);
+            stream->resume_lost_at = 0;
+        }
     }
     if (!video_display_poll_events(stream->display)) {
         printf("[Stream%d] Display window closed by user\n", stream->stream_type);
@@ -157,9 +241,41 @@ void video_manager_stop_stream(VideoStreamManager* mgr, int stream_type) {
         s->display = NULL;
         printf("[Stream%d] Display closed on stop\n", stream_type);
     }
+    // Keep the loss counters, give back the frame buffers
+    package_reasm_reset(s->reasm);
+    package_reasm_reserve(s->reasm, 0, 0);
     s->running = 0; // Mark stream as stopped
 }
 
+void video_manager_resume(VideoStreamManager* mgr, long long lost_at) {
+    if (!mgr) return;
+    for (int i = 0; i < 5; i++) {
+        VideoStream* s = mgr->streams[i];
+        if (s) package_reasm_reset(s->reasm);
+        if (!s || !s->running) continue;
+        s->wait_keyframe = s->codec_type != 3;  // JPEG frames stand alone
+        s->resume_lost_at = lost_at;
+        printf("[Stream%d] Session reopened, waiting for the next I-frame\n", s->stream_type);
+    }
+}
+
+int video_manager_get_loss(VideoStreamManager* mgr, int stream_type, unsigned long long* frames, unsigned long long* lost) {
+    if (!mgr || stream_type < 1 || stream_type > 5 || !mgr->streams[stream_type - 1]) return -1;
+    ReasmStats rs;
+    package_reasm_get_stats(mgr->streams[stream_type - 1]->reasm, &rs);
+    if (frames) *frames = rs.completed;
+    if (lost) *lost = package_reasm_lost(&rs);
+    return 0;
+}
+
+int video_manager_get_decoder_stats(VideoStreamManager* mgr, int stream_type, VideoDecoderStats* stats) {
+    if (!mgr || stream_type < 1 || stream_type > 5 || !mgr->streams[stream_type - 1]) return -1;
+    VideoDecoder* decoder = mgr->streams[stream_type - 1]->decoder;
+    if (!decoder) return -1;
+    video_decoder_get_stats(decoder, stats);
+    return 0;
+}
+
 const char* get_stream_type_name(int stream_type) {
     switch(stream_type) {
         case 1: return "Main Stream";
@@ -171,74 +287,92 @@ const char* get_stream_type_name(int stream_type) {
     }
 }
 
+// The decoder's reference to a frame buffer; may run on a codec thread
+static void release_frame_buf(void* opaque, uint8_t* data) {
+    (void)data;
+    package_buf_release((PackageBuf*)opaque);
+}
+
+// Save, decode and display one complete frame
+static void deliver_video_frame(VideoStream* stream, const ReasmPayload* frame, uint64_t pts) {
+    const unsigned char* data = frame->data;
+    int len = frame->len;
+    metrics_add(MET_FRAMES_REASSEMBLED, 1);
+    metrics_record_since(MET_DEQUEUED_TO_REASSEMBLED, frame->dequeued_at);
+    save_video_frame(stream, data, len);
+    if (!stream->display && stream->resume_lost_at) {
+        metrics_record_since(MET_RECOVERY_TO_VIDEO, stream->resume_lost_at);
+        stream->resume_lost_at = 0;
+    }
+    stream->frame_count++;
+    stream->total_bytes += len;
+
+    // Decode and display
+    if (stream->codec_type == 3) {
+        // JPEG: already saved
+        LOG_RATELIMITED(LOG_LEVEL_DEBUG, "Video", 5, "Stream%d: JPEG frame saved directly (size: %d bytes)", stream->stream_type, len);
+    } else {
+        // H.264/H.265: decode
+        if (stream->decoder) {
+            stream->frame_read_at = frame->read_at;
+            stream->decode_started_at = metrics_now_us();
+            // Padded reassembly buffers are handed over without a copy
+            int ret = frame->buf ? video_decoder_decode_au(stream->decoder, data, len, pts, release_frame_buf, package_buf_ref(frame->buf))
+                                 : video_decoder_decode(stream->decoder, data, len, pts);
+            if (ret < 0) {
+                LOG_RATELIMITED(LOG_LEVEL_WARN, "Video", 5, "Stream%d: Decode error %d", stream->stream_type, ret);
+            }
+        }
+    }
+}
+
 // Handle video package - parse headers, reassemble, decode and display
-int handle_video_package(VideoStreamManager* mgr, const unsigned char* package, int pkg_len) {
-    if (!mgr || !package || pkg_len < 4) {
+int handle_video_package(VideoStreamManager* mgr, const PackageView* pkg) {
+    if (!mgr || !pkg || pkg->len < PKG_MIN_LEN) {
         printf("[Video] Invalid video package\n");
         return -1;
     }
 
-    // Frame buffer for reassembly (static to persist across multiple calls for same frame)
-    typedef struct {
-        unsigned char data[MAX_VIDEO_FRAME_SIZE];
-        int pkg_id;
-        int stream_type;
-        int total_len;
-        int used_len;
-        VideoStream* stream;
-        TAG_PKG_VIDEO_HEADER_S video_header;
-        int valid;
-    } FrameBuffer;
-    static FrameBuffer frame_buf = {0};
-
     // Package structure:
     // offset 0-3: prefix ("$div" for video)
     // offset 4+: TAG_PKG_HEADER_S
-    // offset 4+28: video data or TAG_PKG_VIDEO_HEADER_S (if u8PkgSubHead==1)
-    
-    int offset = 4;  // Skip prefix
+    // offset 4+24: video data or TAG_PKG_VIDEO_HEADER_S (if u8PkgSubHead==1)
     
-    // Validate header size
-    if (pkg_len < offset + sizeof(PKG_HEADER_S)) {
-        printf("[Video] Package header incomplete (pkg_len=%d, need=%d)\n", pkg_len, (int)(offset + sizeof(PKG_HEADER_S)));
-        return -1;
-    }
-
-    PKG_HEADER_S* header = (PKG_HEADER_S*)(package + offset);
-    offset += sizeof(PKG_HEADER_S);
+    const PKG_HEADER_S* header = &pkg->header;
+    int offset = PKG_HEADER_TOTAL_LEN;
 
     VideoStream* stream = NULL;
     int stream_type = -1;
 
     if (header->u8PkgSubHead == 1) {
         // New frame start with video header
-        if (pkg_len < offset + sizeof(TAG_PKG_VIDEO_HEADER_S)) {
+        TAG_PKG_VIDEO_HEADER_S vh;
+        if (package_view_read(pkg, offset, &vh, sizeof(vh)) < 0) {
             printf("[Video] Package incomplete for video header\n");
             return -1;
         }
-
-        TAG_PKG_VIDEO_HEADER_S* video_header = (TAG_PKG_VIDEO_HEADER_S*)(package + offset);
+        const TAG_PKG_VIDEO_HEADER_S* video_header = &vh;
         offset += sizeof(TAG_PKG_VIDEO_HEADER_S);
         stream_type = video_header->s8StreamType;
 
-        // Log frame info (every 10th frame to reduce spam)
-        static int log_counter = 0;
-        if (log_counter++ % 10 == 0) {
-            printf("[Video] Stream:%d(%s), Encode:%d, Frame:%d, Res:%dx%d, FPS:%d, Length:%d\n",
-                stream_type, get_stream_type_name(stream_type),
-                video_header->s8EncodeType, video_header->s8FrameType,
-                video_header->u16VideoWidth, video_header->u16VideoHeight,
-                video_header->u8FrameRate, video_header->s32FrameLen);
-        }
+        LOG_RATELIMITED(LOG_LEVEL_DEBUG, "Video", 5, "Stream:%d(%s), Encode:%d, Frame:%d, Res:%dx%d, FPS:%d, Length:%d",
+            stream_type, get_stream_type_name(stream_type),
+            video_header->s8EncodeType, video_header->s8FrameType,
+            video_header->u16VideoWidth, video_header->u16VideoHeight,
+            video_header->u8FrameRate, video_header->s32FrameLen);
 
         // Get or create stream
-        stream = get_or_create_stream(mgr, stream_type, "output_video", video_header->s8EncodeType);
+        stream = get_or_create_stream(mgr, stream_type, mgr->output_prefix, video_header->s8EncodeType);
         if (!stream) {
             printf("[Video] Failed to get stream for type %d\n", stream_type);
             return -1;
         }
 
         memcpy(&stream->last_header, video_header, sizeof(TAG_PKG_VIDEO_HEADER_S));
+        if (video_stream_size_reasm(mgr, stream, video_header->u16VideoWidth, video_header->u16VideoHeight) < 0) {
+            printf("[Stream%d] ERROR: Failed to create frame reassembly\n", stream_type);
+            return -1;
+        }
 
         // Initialize decoder/display on first frame of stream
         if (!stream->decoder && video_header->s8EncodeType > 0) {
@@ -249,6 +383,10 @@ int handle_video_package(VideoStreamManager* mgr, const unsigned char* package,
             // JPEG: save directly without decoder
             if (video_header->s8EncodeType == 3) {
                 printf("[Stream%d] JPEG detected, will save directly without decoding\n", stream_type);
+            } else if (mgr->headless) {
+                if (stream->frame_count == 0) {
+                    printf("[Stream%d] Headless manager (%s): recording without decoding\n", stream_type, mgr->output_prefix);
+                }
             } else {
                 // H.264/H.265: create decoder and display
                 int display_width, display_height;
@@ -266,10 +404,12 @@ int handle_video_package(VideoStreamManager* mgr, const unsigned char* package,
                 snprintf(window_title, sizeof(window_title), "P2P %s - %dx%d",
                     get_stream_type_name(stream_type), display_width, display_height);
 
-                printf("[Stream%d] Creating display window (%dx%d)...\n", stream_type, display_width, display_height);
-                stream->display = video_display_create(window_title, display_width, display_height);
-                if (!stream->display) {
-                    printf("[Stream%d] Warning: Failed to create display window\n", stream_type);
+                if (!mgr->decode_only) {
+                    printf("[Stream%d] Creating display window (%dx%d)...\n", stream_type, display_width, display_height);
+                    stream->display = video_display_create(window_title, display_width, display_height);
+                    if (!stream->display) {
+                        printf("[Stream%d] Warning: Failed to create display window\n", stream_type);
+                    }
                 }
 
                 printf("[Stream%d] Creating decoder (type: %d)...\n", stream_type, stream->codec_type);
@@ -277,6 +417,12 @@ int handle_video_package(VideoStreamManager* mgr, const unsigned char* package,
                 if (!stream->decoder) {
                     printf("[Stream%d] Warning: Failed to create decoder\n", stream_type);
                 } else {
+                    video_decoder_set_mode(stream->decoder, mgr->decode_mode);
+                    if (mgr->threading.thread_count != 1 || mgr->threading.low_delay) {
+                        if (video_decoder_set_threading(stream->decoder, &mgr->threading) < 0) {
+                            printf("[Stream%d] Warning: Failed to set decoder threading, decoding on one thread\n", stream_type);
+                        }
+                    }
                     // Set scaling if needed
                     if (display_width != stream->video_width || display_height != stream->video_height) {
                         printf("[Stream%d] Setting decoder scale: %dx%d -> %dx%d\n", stream_type,
@@ -290,95 +436,61 @@ int handle_video_package(VideoStreamManager* mgr, const unsigned char* package,
             }
         }
 
-        // Initialize frame reassembly buffer
-        frame_buf.pkg_id = header->u16PkgId;
-        frame_buf.stream_type = stream_type;
-        frame_buf.total_len = 0;
-        frame_buf.used_len = 0;
-        frame_buf.stream = stream;
-        memcpy(&frame_buf.video_header, video_header, sizeof(TAG_PKG_VIDEO_HEADER_S));
-        frame_buf.valid = 1;
-
-        // Add this frame data to buffer
-        int video_data_len = pkg_len - offset - sizeof(PKG_TAIL_S);
-        if (video_data_len > 0 && frame_buf.used_len + video_data_len <= MAX_VIDEO_FRAME_SIZE) {
-            memcpy(frame_buf.data + frame_buf.used_len, package + offset, video_data_len);
-            frame_buf.used_len += video_data_len;
-        }
-
-        // Check if this is the last fragment (u16PkgIndex == 0 means last)
-        if (header->u16PkgIndex == 0) {
-            if (frame_buf.valid && frame_buf.used_len > 0) {
-                // Save frame to file
-                save_video_frame(frame_buf.stream, frame_buf.data, frame_buf.used_len);
-                frame_buf.stream->frame_count++;
-                frame_buf.stream->total_bytes += frame_buf.used_len;
-                uint64_t pts = frame_buf.video_header.u64Pts;
-
-                // Decode and display
-                if (frame_buf.stream->codec_type == 3) {
-                    // JPEG: already saved
-                    printf("[Stream%d] JPEG frame saved directly (size: %d bytes)\n",
-                        frame_buf.stream->stream_type, frame_buf.used_len);
-                } else {
-                    // H.264/H.265: decode
-                    if (frame_buf.stream->decoder) {
-                        int ret = video_decoder_decode(frame_buf.stream->decoder, frame_buf.data, frame_buf.used_len, pts);
-                        if (ret < 0) {
-                            printf("[Stream%d] Warning: Decode error %d\n", frame_buf.stream->stream_type, ret);
-                        }
-                    }
-                }
+        // After a reconnect the decoder needs a keyframe; skip everything before it
+        int skip = 0;
+        if (stream->wait_keyframe) {
+            if (video_header->s8FrameType != 1) {
+                skip = 1;
+            } else {
+                stream->wait_keyframe = 0;
+                printf("[Stream%d] Resumed at I-frame after reconnect\n", stream_type);
             }
-            frame_buf.valid = 0;
         }
 
-        return video_data_len;
+        // Each stream reassembles on its own, several frames at once if the
+        // device interleaves them. A whole frame in one package is still
+        // copied once: the decoder needs zeroed padding after the data
+        // (REASM_PAD), which the ring cannot give it.
+        int video_data_len = pkg->len - offset - sizeof(PKG_TAIL_S);
+        ReasmPayload frame;
+        int ret = package_reasm_begin(stream->reasm, PKG_TYPE_VIDEO, stream_type, pkg, offset, video_data_len,
+                                      video_header->s32FrameLen, video_header, sizeof(*video_header), stream, skip, &frame);
+        if (ret == REASM_COMPLETE) {
+            deliver_video_frame(stream, &frame, video_header->u64Pts);
+            package_reasm_payload_release(&frame);
+        }
+        if (skip) return 0;
+        return ret < 0 ? -1 : video_data_len;
     } else {
-        // Fragment packet - must match existing frame buffer
-        if (!frame_buf.valid || header->u16PkgId != frame_buf.pkg_id) {
-            static int skip_count = 0;
-            if (skip_count++ % 30 == 0) {
-                printf("[Video] No matching frame buffer for fragment (PkgId=%d, skipped %d)\n",
-                    header->u16PkgId, skip_count);
-            }
+        // Fragment packet - carries no stream type, so find the stream with
+        // its u16PkgId open (ids are unique across a device's streams)
+        int video_data_len = pkg->len - offset - sizeof(PKG_TAIL_S);
+        for (int i = 0; i < 5 && !stream; i++) {
+            VideoStream* s = mgr->streams[i];
+            if (s && package_reasm_has(s->reasm, PKG_TYPE_VIDEO, header->u16PkgId)) stream = s;
+        }
+        if (!stream) {
+            mgr->orphan_fragments++;
+            LOG_RATELIMITED(LOG_LEVEL_WARN, "Video", 2, "No stream has frame %d open for fragment %d",
+                            header->u16PkgId, header->u16PkgIndex);
             return -1;
         }
-
-        // Add fragment data to buffer
-        int video_data_len = pkg_len - offset - sizeof(PKG_TAIL_S);
-        if (video_data_len > 0 && frame_buf.used_len + video_data_len <= MAX_VIDEO_FRAME_SIZE) {
-            memcpy(frame_buf.data + frame_buf.used_len, package + offset, video_data_len);
-            frame_buf.used_len += video_data_len;
+        ReasmPayload frame;
+        int ret = package_reasm_add(stream->reasm, PKG_TYPE_VIDEO, pkg, offset, video_data_len, &frame);
+        if (ret == REASM_COMPLETE) {
+            const TAG_PKG_VIDEO_HEADER_S* video_header = (const TAG_PKG_VIDEO_HEADER_S*)frame.meta;
+            deliver_video_frame((VideoStream*)frame.user, &frame, video_header->u64Pts);
+            package_reasm_payload_release(&frame);
         }
+        return ret < 0 ? -1 : video_data_len;
+    }
+}
 
-        // Check if this is the last fragment
-        if (header->u16PkgIndex == 0) {
-            if (frame_buf.valid && frame_buf.used_len > 0) {
-                // Save frame to file
-                save_video_frame(frame_buf.stream, frame_buf.data, frame_buf.used_len);
-                frame_buf.stream->frame_count++;
-                frame_buf.stream->total_bytes += frame_buf.used_len;
-                uint64_t pts = frame_buf.video_header.u64Pts;
-
-                // Decode and display
-                if (frame_buf.stream->codec_type == 3) {
-                    // JPEG: already saved
-                    printf("[Stream%d] JPEG frame saved directly (size: %d bytes)\n",
-                        frame_buf.stream->stream_type, frame_buf.used_len);
-                } else {
-                    // H.264/H.265: decode
-                    if (frame_buf.stream->decoder) {
-                        int ret = video_decoder_decode(frame_buf.stream->decoder, frame_buf.data, frame_buf.used_len, pts);
-                        if (ret < 0) {
-                            printf("[Stream%d] Warning: Decode error %d\n", frame_buf.stream->stream_type, ret);
-                        }
-                    }
-                }
-            }
-            frame_buf.valid = 0;
-        }
+static int video_package_handler(const PackageView* pkg, const PackageContext* ctx) {
+    return handle_video_package((VideoStreamManager*)ctx->video_mgr, pkg);
+}
 
-        return video_data_len;
-    }
+void video_manager_register_packages(void) {
+    package_registry_register(PKG_VIDEO_MAGIC, PKG_TYPE_VIDEO, "video", sizeof(TAG_PKG_VIDEO_HEADER_S),
+                              video_package_handler);
 }
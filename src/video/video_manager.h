@@ -4,6 +4,8 @@
 #include "video_decoder.h"
 #include "video_display.h"
 #include "protocol_defs.h"
+#include "stream_framer.h"
+#include "package_reasm.h"
 #include <stdio.h>
 #include <stdint.h>
 
@@ -19,21 +21,58 @@ typedef struct {
     int video_height;
     TAG_PKG_VIDEO_HEADER_S last_header;    // Last video header for reassembly
     int running; // Indicates if the stream is active
+    char output_prefix[128];
+    // Frame being decoded, for the stage timings taken in on_frame_decoded
+    long long frame_read_at;
+    long long decode_started_at;
+    // Reconnect: frames are skipped until the next I-frame
+    int wait_keyframe;
+    long long resume_lost_at;   // Session loss time, until the first frame is shown again
+    // Frames being reassembled, with buffers sized for this resolution
+    PackageReasm* reasm;
+    int reasm_width;
+    int reasm_height;
 } VideoStream;
 
+// One manager per device session
 typedef struct {
     VideoStream* streams[5];
     int active_stream_count;
+    unsigned long long orphan_fragments;    // Fragments of a frame no stream had open
+    char output_prefix[128];
+    int headless;       // Record only: no decoder or display window
+    int decode_mode;    // DECODE_MODE_* for decoders created from now on
+    VideoDecoderThreading threading;    // Likewise
+    int decode_only;    // Decode without display windows (benchmarks)
 } VideoStreamManager;
 
 VideoStreamManager* create_video_stream_manager(const char* output_file_prefix);
 void destroy_video_stream_manager(VideoStreamManager* mgr);
-int handle_video_package(VideoStreamManager* mgr, const unsigned char* package, int pkg_len);
+// Record streams to file without decoding or opening windows (for fleet devices)
+void video_manager_set_headless(VideoStreamManager* mgr, int headless);
+// DECODE_MODE_* for the streams' decoders (default DECODE_MODE_AU)
+void video_manager_set_decode_mode(VideoStreamManager* mgr, int mode);
+// Threading of the streams' decoders (default one thread, as FFmpeg opens them)
+void video_manager_set_decoder_threading(VideoStreamManager* mgr, const VideoDecoderThreading* threading);
+void video_manager_set_decode_only(VideoStreamManager* mgr, int decode_only);
+int handle_video_package(VideoStreamManager* mgr, const PackageView* pkg);
+// Register "$div" with the package registry; call before sessions start
+void video_manager_register_packages(void);
 void on_frame_decoded(VideoFrame* frame, void* user_data);
 
 // Stop a specific stream: destroy its decoder and close its display (keeps stream object)
 void video_manager_stop_stream(VideoStreamManager* mgr, int stream_type);
 
+// The session was reopened: drop unfinished frames and hold each running
+// stream at its next I-frame, keeping its decoder and window. lost_at is the
+// metrics_now_us() time of the loss, for the recovery-to-video metric.
+void video_manager_resume(VideoStreamManager* mgr, long long lost_at);
+
+// Frames reassembled and lost on a stream so far; -1 if it has none
+int video_manager_get_loss(VideoStreamManager* mgr, int stream_type, unsigned long long* frames, unsigned long long* lost);
+// Statistics of a stream's decoder; -1 if it has none
+int video_manager_get_decoder_stats(VideoStreamManager* mgr, int stream_type, VideoDecoderStats* stats);
+
 // Poll display events for all managed streams; returns 0 if any display closed
 int video_manager_poll_events(VideoStreamManager* mgr);
 
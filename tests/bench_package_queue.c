@@ -0,0 +1,163 @@
+// Package Queue Benchmark
+//
+// Handover throughput between the reader and the main loop: the SPSC view
+// queue against the locked list it replaced, where every package cost a
+// node malloc, a critical section on each side and a free. Both run with a
+// producer and a consumer thread and no events, so only the queues differ.
+//
+//   make bench    (Linux)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "platform.h"
+#include "package_queue.h"
+#include "metrics.h"
+
+#define BENCH_VIEWS 10000000ULL
+#define BENCH_QUEUE_CAPACITY 4096           // As the reader creates it
+#define BENCH_BATCH 64                      // As the main loop pops
+
+// The queue before the SPSC ring
+typedef struct LegacyNode {
+    PackageView view;
+    struct LegacyNode* next;
+} LegacyNode;
+
+typedef struct {
+    CRITICAL_SECTION cs;
+    LegacyNode* head;
+    LegacyNode* tail;
+} LegacyQueue;
+
+typedef struct {
+    PackageQueue* queue;
+    LegacyQueue* legacy;
+    unsigned long long count;
+    unsigned long long checksum;
+} BenchRun;
+
+static void legacy_push(LegacyQueue* q, const PackageView* view) {
+    LegacyNode* node = (LegacyNode*)malloc(sizeof(LegacyNode));
+    if (!node) return;
+    node->view = *view;
+    node->next = NULL;
+    EnterCriticalSection(&q->cs);
+    if (q->tail) {
+        q->tail->next = node;
+        q->tail = node;
+    } else {
+        q->head = q->tail = node;
+    }
+    LeaveCriticalSection(&q->cs);
+}
+
+static int legacy_pop(LegacyQueue* q, PackageView* view) {
+    EnterCriticalSection(&q->cs);
+    LegacyNode* node = q->head;
+    if (node) {
+        q->head = node->next;
+        if (!q->head) q->tail = NULL;
+    }
+    LeaveCriticalSection(&q->cs);
+    if (!node) return 0;
+    *view = node->view;
+    free(node);
+    return 1;
+}
+
+static DWORD WINAPI legacy_producer(LPVOID param) {
+    BenchRun* run = (BenchRun*)param;
+    PackageView view;
+    memset(&view, 0, sizeof(view));
+    for (unsigned long long seq = 1; seq <= run->count; seq++) {
+        view.read_at = (long long)seq;
+        legacy_push(run->legacy, &view);
+    }
+    return 0;
+}
+
+static DWORD WINAPI legacy_consumer(LPVOID param) {
+    BenchRun* run = (BenchRun*)param;
+    PackageView view;
+    unsigned long long got = 0;
+    while (got < run->count) {
+        if (!legacy_pop(run->legacy, &view)) {
+            Sleep(0);
+            continue;
+        }
+        run->checksum += (unsigned long long)view.read_at;
+        got++;
+    }
+    return 0;
+}
+
+static DWORD WINAPI spsc_producer(LPVOID param) {
+    BenchRun* run = (BenchRun*)param;
+    PackageView view;
+    memset(&view, 0, sizeof(view));
+    for (unsigned long long seq = 1; seq <= run->count; seq++) {
+        view.read_at = (long long)seq;
+        while (package_queue_push(run->queue, &view) != 0) Sleep(0);
+    }
+    return 0;
+}
+
+static DWORD WINAPI spsc_consumer(LPVOID param) {
+    BenchRun* run = (BenchRun*)param;
+    PackageView views[BENCH_BATCH];
+    unsigned long long got = 0;
+    while (got < run->count) {
+        int n = package_queue_pop_batch(run->queue, views, BENCH_BATCH);
+        if (n == 0) {
+            Sleep(0);
+            continue;
+        }
+        for (int i = 0; i < n; i++) run->checksum += (unsigned long long)views[i].read_at;
+        got += (unsigned long long)n;
+    }
+    return 0;
+}
+
+static double run_pair(BenchRun* run, LPTHREAD_START_ROUTINE producer, LPTHREAD_START_ROUTINE consumer) {
+    long long started = metrics_now_us();
+    HANDLE c = CreateThread(NULL, 0, consumer, run, 0, NULL);
+    HANDLE p = CreateThread(NULL, 0, producer, run, 0, NULL);
+    WaitForSingleObject(p, INFINITE);
+    WaitForSingleObject(c, INFINITE);
+    CloseHandle(p);
+    CloseHandle(c);
+    return (metrics_now_us() - started) / 1000000.0;
+}
+
+int main(void) {
+    unsigned long long expected = BENCH_VIEWS * (BENCH_VIEWS + 1) / 2;
+    metrics_now_us();
+
+    LegacyQueue legacy;
+    memset(&legacy, 0, sizeof(legacy));
+    InitializeCriticalSection(&legacy.cs);
+    BenchRun run;
+    memset(&run, 0, sizeof(run));
+    run.legacy = &legacy;
+    run.count = BENCH_VIEWS;
+    double legacy_s = run_pair(&run, legacy_producer, legacy_consumer);
+    DeleteCriticalSection(&legacy.cs);
+    int ok = run.checksum == expected;
+
+    memset(&run, 0, sizeof(run));
+    run.queue = package_queue_create(BENCH_QUEUE_CAPACITY);
+    run.count = BENCH_VIEWS;
+    if (!run.queue) return 1;
+    double spsc_s = run_pair(&run, spsc_producer, spsc_consumer);
+    ok = ok && run.checksum == expected;
+    PackageQueueStats st;
+    package_queue_get_stats(run.queue, &st);
+    package_queue_destroy(run.queue);
+
+    printf("[Bench] Package handover, %llu views, producer and consumer threads\n", BENCH_VIEWS);
+    printf("[Bench] %-28s %8.0f ms %12.0f views/s\n", "locked list (malloc/node)", legacy_s * 1000, BENCH_VIEWS / legacy_s);
+    printf("[Bench] %-28s %8.0f ms %12.0f views/s  %.2fx, %.1f views per batch, %llu full waits\n", "SPSC queue (batch 64)",
+           spsc_s * 1000, BENCH_VIEWS / spsc_s, legacy_s / spsc_s, st.batches ? (double)st.popped / st.batches : 0.0, st.full);
+    if (!ok) printf("[Bench] ERROR: views lost or duplicated\n");
+    return ok ? 0 : 1;
+}
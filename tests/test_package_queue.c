@@ -0,0 +1,140 @@
+// Package Queue Stress Test
+//
+// One producer and one consumer thread move views through small queues,
+// so the ring wraps and fills constantly. Every view carries a sequence
+// number; the consumer pops batches of varying size and checks that the
+// numbers arrive complete and in order.
+//
+//   make test     (Linux)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "platform.h"
+#include "package_queue.h"
+
+#define STRESS_VIEWS 5000000ULL
+
+typedef struct {
+    PackageQueue* queue;
+    unsigned long long count;
+    unsigned long long full_waits;
+    unsigned long long errors;
+    unsigned long long batches;
+    int max_batch;
+} StressRun;
+
+static int g_failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { printf("[Test] FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); g_failures++; } \
+} while (0)
+
+static DWORD WINAPI producer_thread(LPVOID param) {
+    StressRun* run = (StressRun*)param;
+    PackageView view;
+    memset(&view, 0, sizeof(view));
+    for (unsigned long long seq = 1; seq <= run->count; seq++) {
+        view.read_at = (long long)seq;
+        view.len = (int)(seq & 0xFFFF);
+        view.type = (int)(seq % 5);
+        while (package_queue_push(run->queue, &view) != 0) {
+            run->full_waits++;
+            Sleep(0);
+        }
+    }
+    return 0;
+}
+
+static DWORD WINAPI consumer_thread(LPVOID param) {
+    StressRun* run = (StressRun*)param;
+    PackageView views[64];
+    unsigned long long expected = 1;
+    unsigned int rng = 12345;
+    while (expected <= run->count) {
+        rng = rng * 1103515245 + 12345;
+        int max = 1 + (int)((rng >> 16) % 64);
+        int n = package_queue_pop_batch(run->queue, views, max);
+        if (n == 0) {
+            Sleep(0);
+            continue;
+        }
+        if (n > max) run->errors++;
+        if (n > run->max_batch) run->max_batch = n;
+        run->batches++;
+        for (int i = 0; i < n; i++, expected++) {
+            const PackageView* v = &views[i];
+            if (v->read_at != (long long)expected || v->len != (int)(expected & 0xFFFF) || v->type != (int)(expected % 5)) {
+                if (run->errors++ < 5) {
+                    printf("[Test] View %lld (len %d) popped where %llu was expected\n", v->read_at, v->len, expected);
+                }
+                expected = (unsigned long long)v->read_at;
+            }
+        }
+    }
+    return 0;
+}
+
+static void stress(int capacity) {
+    StressRun run;
+    memset(&run, 0, sizeof(run));
+    run.queue = package_queue_create(capacity);
+    run.count = STRESS_VIEWS;
+    CHECK(run.queue != NULL, "queue of %d not created", capacity);
+    if (!run.queue) return;
+
+    HANDLE consumer = CreateThread(NULL, 0, consumer_thread, &run, 0, NULL);
+    HANDLE producer = CreateThread(NULL, 0, producer_thread, &run, 0, NULL);
+    WaitForSingleObject(producer, INFINITE);
+    WaitForSingleObject(consumer, INFINITE);
+    CloseHandle(producer);
+    CloseHandle(consumer);
+
+    PackageQueueStats st;
+    package_queue_get_stats(run.queue, &st);
+    CHECK(run.errors == 0, "capacity %d: %llu ordering errors", capacity, run.errors);
+    CHECK(st.pushed == run.count && st.popped == run.count, "capacity %d: pushed %llu, popped %llu of %llu",
+          capacity, st.pushed, st.popped, run.count);
+    CHECK(st.batches == run.batches, "capacity %d: %llu batches counted, %llu seen", capacity, st.batches, run.batches);
+    CHECK(st.max_depth <= capacity, "capacity %d: depth reached %d", capacity, st.max_depth);
+    CHECK(package_queue_count(run.queue) == 0, "capacity %d: %d views left", capacity, package_queue_count(run.queue));
+    printf("[Test] Capacity %-5d %llu views in %llu batches (largest %d), %llu full waits, max depth %d\n",
+           capacity, run.count, run.batches, run.max_batch, run.full_waits, st.max_depth);
+    package_queue_destroy(run.queue);
+}
+
+// Single-threaded edges: rounding, full, empty, batch limits and wrap
+static void edges(void) {
+    PackageQueue* q = package_queue_create(5);
+    CHECK(q && q->capacity == 8, "capacity 5 not rounded to 8");
+    if (!q) return;
+    PackageView view, out[16];
+    memset(&view, 0, sizeof(view));
+    CHECK(package_queue_pop_batch(q, out, 16) == 0, "empty queue popped");
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 8; i++) {
+            view.read_at = round * 100 + i;
+            CHECK(package_queue_push(q, &view) == 0, "push %d of 8 failed", i);
+        }
+        CHECK(package_queue_push(q, &view) == -1, "push into a full queue succeeded");
+        CHECK(package_queue_pop_batch(q, out, 3) == 3 && out[0].read_at == round * 100, "batch of 3");
+        CHECK(package_queue_pop_batch(q, out, 16) == 5 && out[4].read_at == round * 100 + 7, "rest of the queue");
+    }
+    PackageQueueStats st;
+    package_queue_get_stats(q, &st);
+    CHECK(st.full == 3 && st.pushed == 24 && st.popped == 24, "stats: %llu full, %llu pushed, %llu popped",
+          st.full, st.pushed, st.popped);
+    package_queue_destroy(q);
+}
+
+int main(void) {
+    edges();
+    stress(2);
+    stress(64);
+    stress(4096);
+    if (g_failures) {
+        printf("[Test] package_queue: %d failures\n", g_failures);
+        return 1;
+    }
+    printf("[Test] package_queue: passed\n");
+    return 0;
+}
@@ -0,0 +1,322 @@
+// Package Reassembly Test
+//
+// Payloads are cut into fragments, run through a framer one package at a
+// time as the reader hands them over, and fed to package_reasm. Several
+// streams interleave fragment by fragment, counting their indexes down and
+// up; they must come out whole and byte for byte. Then each way a payload
+// is lost is provoked on its own: an index skipped in either direction, a
+// payload shorter than its sub-header announced, a stream that goes quiet
+// past the timeout, and more payloads open than the instance has slots.
+// The time of each fragment is set on its view, so timeouts need no sleep.
+//
+//   make test     (Linux)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "platform.h"
+#include "stream_framer.h"
+#include "package_registry.h"
+#include "package_reasm.h"
+
+#define TEST_RING (64*1024)
+#define TEST_STREAMS 4
+#define TEST_FRAGMENT 700
+#define TEST_PAYLOAD_MAX 8192
+#define TEST_TIMEOUT_MS 100
+
+static StreamFramer* g_framer = NULL;
+static long long g_now = 1000000;           // Dequeue time of the next fragment, us
+static int g_failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { printf("[Test] FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); g_failures++; } \
+} while (0)
+
+// What a step delivered, copied out before its view and payload are released
+typedef struct {
+    int stream;
+    int pkg_id;
+    int fragments;
+    int len;
+    int terminated;
+    unsigned char meta[PACKAGE_REASM_META_MAX];
+    unsigned char data[TEST_PAYLOAD_MAX];
+} Delivered;
+
+// One fragment through the framer and into r: package_reasm_begin with
+// begin set (expected is the announced length, also kept as the meta),
+// else package_reasm_add. Returns the reassembly result, or -100 if the
+// package could not be framed.
+static int step(PackageReasm* r, int begin, int stream, int pkg_id, int index, const unsigned char* data, int len,
+                int expected, Delivered* out) {
+    unsigned char package[PKG_MIN_LEN + TEST_PAYLOAD_MAX];
+    PackageHeader_t header;
+    memset(&header, 0, sizeof(header));
+    header.u16PkgId = (uint16_t)pkg_id;
+    header.u16PkgIndex = (uint16_t)index;
+    int built = package_build(PKG_VIDEO_PREFIX_STR, &header, NULL, 0, data, len, package, sizeof(package));
+    PackageView view;
+    if (built < 0 || stream_framer_push(g_framer, package, built) != 0 || !stream_framer_next(g_framer, &view)) return -100;
+    view.dequeued_at = g_now++;
+
+    ReasmPayload payload;
+    int ret;
+    if (begin) {
+        ret = package_reasm_begin(r, PKG_TYPE_VIDEO, stream, &view, PKG_HEADER_TOTAL_LEN, len, expected, &expected,
+                                  sizeof(expected), NULL, 0, &payload);
+    } else {
+        ret = package_reasm_add(r, PKG_TYPE_VIDEO, &view, PKG_HEADER_TOTAL_LEN, len, &payload);
+    }
+    if (ret == REASM_COMPLETE) {
+        memset(out, 0, sizeof(*out));
+        out->stream = payload.stream;
+        out->pkg_id = payload.pkg_id;
+        out->fragments = payload.fragments;
+        out->len = payload.len;
+        out->terminated = payload.buf && payload.buf->capacity > payload.len && payload.data[payload.len] == 0;
+        memcpy(out->meta, payload.meta, sizeof(out->meta));
+        if (payload.len <= TEST_PAYLOAD_MAX) memcpy(out->data, payload.data, payload.len);
+        package_reasm_payload_release(&payload);
+    }
+    package_view_release(&view);
+    return ret;
+}
+
+// Index of fragment i of n: counting down to 0, or up from 1 and ending with 0
+static int fragment_index(int n, int i, int ascending) {
+    if (ascending) return i == n - 1 ? 0 : i + 1;
+    return n - 1 - i;
+}
+
+static void fill(unsigned char* data, int len, int seed) {
+    for (int i = 0; i < len; i++) data[i] = (unsigned char)(i * 7 + seed * 31);
+}
+
+static void interleaved(void) {
+    static unsigned char payload[TEST_STREAMS][TEST_PAYLOAD_MAX];
+    int len[TEST_STREAMS], fragments[TEST_STREAMS], sent[TEST_STREAMS];
+    PackageReasm* r = package_reasm_create("interleaved", TEST_STREAMS, TEST_PAYLOAD_MAX, 0, 0);
+    CHECK(r != NULL, "instance not created");
+    if (!r) return;
+    for (int s = 0; s < TEST_STREAMS; s++) {
+        len[s] = 1500 + 1234 * s;
+        fragments[s] = (len[s] + TEST_FRAGMENT - 1) / TEST_FRAGMENT;
+        sent[s] = 0;
+        fill(payload[s], len[s], s);
+    }
+
+    // One fragment of every unfinished stream per round; odd streams count up
+    Delivered d;
+    int completed = 0;
+    while (completed < TEST_STREAMS) {
+        for (int s = 0; s < TEST_STREAMS; s++) {
+            if (sent[s] == fragments[s]) continue;
+            int i = sent[s]++;
+            int offset = i * TEST_FRAGMENT;
+            int n = len[s] - offset < TEST_FRAGMENT ? len[s] - offset : TEST_FRAGMENT;
+            int ret = step(r, i == 0, s, 100 + s, fragment_index(fragments[s], i, s & 1), payload[s] + offset, n, len[s], &d);
+            if (sent[s] < fragments[s]) {
+                CHECK(ret == REASM_PENDING, "stream %d: fragment %d of %d gave %d", s, i, fragments[s], ret);
+                continue;
+            }
+            completed++;
+            CHECK(ret == REASM_COMPLETE, "stream %d: last fragment gave %d", s, ret);
+            if (ret != REASM_COMPLETE) continue;
+            CHECK(d.stream == s && d.pkg_id == 100 + s && d.fragments == fragments[s],
+                  "stream %d: delivered as stream %d, id %d, %d fragments", s, d.stream, d.pkg_id, d.fragments);
+            CHECK(d.len == len[s] && memcmp(d.data, payload[s], len[s]) == 0, "stream %d: %d of %d bytes, or corrupted",
+                  s, d.len, len[s]);
+            CHECK(memcmp(d.meta, &len[s], sizeof(len[s])) == 0, "stream %d: sub-header not kept", s);
+        }
+    }
+    CHECK(package_reasm_open_count(r) == 0, "%d payloads left open", package_reasm_open_count(r));
+
+    // A stream beginning again abandons its unfinished payload
+    CHECK(step(r, 1, 0, 200, 2, payload[0], 500, 1500, &d) == REASM_PENDING, "first payload not opened");
+    CHECK(step(r, 1, 1, 300, 2, payload[1], 500, 1500, &d) == REASM_PENDING, "other stream not opened");
+    CHECK(step(r, 1, 0, 201, 2, payload[0], 500, 1500, &d) == REASM_PENDING, "second payload not opened");
+    CHECK(step(r, 0, 0, 200, 1, payload[0], 500, 0, &d) == REASM_DROPPED, "fragment of the abandoned payload taken");
+    CHECK(package_reasm_has(r, PKG_TYPE_VIDEO, 300), "another stream's payload was abandoned");
+
+    ReasmStats st;
+    package_reasm_get_stats(r, &st);
+    CHECK(st.completed == TEST_STREAMS && st.superseded == 1 && st.orphans == 1 && package_reasm_lost(&st) == 1,
+          "stats: %llu completed, %llu superseded, %llu orphans, %llu lost", st.completed, st.superseded, st.orphans,
+          package_reasm_lost(&st));
+    printf("[Test] interleaved: %d streams, %llu fragments, max %d open\n", TEST_STREAMS, st.fragments, st.max_open);
+    package_reasm_destroy(r);
+}
+
+// Responses with no sub-header: any fragment opens a payload, which is NUL-terminated
+static void open_any(void) {
+    static const char* text[2] = { "{\"seq\":1,\"code\":200,\"data\":{\"name\":\"first\"}}",
+                                   "{\"seq\":2,\"code\":200,\"data\":{\"name\":\"second, in one package\"}}" };
+    PackageReasm* r = package_reasm_create("open any", 2, TEST_PAYLOAD_MAX, 0, REASM_OPEN_ANY | REASM_TERMINATE);
+    CHECK(r != NULL, "instance not created");
+    if (!r) return;
+    Delivered d;
+    int len0 = (int)strlen(text[0]);
+    const unsigned char* t0 = (const unsigned char*)text[0];
+    CHECK(step(r, 0, 0, 1, 2, t0, 10, 0, &d) == REASM_PENDING, "first fragment not taken");
+    CHECK(step(r, 0, 0, 1, 1, t0 + 10, 10, 0, &d) == REASM_PENDING, "second fragment not taken");
+    int ret = step(r, 0, 0, 2, 0, (const unsigned char*)text[1], (int)strlen(text[1]), 0, &d);
+    CHECK(ret == REASM_COMPLETE && d.len == (int)strlen(text[1]) && d.terminated && memcmp(d.data, text[1], d.len) == 0,
+          "single-package response: %d, %d bytes, terminated %d", ret, d.len, d.terminated);
+    ret = step(r, 0, 0, 1, 0, t0 + 20, len0 - 20, 0, &d);
+    CHECK(ret == REASM_COMPLETE && d.len == len0 && d.terminated && memcmp(d.data, text[0], len0) == 0,
+          "split response: %d, %d bytes, terminated %d", ret, d.len, d.terminated);
+    CHECK(package_reasm_open_count(r) == 0, "%d payloads left open", package_reasm_open_count(r));
+    package_reasm_destroy(r);
+}
+
+// Indexes must step by one towards 0, whichever way the payload counts
+static void gaps(void) {
+    static const struct {
+        const char* name;
+        int indexes[6];
+        int count;
+        int complete;
+    } cases[] = {
+        { "down",                  { 3, 2, 1, 0 },       4, 1 },
+        { "up",                    { 1, 2, 3, 0 },       4, 1 },
+        { "down, middle skipped",  { 5, 4, 2, 1, 0 },    5, 0 },
+        { "down, 1 skipped",       { 3, 2, 0 },          3, 0 },
+        { "down, repeated",        { 3, 2, 2, 1, 0 },    5, 0 },
+        { "down, first step of 2", { 5, 3, 2, 1, 0 },    5, 0 },
+        { "up, middle skipped",    { 1, 2, 4, 5, 0 },    5, 0 },
+        { "up, turned back",       { 1, 2, 1, 0 },       4, 0 },
+        { "up, first step of 2",   { 1, 3, 4, 0 },       4, 0 },
+    };
+    unsigned char data[6 * 100];
+    fill(data, sizeof(data), 9);
+    PackageReasm* r = package_reasm_create("gaps", 2, TEST_PAYLOAD_MAX, 0, 0);
+    CHECK(r != NULL, "instance not created");
+    if (!r) return;
+    int n = (int)(sizeof(cases) / sizeof(cases[0]));
+    unsigned long long lost_gap = 0;
+    for (int c = 0; c < n; c++) {
+        Delivered d;
+        int ret = 0;
+        for (int i = 0; i < cases[c].count; i++) {
+            ret = step(r, i == 0, 1, 400 + c, cases[c].indexes[i], data + i * 100, 100, 0, &d);
+        }
+        ReasmStats st;
+        package_reasm_get_stats(r, &st);
+        if (cases[c].complete) {
+            CHECK(ret == REASM_COMPLETE && d.len == cases[c].count * 100 && memcmp(d.data, data, d.len) == 0,
+                  "%s: gave %d", cases[c].name, ret);
+            CHECK(st.lost_gap == lost_gap, "%s: counted as a gap", cases[c].name);
+        } else {
+            CHECK(ret == REASM_DROPPED, "%s: last fragment gave %d", cases[c].name, ret);
+            CHECK(st.lost_gap == ++lost_gap, "%s: %llu gaps, %llu expected", cases[c].name, st.lost_gap, lost_gap);
+        }
+        CHECK(package_reasm_open_count(r) == 0, "%s: %d payloads left open", cases[c].name, package_reasm_open_count(r));
+    }
+    printf("[Test] gaps: %d index sequences, %llu lost to gaps\n", n, lost_gap);
+    package_reasm_destroy(r);
+}
+
+// Payloads ending shorter than the length their sub-header announced
+static void short_payloads(void) {
+    unsigned char data[3000];
+    fill(data, sizeof(data), 5);
+    PackageReasm* r = package_reasm_create("short", 2, TEST_PAYLOAD_MAX, 0, 0);
+    CHECK(r != NULL, "instance not created");
+    if (!r) return;
+    Delivered d;
+    step(r, 1, 1, 500, 2, data, 800, 3000, &d);
+    step(r, 0, 1, 500, 1, data + 800, 800, 0, &d);
+    CHECK(step(r, 0, 1, 500, 0, data + 1600, 800, 0, &d) == REASM_DROPPED, "2400 of 3000 bytes delivered");
+    CHECK(step(r, 1, 1, 501, 0, data, 100, 200, &d) == REASM_DROPPED, "single package of 100 of 200 bytes delivered");
+    step(r, 1, 1, 502, 2, data, 1000, 3000, &d);
+    step(r, 0, 1, 502, 1, data + 1000, 1000, 0, &d);
+    int ret = step(r, 0, 1, 502, 0, data + 2000, 1000, 0, &d);
+    CHECK(ret == REASM_COMPLETE && d.len == 3000 && memcmp(d.data, data, 3000) == 0, "full length gave %d", ret);
+    ret = step(r, 1, 1, 503, 0, data, 200, 200, &d);
+    CHECK(ret == REASM_COMPLETE && d.len == 200, "full single package gave %d", ret);
+
+    ReasmStats st;
+    package_reasm_get_stats(r, &st);
+    CHECK(st.lost_short == 2 && st.completed == 2 && package_reasm_lost(&st) == 2,
+          "stats: %llu short, %llu completed, %llu lost", st.lost_short, st.completed, package_reasm_lost(&st));
+    CHECK(package_reasm_open_count(r) == 0, "%d payloads left open", package_reasm_open_count(r));
+    package_reasm_destroy(r);
+}
+
+// A payload with no fragment for the timeout is dropped by the next one to arrive
+static void timeout(void) {
+    unsigned char data[1000];
+    fill(data, sizeof(data), 3);
+    PackageReasm* r = package_reasm_create("timeout", 2, TEST_PAYLOAD_MAX, TEST_TIMEOUT_MS, 0);
+    CHECK(r != NULL, "instance not created");
+    if (!r) return;
+    Delivered d;
+    CHECK(step(r, 1, 1, 600, 2, data, 300, 0, &d) == REASM_PENDING, "payload not opened");
+    g_now += (TEST_TIMEOUT_MS - 10) * 1000;
+    CHECK(step(r, 0, 1, 600, 1, data + 300, 300, 0, &d) == REASM_PENDING, "fragment within the timeout not taken");
+    g_now += (TEST_TIMEOUT_MS + 10) * 1000;
+    CHECK(step(r, 0, 1, 600, 0, data + 600, 300, 0, &d) == REASM_DROPPED, "fragment after the timeout taken");
+
+    // Another stream's traffic expires it just the same
+    CHECK(step(r, 1, 1, 601, 1, data, 300, 0, &d) == REASM_PENDING, "payload not opened");
+    g_now += (TEST_TIMEOUT_MS + 10) * 1000;
+    CHECK(step(r, 1, 2, 602, 1, data, 300, 0, &d) == REASM_PENDING, "other stream not opened");
+    CHECK(!package_reasm_has(r, PKG_TYPE_VIDEO, 601), "quiet payload still open");
+    int ret = step(r, 0, 2, 602, 0, data + 300, 300, 0, &d);
+    CHECK(ret == REASM_COMPLETE && d.len == 600, "other stream gave %d", ret);
+
+    ReasmStats st;
+    package_reasm_get_stats(r, &st);
+    CHECK(st.expired == 2 && st.orphans == 1 && st.completed == 1, "stats: %llu expired, %llu orphans, %llu completed",
+          st.expired, st.orphans, st.completed);
+    CHECK(package_reasm_open_count(r) == 0, "%d payloads left open", package_reasm_open_count(r));
+    package_reasm_destroy(r);
+}
+
+// With every slot taken, a new payload evicts the least recently fed one
+static void eviction(void) {
+    unsigned char data[1000];
+    fill(data, sizeof(data), 4);
+    PackageReasm* r = package_reasm_create("eviction", 2, TEST_PAYLOAD_MAX, 0, 0);
+    CHECK(r != NULL, "instance not created");
+    if (!r) return;
+    Delivered d;
+    step(r, 1, 1, 700, 2, data, 300, 0, &d);
+    step(r, 1, 2, 701, 2, data, 300, 0, &d);
+    step(r, 0, 1, 700, 1, data + 300, 300, 0, &d);          // 701 is now the least recently fed
+    CHECK(step(r, 1, 3, 702, 1, data, 300, 0, &d) == REASM_PENDING, "third payload not opened");
+    CHECK(!package_reasm_has(r, PKG_TYPE_VIDEO, 701), "least recently fed payload kept");
+    CHECK(package_reasm_has(r, PKG_TYPE_VIDEO, 700), "recently fed payload evicted");
+    CHECK(step(r, 0, 2, 701, 1, data + 300, 300, 0, &d) == REASM_DROPPED, "fragment of the evicted payload taken");
+    int ret = step(r, 0, 1, 700, 0, data + 600, 300, 0, &d);
+    CHECK(ret == REASM_COMPLETE && d.len == 900 && memcmp(d.data, data, 900) == 0, "kept payload gave %d", ret);
+    ret = step(r, 0, 3, 702, 0, data + 300, 300, 0, &d);
+    CHECK(ret == REASM_COMPLETE && d.len == 600, "new payload gave %d", ret);
+
+    ReasmStats st;
+    package_reasm_get_stats(r, &st);
+    CHECK(st.expired == 1 && st.orphans == 1 && st.completed == 2 && st.max_open == 2,
+          "stats: %llu expired, %llu orphans, %llu completed, max %d open", st.expired, st.orphans, st.completed,
+          st.max_open);
+    package_reasm_destroy(r);
+}
+
+int main(void) {
+    package_registry_register(PKG_VIDEO_MAGIC, PKG_TYPE_VIDEO, "video", 0, NULL);
+    g_framer = stream_framer_create(TEST_RING);
+    if (!g_framer) return 1;
+
+    interleaved();
+    open_any();
+    gaps();
+    short_payloads();
+    timeout();
+    eviction();
+    stream_framer_destroy(g_framer);
+    if (g_failures) {
+        printf("[Test] package_reasm: %d failures\n", g_failures);
+        return 1;
+    }
+    printf("[Test] package_reasm: passed\n");
+    return 0;
+}
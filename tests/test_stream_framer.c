@@ -0,0 +1,233 @@
+// Stream Framer Fuzz Test
+//
+// stream_framer_find_magic() is checked against a plain byte-by-byte scan
+// on random buffers rich in magic fragments, at every alignment and length.
+// Then streams of valid packages with garbage injected between them are cut
+// in random chunks and fed through a small ring: the framer must resync to
+// exactly the packages that were sent, in order and byte for byte, and
+// count every garbage byte as skipped. The garbage holds partial magics and
+// whole ones with a foreign ident or an impossible length, which the
+// resync must step over.
+//
+//   make test     (Linux)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "platform.h"
+#include "stream_framer.h"
+#include "package_registry.h"
+
+#define FUZZ_SCANS 1000000
+#define FUZZ_SCAN_MAX 300
+#define FUZZ_STREAMS 200
+#define FUZZ_PACKAGES 500                   // Per stream
+#define FUZZ_PAYLOAD_MAX 3000
+#define FUZZ_GARBAGE_MAX 600
+#define FUZZ_RING (64*1024)                 // The smallest ring, so packages wrap often
+#define FUZZ_CHUNK_MAX 5000
+
+static const uint32_t g_magics[] = { PKG_VIDEO_MAGIC, PKG_IMAGE_MAGIC, PKG_JSON_MAGIC, PKG_TIMELAPSE_MAGIC };
+static const char* g_prefixes[] = { PKG_VIDEO_PREFIX_STR, PKG_IMAGE_PREFIX_STR, PKG_JSON_PREFIX_STR, PKG_TIMELAPSE_PREFIX_STR };
+static const char g_alphabet[] = "$div$gmi#nsj@lif";
+
+static uint32_t g_rng = 2024;
+static int g_failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { printf("[Test] FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); g_failures++; } \
+} while (0)
+
+// xorshift32: successive small draws stay independent
+static unsigned int rnd(unsigned int n) {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 17;
+    g_rng ^= g_rng << 5;
+    return n ? g_rng % n : 0;
+}
+
+static int is_magic(const unsigned char* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    for (int k = 0; k < 4; k++) {
+        if (v == g_magics[k]) return 1;
+    }
+    return 0;
+}
+
+// Reference for stream_framer_find_magic: every position, one at a time
+static int reference_find(const unsigned char* data, int len) {
+    for (int i = 0; i + PKG_PREFIX_LEN <= len; i++) {
+        if (is_magic(data + i)) return i;
+    }
+    return -1;
+}
+
+// Bytes drawn mostly from the magics, so partial and whole matches are common
+static void fill_fragments(unsigned char* data, int len) {
+    for (int i = 0; i < len; i++) {
+        data[i] = rnd(4) ? (unsigned char)g_alphabet[rnd(sizeof(g_alphabet) - 1)] : (unsigned char)rnd(256);
+    }
+}
+
+static void fuzz_find_magic(void) {
+    unsigned char buf[FUZZ_SCAN_MAX + 32];
+    int mismatches = 0;
+    unsigned long long found = 0;
+    for (int n = 0; n < FUZZ_SCANS; n++) {
+        int offset = (int)rnd(16);
+        int len = (int)rnd(FUZZ_SCAN_MAX + 1);
+        unsigned char* data = buf + offset;
+        fill_fragments(data, len);
+        if (len >= PKG_PREFIX_LEN && rnd(2)) memcpy(data + rnd(len - PKG_PREFIX_LEN + 1), g_prefixes[rnd(4)], PKG_PREFIX_LEN);
+        // Bytes past len must not be matched
+        memcpy(data + len, PKG_VIDEO_PREFIX_STR, PKG_PREFIX_LEN);
+        int want = reference_find(data, len);
+        int got = stream_framer_find_magic(data, len);
+        if (want >= 0) found++;
+        if (got != want && mismatches++ < 5) {
+            CHECK(0, "find_magic on %d bytes at +%d: %d, reference %d", len, offset, got, want);
+        }
+    }
+    CHECK(mismatches == 0, "%d of %d scans differ from the reference", mismatches, FUZZ_SCANS);
+    printf("[Test] find_magic: %d scans agree with the reference (%llu with a match)\n", FUZZ_SCANS, found);
+}
+
+// Random bytes and partial magics, with no whole magic left in them; may
+// carry decoys: a magic with a foreign ident, or one with a length no ring
+// can hold. Never starts with a magic, so it is never framed in sync.
+static int make_garbage(unsigned char* out, int len, int* decoys) {
+    fill_fragments(out, len);
+    for (int i = 0; i + PKG_PREFIX_LEN <= len; i++) {
+        if (is_magic(out + i)) out[i] = 'x';
+    }
+    if (len < 1 + PKG_HEADER_TOTAL_LEN || rnd(2)) return len;
+    int at = 1 + (int)rnd((unsigned int)(len - PKG_HEADER_TOTAL_LEN));
+    PackageHeader_t header;
+    memset(&header, 0, sizeof(header));
+    if (rnd(2)) {
+        header.s16PkgIdent = PKG_IDENT_DEFAULT ^ (uint16_t)(1 + rnd(0xFFFF));
+        header.u16PkgLen = (uint16_t)rnd(64);
+    } else {
+        header.s16PkgIdent = PKG_IDENT_DEFAULT;
+        // Just over the ring: PKG_MIN_LEN + u16PkgLen > FUZZ_RING
+        header.u16PkgLen = (uint16_t)(0xFFFF - rnd(0xFFFF + PKG_MIN_LEN - FUZZ_RING));
+    }
+    memcpy(out + at, g_prefixes[rnd(4)], PKG_PREFIX_LEN);
+    memcpy(out + at + PKG_PREFIX_LEN, &header, sizeof(header));
+    // The decoy's own bytes must not complete a magic with what is around it
+    for (int i = 0; i + PKG_PREFIX_LEN <= len; i++) {
+        if (i != at && is_magic(out + i)) out[i] = 'x';
+    }
+    (*decoys)++;
+    return len;
+}
+
+typedef struct {
+    int offset;                 // In the stream
+    int len;
+    int type;
+} SentPackage;
+
+static void fuzz_resync(int stream_index) {
+    int max_stream = FUZZ_PACKAGES * (PKG_MIN_LEN + FUZZ_PAYLOAD_MAX + FUZZ_GARBAGE_MAX);
+    unsigned char* stream = (unsigned char*)malloc(max_stream);
+    unsigned char* payload = (unsigned char*)malloc(FUZZ_PAYLOAD_MAX);
+    unsigned char* copy = (unsigned char*)malloc(PKG_MIN_LEN + FUZZ_PAYLOAD_MAX);
+    SentPackage* sent = (SentPackage*)calloc(FUZZ_PACKAGES, sizeof(SentPackage));
+    StreamFramer* framer = stream_framer_create(FUZZ_RING);
+    if (!stream || !payload || !copy || !sent || !framer) {
+        CHECK(0, "allocation failed");
+        free(stream); free(payload); free(copy); free(sent);
+        stream_framer_destroy(framer);
+        return;
+    }
+    stream_framer_set_verify(framer, 1);
+
+    // The first package goes in clean, so the framer learns the ident
+    int len = 0, garbage = 0, gaps = 0, decoys = 0;
+    for (int i = 0; i < FUZZ_PACKAGES; i++) {
+        if (i > 0 && rnd(3) == 0) {
+            int n = 1 + (int)rnd(FUZZ_GARBAGE_MAX);
+            len += make_garbage(stream + len, n, &decoys);
+            garbage += n;
+            gaps++;
+        }
+        int k = (int)rnd(4);
+        int payload_len = (int)rnd(rnd(8) ? 200 : FUZZ_PAYLOAD_MAX);
+        fill_fragments(payload, payload_len);
+        PackageHeader_t header;
+        memset(&header, 0, sizeof(header));
+        header.u16PkgId = (uint16_t)i;
+        sent[i].offset = len;
+        sent[i].type = k + 1;
+        sent[i].len = package_build(g_prefixes[k], &header, NULL, 0, payload, payload_len, stream + len, max_stream - len);
+        len += sent[i].len;
+    }
+
+    // Random chunks through the ring; every package is checked and released at once
+    int pos = 0, received = 0, errors = 0;
+    PackageView view;
+    while (pos < len || stream_framer_used(framer) > 0) {
+        int chunk = 1 + (int)rnd(rnd(4) ? 64 : FUZZ_CHUNK_MAX);
+        if (chunk > len - pos) chunk = len - pos;
+        if (chunk > stream_framer_free(framer)) chunk = stream_framer_free(framer);
+        if (chunk > 0 && stream_framer_push(framer, stream + pos, chunk) == 0) pos += chunk;
+        int popped = 0;
+        while (stream_framer_next(framer, &view)) {
+            popped++;
+            const SentPackage* want = received < FUZZ_PACKAGES ? &sent[received] : NULL;
+            int ok = want && view.type == want->type && view.len == want->len &&
+                     view.header.u16PkgId == (uint16_t)received && view.checksum_ok;
+            if (ok) {
+                package_view_copy(&view, 0, copy, view.len);
+                ok = memcmp(copy, stream + want->offset, view.len) == 0;
+            }
+            if (!ok && errors++ < 5) {
+                CHECK(0, "stream %d: package %d came out as id %u, type %d, %d bytes", stream_index, received,
+                      view.header.u16PkgId, view.type, view.len);
+            }
+            received++;
+            package_view_release(&view);
+        }
+        // Stalled: all pushed, or a full ring the framer takes nothing from
+        if (popped == 0 && (pos == len || stream_framer_free(framer) == 0)) break;
+    }
+
+    StreamFramerStats st;
+    stream_framer_get_stats(framer, &st);
+    CHECK(errors == 0 && received == FUZZ_PACKAGES, "stream %d: %d of %d packages, %d wrong", stream_index,
+          received, FUZZ_PACKAGES, errors);
+    CHECK(st.skipped_bytes == (unsigned long long)garbage, "stream %d: skipped %llu bytes of %d garbage",
+          stream_index, st.skipped_bytes, garbage);
+    CHECK(st.resyncs == (unsigned long)gaps, "stream %d: %lu resyncs for %d gaps", stream_index, st.resyncs, gaps);
+    CHECK(st.rejected_magics + st.bad_length == (unsigned long)decoys, "stream %d: %lu + %lu rejected for %d decoys",
+          stream_index, st.rejected_magics, st.bad_length, decoys);
+    CHECK(st.checksums == (unsigned long long)FUZZ_PACKAGES, "stream %d: %llu checksums", stream_index, st.checksums);
+    CHECK(stream_framer_used(framer) == 0, "stream %d: %d bytes left in the ring", stream_index, stream_framer_used(framer));
+    if (stream_index == 0 || g_failures) {
+        printf("[Test] resync: stream %d, %d bytes, %d packages, %d garbage bytes in %d gaps, %d decoys\n",
+               stream_index, len, received, garbage, gaps, decoys);
+    }
+
+    stream_framer_destroy(framer);
+    free(stream);
+    free(payload);
+    free(copy);
+    free(sent);
+}
+
+int main(void) {
+    package_registry_register(PKG_JSON_MAGIC, PKG_TYPE_JSON, "json", 0, NULL);
+    package_registry_register(PKG_VIDEO_MAGIC, PKG_TYPE_VIDEO, "video", 0, NULL);
+    package_registry_register(PKG_IMAGE_MAGIC, PKG_TYPE_IMAGE, "image", 0, NULL);
+    package_registry_register(PKG_TIMELAPSE_MAGIC, PKG_TYPE_TIMELAPSE, "timelapse", 0, NULL);
+
+    fuzz_find_magic();
+    for (int i = 0; i < FUZZ_STREAMS && !g_failures; i++) fuzz_resync(i);
+    if (g_failures) {
+        printf("[Test] stream_framer: %d failures\n", g_failures);
+        return 1;
+    }
+    printf("[Test] stream_framer: passed (%d streams resynced)\n", FUZZ_STREAMS);
+    return 0;
+}